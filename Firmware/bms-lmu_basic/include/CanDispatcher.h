@@ -0,0 +1,91 @@
+/***************************************************************************
+    CanDispatcher.h
+
+    INTRO
+    Received CAN frames are pushed by the controller's RX interrupt into a
+    lock-free single producer single consumer ring, so back to back frames
+    are queued instead of overwriting each other. dispatch() drains the
+    ring from the main loop and hands each frame to the handler registered
+    for its ID.
+
+****************************************************************************/
+#ifndef CAN_DISPATCHER_H
+#define CAN_DISPATCHER_H
+
+#include <stdint.h>
+#include "CanFrame.h"
+
+#ifndef CAN_RX_QUEUE_SIZE
+#define CAN_RX_QUEUE_SIZE 16 // Power of 2
+#endif
+#define CAN_MAX_HANDLERS 8
+
+static_assert((CAN_RX_QUEUE_SIZE & (CAN_RX_QUEUE_SIZE-1)) == 0, "CAN_RX_QUEUE_SIZE must be a power of 2");
+static_assert(CAN_RX_QUEUE_SIZE <= 128, "Ring counters are uint8_t");
+
+typedef void (*canHandler)(const canFrame &frame);
+
+struct canRxStats {
+    uint32_t received;   // Frames pushed by the ISR
+    uint32_t dropped;    // Frames lost because the ring was full
+    uint32_t unhandled;  // Frames with no matching handler
+    uint8_t highWater;   // Deepest the ring has been since the last reset
+};
+
+/**CanDispatcher Contructor
+ *
+ * Empty ring and handler table
+*/
+class CanDispatcher {
+public:
+    CanDispatcher();
+
+    /**push()
+     * Queue a received frame, call from the CAN RX interrupt only
+     *
+     * @return false if the ring was full and the frame was dropped
+    */
+    bool push(const canFrame &frame);
+
+    /**on()
+     * Register a handler, frames match when (frame.id & _mask) == (_id & _mask).
+     * The first matching entry in registration order wins.
+     *
+     * @return false if the table is full
+    */
+    bool on(uint32_t _id, uint32_t _mask, canHandler _handler);
+
+    /**dispatch()
+     * Hand queued frames to their handlers, call from loop()
+     *
+     * @param maxFrames  Most frames to handle in this call
+     * @return number of frames taken from the ring
+    */
+    uint8_t dispatch(uint8_t maxFrames = CAN_RX_QUEUE_SIZE);
+
+    /// Frames waiting in the ring
+    uint8_t depth() const { return (uint8_t)(head - tail); }
+
+    const canRxStats &stats() const { return _stats; }
+    void resetStats();
+
+private:
+    struct handlerEntry {
+        uint32_t id;
+        uint32_t mask;
+        canHandler handler;
+    };
+
+    // head and tail run free and are masked on access, so the ring holds
+    // all CAN_RX_QUEUE_SIZE frames
+    canFrame ring[CAN_RX_QUEUE_SIZE];
+    volatile uint8_t head;   // Frames pushed
+    volatile uint8_t tail;   // Frames dispatched
+
+    handlerEntry handlers[CAN_MAX_HANDLERS];
+    uint8_t handlerCount;
+
+    canRxStats _stats;
+};
+
+#endif
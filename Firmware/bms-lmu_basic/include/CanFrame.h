@@ -0,0 +1,13 @@
+#ifndef CAN_FRAME_H
+#define CAN_FRAME_H
+
+#include <stdint.h>
+
+// A classic CAN data frame as it is handed to or taken from the controller
+struct canFrame {
+    uint32_t id;
+    uint8_t len;
+    uint8_t bytes[8];
+};
+
+#endif
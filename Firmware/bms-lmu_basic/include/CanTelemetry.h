@@ -0,0 +1,115 @@
+/***************************************************************************
+    CanTelemetry.h
+
+    INTRO
+    Packed cell voltage telemetry for CAN. A pack update is sent as the
+    lowest cell code followed by every cell as a delta from it, each delta
+    using just enough bits for the current spread. The bit stream runs
+    across as few 8 byte frames as it needs, the frame index is added to
+    the base CAN ID and a CRC-8 of the cell codes closes the stream, so the
+    receiver gets back the exact ADC codes or nothing.
+
+    Frame layout
+        byte 0 bits 7..4   sequence counter, same in every frame of an update
+        byte 0 bits 3..0   \
+        bytes 1..7          > payload bit stream, MSB first
+    Payload bit stream
+        16 bits            lowest cell code
+        5 bits             delta width w, 0..16
+        cells x w bits     cell code - lowest code, in cell order
+        8 bits             CRC-8 (poly 0x07) of the sequence and cell codes
+    The last frame is only as long as the stream needs.
+
+****************************************************************************/
+#ifndef CAN_TELEMETRY_H
+#define CAN_TELEMETRY_H
+
+#include <stdint.h>
+#include "CanFrame.h"
+
+#define CAN_TELEMETRY_MAX_CELLS 16
+#define CAN_TELEMETRY_HEADER_BITS 21 // Lowest code + delta width
+#define CAN_TELEMETRY_CRC_BITS 8
+#define CAN_TELEMETRY_FRAME_BITS 60  // Payload bits per frame after the sequence nibble
+
+/**canTelemetryFrames()
+ * Frames needed for one pack update
+ *
+ * @param cells  Number of cells in the update
+ * @param width  Delta width in bits
+*/
+constexpr uint8_t canTelemetryFrames(uint8_t cells, uint8_t width) {
+    return (CAN_TELEMETRY_HEADER_BITS + cells*width + CAN_TELEMETRY_CRC_BITS + CAN_TELEMETRY_FRAME_BITS - 1)
+           / CAN_TELEMETRY_FRAME_BITS;
+}
+
+#define CAN_TELEMETRY_MAX_FRAMES canTelemetryFrames(CAN_TELEMETRY_MAX_CELLS, 16)
+
+// A 12 cell stack used two frames of 6 single bytes, which cannot hold a
+// 16 bit code, or three frames as plain uint16_t codes
+static_assert(canTelemetryFrames(12, 7) == 2, "12 cells within 12.7mV of each other fit two frames");
+static_assert(canTelemetryFrames(12, 12) == 3, "12 cells within 409.5mV match the plain uint16_t layout");
+static_assert(canTelemetryFrames(12, 16) == 4, "Worst case 12 cell update");
+static_assert(CAN_TELEMETRY_MAX_FRAMES <= 16, "Frame index must stay a small offset on the base ID");
+
+struct telemetryStats {
+    uint32_t updatesSent;
+    uint32_t framesSent;
+    uint32_t updatesReceived;
+    uint32_t crcErrors;      // Complete updates whose CRC did not match
+    uint32_t incomplete;     // Updates abandoned because a newer sequence started
+};
+
+/**CanTelemetry Contructor
+ *
+ * @param _baseId  CAN ID of frame 0, frame n goes out on _baseId + n
+ * @param _cells   Cells per update, at most CAN_TELEMETRY_MAX_CELLS
+*/
+class CanTelemetry {
+public:
+    CanTelemetry(uint32_t _baseId, uint8_t _cells);
+
+    /**encode()
+     * Pack one update of cell codes
+     *
+     * @param[in]  codes   Cell codes (100uV LSB)
+     * @param      minCode Lowest of codes
+     * @param      maxCode Highest of codes
+     * @param[out] frames  At least CAN_TELEMETRY_MAX_FRAMES frames
+     *
+     * @return number of frames filled
+    */
+    uint8_t encode(const uint16_t *codes, uint16_t minCode, uint16_t maxCode, canFrame *frames);
+
+    /// As above, finding the lowest and highest code itself
+    uint8_t encode(const uint16_t *codes, canFrame *frames);
+
+    /**decode()
+     * Collect a received telemetry frame
+     *
+     * @param[in]  frame  Frame with an ID in this encoder's range
+     * @param[out] codes  Cell codes, written only when an update completes
+     *
+     * @return true when a complete update with a matching CRC was decoded
+    */
+    bool decode(const canFrame &frame, uint16_t *codes);
+
+    const telemetryStats &stats() const { return _stats; }
+
+private:
+    uint32_t baseId;
+    uint8_t cells;
+    uint8_t txSeq;
+
+    uint8_t rxSeq;
+    uint16_t rxMask;
+    uint8_t rxBytes[CAN_TELEMETRY_MAX_FRAMES*8];
+
+    telemetryStats _stats;
+
+    static void putBits(uint8_t *buffer, uint16_t pos, uint32_t value, uint8_t bits);
+    static uint32_t getBits(const uint8_t *buffer, uint16_t pos, uint8_t bits);
+    static uint8_t crc8(uint8_t seq, const uint16_t *codes, uint8_t cells);
+};
+
+#endif
@@ -0,0 +1,122 @@
+/***************************************************************************
+    CanTxQueue.h
+
+    INTRO
+    Prioritised CAN transmit queue. Frames are queued with a priority and
+    handed to the controller one at a time as its transmit mailboxes free
+    up, highest priority first and oldest first within a priority. A
+    periodic frame queued again before the last copy went out replaces
+    that copy in place, so only the latest value is ever sent, and takes
+    the higher of the two priorities.
+
+****************************************************************************/
+#ifndef CAN_TX_QUEUE_H
+#define CAN_TX_QUEUE_H
+
+#include "hal.h"
+#include "CanFrame.h"
+
+#ifndef CAN_TX_QUEUE_SIZE
+#define CAN_TX_QUEUE_SIZE 16
+#endif
+#define CAN_TX_MAILBOXES 3
+
+static_assert(CAN_TX_QUEUE_SIZE <= 127, "Queue slots are indexed with int8_t");
+
+enum canTxPriority {
+    CAN_TX_FAULT,       // Faults and heartbeat
+    CAN_TX_CELL,        // Cell and temperature data
+    CAN_TX_DIAG,        // Diagnostics
+    CAN_TX_PRIORITY_COUNT
+};
+
+typedef bool (*canTransmitFn)(const canFrame &frame);
+
+struct canTxStats {
+    uint32_t queued;
+    uint32_t sent;
+    uint32_t coalesced;                             // Frames replaced by a newer copy before going out
+    uint32_t dropped;                               // Frames lost to a full queue
+    uint32_t latencyMax[CAN_TX_PRIORITY_COUNT];     // Queue to mailbox (us)
+    uint32_t latencyMean[CAN_TX_PRIORITY_COUNT];
+    uint32_t busBits;                               // Bits put on the bus since the last reset
+    uint16_t busLoad;                               // Share of the bus used by this node since the last reset, 1/1000
+};
+
+/**CanTxQueue Contructor
+ *
+ * @param _transmit  Puts a frame in a free controller mailbox, false if it could not
+ * @param _bitrate   CAN bit rate, for the bus load figure
+*/
+class CanTxQueue {
+public:
+    CanTxQueue(canTransmitFn _transmit, uint32_t _bitrate);
+
+    /**queue()
+     * Queue a frame for transmission
+     *
+     * @param frame      Frame to send
+     * @param priority   Queue the frame is sent from
+     * @param coalesce   Replace a queued frame with the same ID instead of adding another
+     *
+     * @return false if the frame was dropped
+    */
+    bool queue(const canFrame &frame, canTxPriority priority, bool coalesce = true);
+
+    /**queuePinned()
+     * Queue a frame that is never coalesced or evicted, for segments of a
+     * transfer that must go out whole
+     *
+     * @param frame      Frame to send
+     * @param priority   Queue the frame is sent from
+     * @param ticket     Set to the handle pending() takes
+     *
+     * @return false if the queue had no free slot
+    */
+    bool queuePinned(const canFrame &frame, canTxPriority priority, uint32_t &ticket);
+
+    /// True while a pinned frame is still waiting for a mailbox
+    bool pending(uint32_t ticket) const;
+
+    /**service()
+     * Move queued frames into free mailboxes, call from loop()
+     *
+     * @return number of frames handed to the controller
+    */
+    uint8_t service();
+
+    /// Frames waiting in the queue
+    uint8_t depth() const { return count; }
+
+    const canTxStats &stats();
+    void resetStats();
+
+    /// Free transmit mailboxes in the controller
+    static uint8_t freeMailboxes();
+
+private:
+    struct txEntry {
+        canFrame frame;
+        canTxPriority priority;
+        bool inUse;
+        bool pinned;        // Never coalesced or evicted
+        uint32_t order;     // Queue order within a priority
+        uint32_t queuedAt;  // hal_micros()
+    };
+
+    canTransmitFn transmit;
+    uint32_t bitrate;
+    txEntry entries[CAN_TX_QUEUE_SIZE];
+    uint8_t count;
+    uint32_t nextOrder;
+
+    uint32_t statsSince;
+    uint64_t latencySum[CAN_TX_PRIORITY_COUNT];
+    uint32_t latencyCount[CAN_TX_PRIORITY_COUNT];
+    canTxStats _stats;
+
+    int8_t insert(const canFrame &frame, canTxPriority priority, bool coalesce, bool pinned);
+    int8_t next() const;
+};
+
+#endif
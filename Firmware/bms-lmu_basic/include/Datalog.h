@@ -0,0 +1,64 @@
+/*
+Datalog.h
+
+Binary data-log stream for the serial port. Each record carries raw ADC codes
+and a microsecond timestamp, closed by a CRC-8 and framed with COBS so the
+stream can be picked up at any 0x00. tools/datalog_decode.py turns it into CSV.
+
+Record, before COBS encoding (multi-byte fields little endian)
+  type      1 byte   DATALOG_CELLS, DATALOG_AUX or DATALOG_STAT
+  ic        1 byte   index of the IC in the daisy chain
+  seq       1 byte   record counter, gaps show dropped records
+  time      4 bytes  micros() when the record was sent
+  payload            cells/aux: uint16_t codes
+                     stat: 4 uint16_t codes (SOC, ITMP, VA, VD), flags[3], mux_fail, thsd
+  crc       1 byte   CRC-8 (poly 0x07) of everything above
+
+COBS adds one code byte for payloads this short and the frame ends with the
+0x00 delimiter, so on the wire a cell record of 12 codes is 7+24+1+1+1 = 34
+bytes, an aux record of 6 codes 22 and a stat record 23.
+*/
+
+#ifndef DATALOG_H
+#define DATALOG_H
+
+#include <stdint.h>
+
+#define DATALOG_CELLS 0x01
+#define DATALOG_AUX 0x02
+#define DATALOG_STAT 0x03
+
+#define DATALOG_HEADER_LEN 7
+#define DATALOG_MAX_PAYLOAD 48
+#define DATALOG_MAX_RECORD (DATALOG_HEADER_LEN + DATALOG_MAX_PAYLOAD + 1)
+#define DATALOG_MAX_FRAME (DATALOG_MAX_RECORD + DATALOG_MAX_RECORD/254 + 2) // COBS overhead and the 0x00 delimiter
+#define DATALOG_FRAME_LEN(len) (DATALOG_HEADER_LEN + (len) + 1 + 2) // Bytes on the wire for a len byte payload
+
+static_assert(DATALOG_MAX_RECORD < 254, "DATALOG_FRAME_LEN assumes a single COBS code byte");
+
+// Send one record. The record is dropped rather than waiting when the serial
+// transmit buffer has no room for it. Returns false if it was dropped.
+bool datalog_record(uint8_t type, uint8_t ic, const uint8_t *payload, uint8_t len);
+
+// True if a record with a len byte payload fits in the serial transmit buffer now
+bool datalog_fits(uint8_t len);
+
+// Count a record that is never sent as dropped. Its seq is used up so the
+// gap shows in the stream.
+void datalog_skip();
+
+// Send count raw ADC codes as one record
+bool datalog_codes(uint8_t type, uint8_t ic, const uint16_t *codes, uint8_t count);
+
+// COBS encode len bytes into out, appending the 0x00 delimiter. out must hold
+// len + len/254 + 2 bytes. Returns the encoded length including the delimiter.
+uint16_t cobs_encode(const uint8_t *data, uint16_t len, uint8_t *out);
+
+// Start a new log: resets seq and the drop count and sends a 0x00 so the
+// first record is not joined to any text before it
+void datalog_start();
+
+// Records dropped because the serial port was busy
+uint32_t datalog_dropped();
+
+#endif  // DATALOG_H
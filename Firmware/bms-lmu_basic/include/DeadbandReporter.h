@@ -0,0 +1,83 @@
+/***************************************************************************
+    DeadbandReporter.h
+
+    INTRO
+    Decides when cell and temperature data is worth putting on the bus.
+    A group is reported when any of its values has moved further than the
+    deadband from the value last reported, when the slower forced refresh
+    comes round, or straight away when the fault code changes. Shared by
+    many LMUs, this keeps a quiet pack to a trickle of refresh frames.
+
+****************************************************************************/
+#ifndef DEADBAND_REPORTER_H
+#define DEADBAND_REPORTER_H
+
+#include <stdint.h>
+
+#define REPORT_MAX_CELLS 16
+#define REPORT_MAX_TEMPERATURES 16
+
+enum reportGroup {
+    REPORT_NONE = 0,
+    REPORT_HEARTBEAT = 1 << 0,
+    REPORT_CELLS = 1 << 1,
+    REPORT_TEMPERATURES = 1 << 2
+};
+
+struct reportStats {
+    uint32_t polls;
+    uint32_t cellReports;
+    uint32_t temperatureReports;
+    uint32_t refreshes;    // Groups sent only because the forced refresh was due
+    uint32_t faultReports; // Polls that reported everything on a fault code change
+};
+
+/**DeadbandReporter Contructor
+ *
+ * @param _cells         Number of cell codes per poll
+ * @param _temperatures  Number of temperatures per poll
+ * @param _cellDeadband  Cell change that is reported (ADC codes, 100uV)
+ * @param _tempDeadband  Temperature change that is reported (0.1 degC)
+ * @param _refresh(ms)   Longest time a group goes unreported
+*/
+class DeadbandReporter {
+public:
+    DeadbandReporter(uint8_t _cells, uint8_t _temperatures, uint16_t _cellDeadband,
+                     uint16_t _tempDeadband, uint32_t _refresh);
+
+    /**poll()
+     * Check the latest values, the groups returned are taken as sent
+     *
+     * @param cellCodes     Cell codes (100uV)
+     * @param temps         Temperatures (0.1 degC), may be NULL without temperatures
+     * @param faultCode     Heartbeat::fault_code()
+     * @param now(ms)       millis()
+     *
+     * @return reportGroup bits to send now
+    */
+    uint8_t poll(const uint16_t *cellCodes, const int16_t *temps, uint8_t faultCode, uint32_t now);
+
+    /// Report every group on the next poll
+    void invalidate() { primed = false; }
+
+    const reportStats &stats() const { return _stats; }
+    void resetStats() { _stats = reportStats(); }
+
+private:
+    uint8_t cells;
+    uint8_t temperatures;
+    uint16_t cellDeadband;
+    uint16_t tempDeadband;
+    uint32_t refresh;
+
+    bool primed;
+    uint8_t lastFault;
+    uint32_t lastCellReport;
+    uint32_t lastTempReport;
+    uint16_t reportedCells[REPORT_MAX_CELLS];
+    int16_t reportedTemps[REPORT_MAX_TEMPERATURES];
+
+    reportStats _stats;
+};
+
+#endif
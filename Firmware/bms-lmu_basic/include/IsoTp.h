@@ -0,0 +1,126 @@
+/***************************************************************************
+    IsoTp.h
+
+    INTRO
+    ISO 15765-2 style segmented transfer for bulk diagnostics over CAN.
+    A payload of up to ISOTP_BUFFER_SIZE bytes goes out as a single frame
+    or as a first frame followed by consecutive frames, paced by the
+    block size and separation time the receiver grants in its flow
+    control frames. Consecutive frames are queued at diagnostic priority,
+    one at a time and only while the TX queue has room, so a transfer
+    never holds up the periodic cell traffic. The next one is queued only
+    once the last has left the queue, STmin is timed from then rather
+    than from queueing. Segments are pinned in the queue, a burst of
+    higher priority frames can not evict part of a transfer. A segment
+    still queued ISOTP_TIMEOUT_MS after it was queued ends the transfer
+    as a timeout, as a silent receiver does.
+
+    Single frame requests from the gateway are passed to a request
+    handler, which normally answers with send(). Segmented requests are
+    refused with an overflow flow control frame.
+
+****************************************************************************/
+#ifndef ISO_TP_H
+#define ISO_TP_H
+
+#include "hal.h"
+#include "CanFrame.h"
+#include "CanTxQueue.h"
+
+#ifndef ISOTP_BUFFER_SIZE
+#define ISOTP_BUFFER_SIZE 512
+#endif
+#define ISOTP_TIMEOUT_MS 1000 // N_Bs, longest wait for a flow control frame
+#define ISOTP_SF_MAX 7
+#define ISOTP_FF_DATA 6
+#define ISOTP_CF_DATA 7
+
+static_assert(ISOTP_BUFFER_SIZE <= 4095, "First frame length is 12 bits");
+
+enum isoTpPci {
+    ISOTP_SINGLE = 0x0,
+    ISOTP_FIRST = 0x1,
+    ISOTP_CONSECUTIVE = 0x2,
+    ISOTP_FLOW_CONTROL = 0x3
+};
+
+enum isoTpFlowStatus {
+    ISOTP_FC_CTS = 0x0,
+    ISOTP_FC_WAIT = 0x1,
+    ISOTP_FC_OVERFLOW = 0x2
+};
+
+typedef void (*isoTpRequestFn)(const uint8_t *data, uint8_t len);
+
+struct isoTpStats {
+    uint32_t transfers;    // Accepted by send()
+    uint32_t completed;
+    uint32_t aborted;      // Receiver answered overflow
+    uint32_t timeouts;     // No flow control, or a segment stuck in the queue, for ISOTP_TIMEOUT_MS
+    uint32_t framesSent;
+    uint32_t requests;
+};
+
+/**IsoTp Contructor
+ *
+ * @param _tx    Queue the frames are sent through
+ * @param _txId  CAN ID of the frames this node sends
+ * @param _rxId  CAN ID of the gateway's flow control and request frames
+*/
+class IsoTp {
+public:
+    IsoTp(CanTxQueue &_tx, uint32_t _txId, uint32_t _rxId);
+
+    /**send()
+     * Start a transfer, the payload is copied
+     *
+     * @return false if a transfer is in progress or len is over ISOTP_BUFFER_SIZE
+    */
+    bool send(const uint8_t *data, uint16_t len);
+
+    /// Feed a received frame, register with CanDispatcher for _rxId
+    void receive(const canFrame &frame);
+
+    /// Handler for single frame requests
+    void onRequest(isoTpRequestFn _handler) { handler = _handler; }
+
+    /// Send due consecutive frames and time out a silent receiver, call from loop()
+    void service();
+
+    bool busy() const { return state != ISOTP_IDLE; }
+
+    const isoTpStats &stats() const { return _stats; }
+    void resetStats() { _stats = isoTpStats(); }
+
+private:
+    enum isoTpState {
+        ISOTP_IDLE,
+        ISOTP_WAIT_FC,
+        ISOTP_SENDING
+    };
+
+    CanTxQueue &tx;
+    uint32_t txId;
+    uint32_t rxId;
+    isoTpRequestFn handler;
+
+    isoTpState state;
+    uint8_t buffer[ISOTP_BUFFER_SIZE];
+    uint16_t length;
+    uint16_t offset;
+    uint8_t sequence;
+    uint8_t blockSize;
+    uint8_t blockLeft;
+    uint32_t separation;  // us between consecutive frames
+    uint32_t lastFrame;   // hal_micros() the last consecutive frame left the queue
+    uint32_t ticket;      // Queue handle of the segment in flight
+    bool inFlight;        // A segment is still waiting in the queue
+    uint32_t waitStart;   // hal_millis() the segment in flight was queued, or the wait for flow control began
+
+    isoTpStats _stats;
+
+    bool queueFrame(const uint8_t *bytes, uint8_t len, bool segment = false);
+    static uint32_t separationTime(uint8_t stMin);
+};
+
+#endif
@@ -141,6 +141,21 @@ uint8_t LTC6811_rdcv(uint8_t reg, //!< Controls which cell voltage register is r
                      cell_asic *ic //!< Array of the parsed cell codes from lowest to highest.
                     );				  
 				  
+/*!
+ Starts a non-blocking read of all cell voltage registers, finish it with LTC6811_rdcv_service()
+ @return void
+ */
+void LTC6811_rdcv_start(uint8_t total_ic, //!< The number of ICs in the daisy chain
+                        cell_asic *ic //!< Array of the parsed cell codes from lowest to highest.
+                       );
+
+/*!
+ Advances a read started with LTC6811_rdcv_start()
+ @return uint8_t, 1 once the read is complete, 0 while the register groups are on the wire
+ */
+uint8_t LTC6811_rdcv_service(int8_t *pec_error //!< Number of register groups with a PEC error, set on completion
+                            );
+
 /*!
  Reads and parses the LTC6811 auxiliary registers.
  @return  int8_t, PEC Status
@@ -171,9 +186,33 @@ uint8_t LTC6811_pladc();
 
 /*!
  This function will block operation until the ADC has finished it's conversion
-  @returns uint32_t, the approximate time it took for the ADC function to complete. 
+  @returns uint32_t, the time in microseconds it took for the ADC function to complete. 
   */
-uint32_t LTC6811_pollAdc();						 
+uint32_t LTC6811_pollAdc();
+
+/*!
+ Non-blocking conversion check. Waits out the conversion time of the last ADC command
+ before confirming with PLADC, then fires the callback set with LTC6811_adc_set_callback()
+ @returns uint8_t, 1 if no conversion is in flight, 0 while converting
+ */
+uint8_t LTC6811_adc_service();
+
+/*!
+ @returns uint8_t 1 once the next LTC6811_adc_service() will touch the bus, wake the isoSPI first
+ */
+uint8_t LTC6811_adc_confirm_due();
+
+/*!
+ Sets the continuation fired when a conversion completes
+ @return void
+ */
+void LTC6811_adc_set_callback(adc_callback callback //!< Function to call, NULL for none
+                              );
+
+/*!
+ @returns uint32_t, the time in microseconds the last completed conversion took
+ */
+uint32_t LTC6811_adc_elapsed();						 
 	
 /*!
  Clears the LTC6811 cell voltage registers
@@ -396,6 +435,160 @@ int8_t LTC6811_rdcomm(uint8_t total_ic, //!< Number of ICs in the daisy chain
                       cell_asic *ic //!< Two dimensional array that the function stores the read comm data.
                      );
 
+/*!
+ Writes the configuration register only if any IC's config.tx_data changed since the
+ last write, and verifies the readback every verify interval calls
+ @return int8_t, 0: In sync, -1: Readback did not match or failed PEC, rewritten on the next call
+ */
+int8_t LTC6811_sync_cfg(uint8_t total_ic, //!< Number of ICs in the system
+                        cell_asic *ic //!< A two dimensional array of the configuration data
+                       );
+
+/*!
+ Writes a PWM register group only if it changed, see LTC6811_sync_cfg()
+ @return int8_t, 0: In sync, -1: Readback did not match or failed PEC
+ */
+int8_t LTC6811_sync_pwm(uint8_t total_ic, //!< Number of ICs in the system
+                        uint8_t pwmReg, //!< The PWM register group, A (0) or B
+                        cell_asic *ic //!< A two dimensional array of the pwm data
+                       );
+
+/*!
+ Writes a Sctrl register group only if it changed, see LTC6811_sync_cfg()
+ @return int8_t, 0: In sync, -1: Readback did not match or failed PEC
+ */
+int8_t LTC6811_sync_sctrl(uint8_t total_ic, //!< Number of ICs in the system
+                          uint8_t sctrl_reg, //!< The Sctrl register group, A (0) or B
+                          cell_asic *ic //!< A two dimensional array of the sctrl data
+                         );
+
+/*!
+ Writes the COMM registers only if they changed or were used by a stcomm
+ @return int8_t, always 0
+ */
+int8_t LTC6811_sync_comm(uint8_t total_ic, //!< Number of ICs in the system
+                         cell_asic *ic //!< A two dimensional array of the comm data
+                        );
+
+/*!
+ Forgets the register shadows so the next sync writes every group.
+ Call after waking the chain from sleep.
+ @return void
+ */
+void LTC6811_shadow_invalidate(uint8_t total_ic, //!< Number of ICs in the system
+                               cell_asic *ic //!< A two dimensional array that stores the data
+                              );
+
+/*!
+ Sets how many syncs of a register group pass between readback verifications
+ @return void
+ */
+void LTC6811_shadow_set_verify_interval(uint16_t interval //!< Syncs per verification, 0 to never verify
+                                        );
+
+/*!
+ @returns shadow_stats, the register shadow cache counters
+ */
+shadow_stats LTC6811_shadow_stats();
+
+/*!
+ Sets the timeouts the wake state is tracked against, 0 wakes every time
+ @return void
+ */
+void LTC6811_wake_set_timeouts(uint32_t idle_us, //!< Bus silence before the isoSPI ports are woken again
+                               uint32_t sleep_ms //!< Time since the last broadcast command before the cores are woken again
+                              );
+
+/*!
+ Forgets the wake state so the next wake-up routines pulse the chain
+ @return void
+ */
+void LTC6811_wake_invalidate();
+
+/*!
+ @returns wake_stats, the wake state tracker counters
+ */
+wake_stats LTC6811_wake_stats();
+
+/*!
+ Clears the wake state tracker counters
+ @return void
+ */
+void LTC6811_wake_reset_stats();
+
+/*!
+ Sets the LTC6811-2 address used by the _addr functions for one IC
+ @return void
+ */
+void LTC6811_set_address(uint8_t nIC, //!< Current IC
+                         cell_asic *ic, //!< A two dimensional array that stores the data
+                         uint8_t addr //!< Address strapped on the A0-A3 pins
+                        );
+
+/*!
+ Writes the configuration register of a single addressed LTC6811-2
+ @return void
+ */
+void LTC6811_wrcfg_addr(uint8_t nIC, //!< IC to be written
+                        cell_asic *ic //!< A two dimensional array of the configuration data
+                       );
+
+/*!
+ Reads the configuration register of a single addressed LTC6811-2
+ @return int8_t, PEC Status. 0: Match, -1: PEC error
+ */
+int8_t LTC6811_rdcfg_addr(uint8_t nIC, //!< IC to be read
+                          cell_asic *ic //!< A two dimensional array that stores the read data
+                         );
+
+/*!
+ Reads and parses the cell voltage registers of a single addressed LTC6811-2.
+ Start the conversion with the broadcast LTC6811_adcv() and read back only the ICs needed.
+ @return int8_t, Number of registers read back with a PEC error
+ */
+int8_t LTC6811_rdcv_addr(uint8_t reg, //!< Cell voltage register to read back, REG_ALL for all
+                         uint8_t nIC, //!< IC to be read
+                         cell_asic *ic //!< A two dimensional array that stores the parsed codes
+                        );
+
+/*!
+ Reads and parses the auxiliary registers of a single addressed LTC6811-2
+ @return int8_t, Number of registers read back with a PEC error
+ */
+int8_t LTC6811_rdaux_addr(uint8_t reg, //!< Aux register to read back, REG_ALL for all
+                          uint8_t nIC, //!< IC to be read
+                          cell_asic *ic //!< A two dimensional array that stores the parsed codes
+                         );
+
+/*!
+ Reads and parses the status registers of a single addressed LTC6811-2
+ @return int8_t, Number of registers read back with a PEC error
+ */
+int8_t LTC6811_rdstat_addr(uint8_t reg, //!< Stat register to read back, REG_ALL for all
+                           uint8_t nIC, //!< IC to be read
+                           cell_asic *ic //!< A two dimensional array that stores the parsed codes
+                          );
+
+/*!
+ Reads the cell voltages of the LTC6811-2s selected in ic_mask only, 12 bytes per register per IC
+ @return int8_t, Number of registers read back with a PEC error
+ */
+int8_t LTC6811_rdcv_subset(uint8_t reg, //!< Cell voltage register to read back, REG_ALL for all
+                           uint8_t total_ic, //!< Number of ICs in the system
+                           cell_asic *ic, //!< A two dimensional array that stores the parsed codes
+                           uint32_t ic_mask //!< Bit n set reads IC n
+                          );
+
+/*!
+ Reads the auxiliary registers of the LTC6811-2s selected in ic_mask only
+ @return int8_t, Number of registers read back with a PEC error
+ */
+int8_t LTC6811_rdaux_subset(uint8_t reg, //!< Aux register to read back, REG_ALL for all
+                            uint8_t total_ic, //!< Number of ICs in the system
+                            cell_asic *ic, //!< A two dimensional array that stores the parsed codes
+                            uint32_t ic_mask //!< Bit n set reads IC n
+                           );
+
 /*!
  Issues a stcomm command and clocks data out of the COMM register 
  @return void 
@@ -45,18 +45,59 @@
 #ifndef LTC681x_h
 #define LTC681x_h
 #include <stdint.h>
-#include <Arduino.h>
-#define LINDUINO
+#include "hal.h"
 
-#ifdef MBED
-#include "mbed.h"//remove when using with LINDUINO
+#include "pec15.h"
+
+#ifndef LTC681X_VARIANT
+#define LTC681X_VARIANT 6811 //!< Monitor on the board: 6811, 6812 or 6813
 #endif
 
-#ifdef LINDUINO
-#include <Arduino.h>
+#if (LTC681X_VARIANT == 6812) || (LTC681X_VARIANT == 6813)
+#define LTC681X_HAS_B_REGS 1 //!< CFGRB, PWMB and SCTRLB register groups exist
+#else
+#define LTC681X_HAS_B_REGS 0
 #endif
 
-#define IC_LTC6813
+/*! Register map of each monitor variant, fixed at compile time */
+template <int VARIANT> struct ltc681x_traits;
+
+template <> struct ltc681x_traits<6811>
+{
+  static constexpr uint8_t cell_channels = 12;
+  static constexpr uint8_t stat_channels = 4;
+  static constexpr uint8_t aux_channels = 6;
+  static constexpr uint8_t num_cv_reg = 4;
+  static constexpr uint8_t num_gpio_reg = 2;
+  static constexpr uint8_t num_stat_reg = 3;
+};
+
+template <> struct ltc681x_traits<6812>
+{
+  static constexpr uint8_t cell_channels = 15;
+  static constexpr uint8_t stat_channels = 4;
+  static constexpr uint8_t aux_channels = 9;
+  static constexpr uint8_t num_cv_reg = 5;
+  static constexpr uint8_t num_gpio_reg = 4;
+  static constexpr uint8_t num_stat_reg = 3;
+};
+
+template <> struct ltc681x_traits<6813>
+{
+  static constexpr uint8_t cell_channels = 18;
+  static constexpr uint8_t stat_channels = 4;
+  static constexpr uint8_t aux_channels = 9;
+  static constexpr uint8_t num_cv_reg = 6;
+  static constexpr uint8_t num_gpio_reg = 4;
+  static constexpr uint8_t num_stat_reg = 3;
+};
+
+typedef ltc681x_traits<LTC681X_VARIANT> ic_traits; //!< Register map of the monitor this build is for
+
+#define CELL_CODES (ic_traits::num_cv_reg*3) //!< Codes parsed from the cell voltage registers, 3 per register
+#define AUX_CODES (ic_traits::num_gpio_reg*3) //!< Codes parsed from the auxiliary registers, 3 per register
+static_assert(ic_traits::cell_channels <= CELL_CODES, "Cell channels do not fit the cell voltage registers");
+static_assert(ic_traits::aux_channels <= AUX_CODES, "Aux channels do not fit the auxiliary registers");
 
 #define MD_422HZ_1KHZ 0
 #define MD_27KHZ_14KHZ 1
@@ -106,6 +147,37 @@
 #define PULL_DOWN_CURRENT 0
 
 #define NUM_RX_BYT 8
+#define NUM_CMD_BYT 4
+
+#ifndef TOTAL_IC_MAX
+#define TOTAL_IC_MAX 1 //!< Longest daisy chain the driver is built for. Sizes the static frame buffer, must be >= TOTAL_IC
+#endif
+#define FRAME_BUFFER_LEN (NUM_CMD_BYT+(NUM_RX_BYT*TOTAL_IC_MAX)) //!< Command + PEC followed by 6 data bytes + PEC per IC
+
+#define ADC_STEPS_CELL_ALL 6 //!< ADC measurement steps per conversion, scales the conversion time table
+#define ADC_STEPS_AUX_ALL 6
+#define ADC_STEPS_STAT_ALL 4
+#define ADC_STEPS_CVAX 8
+#define ADC_STEPS_CVSC 7
+#define ADC_STEPS_SINGLE 1
+
+#ifndef ADC_PLADC_CONFIRM
+#define ADC_PLADC_CONFIRM 1 //!< Confirm the end of a timed conversion with a single PLADC byte
+#endif
+#define ADC_CONV_MARGIN_US 50 //!< Added to every table conversion time
+#define ADC_POLL_TIMEOUT_US 250000 //!< Longest wait on a conversion with no table entry (26Hz all cells is 201ms)
+
+typedef void (*adc_callback)(void); //!< Continuation fired when a conversion completes
+
+#ifndef LTC681X_WAKE_IDLE_US
+#define LTC681X_WAKE_IDLE_US 4000 //!< Bus silence before the isoSPI ports are woken again (tIDLE min 4.3ms)
+#endif
+#ifndef LTC681X_WAKE_SLEEP_MS
+#define LTC681X_WAKE_SLEEP_MS 1700 //!< Time since the last broadcast command before the cores are woken again (tSLEEP min 1.8s)
+#endif
+
+#define ADDR_CMD0(addr, cmd0) (0x80 | (((addr) & 0x0F) << 3) | ((cmd0) & 0x07)) //!< LTC681x-2 addressed CMD0, address bits sit above command bits 10:8
+
 #define CELL 1
 #define AUX 2
 #define STAT 3
@@ -117,15 +189,15 @@
 /*! Cell Voltage data structure. */
 typedef struct
 {
-  uint16_t c_codes[18]; //!< Cell Voltage Codes
-  uint8_t pec_match[6]; //!< If a PEC error was detected during most recent read cmd
+  uint16_t c_codes[CELL_CODES]; //!< Cell Voltage Codes
+  uint8_t pec_match[ic_traits::num_cv_reg]; //!< If a PEC error was detected during most recent read cmd
 } cv;
 
 /*! AUX Reg Voltage Data structure */
 typedef struct
 {
-  uint16_t a_codes[9]; //!< Aux Voltage Codes
-  uint8_t pec_match[4]; //!< If a PEC error was detected during most recent read cmd
+  uint16_t a_codes[AUX_CODES]; //!< Aux Voltage Codes
+  uint8_t pec_match[ic_traits::num_gpio_reg]; //!< If a PEC error was detected during most recent read cmd
 } ax;
 
 /*! Status Reg data structure. */
@@ -144,15 +216,37 @@ typedef struct
   uint8_t tx_data[6];  //!< Stores data to be transmitted 
   uint8_t rx_data[8];  //!< Stores received data 
   uint8_t rx_pec_match; //!< If a PEC error was detected during most recent read cmd
+  uint8_t shadow[6];  //!< Last data written to the IC by a sync
+  uint8_t shadow_valid; //!< The shadow is known to match the IC
 } ic_register;
 
+/*! Register shadow cache counters */
+typedef struct
+{
+  uint32_t writes; //!< Register group writes sent
+  uint32_t writes_skipped; //!< Writes not sent because the shadow already matched
+  uint32_t verifies; //!< Readback verifications done
+  uint32_t verify_failures; //!< Readbacks that did not match the shadow or failed PEC
+  uint32_t bytes_saved; //!< Bus bytes not sent because of skipped writes and readbacks
+} shadow_stats;
+
+/*! Wake state tracker counters */
+typedef struct
+{
+  uint32_t sleep_wakes; //!< wakeup_sleep() sequences sent
+  uint32_t idle_wakes; //!< wakeup_idle() sequences sent, including wakeup_sleep() calls that only needed one
+  uint32_t sleep_downgraded; //!< wakeup_sleep() calls answered with a wakeup_idle() sequence, the cores were awake
+  uint32_t skipped; //!< Wake-up calls that sent nothing, the chain was ready
+  uint32_t pulses_skipped; //!< Chip select pulses not sent by the skipped calls
+} wake_stats;
+
 /*! PEC error counter structure. */
 typedef struct
 {
   uint16_t pec_count; //!< Overall PEC error count
   uint16_t cfgr_pec;  //!< Configuration register data PEC error count
-  uint16_t cell_pec[6]; //!< Cell voltage register data PEC error count
-  uint16_t aux_pec[4];  //!< Aux register data PEC error count
+  uint16_t cell_pec[ic_traits::num_cv_reg]; //!< Cell voltage register data PEC error count
+  uint16_t aux_pec[ic_traits::num_gpio_reg];  //!< Aux register data PEC error count
   uint16_t stat_pec[2]; //!< Status register data PEC error count
 } pec_counter;
 
@@ -171,34 +265,69 @@ typedef struct
 typedef struct
 {
   ic_register config;
+#if LTC681X_HAS_B_REGS
   ic_register configb;
+#endif
   cv  cells;
   ax  aux;
   st  stat;
   ic_register com;
   ic_register pwm;
+#if LTC681X_HAS_B_REGS
   ic_register pwmb;
+#endif
   ic_register sctrl;
+#if LTC681X_HAS_B_REGS
   ic_register sctrlb;
+#endif
   uint8_t sid[6];
   bool isospi_reverse;
+  uint8_t address; //!< LTC681x-2 address strapped on the A0-A3 pins
   pec_counter crc_count;
   register_cfg ic_reg;
   long system_open_wire;
 } cell_asic;
 
 /*!
- Wake isoSPI up from IDlE state and enters the READY state
+ Wake isoSPI up from IDlE state and enters the READY state.
+ Nothing is sent while the ports are known to be ready.
  @return void
  */
 void wakeup_idle(uint8_t total_ic);//!< Number of ICs in the daisy chain
 
 /*!
- Wake the LTC681x from the sleep state 
+ Wake the LTC681x from the sleep state.
+ Only the isoSPI is woken while the cores are known to be awake.
  @return void  
  */
 void wakeup_sleep(uint8_t total_ic); //!< Number of ICs in the daisy chain
 
+/*!
+ Sets the timeouts the wake state is tracked against, 0 wakes every time
+ @return void
+ */
+void LTC681x_wake_set_timeouts(uint32_t idle_us, //!< Bus silence before the isoSPI ports are woken again
+                               uint32_t sleep_ms //!< Time since the last broadcast command before the cores are woken again
+                              );
+
+/*!
+ Forgets the wake state so the next wake-up routines pulse the chain.
+ Call when the chain may have lost power or a read failed its PEC.
+ @return void
+ */
+void LTC681x_wake_invalidate();
+
+/*!
+ @returns wake_stats, the wake state tracker counters
+ */
+wake_stats LTC681x_wake_stats();
+
+/*!
+ Clears the wake state tracker counters
+ @return void
+ */
+void LTC681x_wake_reset_stats();
+
 /*!
  Sends a command to the BMS IC. This code will calculate the PEC code for the transmitted command
  @return void  
@@ -223,6 +352,34 @@ void write_68(uint8_t total_ic , //!< Number of ICs in the daisy chain
 int8_t read_68( uint8_t total_ic, //!< Number of ICs in the daisy chain
                 uint8_t tx_cmd[2], //!< 2 byte array containing the BMS command to be sent
                 uint8_t *rx_data); //!< Array that the read back data will be stored in.
+
+/*!
+ Sends a command to a single LTC681x-2 using the addressed command format
+ @return void
+ */
+void cmd_68_addr(uint8_t addr, //!< Address of the IC
+                 uint8_t tx_cmd[2] //!< 2 byte array containing the broadcast form of the command
+                );
+
+/*!
+ Writes one register group of a single LTC681x-2
+ @return void
+ */
+void write_68_addr(uint8_t addr, //!< Address of the IC
+                   uint8_t tx_cmd[2], //!< 2 byte array containing the broadcast form of the command
+                   uint8_t data[6] //!< Register data to be written
+                  );
+
+/*!
+ Reads one register group, 6 data bytes and the PEC, from a single LTC681x-2
+ @return int8_t, PEC Status.
+  0: Data read back has matching PEC
+ -1: Data read back has incorrect PEC
+ */
+int8_t read_68_addr(uint8_t addr, //!< Address of the IC
+                    uint8_t tx_cmd[2], //!< 2 byte array containing the broadcast form of the command
+                    uint8_t rx_data[8] //!< Array that the read back data will be stored in
+                   );
 				
 /*!
  Calculates  and returns the CRC15
@@ -242,6 +399,7 @@ void LTC681x_wrcfg(uint8_t total_ic, //!< The number of ICs being written to
                    cell_asic *ic //!< A two dimensional array of the configuration data that will be written
                   );
 				  
+#if LTC681X_HAS_B_REGS
 /*!
  Write the LTC681x CFGRB register
  This command will write the configuration registers of the LTC681xs connected in a daisy chain stack. 
@@ -251,6 +409,7 @@ void LTC681x_wrcfg(uint8_t total_ic, //!< The number of ICs being written to
 void LTC681x_wrcfgb(uint8_t total_ic, //!< The number of ICs being written to
                     cell_asic *ic //!< A two dimensional array of the configuration data that will be written
                    );
+#endif
 				   
 /*!
  Reads the LTC681x CFGRA register 
@@ -262,6 +421,7 @@ int8_t LTC681x_rdcfg(uint8_t total_ic, //!< Number of ICs in the system
                      cell_asic *ic //!< A two dimensional array that the function stores the read configuration data.
                     );
 
+#if LTC681X_HAS_B_REGS
 /*!
  Reads the LTC681x CFGRB register 
  @return int8_t, PEC Status.
@@ -271,6 +431,7 @@ int8_t LTC681x_rdcfg(uint8_t total_ic, //!< Number of ICs in the system
 int8_t LTC681x_rdcfgb(uint8_t total_ic, //!< Number of ICs in the system
                       cell_asic *ic //!< A two dimensional array that the function stores the read configuration data.
                      );		   
+#endif
 
 /*!
  Starts cell voltage conversion
@@ -328,6 +489,23 @@ uint8_t LTC681x_rdcv(uint8_t reg, //!< Controls which cell voltage register is r
                      cell_asic *ic //!< Array of the parsed cell codes
                     );
 
+/*!
+ Starts a non-blocking read of all cell voltage registers. Each register group
+ is moved with spi_write_read_async(), finish the read with LTC681x_rdcv_service().
+ The isoSPI must be awake.
+ @return void
+ */
+void LTC681x_rdcv_start(uint8_t total_ic, //!< The number of ICs in the system
+                        cell_asic *ic //!< Array of the parsed cell codes, written as each group arrives
+                       );
+
+/*!
+ Parses the register group that has arrived and queues the next one
+ @return uint8_t, 1 once every group has been read and parsed (or no read was started), 0 while reading
+ */
+uint8_t LTC681x_rdcv_service(int8_t *pec_error //!< Number of register groups with a PEC error, set on completion
+                            );
+
 /*! 
  Reads and parses the LTC681x auxiliary registers.
  The function is used to read the  parsed GPIO codes of the LTC681x. 
@@ -405,11 +583,57 @@ int8_t parse_cells(uint8_t current_ic, //!< Current IC
 uint8_t LTC681x_pladc();
 
 /*! 
-  This function will block operation until the ADC has finished it's conversion
-  @returns uint32_t counter The approximate time it took for the ADC function to complete.
+  This function will block operation until the ADC has finished it's conversion.
+  The bus is left idle until the conversion time of the armed command has passed.
+  @returns uint32_t The time in microseconds from the ADC command to completion.
   */
 uint32_t LTC681x_pollAdc();
 
+/*!
+ Looks up the conversion time of an ADC command
+ @returns uint32_t Conversion time in microseconds
+ */
+uint32_t LTC681x_adc_conv_time(uint8_t MD, //!< ADC Mode
+							   uint8_t adcopt, //!< ADCOPT bit in the configuration register
+							   uint8_t steps //!< Number of measurement steps, ADC_STEPS_*
+							   );
+
+/*!
+ Records the start and deadline of the ADC command just sent. Called by the ADC start commands.
+ @return void
+ */
+void LTC681x_adc_arm(uint8_t MD, //!< ADC Mode
+					 uint8_t steps //!< Number of measurement steps, ADC_STEPS_*
+					 );
+
+/*!
+ Sets the continuation fired by LTC681x_adc_service() when a conversion completes
+ @return void
+ */
+void LTC681x_adc_set_callback(adc_callback callback //!< Function to call, NULL for none
+							  );
+
+/*!
+ Non-blocking conversion check. Does not touch the bus until the deadline has passed.
+ @returns uint8_t 1 if no conversion is in flight, 0 while converting
+ */
+uint8_t LTC681x_adc_service();
+
+/*!
+ @returns uint8_t 1 while an armed conversion has not been seen to complete
+ */
+uint8_t LTC681x_adc_busy();
+
+/*!
+ @returns uint8_t 1 once the next LTC681x_adc_service() will confirm with a PLADC byte, so the isoSPI must be awake
+ */
+uint8_t LTC681x_adc_confirm_due();
+
+/*!
+ @returns uint32_t The measured time in microseconds of the last completed conversion
+ */
+uint32_t LTC681x_adc_elapsed();
+
 /*! 
  Clears the LTC681x Cell voltage registers
  The command clears the cell voltage registers and initializes all values to 1.
@@ -658,6 +882,73 @@ int8_t LTC681x_rdcomm(uint8_t total_ic, //!< Number of ICs in the system
                       cell_asic *ic //!< A two dimensional array that the function stores the read data
                      );
 
+/*!
+ Writes CFGR only if any IC's config.tx_data differs from what was last written, and
+ verifies the readback every verify interval calls
+ @return int8_t, 0: In sync, -1: Readback did not match or failed PEC, rewritten on the next call
+ */
+int8_t LTC681x_sync_cfg(uint8_t total_ic, //!< Number of ICs in the daisy chain
+                        cell_asic *ic //!< A two dimensional array that stores the data
+                       );
+
+#if LTC681X_HAS_B_REGS
+/*!
+ Writes CFGRB only if it changed, see LTC681x_sync_cfg()
+ @return int8_t, 0: In sync, -1: Readback did not match or failed PEC
+ */
+int8_t LTC681x_sync_cfgb(uint8_t total_ic, //!< Number of ICs in the daisy chain
+                         cell_asic *ic //!< A two dimensional array that stores the data
+                        );
+#endif
+
+/*!
+ Writes PWM register group A (pwm) or B (pwmb) only if it changed, see LTC681x_sync_cfg()
+ @return int8_t, 0: In sync, -1: Readback did not match or failed PEC
+ */
+int8_t LTC681x_sync_pwm(uint8_t total_ic, //!< Number of ICs in the daisy chain
+                        uint8_t pwmReg, //!< The PWM Register group, A (0) or B
+                        cell_asic *ic //!< A two dimensional array that stores the data
+                       );
+
+/*!
+ Writes SCTRL register group A (sctrl) or B (sctrlb) only if it changed, see LTC681x_sync_cfg()
+ @return int8_t, 0: In sync, -1: Readback did not match or failed PEC
+ */
+int8_t LTC681x_sync_sctrl(uint8_t total_ic, //!< Number of ICs in the daisy chain
+                          uint8_t sctrl_reg, //!< The SCTRL Register group, A (0) or B
+                          cell_asic *ic //!< A two dimensional array that stores the data
+                         );
+
+/*!
+ Writes COMM only if it changed or a STCOMM has run since the last write.
+ COMM holds the received data after a transfer, so it is never verified.
+ @return int8_t, always 0
+ */
+int8_t LTC681x_sync_comm(uint8_t total_ic, //!< Number of ICs in the daisy chain
+                         cell_asic *ic //!< A two dimensional array that stores the data
+                        );
+
+/*!
+ Forgets what the ICs are known to hold so the next sync writes every group.
+ Call after waking the chain from sleep, which resets the registers.
+ @return void
+ */
+void LTC681x_shadow_invalidate(uint8_t total_ic, //!< Number of ICs in the daisy chain
+                               cell_asic *ic //!< A two dimensional array that stores the data
+                              );
+
+/*!
+ Sets how many sync calls of a register group pass between readback verifications
+ @return void
+ */
+void LTC681x_shadow_set_verify_interval(uint16_t interval //!< Sync calls per verification, 0 to never verify
+                                        );
+
+/*!
+ @returns shadow_stats, the register shadow cache counters
+ */
+shadow_stats LTC681x_shadow_stats();
+
 /*!
  Issues a stcomm command and clocks data out of the COMM register  
  @return void	 
@@ -682,6 +973,78 @@ void LTC681x_reset_crc_count(uint8_t total_ic, //!< Number of ICs in the daisy c
                              cell_asic *ic //!< A two dimensional array that will store the data
 							 );
 							 								
+/*!
+ Sets the LTC681x-2 address used by the _addr functions for one IC
+ @return void
+ */
+void LTC681x_set_address(uint8_t nIC, //!< Current IC
+                         cell_asic *ic, //!< A two dimensional array that stores the data
+                         uint8_t addr //!< Address strapped on the A0-A3 pins
+                        );
+
+/*!
+ Writes the configuration register of a single addressed IC
+ @return void
+ */
+void LTC681x_wrcfg_addr(uint8_t nIC, //!< IC to be written
+                        cell_asic *ic //!< A two dimensional array of the configuration data
+                       );
+
+/*!
+ Reads the configuration register of a single addressed IC
+ @return int8_t, PEC Status. 0: Match, -1: PEC error
+ */
+int8_t LTC681x_rdcfg_addr(uint8_t nIC, //!< IC to be read
+                          cell_asic *ic //!< A two dimensional array that stores the read data
+                         );
+
+/*!
+ Reads and parses the cell voltage registers of a single addressed IC
+ @return int8_t, Number of registers read back with a PEC error
+ */
+int8_t LTC681x_rdcv_addr(uint8_t reg, //!< Cell voltage register to read back, REG_ALL for all
+                         uint8_t nIC, //!< IC to be read
+                         cell_asic *ic //!< A two dimensional array that stores the parsed codes
+                        );
+
+/*!
+ Reads and parses the auxiliary registers of a single addressed IC
+ @return int8_t, Number of registers read back with a PEC error
+ */
+int8_t LTC681x_rdaux_addr(uint8_t reg, //!< Aux register to read back, REG_ALL for all
+                          uint8_t nIC, //!< IC to be read
+                          cell_asic *ic //!< A two dimensional array that stores the parsed codes
+                         );
+
+/*!
+ Reads and parses the status registers of a single addressed IC
+ @return int8_t, Number of registers read back with a PEC error
+ */
+int8_t LTC681x_rdstat_addr(uint8_t reg, //!< Stat register to read back, REG_ALL for all
+                           uint8_t nIC, //!< IC to be read
+                           cell_asic *ic //!< A two dimensional array that stores the parsed codes
+                          );
+
+/*!
+ Reads the cell voltages of the ICs selected in ic_mask only, one addressed read per IC
+ @return int8_t, Number of registers read back with a PEC error
+ */
+int8_t LTC681x_rdcv_subset(uint8_t reg, //!< Cell voltage register to read back, REG_ALL for all
+                           uint8_t total_ic, //!< Number of ICs in the system
+                           cell_asic *ic, //!< A two dimensional array that stores the parsed codes
+                           uint32_t ic_mask //!< Bit n set reads IC n
+                          );
+
+/*!
+ Reads the auxiliary registers of the ICs selected in ic_mask only
+ @return int8_t, Number of registers read back with a PEC error
+ */
+int8_t LTC681x_rdaux_subset(uint8_t reg, //!< Aux register to read back, REG_ALL for all
+                            uint8_t total_ic, //!< Number of ICs in the system
+                            cell_asic *ic, //!< A two dimensional array that stores the parsed codes
+                            uint32_t ic_mask //!< Bit n set reads IC n
+                           );
+
 /*!
  Helper Function to initialize the CFGR data structures 
  @return void 
@@ -768,57 +1131,4 @@ void LTC681x_set_cfgr_ov(uint8_t nIC, //!< Current IC
                          uint16_t ov //!< The OV value
 						 );		
 						 
-#ifdef MBED
-//This needs a PROGMEM =  when using with a LINDUINO
-const uint16_t crc15Table[256] {0x0,0xc599, 0xceab, 0xb32, 0xd8cf, 0x1d56, 0x1664, 0xd3fd, 0xf407, 0x319e, 0x3aac,  // precomputed CRC15 Table
-                                0xff35, 0x2cc8, 0xe951, 0xe263, 0x27fa, 0xad97, 0x680e, 0x633c, 0xa6a5, 0x7558, 0xb0c1,
-                                0xbbf3, 0x7e6a, 0x5990, 0x9c09, 0x973b, 0x52a2, 0x815f, 0x44c6, 0x4ff4, 0x8a6d, 0x5b2e,
-                                0x9eb7, 0x9585, 0x501c, 0x83e1, 0x4678, 0x4d4a, 0x88d3, 0xaf29, 0x6ab0, 0x6182, 0xa41b,
-                                0x77e6, 0xb27f, 0xb94d, 0x7cd4, 0xf6b9, 0x3320, 0x3812, 0xfd8b, 0x2e76, 0xebef, 0xe0dd,
-                                0x2544, 0x2be, 0xc727, 0xcc15, 0x98c, 0xda71, 0x1fe8, 0x14da, 0xd143, 0xf3c5, 0x365c,
-                                0x3d6e, 0xf8f7,0x2b0a, 0xee93, 0xe5a1, 0x2038, 0x7c2, 0xc25b, 0xc969, 0xcf0, 0xdf0d,
-                                0x1a94, 0x11a6, 0xd43f, 0x5e52, 0x9bcb, 0x90f9, 0x5560, 0x869d, 0x4304, 0x4836, 0x8daf,
-                                0xaa55, 0x6fcc, 0x64fe, 0xa167, 0x729a, 0xb703, 0xbc31, 0x79a8, 0xa8eb, 0x6d72, 0x6640,
-                                0xa3d9, 0x7024, 0xb5bd, 0xbe8f, 0x7b16, 0x5cec, 0x9975, 0x9247, 0x57de, 0x8423, 0x41ba,
-                                0x4a88, 0x8f11, 0x57c, 0xc0e5, 0xcbd7, 0xe4e, 0xddb3, 0x182a, 0x1318, 0xd681, 0xf17b,
-                                0x34e2, 0x3fd0, 0xfa49, 0x29b4, 0xec2d, 0xe71f, 0x2286, 0xa213, 0x678a, 0x6cb8, 0xa921,
-                                0x7adc, 0xbf45, 0xb477, 0x71ee, 0x5614, 0x938d, 0x98bf, 0x5d26, 0x8edb, 0x4b42, 0x4070,
-                                0x85e9, 0xf84, 0xca1d, 0xc12f, 0x4b6, 0xd74b, 0x12d2, 0x19e0, 0xdc79, 0xfb83, 0x3e1a, 0x3528,
-                                0xf0b1, 0x234c, 0xe6d5, 0xede7, 0x287e, 0xf93d, 0x3ca4, 0x3796, 0xf20f, 0x21f2, 0xe46b, 0xef59,
-                                0x2ac0, 0xd3a, 0xc8a3, 0xc391, 0x608, 0xd5f5, 0x106c, 0x1b5e, 0xdec7, 0x54aa, 0x9133, 0x9a01,
-                                0x5f98, 0x8c65, 0x49fc, 0x42ce, 0x8757, 0xa0ad, 0x6534, 0x6e06, 0xab9f, 0x7862, 0xbdfb, 0xb6c9,
-                                0x7350, 0x51d6, 0x944f, 0x9f7d, 0x5ae4, 0x8919, 0x4c80, 0x47b2, 0x822b, 0xa5d1, 0x6048, 0x6b7a,
-                                0xaee3, 0x7d1e, 0xb887, 0xb3b5, 0x762c, 0xfc41, 0x39d8, 0x32ea, 0xf773, 0x248e, 0xe117, 0xea25,
-                                0x2fbc, 0x846, 0xcddf, 0xc6ed, 0x374, 0xd089, 0x1510, 0x1e22, 0xdbbb, 0xaf8, 0xcf61, 0xc453,
-                                0x1ca, 0xd237, 0x17ae, 0x1c9c, 0xd905, 0xfeff, 0x3b66, 0x3054, 0xf5cd, 0x2630, 0xe3a9, 0xe89b,
-                                0x2d02, 0xa76f, 0x62f6, 0x69c4, 0xac5d, 0x7fa0, 0xba39, 0xb10b, 0x7492, 0x5368, 0x96f1, 0x9dc3,
-                                0x585a, 0x8ba7, 0x4e3e, 0x450c, 0x8095
-                               };
-
-#else
-const uint16_t crc15Table[256] PROGMEM =  {0x0,0xc599, 0xceab, 0xb32, 0xd8cf, 0x1d56, 0x1664, 0xd3fd, 0xf407, 0x319e, 0x3aac,  // precomputed CRC15 Table
-                               0xff35, 0x2cc8, 0xe951, 0xe263, 0x27fa, 0xad97, 0x680e, 0x633c, 0xa6a5, 0x7558, 0xb0c1,
-                               0xbbf3, 0x7e6a, 0x5990, 0x9c09, 0x973b, 0x52a2, 0x815f, 0x44c6, 0x4ff4, 0x8a6d, 0x5b2e,
-                               0x9eb7, 0x9585, 0x501c, 0x83e1, 0x4678, 0x4d4a, 0x88d3, 0xaf29, 0x6ab0, 0x6182, 0xa41b,
-                               0x77e6, 0xb27f, 0xb94d, 0x7cd4, 0xf6b9, 0x3320, 0x3812, 0xfd8b, 0x2e76, 0xebef, 0xe0dd,
-                               0x2544, 0x2be, 0xc727, 0xcc15, 0x98c, 0xda71, 0x1fe8, 0x14da, 0xd143, 0xf3c5, 0x365c,
-                               0x3d6e, 0xf8f7,0x2b0a, 0xee93, 0xe5a1, 0x2038, 0x7c2, 0xc25b, 0xc969, 0xcf0, 0xdf0d,
-                               0x1a94, 0x11a6, 0xd43f, 0x5e52, 0x9bcb, 0x90f9, 0x5560, 0x869d, 0x4304, 0x4836, 0x8daf,
-                               0xaa55, 0x6fcc, 0x64fe, 0xa167, 0x729a, 0xb703, 0xbc31, 0x79a8, 0xa8eb, 0x6d72, 0x6640,
-                               0xa3d9, 0x7024, 0xb5bd, 0xbe8f, 0x7b16, 0x5cec, 0x9975, 0x9247, 0x57de, 0x8423, 0x41ba,
-                               0x4a88, 0x8f11, 0x57c, 0xc0e5, 0xcbd7, 0xe4e, 0xddb3, 0x182a, 0x1318, 0xd681, 0xf17b,
-                               0x34e2, 0x3fd0, 0xfa49, 0x29b4, 0xec2d, 0xe71f, 0x2286, 0xa213, 0x678a, 0x6cb8, 0xa921,
-                               0x7adc, 0xbf45, 0xb477, 0x71ee, 0x5614, 0x938d, 0x98bf, 0x5d26, 0x8edb, 0x4b42, 0x4070,
-                               0x85e9, 0xf84, 0xca1d, 0xc12f, 0x4b6, 0xd74b, 0x12d2, 0x19e0, 0xdc79, 0xfb83, 0x3e1a, 0x3528,
-                               0xf0b1, 0x234c, 0xe6d5, 0xede7, 0x287e, 0xf93d, 0x3ca4, 0x3796, 0xf20f, 0x21f2, 0xe46b, 0xef59,
-                               0x2ac0, 0xd3a, 0xc8a3, 0xc391, 0x608, 0xd5f5, 0x106c, 0x1b5e, 0xdec7, 0x54aa, 0x9133, 0x9a01,
-                               0x5f98, 0x8c65, 0x49fc, 0x42ce, 0x8757, 0xa0ad, 0x6534, 0x6e06, 0xab9f, 0x7862, 0xbdfb, 0xb6c9,
-                               0x7350, 0x51d6, 0x944f, 0x9f7d, 0x5ae4, 0x8919, 0x4c80, 0x47b2, 0x822b, 0xa5d1, 0x6048, 0x6b7a,
-                               0xaee3, 0x7d1e, 0xb887, 0xb3b5, 0x762c, 0xfc41, 0x39d8, 0x32ea, 0xf773, 0x248e, 0xe117, 0xea25,
-                               0x2fbc, 0x846, 0xcddf, 0xc6ed, 0x374, 0xd089, 0x1510, 0x1e22, 0xdbbb, 0xaf8, 0xcf61, 0xc453,
-                               0x1ca, 0xd237, 0x17ae, 0x1c9c, 0xd905, 0xfeff, 0x3b66, 0x3054, 0xf5cd, 0x2630, 0xe3a9, 0xe89b,
-                               0x2d02, 0xa76f, 0x62f6, 0x69c4, 0xac5d, 0x7fa0, 0xba39, 0xb10b, 0x7492, 0x5368, 0x96f1, 0x9dc3,
-                               0x585a, 0x8ba7, 0x4e3e, 0x450c, 0x8095
-                               };
-     #endif
 #endif
@@ -46,7 +46,18 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define LT_SPI_H
 
 #include <stdint.h>
-#include <SPI.h>
+
+#ifdef ARDUINO
+#include <SPI.h> // SPI_CLOCK_DIVx
+#else
+#define SPI_CLOCK_DIV2 2
+#define SPI_CLOCK_DIV4 4
+#define SPI_CLOCK_DIV8 8
+#define SPI_CLOCK_DIV16 16
+#define SPI_CLOCK_DIV32 32
+#define SPI_CLOCK_DIV64 64
+#define SPI_CLOCK_DIV128 128
+#endif
 
 // Uncomment the following to use functions that implement LTC SPI routines
 
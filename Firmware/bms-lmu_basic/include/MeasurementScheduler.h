@@ -0,0 +1,108 @@
+/***************************************************************************
+    MeasurementScheduler.h
+
+    INTRO
+    Pipelined cell/aux/stat acquisition for an LTC6811 daisy chain.
+    Each ADC conversion is overlapped with the readout of the previous
+    register group: ADAX is started as soon as ADCVSC completes and the
+    cell registers are read while the GPIOs convert, then the next ADCVSC
+    is started before the aux registers are read. A full status conversion
+    (ADSTAT) is slotted between cells and aux every statInterval cycles.
+
+    service() never blocks on a conversion. Completion comes from the
+    driver's conversion time table (LTC6811_adc_service), confirmed with a
+    single PLADC byte once the deadline has passed. The driver's wake
+    state tracker decides whether the isoSPI needs a wake-up first.
+
+    Nor does it block on the cell register read: the groups are moved by
+    DMA (LTC6811_rdcv_start) and service() returns while they are on the
+    wire, finishing the cycle once the last one has been parsed.
+
+****************************************************************************/
+#ifndef MEASUREMENT_SCHEDULER_H
+#define MEASUREMENT_SCHEDULER_H
+
+#include "hal.h"
+#include "LTC681x.h"
+
+struct measurementStats {
+    uint32_t cycles;         // Completed cell/aux cycles
+    uint32_t periodLast;     // Cell sample period (us), start to start
+    uint32_t periodMin;
+    uint32_t periodMax;
+    uint32_t periodMean;
+    uint32_t jitter;         // Peak to peak period deviation (us) since the last reset
+    uint32_t convTimeCell;   // Last measured conversion times (us)
+    uint32_t convTimeAux;
+    uint32_t convTimeStat;
+    uint16_t pecErrors;      // Register reads that returned a PEC error
+};
+
+/**MeasurementScheduler Contructor
+ *
+ * @param _totalIc       Number of ICs in the daisy chain
+ * @param _ic            Chain the results are stored in
+ * @param _md            ADC conversion mode (MD_7KHZ_3KHZ, etc.)
+ * @param _dcp           Discharge permitted during cell conversions
+ * @param _measureAux    Convert and read the GPIOs every cycle
+ * @param _statInterval  Run a full ADSTAT every n cycles, 0 to only read the sum of cells
+*/
+class MeasurementScheduler {
+public:
+    MeasurementScheduler(uint8_t _totalIc, cell_asic *_ic, uint8_t _md, uint8_t _dcp,
+                         bool _measureAux, uint8_t _statInterval);
+
+    /// Wake the chain and start the first cell conversion
+    void start();
+
+    /// Stop issuing conversions, the one in flight is left to finish
+    void stop();
+
+    /**service()
+     * Advance the pipeline, call as often as possible from loop()
+     *
+     * @return true when a new cell (and aux) cycle has been read into the chain
+    */
+    bool service();
+
+    const measurementStats &stats() const { return _stats; }
+    void resetStats();
+
+private:
+    enum group_t {
+        GROUP_NONE,
+        GROUP_CELL,
+        GROUP_AUX,
+        GROUP_STAT
+    };
+
+    uint8_t totalIc;
+    cell_asic *ic;
+    uint8_t md;
+    uint8_t dcp;
+    bool measureAux;
+    uint8_t statInterval;
+
+    bool running;
+    group_t converting;
+    bool readingCells;       // Cell register read in flight
+    group_t startAfterRead;  // Conversion held back until the registers it overwrites are read
+    bool cycleDone;          // The read in flight completes a cycle
+    bool statCycle;
+    uint8_t statCountdown;
+    uint32_t convStart;
+    uint32_t cellStart;
+    bool cellStartValid;
+    uint32_t periodSum;
+    uint32_t periodCount;
+    measurementStats _stats;
+
+    group_t nextGroup(group_t done);
+    void startConversion(group_t group);
+    void readResults(group_t group);
+    bool finishRead();
+    void checkError(int8_t error);
+    static bool conflicts(group_t next, group_t done);
+};
+
+#endif
@@ -1,51 +1,147 @@
-#include <Arduino.h>
 #include <stdint.h>
+#ifdef ARDUINO
+#include <Arduino.h>
 #include "Linduino.h"
 #include "SPI.h"
+#endif
 #include "LT_SPI.h"
 #include "LTC6811.h"
 #include "LTC681x.h"
+#include "bms_units.h"
 
+#ifndef STACK_SIZE
 #define STACK_SIZE 12
+#endif
+static_assert(STACK_SIZE > 0 && STACK_SIZE < 256, "Cell positions are kept as uint8_t");
+#ifndef STACK_TEMPERATURES
+#define STACK_TEMPERATURES 5 // GPIO1-5 thermistors
+#endif
 
 // SAFETY PARAMETERS!
-#define MAX_VOLTAGE 4.2
-#define MIN_VOLTAGE 2.8
-#define MAX_TEMPERATURE 60
+constexpr CellVoltage MAX_VOLTAGE = CellVoltage::from_millivolts(4200);
+constexpr CellVoltage MIN_VOLTAGE = CellVoltage::from_millivolts(2800);
+constexpr Temperature MAX_TEMPERATURE = Temperature::from_celsius(60);
 
+static_assert(MAX_VOLTAGE.code == 42000 && MIN_VOLTAGE.code == 28000, "Thresholds must be in 100uV ADC codes");
+static_assert(!(CellVoltage::from_code(42000) > MAX_VOLTAGE) && CellVoltage::from_code(42001) > MAX_VOLTAGE, "OV trips above 4.2V");
+static_assert(!(CellVoltage::from_code(28000) < MIN_VOLTAGE) && CellVoltage::from_code(27999) < MIN_VOLTAGE, "UV trips below 2.8V");
+static_assert(!(Temperature::from_decidegrees(600) > MAX_TEMPERATURE) && Temperature::from_decidegrees(601) > MAX_TEMPERATURE, "OT trips above 60C");
 
+
+// Pack statistics are kept up to date as each cell is written, so every
+// query is constant time however many cells the stack holds. The extremes
+// are the winners of two tournament trees over the cells, a write replays
+// only the matches on its own path to the root, O(log STACK_SIZE).
 class Stack {
   private: 
     uint16_t cells[STACK_SIZE];
+    int32_t deltas[STACK_SIZE];   // change of each cell since its previous sample
+
+    uint32_t sum;
+    uint64_t sum_sq;
+
+    // Winning cell of each match, node 1 is the final and nodes 2n, 2n+1 play
+    // in node n. Nodes from STACK_SIZE up are the cells themselves.
+    uint8_t min_node[STACK_SIZE];
+    uint8_t max_node[STACK_SIZE];
+
+    int16_t temps[STACK_TEMPERATURES]; // tenths of a degree Celsius
+    int max_temp_pos;
+
+    int min_winner(int node){
+      return (node >= STACK_SIZE) ? node - STACK_SIZE : min_node[node];
+    }
+
+    int max_winner(int node){
+      return (node >= STACK_SIZE) ? node - STACK_SIZE : max_node[node];
+    }
+
+    void play(int node){
+      int left = min_winner(2*node);
+      int right = min_winner(2*node + 1);
+      min_node[node] = (cells[right] < cells[left]) ? right : left;
+
+      left = max_winner(2*node);
+      right = max_winner(2*node + 1);
+      max_node[node] = (cells[right] > cells[left]) ? right : left;
+    }
+
+    void rescan_max_temperature(){
+      max_temp_pos = 0;
+      for (int i = 1; i < STACK_TEMPERATURES; i++){
+        if (temps[i] > temps[max_temp_pos]) {
+          max_temp_pos = i;
+        }
+      }
+    }
 
   public:
+    Stack(){
+      for (int i = 0; i < STACK_SIZE; i++){
+        cells[i] = 0;
+        deltas[i] = 0;
+      }
+      sum = 0;
+      sum_sq = 0;
+      for (int node = STACK_SIZE - 1; node > 0; node--){
+        play(node);
+      }
+      for (int i = 0; i < STACK_TEMPERATURES; i++){
+        temps[i] = 0;
+      }
+      max_temp_pos = 0;
+    }
+
     bool update_cell(int pos, uint16_t cell_voltage){
       if (pos >= STACK_SIZE || pos < 0) {
         return false;
-      } else {
-        cells[pos] = cell_voltage;
-        return true;
       }
+
+      uint16_t old_voltage = cells[pos];
+      cells[pos] = cell_voltage;
+      deltas[pos] = (int32_t)cell_voltage - old_voltage;
+      sum = sum - old_voltage + cell_voltage;
+      sum_sq = sum_sq - (uint32_t)old_voltage*old_voltage + (uint32_t)cell_voltage*cell_voltage;
+
+      for (int node = (pos + STACK_SIZE)/2; node > 0; node /= 2){
+        play(node);
+      }
+      return true;
     }
 
-    uint16_t min(){
-      uint16_t lowest_cell = cells[0];
-      for (int i = 0; i < STACK_SIZE; i++){
-        if (lowest_cell > cells[i]) {
-          lowest_cell = cells[i];
-        }
+    bool update_temperature(int pos, Temperature temperature){
+      if (pos >= STACK_TEMPERATURES || pos < 0) {
+        return false;
+      }
+
+      temps[pos] = temperature.decidegrees;
+      if (temps[pos] >= temps[max_temp_pos]) {
+        max_temp_pos = pos;
+      } else if (pos == max_temp_pos) {
+        rescan_max_temperature();
       }
-      return lowest_cell;
+      return true;
+    }
+
+    uint16_t min(){
+      return cells[argmin()];
     }
 
     uint16_t max(){
-      uint16_t highest_cell = cells[0];
-      for (int i = 0; i < STACK_SIZE; i++){
-        if (highest_cell < cells[i]) {
-          highest_cell = cells[i];
-        }
-      }
-      return highest_cell;
+      return cells[argmax()];
+    }
+
+    int argmin(){
+      return min_winner(1);
+    }
+
+    int argmax(){
+      return max_winner(1);
+    }
+
+    // Difference between the highest and lowest cell
+    uint16_t spread(){
+      return max() - min();
     }
 
     float average(){
@@ -53,24 +149,46 @@ class Stack {
     }
 
     int sum_stack_voltage(){
-      int sum = 0;
-      for (int i = 0; i < STACK_SIZE; i++){
-        sum = sum + cells[i];
-      }
       return sum;
     }
 
+    // Population variance of the cell voltages, in ADC codes squared
+    uint32_t variance(){
+      return (uint32_t)((STACK_SIZE*sum_sq - (uint64_t)sum*sum)/((uint64_t)STACK_SIZE*STACK_SIZE));
+    }
+
+    // Change of a cell since its previous sample
+    int32_t delta(int cell_number){
+      return deltas[cell_number];
+    }
+
     bool ov_fault(){
-        return (max() > MAX_VOLTAGE);
+        return (CellVoltage::from_code(max()) > MAX_VOLTAGE);
     }
 
     bool uv_fault(){
-        return (min() < MIN_VOLTAGE);
+        return (CellVoltage::from_code(min()) < MIN_VOLTAGE);
+    }
+
+    Temperature max_temperature(){
+        return Temperature::from_decidegrees(temps[max_temp_pos]);
+    }
+
+    bool ot_fault(){
+        return (max_temperature() > MAX_TEMPERATURE);
     }
 
     uint16_t cell_voltage(int cell_number){
         return cells[cell_number];
     }
+
+    const uint16_t *cell_voltages(){
+        return cells;
+    }
+
+    const int16_t *temperatures(){
+        return temps;
+    }
 };
 
 
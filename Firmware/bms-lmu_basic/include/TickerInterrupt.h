@@ -8,9 +8,17 @@
     INTRO
     This library support attaching callback function to "proper"ticker
     with stm32duino framework.
-    A HardwareTimer is used as the base interrupt will call the timerHandler 
-    function every 1ms. timerHandler will then check if it's time to call the
-    actual callback function using a counter
+    A HardwareTimer, set up by hal_tick_start(), is used as the base interrupt will call the timerHandler 
+    function every 1ms. Tickers are kept in a two level timer wheel, so
+    timerHandler only looks at the slot for the current tick and attach,
+    once and detach are O(1) whatever the number of tickers. An expired
+    ticker is posted to a ready queue for its priority and its callback
+    runs to completion from dispatch() in the main loop, so SPI and CAN
+    work never holds off other interrupts.
+
+    With tickless idle enabled, idle() stretches the timer period to the
+    next occupied wheel slot, stops SysTick and sleeps the core until the
+    timer or another interrupt wakes it.
 
     Based on STM32_TimerInterrupt
     Author: Khoi Hoang
@@ -18,18 +26,92 @@
     Revision     Date          Comments
     --------   ----------     ------------
     0.0        24/06/2021     Initial coding
+    0.1        17/10/2026     Callbacks run from dispatch(), priorities,
+                              deadlines and run time statistics
+    0.2        17/10/2026     Timer wheel, detach, one shot tickers and
+                              phase offsets
+    0.3        17/10/2026     Tickless idle
+    0.4        17/10/2026     Timer and sleep through hal.h
+    0.5        17/10/2026     Ready queues use every entry, detach takes
+                              a queued release out
 
 ****************************************************************************/
-#include "Arduino.h"
+#include "hal.h"
 
 typedef void (*fpointer)(); // function pointer for passing ticker callback
+
+enum tickerPriority {
+    TICKER_PRIORITY_HIGH,
+    TICKER_PRIORITY_NORMAL,
+    TICKER_PRIORITY_LOW,
+    TICKER_PRIORITY_COUNT
+};
+
+struct tickerStats {
+    uint32_t runs;
+    uint32_t runTimeLast;    // Callback run time (us)
+    uint32_t runTimeMax;
+    uint32_t runTimeMean;
+    uint32_t latencyMax;     // Release in the ISR to start of the callback (us)
+    uint32_t deadlineMisses; // Runs that finished later than the deadline after release
+    uint32_t overruns;       // Releases dropped because the previous one had not run yet
+};
+
+struct idleStats {
+    uint32_t sleeps;
+    uint32_t ticksSlept;
+    uint32_t earlyWakes;       // Woken by another interrupt before the next ticker was due
+    uint32_t wakeLatencyLast;  // Due tick to idle() running again (us)
+    uint32_t wakeLatencyMax;
+};
+
 struct tickerInfo {
-    uint32_t interval;
-    uint32_t counter;
+    uint32_t interval;          // 0 for a one shot ticker
+    uint32_t expires;           // Tick the ticker is next due on
+    int16_t next;               // Links in a wheel slot or the free list
+    int16_t prev;
+    uint8_t slot;               // Wheel slot the ticker is linked in
+    bool inUse;
     fpointer callback;
+    tickerPriority priority;
+    uint32_t deadline;          // us after release
+    volatile bool pending;
+    volatile uint32_t released; // hal_micros() at release
+    uint32_t runTimeSum;
+    tickerStats stats;
 };
 
-#define MAX_TICKER_NUMBER 10
+#ifndef MAX_TICKER_NUMBER
+#define MAX_TICKER_NUMBER 16
+#endif
+#ifndef TICKER_QUEUE_SIZE
+#define TICKER_QUEUE_SIZE 16 // Power of 2, at least MAX_TICKER_NUMBER so a ready queue does not fill
+#endif
+
+#define TICKER_WHEEL_BITS 6                              // Slots per wheel level = 2^bits
+#define TICKER_WHEEL_SIZE (1 << TICKER_WHEEL_BITS)
+#define TICKER_WHEEL_MASK (TICKER_WHEEL_SIZE - 1)
+#define TICKER_WHEEL_SPAN (TICKER_WHEEL_SIZE * TICKER_WHEEL_SIZE) // Ticks reachable without a re-cascade
+#define TICKER_SLOT_NONE 0xFF
+
+#define TICKER_COUNTS_PER_TICK 100 // Timer counts per tick, sets the wake latency resolution
+#define TICKER_MAX_SLEEP_TICKS (0x10000 / TICKER_COUNTS_PER_TICK) // Longest period a 16 bit timer can hold
+
+static_assert((TICKER_QUEUE_SIZE & (TICKER_QUEUE_SIZE-1)) == 0, "TICKER_QUEUE_SIZE must be a power of 2");
+static_assert(TICKER_QUEUE_SIZE >= MAX_TICKER_NUMBER, "Every ticker must fit in a ready queue");
+static_assert(TICKER_QUEUE_SIZE <= 0x8000, "Queue counters are uint16_t");
+static_assert(MAX_TICKER_NUMBER < 0x7FFF, "Ticker ids are int16_t");
+static_assert(2*TICKER_WHEEL_SIZE <= TICKER_SLOT_NONE, "Wheel slots are uint8_t");
+static_assert(TICKER_WHEEL_SIZE == 64, "Slot occupancy is one uint64_t per level");
+
+// Single producer (timerHandler) single consumer (dispatch) ring of ticker ids.
+// head and tail run free and are masked on access, so all TICKER_QUEUE_SIZE
+// entries are usable. A ticker has at most one entry, while it is pending.
+struct tickerQueue {
+    volatile uint16_t head;     // Entries posted
+    volatile uint16_t tail;     // Entries taken
+    int16_t slot[TICKER_QUEUE_SIZE];
+};
 
 /**TickerInterrupt Contructor
  *
@@ -42,28 +124,89 @@ struct tickerInfo {
 */
 class TickerInterrupt {
 public:
-    TickerInterrupt(TIM_TypeDef *_hardwareTimer, double _interval);
+    TickerInterrupt(hal_timer _hardwareTimer, double _interval);
     
     /// Start the Hardware timer
     void start();
 
-    /**start()
-     * Attach callback function
+    /**attach()
+     * Attach a periodic callback function
      
      * @param[in] _callback  Pass callback function (global or static only)
      * @param _interval(ms)  Callback execution interval
+     * @param _priority      Ready tickers of a higher priority are dispatched first
+     * @param _deadline(ms)  Latest finish after release before a miss is counted, 0 for the interval
+     * @param _phase(ms)     Delay of the first release beyond one interval, spreads
+     *                       tickers with a common period over different ticks
+     *
+     * @return ticker id, -1 if MAX_TICKER_NUMBER are already attached
+    */
+    int attach(fpointer _callback, int _interval,
+               tickerPriority _priority = TICKER_PRIORITY_NORMAL, int _deadline = 0, int _phase = 0);
+
+    /**once()
+     * Attach a callback function that runs a single time, the id is
+     * released once the callback has run
+     *
+     * @param[in] _callback  Pass callback function (global or static only)
+     * @param _delay(ms)     Time until the callback is released
+     *
+     * @return ticker id, -1 if MAX_TICKER_NUMBER are already attached
+    */
+    int once(fpointer _callback, int _delay,
+             tickerPriority _priority = TICKER_PRIORITY_NORMAL, int _deadline = 0);
+
+    /// Remove a ticker, a release that is already queued is dropped
+    void detach(int id);
+
+    /**dispatch()
+     * Run the highest priority ready callback to completion, call as often
+     * as possible from loop()
+     *
+     * @return true if a callback was run
+    */
+    bool dispatch();
+
+    /// Let idle() sleep between tickers, off by default
+    void setTickless(bool enable) { tickless = enable; }
+
+    /**idle()
+     * Sleep until the next ticker is due or another interrupt fires. Call
+     * from loop() once dispatch() has nothing left to run.
+     *
+     * @return true if the core slept
     */
-    void attach(fpointer _callback, int _interval);
+    bool idle();
+
+    const tickerStats &stats(int id) const { return ticker[id].stats; }
+    const idleStats &sleepStats() const { return _idleStats; }
+    void resetStats();
 
 private:
     uint32_t interval;
-    TIM_TypeDef *timerInstance;
+    hal_timer timerInstance;
+    bool started;
+    bool tickless;
+    idleStats _idleStats;
 
-    static volatile int tickerNumber;
+    static volatile uint32_t tick;
+    static int16_t freeList;
+    static int16_t wheel[2*TICKER_WHEEL_SIZE]; // Level 0 (1 tick slots) then level 1 (TICKER_WHEEL_SIZE tick slots)
+    static uint64_t occupied[2];               // Non empty slots of each level
     static tickerInfo ticker[MAX_TICKER_NUMBER];
+    static tickerQueue queue[TICKER_PRIORITY_COUNT];
 
     /**timerHandler()
-     * main "logic" of the ticker
+     * main "logic" of the ticker, releases expired tickers
     */
     static void timerHandler();
-};
\ No newline at end of file
+    static void step();
+    static uint32_t nextDue();
+    static void link(int16_t id);
+    static void unlink(int16_t id);
+    static void release(int16_t id);
+    static void unqueue(int16_t id);
+    int add(fpointer _callback, uint32_t _interval, uint32_t _delay,
+            tickerPriority _priority, uint32_t _deadline);
+    void run(int16_t id);
+};
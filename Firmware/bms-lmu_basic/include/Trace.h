@@ -0,0 +1,102 @@
+/*
+Trace.h
+
+Cycle accurate timing of hot paths. A probe is a fixed slot in a RAM table;
+TRACE_SCOPE(id) times the rest of the enclosing block with hal_cycles() (the
+DWT cycle counter on the STM32, clock_gettime() on the host) and folds the
+sample into the slot: count, min, mean, max and a log2 histogram. The cost of
+reading the counter twice is measured by trace_init() and taken off each
+sample.
+
+The table is printed with trace_print() (serial command 32) or packed with
+trace_encode() for the CAN diagnostic channel. Build with -DTRACE_ENABLED=0
+to compile every probe out.
+
+Probes are recorded from the main loop only; a probe inside an interrupt
+handler could tear the update of a slot the loop is writing.
+
+trace_encode() layout (multi-byte fields little endian)
+  version     1 byte   TRACE_FORMAT
+  probes      1 byte   TRACE_PROBE_COUNT
+  buckets     1 byte   TRACE_BUCKETS
+  hz          4 bytes  counts per second of the cycles below
+  per probe   id 1 byte, count, min, mean, max 4 bytes each,
+              buckets 2 bytes each (saturated at 0xFFFF)
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include "hal.h"
+
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1
+#endif
+#ifndef TRACE_BUCKETS
+#define TRACE_BUCKETS 20 // Bucket n counts samples of 2^n to 2^(n+1)-1 cycles, the last takes the rest
+#endif
+#define TRACE_FORMAT 1
+
+enum trace_probe_id
+{
+  TRACE_LTC6811_RDCV,    //!< LTC6811_rdcv(), wake-up, bus and parsing
+  TRACE_PEC15_CALC,      //!< pec15_calc()
+  TRACE_PARSE_CELLS,     //!< parse_cells(), one register group of one IC
+  TRACE_TICKER_CALLBACK, //!< Every ticker callback run from dispatch()
+  TRACE_CS_LOW,          //!< cs_low(), chip select set up
+  TRACE_FAULT_CHECK,     //!< check_errors(), the heartbeat's pack fault checks
+  TRACE_PROBE_COUNT
+};
+
+typedef struct
+{
+  uint32_t count;
+  uint32_t min;     //!< Cycles
+  uint32_t max;
+  uint64_t sum;
+  uint32_t buckets[TRACE_BUCKETS];
+} trace_stats;
+
+#define TRACE_PROBE_ENCODED_LEN (1 + 4*4 + 2*TRACE_BUCKETS)
+#define TRACE_ENCODED_LEN (7 + TRACE_PROBE_COUNT*TRACE_PROBE_ENCODED_LEN)
+
+// Starts the cycle counter, measures the probe overhead and clears the table
+void trace_init();
+
+// Clears the table
+void trace_reset();
+
+// Adds a sample of cycles to a probe
+void trace_record(trace_probe_id id, uint32_t cycles);
+
+const trace_stats *trace_get(trace_probe_id id);
+const char *trace_name(trace_probe_id id);
+
+// Prints a line per probe that has samples, times in ns, through hal_log()
+void trace_print();
+
+// Packs the table as laid out above. Returns the length, 0 if size is
+// below TRACE_ENCODED_LEN
+uint16_t trace_encode(uint8_t *out, uint16_t size);
+
+#if TRACE_ENABLED
+class trace_scope
+{
+  public:
+    explicit trace_scope(trace_probe_id _id) : id(_id), start(hal_cycles()) {}
+    ~trace_scope() { trace_record(id, hal_cycles() - start); }
+
+  private:
+    trace_probe_id id;
+    uint32_t start;
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SCOPE(id) trace_scope TRACE_CONCAT(trace_scope_, __LINE__)(id)
+#else
+#define TRACE_SCOPE(id) ((void)0)
+#endif
+
+#endif  // TRACE_H
@@ -50,7 +50,31 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 // io buffer
 extern char ui_buffer[UI_BUFFER_SIZE];
 
-// Read data from the serial interface into the ui_buffer buffer
+// Collect whatever serial input is available without waiting. When a line
+// is complete it is copied into ui_buffer and its length returned, otherwise
+// returns -1.
+int16_t ui_poll();
+
+// Handler for a command number, args points past the number and any spaces
+typedef void (*ui_handler)(uint32_t cmd, const char *args);
+
+// Commands first..last are passed to handler
+typedef struct
+{
+  uint32_t first;
+  uint32_t last;
+  ui_handler handler;
+} ui_command;
+
+// Parse an integer with the same prefixes as read_int(). If end is not
+// NULL it is set to the first character after the number.
+int32_t ui_parse_int(const char *text, const char **end);
+
+// Run the table entry covering the command number at the start of line.
+// Returns false if the line has no number or no entry covers it.
+bool ui_dispatch(const char *line, const ui_command *table, uint8_t count);
+
+// Read data from the serial interface into the ui_buffer buffer, waits for a complete line
 uint8_t read_data();
 
 // Read a float value from the serial interface
@@ -78,4 +78,40 @@ void spi_write_read(uint8_t tx_Data[],//array of data to be written on SPI port
                    );
 
 uint8_t spi_read_byte(uint8_t tx_dat);//name conflicts with linduino also needs to take a byte as a parameter
+
+/*
+ Asynchronous SPI transport.
+ A whole frame (command bytes followed by rx_len read bytes) is queued with
+ one call. Chip select is pulled low for the duration of the frame and
+ released when it completes. Completion is signalled through spi_async_busy()
+ and, if given, the callback, which runs in interrupt context.
+ On the STM32F1 the frame is moved by DMA1 channels 2/3 on SPI1, elsewhere
+ (and on host builds) the frame is transferred in place and the callback
+ fires before spi_write_read_async returns.
+ The blocking helpers and cs_low() wait for a frame in flight to complete
+ before touching the port.
+*/
+typedef void (*spi_callback)(void);
+
+void spi_async_init();
+
+/*
+ Queues a frame on the SPI port. An empty frame only pulses chip select and
+ completes before returning.
+ Returns 0 if the frame was queued, 1 if a frame is already in flight.
+*/
+uint8_t spi_write_read_async(uint8_t cs_pin, //chip select pin held low for the frame
+                             uint8_t tx_data[], //array of data to be written on SPI port, must stay valid until completion
+                             uint8_t tx_len, //length of the tx data array
+                             uint8_t *rx_data, //array that will store the data read by the SPI port
+                             uint16_t rx_len, //number of bytes to be read after tx_data
+                             spi_callback callback //called once the frame has completed, may be NULL
+                            );
+
+bool spi_async_busy();
+
+/*
+ Blocks until the frame in flight (if any) has completed.
+*/
+void spi_async_wait();
 #endif
\ No newline at end of file
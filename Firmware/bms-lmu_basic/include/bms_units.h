@@ -0,0 +1,99 @@
+#ifndef BMS_UNITS_H
+#define BMS_UNITS_H
+
+#include <stdint.h>
+
+// Fixed point measurement types. Thresholds are built from engineering units
+// at compile time so every runtime comparison is a plain integer compare,
+// no float is ever promoted on the M3.
+
+// Cell voltage as an LTC681x ADC code, LSB = 100uV
+struct CellVoltage {
+    uint16_t code;
+
+    static constexpr CellVoltage from_code(uint16_t adc_code) {
+        return CellVoltage{adc_code};
+    }
+
+    static constexpr CellVoltage from_millivolts(uint32_t millivolts) {
+        return CellVoltage{(uint16_t)(millivolts*10)};
+    }
+
+    constexpr uint16_t millivolts() const {
+        return code/10;
+    }
+
+    constexpr bool operator<(CellVoltage rhs) const { return code < rhs.code; }
+    constexpr bool operator>(CellVoltage rhs) const { return code > rhs.code; }
+    constexpr bool operator<=(CellVoltage rhs) const { return code <= rhs.code; }
+    constexpr bool operator>=(CellVoltage rhs) const { return code >= rhs.code; }
+    constexpr bool operator==(CellVoltage rhs) const { return code == rhs.code; }
+    constexpr bool operator!=(CellVoltage rhs) const { return code != rhs.code; }
+};
+
+// Temperature in tenths of a degree Celsius
+struct Temperature {
+    int16_t decidegrees;
+
+    static constexpr Temperature from_decidegrees(int16_t value) {
+        return Temperature{value};
+    }
+
+    static constexpr Temperature from_celsius(int16_t celsius) {
+        return Temperature{(int16_t)(celsius*10)};
+    }
+
+    constexpr int16_t celsius() const {
+        return decidegrees/10;
+    }
+
+    constexpr bool operator<(Temperature rhs) const { return decidegrees < rhs.decidegrees; }
+    constexpr bool operator>(Temperature rhs) const { return decidegrees > rhs.decidegrees; }
+    constexpr bool operator<=(Temperature rhs) const { return decidegrees <= rhs.decidegrees; }
+    constexpr bool operator>=(Temperature rhs) const { return decidegrees >= rhs.decidegrees; }
+    constexpr bool operator==(Temperature rhs) const { return decidegrees == rhs.decidegrees; }
+    constexpr bool operator!=(Temperature rhs) const { return decidegrees != rhs.decidegrees; }
+};
+
+// NTC thermistor on an LTC681x GPIO: 10k B3435 below a 10k pull-up to VREF2,
+// as on the LTC681x demo boards. GPIO/VREF2 ratio (1/10000) every 5 degC from
+// -40 degC, interpolated to within 0.15 degC.
+constexpr int16_t THERMISTOR_MIN_CELSIUS = -40;
+constexpr int16_t THERMISTOR_STEP_CELSIUS = 5;
+static constexpr uint16_t THERMISTOR_RATIO[] = {
+    9613, 9480, 9312, 9106, 8857, 8563, 8223, 7840, 7416, 6960, 6480, 5986,
+    5490, 5000, 4526, 4076, 3654, 3265, 2908, 2586, 2296, 2038, 1808, 1605,
+    1425, 1267, 1128, 1006, 898, 804, 720, 647, 582, 525
+};
+constexpr uint8_t THERMISTOR_POINTS = sizeof(THERMISTOR_RATIO)/sizeof(THERMISTOR_RATIO[0]);
+
+// Temperature of a GPIO aux code, taken against the VREF2 aux code so the
+// reference tolerance cancels. Clamped to the table, a shorted sensor reads hot.
+constexpr Temperature thermistor_temperature(uint16_t gpio_code, uint16_t vref2_code) {
+    uint32_t ratio = vref2_code ? (uint32_t)gpio_code*10000/vref2_code : 0;
+    if (ratio >= THERMISTOR_RATIO[0]) {
+        return Temperature::from_celsius(THERMISTOR_MIN_CELSIUS);
+    }
+    for (uint8_t i = 0; i + 1 < THERMISTOR_POINTS; i++) {
+        if (ratio >= THERMISTOR_RATIO[i + 1]) {
+            int32_t span = THERMISTOR_RATIO[i] - THERMISTOR_RATIO[i + 1];
+            int32_t into = (int32_t)THERMISTOR_RATIO[i] - (int32_t)ratio;
+            return Temperature::from_decidegrees((int16_t)((THERMISTOR_MIN_CELSIUS + i*THERMISTOR_STEP_CELSIUS)*10
+                                                           + into*THERMISTOR_STEP_CELSIUS*10/span));
+        }
+    }
+    return Temperature::from_celsius(THERMISTOR_MIN_CELSIUS + (THERMISTOR_POINTS - 1)*THERMISTOR_STEP_CELSIUS);
+}
+
+// Conversion checks
+static_assert(CellVoltage::from_millivolts(4200).code == 42000, "4.2V is ADC code 42000");
+static_assert(CellVoltage::from_millivolts(6553).code == 65530, "Largest whole mV that fits the ADC code");
+static_assert(CellVoltage::from_code(41999).millivolts() == 4199, "Code to mV truncates");
+static_assert(Temperature::from_celsius(-40).decidegrees == -400, "Negative temperatures");
+static_assert(Temperature::from_celsius(60) > Temperature::from_decidegrees(599), "Temperature ordering");
+static_assert(thermistor_temperature(15000, 30000).decidegrees == 250, "Half of VREF2 is 25 degC");
+static_assert(thermistor_temperature(6888, 30000).decidegrees == 600, "Table point at 60 degC");
+static_assert(thermistor_temperature(30000, 30000).decidegrees == -400, "Open sensor clamps cold");
+static_assert(thermistor_temperature(0, 30000).decidegrees == 1250, "Shorted sensor clamps hot");
+
+#endif
@@ -0,0 +1,182 @@
+/*
+hal.h
+
+Hardware abstraction for the driver code: time, pins, the SPI port, critical
+sections, the ticker timer and a console. Every function is implemented by
+one port, picked at link time:
+
+  src/hal_stm32.cpp   STM32duino (ARDUINO defined)
+  src/hal_linux.cpp   Linux host builds, see hal_linux.h
+
+The calls are plain functions, so the MCU build has no virtual dispatch or
+function pointers between the driver and the core (and -flto can inline
+them). The cycle counter and fast pin accessors are the exception: they are inline here, per
+port, because a call would cost more than the register access itself.
+Code above this layer must not include Arduino.h or call the core.
+*/
+
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef ARDUINO
+#include <Arduino.h> // Board pin names (PA1, ...) only
+#else
+/* Pin names of the STM32 variant, so board level code builds unchanged on the host */
+enum hal_pin_name
+{
+  PA0, PA1, PA2, PA3, PA4, PA5, PA6, PA7, PA8, PA9, PA10, PA11, PA12, PA13, PA14, PA15,
+  PB0, PB1, PB2, PB3, PB4, PB5, PB6, PB7, PB8, PB9, PB10, PB11, PB12, PB13, PB14, PB15,
+  PC0, PC1, PC2, PC3, PC4, PC5, PC6, PC7, PC8, PC9, PC10, PC11, PC12, PC13, PC14, PC15
+};
+#endif
+
+#define HAL_PIN_INPUT 0
+#define HAL_PIN_OUTPUT 1
+
+/* Time */
+uint32_t hal_micros();
+uint32_t hal_millis();
+void hal_delay_us(uint32_t us);
+void hal_delay_ms(uint32_t ms);
+
+/*
+ Cycle counter for timing code paths: the DWT CYCCNT on the STM32,
+ CLOCK_MONOTONIC in ns on the host. Free running, wraps at 32 bits, so
+ only differences are meaningful (up to 59s at 72MHz).
+*/
+void hal_cycles_init();
+uint32_t hal_cycles_hz();
+#ifdef ARDUINO
+static inline uint32_t hal_cycles()
+{
+  return DWT->CYCCNT;
+}
+#else
+uint32_t hal_cycles();
+#endif
+
+/* Pins */
+void hal_pin_mode(uint32_t pin, uint8_t mode);
+void hal_pin_write(uint32_t pin, uint32_t level);
+int hal_pin_read(uint32_t pin);
+
+/*
+ Fast pins, for chip selects and anything toggled per transfer.
+ hal_gpio_bind() resolves the pin once, after hal_pin_mode(); the accessors
+ are then a single store to BSRR or load from IDR on the STM32, against the
+ pin map lookups digitalWrite()/digitalRead() repeat on every call.
+*/
+#ifdef ARDUINO
+typedef struct
+{
+  GPIO_TypeDef *port;
+  uint32_t mask;
+} hal_gpio;
+
+static inline hal_gpio hal_gpio_bind(uint32_t pin)
+{
+  hal_gpio gpio = {digitalPinToPort(pin), digitalPinToBitMask(pin)};
+  return gpio;
+}
+
+static inline void hal_gpio_set(const hal_gpio *gpio)
+{
+  gpio->port->BSRR = gpio->mask;
+}
+
+static inline void hal_gpio_clear(const hal_gpio *gpio)
+{
+  gpio->port->BSRR = gpio->mask << 16; // Upper half resets
+}
+
+static inline int hal_gpio_read(const hal_gpio *gpio)
+{
+  return (gpio->port->IDR & gpio->mask) != 0;
+}
+#else
+/* No registers on the host, the pin calls keep the device hooks working */
+typedef struct
+{
+  uint32_t pin;
+} hal_gpio;
+
+static inline hal_gpio hal_gpio_bind(uint32_t pin)
+{
+  hal_gpio gpio = {pin};
+  return gpio;
+}
+
+static inline void hal_gpio_set(const hal_gpio *gpio)
+{
+  hal_pin_write(gpio->pin, 1);
+}
+
+static inline void hal_gpio_clear(const hal_gpio *gpio)
+{
+  hal_pin_write(gpio->pin, 0);
+}
+
+static inline int hal_gpio_read(const hal_gpio *gpio)
+{
+  return hal_pin_read(gpio->pin);
+}
+#endif
+
+static inline void hal_gpio_write(const hal_gpio *gpio, uint32_t level)
+{
+  if (level)
+  {
+    hal_gpio_set(gpio);
+  }
+  else
+  {
+    hal_gpio_clear(gpio);
+  }
+}
+
+/*
+ SPI port, mode 0, MSB first.
+ clock_divider divides the 72MHz SPI1 clock (SPI_CLOCK_DIVx on the STM32)
+*/
+void hal_spi_begin(uint8_t clock_divider);
+void hal_spi_end();
+uint8_t hal_spi_transfer(uint8_t data);
+
+/* Critical sections, not nested */
+void hal_irq_disable();
+void hal_irq_enable();
+
+/*
+ Ticker timer.
+ handler runs in interrupt context once per tick of tick_us, the timer
+ counts counts_per_tick per tick so hal_tick_sleep() can stretch a period
+ without touching the prescaler.
+*/
+typedef void *hal_timer; //!< Port timer handle, the TIM_TypeDef * on the STM32
+typedef void (*hal_isr)(void);
+
+void hal_tick_start(hal_timer timer, uint32_t tick_us, uint16_t counts_per_tick, hal_isr handler);
+
+typedef struct
+{
+  uint32_t position; //!< Timer counts from the start of the tick in progress at the call
+  uint32_t count;    //!< Counter value on waking, the latency past the due tick if fired
+  bool fired;        //!< Woken by the ticker timer rather than another interrupt
+} hal_tick_wake;
+
+/*
+ Sleeps for up to ticks ticks or until any interrupt. Call with interrupts
+ disabled, returns with them still disabled. The handler is not run for the
+ ticks slept, the caller catches up from wake->position.
+ Returns false if the port cannot sleep or a tick is already pending,
+ nothing was done.
+*/
+bool hal_tick_sleep(uint32_t ticks, hal_tick_wake *wake);
+
+/* Console, printf format */
+void hal_log(const char *format, ...);
+
+#endif
@@ -0,0 +1,53 @@
+/*
+hal_linux.h
+
+Hooks of the Linux port of hal.h. By default time comes from
+CLOCK_MONOTONIC, the delays sleep and the SPI port reads 0xFF. A device
+model (lib/ltc6811_sim) can take over the clock, so runs are repeatable and
+never sleep, and the SPI port with its chip select pin. hal_cycles() always
+reads CLOCK_MONOTONIC, so trace probes time the host code even then.
+
+The ticker timer is SIGALRM from setitimer(), hal_irq_disable() blocks it.
+With manual ticks set the timer is never started and the ticker handler
+only runs from hal_linux_tick(), so a host program can step it directly.
+hal_tick_sleep() is not supported, the core never sleeps on the host.
+*/
+
+#ifndef HAL_LINUX_H
+#define HAL_LINUX_H
+
+#ifndef ARDUINO
+
+#include <stdint.h>
+#include "hal.h"
+
+typedef struct
+{
+  uint64_t (*now_ns)(void);       //!< Current time
+  void (*wait_ns)(uint64_t ns);   //!< Let ns pass
+} hal_linux_clock;
+
+typedef struct
+{
+  uint32_t cs_pin;                //!< hal_pin_write() on this pin selects the device
+  void (*select)(void);           //!< Chip select low
+  void (*deselect)(void);         //!< Chip select high
+  uint8_t (*transfer)(uint8_t mosi);
+  void (*set_clock)(uint32_t hz); //!< SCK frequency from hal_spi_begin(), may be NULL
+} hal_linux_spi_device;
+
+/* Replaces the time source, NULL restores CLOCK_MONOTONIC */
+void hal_linux_set_clock(const hal_linux_clock *clock);
+
+/* Connects a device to the SPI port, NULL disconnects it */
+void hal_linux_set_spi_device(const hal_linux_spi_device *device);
+
+/* Leaves the ticker timer stopped, call before hal_tick_start() */
+void hal_linux_set_manual_tick(bool manual);
+
+/* Runs the ticker handler once, as a timer interrupt would */
+void hal_linux_tick();
+
+#endif // ARDUINO
+
+#endif
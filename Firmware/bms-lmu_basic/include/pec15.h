@@ -0,0 +1,71 @@
+/*
+pec15.h
+
+PEC (CRC15) engine for the LTC681x command and register data.
+
+The state is kept left aligned in 16 bits (the LTC681x remainder multiplied
+by 2), which is also the value that goes on the wire, so pec15_final() is
+free and a running PEC can be folded into a frame as it is built.
+
+  uint16_t pec = pec15_init();
+  pec = pec15_update(pec, data, len);    // or pec15_update_byte() per byte
+  frame[n] = pec15_final(pec) >> 8; frame[n+1] = pec15_final(pec);
+
+The lookup tables are generated at compile time (slice-by-4, 2 KB of flash).
+*/
+
+#ifndef PEC15_H
+#define PEC15_H
+
+#include <stdint.h>
+
+#define PEC15_POLY 0x8B32 //!< x^15+x^14+x^10+x^8+x^7+x^4+x^3+1, left aligned
+#define PEC15_SEED 0x0020 //!< Datasheet seed of 16, left aligned
+
+/*! Lookup tables, t[k][i] is the PEC of byte i followed by k zero bytes. */
+typedef struct
+{
+  uint16_t t[4][256];
+} pec15_tables;
+
+extern const pec15_tables pec15_lut;
+
+/*!
+ Starts a new PEC
+ @return the seeded PEC state
+ */
+inline uint16_t pec15_init()
+{
+  return PEC15_SEED;
+}
+
+/*!
+ Folds one byte into a running PEC
+ @return the updated PEC state
+ */
+inline uint16_t pec15_update_byte(uint16_t pec, //!< Running PEC state
+                                  uint8_t data //!< Byte to be added
+                                 )
+{
+  return (uint16_t)((pec << 8) ^ pec15_lut.t[0][(pec >> 8) ^ data]);
+}
+
+/*!
+ Folds an array of bytes into a running PEC, four bytes per step
+ @return the updated PEC state
+ */
+uint16_t pec15_update(uint16_t pec, //!< Running PEC state
+                      const uint8_t *data, //!< Bytes to be added
+                      uint16_t len //!< Number of bytes
+                     );
+
+/*!
+ Finishes a PEC
+ @return the 16 bit PEC as transmitted, MSB first, LSB always 0
+ */
+inline uint16_t pec15_final(uint16_t pec)
+{
+  return pec;
+}
+
+#endif
@@ -1,25 +1,27 @@
-#include <Arduino.h>
+#include "hal.h"
 
+// Port and mask are resolved once in the constructor, accesses are a
+// single BSRR/IDR register access on the STM32
 class DigitalOut {
   private:
-    uint32_t _pin_number;
+    hal_gpio _gpio;
 
   public:
     DigitalOut(uint32_t pin_number){
-      _pin_number = pin_number;
-      pinMode(_pin_number, OUTPUT);
+      hal_pin_mode(pin_number, HAL_PIN_OUTPUT);
+      _gpio = hal_gpio_bind(pin_number);
     }
 
     int read(){
-      return digitalRead(_pin_number);
+      return hal_gpio_read(&_gpio);
     }
 
     void write(uint32_t state){
-      digitalWrite(_pin_number, state);
+      hal_gpio_write(&_gpio, state);
     }
 
     DigitalOut &operator= (uint32_t value){
-      digitalWrite(_pin_number, value);
+      hal_gpio_write(&_gpio, value);
       return *this;
     }
 
@@ -32,19 +34,19 @@ class DigitalOut {
 
 class DigitalIn {
     private:
-        uint32_t _pin_number;
+        hal_gpio _gpio;
 
     public:
         DigitalIn(uint32_t pin_number){
-            _pin_number = pin_number;
-            pinMode(_pin_number, INPUT);
+            hal_pin_mode(pin_number, HAL_PIN_INPUT);
+            _gpio = hal_gpio_bind(pin_number);
         }
 
         int read() {
-            return digitalRead(_pin_number);
+            return hal_gpio_read(&_gpio);
         }
 
         operator int(){
             return read();
         }
-};
\ No newline at end of file
+};
@@ -0,0 +1,257 @@
+/*
+can_report_load.cpp
+
+Bus load of a pack of LMUs reporting over CAN, fixed rate against deadband
+reporting, with the rates and frame layouts of src/1main.cpp. Every LMU
+runs its own DeadbandReporter and CanTelemetry encoder over resting cells
+and thermistors with noise and slow drift. Frames are counted at 47 bits
+plus the data, as CanTxQueue does. A fault code change and a temperature
+step check that deadband reporting still sends what matters at once, and
+a gateway side CanTelemetry decodes every cell update that goes out.
+Prints PASS/FAIL per check and exits non-zero if any failed.
+*/
+
+// From Firmware/bms-lmu_basic:
+//
+//   g++ -std=gnu++14 -O2 -Iinclude lib/ltc6811_sim/examples/can_report_load/can_report_load.cpp src/DeadbandReporter.cpp src/CanTelemetry.cpp -o can_report_load && ./can_report_load
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <random>
+#include "CanFrame.h"
+#include "CanTelemetry.h"
+#include "DeadbandReporter.h"
+
+#define LMU_COUNT 20
+#define SIM_SECONDS 600
+#define STACK_SIZE 12
+#define STACK_TEMPERATURES 5
+
+// As in src/1main.cpp
+#define HEART_RATE 1000
+#define CAN_INTERVAL 800
+#define CANBUS_FREQUENCY 250000
+#define CAN_POLL_INTERVAL 100
+#define CAN_REFRESH_INTERVAL 10000
+#define CELL_DEADBAND 20
+#define TEMPERATURE_DEADBAND 5
+#define CAN_DIAG_INTERVAL 1000
+#define HEART_LEN 3
+#define TEMPERATURE_LEN (2 + STACK_TEMPERATURES)
+#define DIAG_LEN 6
+
+#define FAULT_AT_MS 300000 // LMU 0 raises a fault code
+#define STEP_AT_MS 400000  // LMU 1 sensor 2 jumps by 2 degC
+
+enum traffic {
+    TRAFFIC_HEARTBEAT,
+    TRAFFIC_CELLS,
+    TRAFFIC_TEMPERATURES,
+    TRAFFIC_DIAGNOSTICS,
+    TRAFFIC_KINDS
+};
+
+static const char *const traffic_names[TRAFFIC_KINDS] = {"heartbeat", "cells", "temperatures", "diagnostics"};
+
+struct lmu {
+    uint16_t cells[STACK_SIZE];
+    double cellDrift[STACK_SIZE];   // codes/s
+    int16_t temps[STACK_TEMPERATURES];
+    double tempDrift;               // 0.1 degC/s
+    uint16_t cellRest[STACK_SIZE];
+    int16_t tempRest[STACK_TEMPERATURES];
+    uint8_t faultCode;
+};
+
+static int failures = 0;
+static std::mt19937 rng(1);
+
+static void check(bool ok, const char *what)
+{
+  printf("%s  %s\n", ok ? "PASS" : "FAIL", what);
+  if (!ok)
+  {
+    failures++;
+  }
+}
+
+static uint32_t frame_bits(uint8_t len)
+{
+  return 47 + 8*len;
+}
+
+static int noise(int amplitude)
+{
+  return std::uniform_int_distribution<int>(-amplitude, amplitude)(rng);
+}
+
+static void init_lmu(lmu &l)
+{
+  for (int c = 0; c < STACK_SIZE; c++)
+  {
+    l.cellRest[c] = 37000 + noise(50);
+    l.cellDrift[c] = std::uniform_real_distribution<double>(-0.05, 0.05)(rng); // up to 3mV over the run
+  }
+  for (int t = 0; t < STACK_TEMPERATURES; t++)
+  {
+    l.tempRest[t] = 250 + noise(20);
+  }
+  l.tempDrift = std::uniform_real_distribution<double>(0, 0.01)(rng); // up to 0.6 degC over the run
+  l.faultCode = 0;
+}
+
+// +/-0.2mV and +/-0.1 degC of noise on top of the drift
+static void sample_lmu(lmu &l, uint32_t now)
+{
+  for (int c = 0; c < STACK_SIZE; c++)
+  {
+    l.cells[c] = (uint16_t)(l.cellRest[c] + l.cellDrift[c]*now/1000 + noise(2));
+  }
+  for (int t = 0; t < STACK_TEMPERATURES; t++)
+  {
+    l.temps[t] = (int16_t)(l.tempRest[t] + l.tempDrift*now/1000 + noise(1));
+  }
+}
+
+static void print_load(const char *mode, const uint64_t bits[TRAFFIC_KINDS])
+{
+  uint64_t total = 0;
+  printf("      %s, bit/s per LMU:", mode);
+  for (int k = 0; k < TRAFFIC_KINDS; k++)
+  {
+    printf(" %s %.0f", traffic_names[k], (double)bits[k]/LMU_COUNT/SIM_SECONDS);
+    total += bits[k];
+  }
+  printf(", %d LMUs %.2f%% of %d bit/s\n", LMU_COUNT, 100.0*total/SIM_SECONDS/CANBUS_FREQUENCY, CANBUS_FREQUENCY);
+}
+
+static uint64_t total_bits(const uint64_t bits[TRAFFIC_KINDS])
+{
+  uint64_t total = 0;
+  for (int k = 0; k < TRAFFIC_KINDS; k++)
+  {
+    total += bits[k];
+  }
+  return total;
+}
+
+int main()
+{
+  static lmu pack[LMU_COUNT];
+  CanTelemetry *telemetry[LMU_COUNT];
+  CanTelemetry *gateway[LMU_COUNT];
+  uint16_t received[STACK_SIZE];
+  uint32_t cellUpdates = 0;
+  uint32_t decoded = 0;
+  DeadbandReporter *reporter[LMU_COUNT];
+  canFrame frames[CAN_TELEMETRY_MAX_FRAMES];
+  uint64_t fixed[TRAFFIC_KINDS] = {0};
+  uint64_t deadband[TRAFFIC_KINDS] = {0};
+  bool faultReported = false;
+  bool stepReported = false;
+  uint32_t stepTempReports = 0;
+
+  for (int i = 0; i < LMU_COUNT; i++)
+  {
+    init_lmu(pack[i]);
+    telemetry[i] = new CanTelemetry(0x482, STACK_SIZE);
+    gateway[i] = new CanTelemetry(0x482, STACK_SIZE);
+    reporter[i] = new DeadbandReporter(STACK_SIZE, STACK_TEMPERATURES, CELL_DEADBAND, TEMPERATURE_DEADBAND,
+                                       CAN_REFRESH_INTERVAL);
+  }
+
+  for (uint32_t now = 0; now < SIM_SECONDS*1000UL; now += CAN_POLL_INTERVAL)
+  {
+    for (int i = 0; i < LMU_COUNT; i++)
+    {
+      lmu &l = pack[i];
+      sample_lmu(l, now);
+      if (i == 0 && now >= FAULT_AT_MS)
+      {
+        l.faultCode = 1 << 2; // ERROR_OT_FAULT
+      }
+      if (i == 1 && now >= STEP_AT_MS)
+      {
+        l.temps[2] += 20;
+      }
+      uint8_t cellFrames = telemetry[i]->encode(l.cells, frames);
+      uint32_t cellBits = 0;
+      for (int f = 0; f < cellFrames; f++)
+      {
+        cellBits += frame_bits(frames[f].len);
+      }
+
+      // Fixed rate: everything every CAN_INTERVAL
+      if (now % CAN_INTERVAL == 0)
+      {
+        fixed[TRAFFIC_HEARTBEAT] += frame_bits(HEART_LEN);
+        fixed[TRAFFIC_CELLS] += cellBits;
+        fixed[TRAFFIC_TEMPERATURES] += frame_bits(TEMPERATURE_LEN);
+        fixed[TRAFFIC_DIAGNOSTICS] += frame_bits(DIAG_LEN);
+      }
+
+      // Deadband: polled every CAN_POLL_INTERVAL, heartbeat and diagnostics on their own tickers
+      uint8_t groups = reporter[i]->poll(l.cells, l.temps, l.faultCode, now);
+      if (groups & REPORT_HEARTBEAT)
+      {
+        deadband[TRAFFIC_HEARTBEAT] += frame_bits(HEART_LEN);
+      }
+      if (groups & REPORT_CELLS)
+      {
+        deadband[TRAFFIC_CELLS] += cellBits;
+        cellUpdates++;
+        for (int f = 0; f < cellFrames; f++)
+        {
+          if (gateway[i]->decode(frames[f], received))
+          {
+            decoded += memcmp(received, l.cells, sizeof(received)) == 0;
+          }
+        }
+      }
+      if (groups & REPORT_TEMPERATURES)
+      {
+        deadband[TRAFFIC_TEMPERATURES] += frame_bits(TEMPERATURE_LEN);
+      }
+      if ((now + CAN_POLL_INTERVAL/2) % HEART_RATE < CAN_POLL_INTERVAL)
+      {
+        deadband[TRAFFIC_HEARTBEAT] += frame_bits(HEART_LEN);
+      }
+      if (now % CAN_DIAG_INTERVAL == 0)
+      {
+        deadband[TRAFFIC_DIAGNOSTICS] += frame_bits(DIAG_LEN);
+      }
+
+      if (i == 0 && now == FAULT_AT_MS)
+      {
+        faultReported = groups == (REPORT_HEARTBEAT | REPORT_CELLS | REPORT_TEMPERATURES);
+      }
+      if (i == 1 && now == STEP_AT_MS - CAN_POLL_INTERVAL)
+      {
+        stepTempReports = reporter[i]->stats().temperatureReports;
+      }
+      if (i == 1 && now == STEP_AT_MS)
+      {
+        stepReported = (groups & REPORT_TEMPERATURES) != 0;
+      }
+    }
+  }
+
+  print_load("fixed rate", fixed);
+  print_load("deadband", deadband);
+
+  uint32_t tempReports = 0;
+  for (int i = 0; i < LMU_COUNT; i++)
+  {
+    tempReports += reporter[i]->stats().temperatureReports;
+  }
+  check(tempReports >= LMU_COUNT*SIM_SECONDS*1000UL/CAN_REFRESH_INTERVAL, "temperatures reported at least every refresh");
+  check(faultReported, "fault code change reports every group at once");
+  check(stepReported && reporter[1]->stats().temperatureReports > stepTempReports, "2 degC step reported on the next poll");
+  check(deadband[TRAFFIC_DIAGNOSTICS] <= fixed[TRAFFIC_DIAGNOSTICS], "diagnostics no faster than at the fixed rate");
+  check(total_bits(deadband)*2 < total_bits(fixed), "deadband at least halves the bus load");
+  check(cellUpdates > 0 && decoded == cellUpdates, "every cell update sent decodes to the exact codes");
+
+  printf("%s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
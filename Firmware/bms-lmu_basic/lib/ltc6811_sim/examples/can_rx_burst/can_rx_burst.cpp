@@ -0,0 +1,121 @@
+/*
+can_rx_burst.cpp
+
+CanDispatcher ring overrun on the host: back to back frames pushed as the
+RX interrupt would while the main loop does not get to dispatch(). The
+ring must take exactly CAN_RX_QUEUE_SIZE frames and count every one after
+that in dropped, with highWater at the full ring. The queued frames must
+come out in order, to their handler or counted as unhandled. A burst that
+outruns a loop draining half as fast must lose only the frames pushed
+into a full ring, and resetStats() must clear highWater. Prints PASS/FAIL
+per check and exits non-zero if any failed.
+*/
+
+// From Firmware/bms-lmu_basic:
+//
+//   g++ -std=gnu++14 -O2 -Iinclude lib/ltc6811_sim/examples/can_rx_burst/can_rx_burst.cpp src/CanDispatcher.cpp -o can_rx_burst && ./can_rx_burst
+//
+// Add -DCAN_RX_QUEUE_SIZE=128 for the largest ring.
+
+#include <stdio.h>
+#include <stdint.h>
+#include "CanFrame.h"
+#include "CanDispatcher.h"
+
+#define CELL_ID 0x480
+#define OTHER_ID 0x700       // No handler registered
+#define BURST_PUSH 4         // Frames the ISR pushes per loop pass
+#define BURST_DISPATCH 2     // Frames the loop dispatches per pass
+#define BURST_PASSES 100
+
+static int failures = 0;
+static uint32_t delivered = 0;
+static uint32_t lastSequence = 0;
+static bool inOrder = true;
+
+static void check(bool ok, const char *what)
+{
+  printf("%s  %s\n", ok ? "PASS" : "FAIL", what);
+  if (!ok)
+  {
+    failures++;
+  }
+}
+
+static canFrame make_frame(uint32_t id, uint32_t sequence)
+{
+  canFrame frame;
+  frame.id = id;
+  frame.len = 4;
+  frame.bytes[0] = (uint8_t)(sequence >> 24);
+  frame.bytes[1] = (uint8_t)(sequence >> 16);
+  frame.bytes[2] = (uint8_t)(sequence >> 8);
+  frame.bytes[3] = (uint8_t)sequence;
+  return frame;
+}
+
+static void take_cells(const canFrame &frame)
+{
+  uint32_t sequence = (uint32_t)frame.bytes[0] << 24 | (uint32_t)frame.bytes[1] << 16
+                      | (uint32_t)frame.bytes[2] << 8 | frame.bytes[3];
+  inOrder = inOrder && (delivered == 0 || sequence > lastSequence);
+  lastSequence = sequence;
+  delivered++;
+}
+
+int main()
+{
+  CanDispatcher rx;
+  rx.on(CELL_ID, 0x7F0, take_cells);
+
+  // Three rings' worth back to back, nothing dispatched in between
+  uint32_t accepted = 0;
+  uint32_t sequence = 1;
+  for (int i = 0; i < 3*CAN_RX_QUEUE_SIZE; i++)
+  {
+    uint32_t id = (i % 4 == 3) ? OTHER_ID : CELL_ID + (i & 0x0F);
+    accepted += rx.push(make_frame(id, sequence++));
+  }
+  const canRxStats &stats = rx.stats();
+  printf("      ring of %d: %lu accepted, %lu dropped, high water %u\n", CAN_RX_QUEUE_SIZE,
+         (unsigned long)accepted, (unsigned long)stats.dropped, stats.highWater);
+  check(accepted == CAN_RX_QUEUE_SIZE && rx.depth() == CAN_RX_QUEUE_SIZE, "the ring holds CAN_RX_QUEUE_SIZE frames");
+  check(stats.received == 3*CAN_RX_QUEUE_SIZE && stats.dropped == 2*CAN_RX_QUEUE_SIZE,
+        "every frame past a full ring is counted as dropped");
+  check(stats.highWater == CAN_RX_QUEUE_SIZE, "high water reaches the full ring");
+
+  uint8_t handled = rx.dispatch();
+  check(handled == CAN_RX_QUEUE_SIZE && rx.depth() == 0 && delivered == CAN_RX_QUEUE_SIZE - CAN_RX_QUEUE_SIZE/4
+        && stats.unhandled == CAN_RX_QUEUE_SIZE/4 && inOrder && lastSequence == CAN_RX_QUEUE_SIZE - 1,
+        "the queued frames are dispatched in order, the unmatched ones counted");
+
+  // The loop drains half as fast as the frames come, until the burst ends
+  rx.resetStats();
+  check(stats.highWater == 0 && stats.dropped == 0, "resetStats() clears high water and drops");
+  delivered = 0;
+  accepted = 0;
+  uint32_t firstDrop = 0;
+  for (int pass = 0; pass < BURST_PASSES; pass++)
+  {
+    for (int i = 0; i < BURST_PUSH; i++)
+    {
+      bool queued = rx.push(make_frame(CELL_ID, sequence++));
+      accepted += queued;
+      if (!queued && firstDrop == 0)
+      {
+        firstDrop = stats.received;
+      }
+    }
+    rx.dispatch(BURST_DISPATCH);
+  }
+  while (rx.dispatch());
+  printf("      %d in, %d out per pass: first drop on frame %lu, %lu of %lu dropped\n", BURST_PUSH,
+         BURST_DISPATCH, (unsigned long)firstDrop, (unsigned long)stats.dropped, (unsigned long)stats.received);
+  check(firstDrop == (uint32_t)CAN_RX_QUEUE_SIZE*BURST_PUSH/(BURST_PUSH - BURST_DISPATCH) - BURST_DISPATCH + 1,
+        "the first frame lost is the first one pushed into a full ring");
+  check(accepted + stats.dropped == stats.received && delivered == accepted && inOrder
+        && stats.highWater == CAN_RX_QUEUE_SIZE, "every accepted frame is delivered, in order");
+
+  printf("%s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
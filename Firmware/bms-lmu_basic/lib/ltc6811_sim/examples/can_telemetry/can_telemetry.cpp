@@ -0,0 +1,169 @@
+/*
+can_telemetry.cpp
+
+CanTelemetry encode() against decode() for every cell count from 1 to
+CAN_TELEMETRY_MAX_CELLS and every delta width from 0 to 16, with the frames
+of each update handed to the receiver in a shuffled order. Codes are random
+with the spread set so the encoder needs exactly the width under test, up to
+the full 0..65535 range; a single cell always goes out at width 0. Also
+checks that a lost frame is counted as an incomplete update, that a flipped
+bit fails the CRC and that the frame count matches canTelemetryFrames().
+Prints PASS/FAIL per check and exits non-zero if any failed.
+*/
+
+// From Firmware/bms-lmu_basic:
+//
+//   g++ -std=gnu++14 -O2 -Iinclude lib/ltc6811_sim/examples/can_telemetry/can_telemetry.cpp src/CanTelemetry.cpp -o can_telemetry && ./can_telemetry
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include "CanFrame.h"
+#include "CanTelemetry.h"
+
+#define BASE_ID 0x482
+#define ROUNDS 200         // Updates per cell count and width
+
+static int failures = 0;
+static std::mt19937 rng(14);
+
+static void check(bool ok, const char *what)
+{
+  printf("%s  %s\n", ok ? "PASS" : "FAIL", what);
+  if (!ok)
+  {
+    failures++;
+  }
+}
+
+static uint32_t random_below(uint32_t limit)
+{
+  return std::uniform_int_distribution<uint32_t>(0, limit - 1)(rng);
+}
+
+/* Random codes whose spread needs exactly width bits */
+static void make_codes(uint16_t *codes, uint8_t cells, uint8_t width)
+{
+  uint32_t spread = width ? (1u << (width - 1)) + random_below(1u << (width - 1)) : 0;
+  uint16_t lowest = (uint16_t)random_below(0x10000 - spread);
+  for (uint8_t i = 0; i < cells; i++)
+  {
+    codes[i] = (uint16_t)(lowest + random_below(spread + 1));
+  }
+  // Both extremes somewhere in the update, so the width is the one under test
+  uint8_t low = (uint8_t)random_below(cells);
+  codes[low] = lowest;
+  if (cells > 1)
+  {
+    uint8_t high = (uint8_t)((low + 1 + random_below(cells - 1)) % cells);
+    codes[high] = (uint16_t)(lowest + spread);
+  }
+}
+
+static uint8_t width_of(const uint16_t *codes, uint8_t cells)
+{
+  uint16_t lo = codes[0];
+  uint16_t hi = codes[0];
+  for (uint8_t i = 1; i < cells; i++)
+  {
+    lo = (codes[i] < lo) ? codes[i] : lo;
+    hi = (codes[i] > hi) ? codes[i] : hi;
+  }
+  uint8_t width = 0;
+  for (uint16_t spread = hi - lo; spread != 0; spread >>= 1)
+  {
+    width++;
+  }
+  return width;
+}
+
+int main()
+{
+  canFrame frames[CAN_TELEMETRY_MAX_FRAMES];
+  uint16_t codes[CAN_TELEMETRY_MAX_CELLS];
+  uint16_t received[CAN_TELEMETRY_MAX_CELLS];
+  uint32_t updates = 0;
+  uint32_t roundTrips = 0;
+  uint32_t early = 0;
+  uint32_t countMismatch = 0;
+  uint32_t widthMismatch = 0;
+  uint32_t maxFrames = 0;
+
+  for (uint8_t cells = 1; cells <= CAN_TELEMETRY_MAX_CELLS; cells++)
+  {
+    for (uint8_t width = 0; width <= 16; width++)
+    {
+      CanTelemetry sender(BASE_ID, cells);
+      CanTelemetry receiver(BASE_ID, cells);
+      for (int round = 0; round < ROUNDS; round++)
+      {
+        make_codes(codes, cells, width);
+        if (cells > 1 && width_of(codes, cells) != width)
+        {
+          widthMismatch++;
+        }
+        uint8_t count = sender.encode(codes, frames);
+        uint8_t expected = canTelemetryFrames(cells, (cells > 1) ? width : 0);
+        countMismatch += count != expected;
+        maxFrames = (count > maxFrames) ? count : maxFrames;
+        std::shuffle(frames, frames + count, rng);
+
+        memset(received, 0, sizeof(received));
+        bool done = false;
+        for (uint8_t f = 0; f < count; f++)
+        {
+          bool complete = receiver.decode(frames[f], received);
+          early += complete && f + 1 < count;
+          done = done || complete;
+        }
+        updates++;
+        roundTrips += done && memcmp(received, codes, cells*sizeof(uint16_t)) == 0;
+      }
+      if (receiver.stats().crcErrors != 0 || receiver.stats().incomplete != 0)
+      {
+        roundTrips = 0;
+      }
+    }
+  }
+  printf("      %lu updates, 1-%d cells, widths 0-16, up to %lu frames\n", (unsigned long)updates,
+         CAN_TELEMETRY_MAX_CELLS, (unsigned long)maxFrames);
+  check(widthMismatch == 0, "test codes span exactly the width under test");
+  check(countMismatch == 0 && maxFrames == CAN_TELEMETRY_MAX_FRAMES, "frame counts match canTelemetryFrames()");
+  check(roundTrips == updates && early == 0, "every shuffled update decodes to the exact codes, on its last frame");
+
+  // A lost frame: the next update starts a new sequence and the partial one is counted
+  CanTelemetry sender(BASE_ID, 12);
+  CanTelemetry receiver(BASE_ID, 12);
+  make_codes(codes, 12, 12);
+  uint8_t count = sender.encode(codes, frames);
+  bool partial = false;
+  for (uint8_t f = 1; f < count; f++)
+  {
+    partial = partial || receiver.decode(frames[f], received);
+  }
+  make_codes(codes, 12, 12);
+  count = sender.encode(codes, frames);
+  bool next = false;
+  for (uint8_t f = 0; f < count; f++)
+  {
+    next = receiver.decode(frames[f], received);
+  }
+  check(!partial && next && receiver.stats().incomplete == 1 && memcmp(received, codes, sizeof(uint16_t)*12) == 0,
+        "a lost frame drops only its own update");
+
+  // A flipped payload bit
+  make_codes(codes, 12, 7);
+  count = sender.encode(codes, frames);
+  frames[count - 1].bytes[1] ^= 0x10;
+  bool corrupt = false;
+  for (uint8_t f = 0; f < count; f++)
+  {
+    corrupt = corrupt || receiver.decode(frames[f], received);
+  }
+  check(!corrupt && receiver.stats().crcErrors == 1, "a flipped bit fails the CRC");
+
+  printf("%s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,179 @@
+/*
+can_tx_queue.cpp
+
+CanTxQueue eviction, pinning and coalescing on the host, against a
+controller that takes every frame and a clock the program moves itself
+through the Linux HAL port. A full queue makes room for a more urgent
+frame by dropping the newest of the lowest priority, never a pinned one;
+a coalesced frame keeps its place and takes the higher priority; the mean
+latency stays right once the latencies add up past 32 bits. Prints
+PASS/FAIL per check and exits non-zero if any failed.
+*/
+
+// From Firmware/bms-lmu_basic:
+//
+//   g++ -std=gnu++14 -O2 -Iinclude lib/ltc6811_sim/examples/can_tx_queue/can_tx_queue.cpp src/CanTxQueue.cpp src/hal_linux.cpp -o can_tx_queue && ./can_tx_queue
+
+#include <stdio.h>
+#include <stdint.h>
+#include "hal.h"
+#include "hal_linux.h"
+#include "CanFrame.h"
+#include "CanTxQueue.h"
+
+#define SENT_MAX 64
+#define LATENCY_FRAMES 5000
+#define LATENCY_US 1000000 // 5000 frames at 1s add up to 5e9us
+
+static int failures = 0;
+static uint64_t now_ns = 0;
+static canFrame sent[SENT_MAX];
+static int sentCount = 0;
+
+static void check(bool ok, const char *what)
+{
+  printf("%s  %s\n", ok ? "PASS" : "FAIL", what);
+  if (!ok)
+  {
+    failures++;
+  }
+}
+
+static uint64_t clock_now()
+{
+  return now_ns;
+}
+
+static void clock_wait(uint64_t ns)
+{
+  now_ns += ns;
+}
+
+static const hal_linux_clock clock_hooks = {clock_now, clock_wait};
+
+static bool take_frame(const canFrame &frame)
+{
+  if (sentCount < SENT_MAX)
+  {
+    sent[sentCount] = frame;
+  }
+  sentCount++;
+  return true;
+}
+
+static canFrame make_frame(uint32_t id, uint8_t value)
+{
+  canFrame frame;
+  frame.id = id;
+  frame.len = 1;
+  frame.bytes[0] = value;
+  return frame;
+}
+
+/* Sends everything queued, returns the number of frames */
+static int drain(CanTxQueue &tx)
+{
+  sentCount = 0;
+  while (tx.depth() > 0)
+  {
+    tx.service();
+  }
+  return sentCount;
+}
+
+static bool was_sent(uint32_t id, int count)
+{
+  for (int i = 0; i < count && i < SENT_MAX; i++)
+  {
+    if (sent[i].id == id)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+int main()
+{
+  hal_linux_set_clock(&clock_hooks);
+  CanTxQueue tx(take_frame, 250000);
+
+  // Full of diagnostics, a cell frame and a fault frame evict the two newest
+  for (uint32_t i = 0; i < CAN_TX_QUEUE_SIZE; i++)
+  {
+    tx.queue(make_frame(0x100 + i, 0), CAN_TX_DIAG);
+  }
+  bool cell = tx.queue(make_frame(0x200, 0), CAN_TX_CELL);
+  bool fault = tx.queue(make_frame(0x300, 0), CAN_TX_FAULT);
+  bool diag = tx.queue(make_frame(0x101 + CAN_TX_QUEUE_SIZE, 0), CAN_TX_DIAG);
+  int count = drain(tx);
+  check(cell && fault && !diag && tx.stats().dropped == 3 && count == CAN_TX_QUEUE_SIZE,
+        "full queue evicts lower priority frames, drops an equal one");
+  check(sent[0].id == 0x300 && sent[1].id == 0x200 && !was_sent(0x100 + CAN_TX_QUEUE_SIZE - 1, count)
+        && !was_sent(0x100 + CAN_TX_QUEUE_SIZE - 2, count) && was_sent(0x100 + CAN_TX_QUEUE_SIZE - 3, count),
+        "the newest diagnostics are the ones evicted, the rest go out after");
+
+  // Pinned segments survive a burst of fault frames
+  tx.resetStats();
+  uint32_t tickets[CAN_TX_QUEUE_SIZE];
+  bool pinned = true;
+  for (uint32_t i = 0; i < CAN_TX_QUEUE_SIZE; i++)
+  {
+    pinned = pinned && tx.queuePinned(make_frame(0x400, (uint8_t)i), CAN_TX_DIAG, tickets[i]);
+  }
+  bool burst = false;
+  for (int i = 0; i < 8; i++)
+  {
+    burst = burst || tx.queue(make_frame(0x300 + i, 0), CAN_TX_FAULT);
+  }
+  bool waiting = true;
+  for (uint32_t i = 0; i < CAN_TX_QUEUE_SIZE; i++)
+  {
+    waiting = waiting && tx.pending(tickets[i]);
+  }
+  count = drain(tx);
+  bool inOrder = count == CAN_TX_QUEUE_SIZE;
+  for (int i = 0; i < count && i < SENT_MAX; i++)
+  {
+    inOrder = inOrder && sent[i].id == 0x400 && sent[i].bytes[0] == i;
+  }
+  check(pinned && !burst && waiting && tx.stats().dropped == 8, "pinned frames are never evicted");
+  check(inOrder && !tx.pending(tickets[0]) && !tx.pending(tickets[CAN_TX_QUEUE_SIZE - 1]),
+        "pinned frames go out whole and in order, then are no longer pending");
+
+  // Pinned frames are never coalesced either
+  uint32_t ticket;
+  tx.queuePinned(make_frame(0x400, 1), CAN_TX_DIAG, ticket);
+  tx.queue(make_frame(0x400, 2), CAN_TX_DIAG);
+  count = drain(tx);
+  check(count == 2 && sent[0].bytes[0] == 1 && sent[1].bytes[0] == 2, "a pinned frame is not replaced by a newer copy");
+
+  // A coalesced copy of higher priority lifts the queued frame
+  tx.resetStats();
+  tx.queue(make_frame(0x500, 1), CAN_TX_CELL);
+  tx.queue(make_frame(0x501, 1), CAN_TX_CELL);
+  tx.queue(make_frame(0x502, 1), CAN_TX_FAULT);
+  tx.queue(make_frame(0x501, 2), CAN_TX_FAULT);
+  tx.queue(make_frame(0x500, 2), CAN_TX_CELL);
+  count = drain(tx);
+  check(count == 3 && tx.stats().coalesced == 2, "coalesced copies replace the queued frame");
+  check(sent[0].id == 0x501 && sent[0].bytes[0] == 2 && sent[1].id == 0x502 && sent[2].id == 0x500 && sent[2].bytes[0] == 2,
+        "a more urgent copy takes the fault priority and keeps its place in it");
+
+  // Latency sum past 32 bits
+  tx.resetStats();
+  for (int i = 0; i < LATENCY_FRAMES; i++)
+  {
+    tx.queue(make_frame(0x600, 0), CAN_TX_CELL);
+    now_ns += (uint64_t)LATENCY_US*1000;
+    drain(tx);
+  }
+  const canTxStats &stats = tx.stats();
+  printf("      %d frames at %d us: mean latency %lu us, max %lu us\n", LATENCY_FRAMES, LATENCY_US,
+         (unsigned long)stats.latencyMean[CAN_TX_CELL], (unsigned long)stats.latencyMax[CAN_TX_CELL]);
+  check(stats.latencyMean[CAN_TX_CELL] == LATENCY_US && stats.latencyMax[CAN_TX_CELL] == LATENCY_US,
+        "mean latency holds past 2^32 us of summed latency");
+
+  printf("%s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
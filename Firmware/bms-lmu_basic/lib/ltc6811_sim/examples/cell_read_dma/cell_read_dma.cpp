@@ -0,0 +1,190 @@
+/*
+cell_read_dma.cpp
+
+Latency and CPU occupancy of the non-blocking cell register read
+(LTC6811_rdcv_start/LTC6811_rdcv_service) that MeasurementScheduler uses,
+against the blocking LTC6811_rdcv it replaced, on the simulated chain.
+
+The host port has no DMA: the stand-in in bms_hardware.cpp moves a frame
+inside spi_write_read_async(). The simulated clock only moves on bus bytes
+and a few ns per time read, so the time spent inside the calls is the time
+the CPU is held on the bus. The scheduler is run as main.cpp runs it and
+that time is split into the cell register frames, which DMA takes off the
+CPU on the target, and everything else. Interrupt entry and parsing on the
+target are not in these figures, TRACE_PARSE_CELLS times the parsing there.
+
+Checks that the read matches the blocking one, that its frames stamp the
+wake tracker, that a loop pass longer than tIDLE between register groups
+does not lose a frame and that the scheduler keeps up with the sim. Prints
+PASS/FAIL per check and exits non-zero if any failed.
+*/
+
+// From Firmware/bms-lmu_basic:
+//
+//   g++ -std=gnu++14 -O2 -DTOTAL_IC_MAX=4 -Ilib/ltc6811_sim/src -Iinclude lib/ltc6811_sim/examples/cell_read_dma/cell_read_dma.cpp lib/ltc6811_sim/src/*.cpp src/LTC681x.cpp src/LTC6811.cpp src/MeasurementScheduler.cpp src/pec15.cpp src/bms_hardware.cpp src/hal_linux.cpp src/Trace.cpp -o cell_read_dma && ./cell_read_dma
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "LTC6811.h"
+#include "LTC681x.h"
+#include "bms_hardware.h"
+#include "MeasurementScheduler.h"
+#include "LTC6811Sim.h"
+
+#define TOTAL_IC TOTAL_IC_MAX
+#define SPI_HZ 1000000     // main.cpp: SPI_CLOCK_DIV128
+#define CYCLES 200
+#define STAT_INTERVAL 10   // As in src/main.cpp
+#define LOOP_PASS_US 100   // Other work of the loop between service() calls
+
+cell_asic bms_ic[TOTAL_IC];
+static int failures = 0;
+
+static void check(bool ok, const char *what)
+{
+  printf("%s  %s\n", ok ? "PASS" : "FAIL", what);
+  if (!ok)
+  {
+    failures++;
+  }
+}
+
+static void configure()
+{
+  bool gpio[5] = {true, true, true, true, true};
+  bool dcc[12] = {false};
+  bool dcto[4] = {false};
+
+  LTC6811_init_cfg(TOTAL_IC, bms_ic);
+  for (uint8_t ic = 0; ic < TOTAL_IC; ic++)
+  {
+    LTC6811_set_cfgr(ic, bms_ic, true, false, gpio, dcc, dcto, 30000, 41000);
+  }
+  LTC6811_reset_crc_count(TOTAL_IC, bms_ic);
+  LTC6811_init_reg_limits(TOTAL_IC, bms_ic);
+  wakeup_sleep(TOTAL_IC);
+  LTC6811_wrcfg(TOTAL_IC, bms_ic);
+}
+
+static void convert_cells()
+{
+  wakeup_idle(TOTAL_IC);
+  LTC6811_adcv(MD_7KHZ_3KHZ, DCP_DISABLED, CELL_CH_ALL);
+  LTC6811_pollAdc();
+  wakeup_idle(TOTAL_IC);
+}
+
+/* Async read with pass_us of other work between service() calls, returns the PEC error count */
+static int8_t read_async(uint32_t pass_us, uint64_t *held_ns, uint64_t *latency_ns)
+{
+  int8_t error = 0;
+  uint64_t start = ltcSim.nowNs();
+  uint64_t held = 0;
+
+  uint64_t call = ltcSim.nowNs();
+  LTC6811_rdcv_start(TOTAL_IC, bms_ic);
+  held += ltcSim.nowNs() - call;
+  for (;;)
+  {
+    call = ltcSim.nowNs();
+    uint8_t done = LTC6811_rdcv_service(&error);
+    held += ltcSim.nowNs() - call;
+    if (done)
+    {
+      break;
+    }
+    hal_delay_us(pass_us);
+  }
+  *held_ns = held;
+  *latency_ns = ltcSim.nowNs() - start;
+  return error;
+}
+
+int main()
+{
+  uint16_t blocking_codes[TOTAL_IC][ic_traits::cell_channels];
+  uint64_t held = 0;
+  uint64_t latency = 0;
+
+  ltcSim.reset(TOTAL_IC);
+  ltcSim.attach();
+  ltcSim.setSpiClock(SPI_HZ);
+  for (uint8_t ic = 0; ic < TOTAL_IC; ic++)
+  {
+    for (uint8_t c = 0; c < ic_traits::cell_channels; c++)
+    {
+      ltcSim.setCell(ic, c, 3.6 + 0.01*ic + 0.001*c);
+    }
+  }
+  configure();
+
+  // Same conversion read both ways
+  convert_cells();
+  uint64_t start = ltcSim.nowNs();
+  int8_t blocking_error = (int8_t)LTC6811_rdcv(REG_ALL, TOTAL_IC, bms_ic);
+  uint64_t blocking_ns = ltcSim.nowNs() - start;
+  for (uint8_t ic = 0; ic < TOTAL_IC; ic++)
+  {
+    memcpy(blocking_codes[ic], bms_ic[ic].cells.c_codes, sizeof(blocking_codes[ic]));
+    memset(bms_ic[ic].cells.c_codes, 0, sizeof(bms_ic[ic].cells.c_codes));
+  }
+  uint32_t bytes = ltcSim.stats().busBytes;
+  int8_t async_error = read_async(0, &held, &latency);
+  uint32_t cell_bytes = ltcSim.stats().busBytes - bytes;
+  uint64_t async_ns = latency;
+  uint64_t held_ns = held;
+  bool same = true;
+  for (uint8_t ic = 0; ic < TOTAL_IC; ic++)
+  {
+    same = same && memcmp(blocking_codes[ic], bms_ic[ic].cells.c_codes, sizeof(blocking_codes[ic])) == 0;
+  }
+  check(blocking_error == 0 && async_error == 0 && same, "async read matches the blocking read");
+  check(cell_bytes == ic_traits::num_cv_reg*(NUM_CMD_BYT + NUM_RX_BYT*TOTAL_IC), "one frame per register group, nothing else on the bus");
+
+  // The DMA completion goes through release_cs, so the tracker knows the ports are ready. With a
+  // 2 ms tIDLE and 1.5 ms of silence first, a group frame left unstamped shows up as a wake pulse
+  LTC6811_wake_set_timeouts(2000, LTC681X_WAKE_SLEEP_MS);
+  convert_cells();
+  hal_delay_us(1500);
+  uint32_t frames = ltcSim.stats().frames;
+  read_async(0, &held, &latency);
+  wakeup_idle(TOTAL_IC);
+  check(ltcSim.stats().frames - frames == ic_traits::num_cv_reg, "async frames stamp the wake tracker, no wake pulse");
+  LTC6811_wake_set_timeouts(LTC681X_WAKE_IDLE_US, LTC681X_WAKE_SLEEP_MS);
+
+  printf("      cell read, %d ICs at %d Hz SCK: %lu bytes, blocking %.1f us, async %.1f us with %.1f us on the bus in the calls\n",
+         TOTAL_IC, SPI_HZ, (unsigned long)cell_bytes, blocking_ns/1000.0, async_ns/1000.0, held_ns/1000.0);
+
+  // The loop away for longer than tIDLE between two groups
+  convert_cells();
+  ltcSim.resetStats();
+  async_error = read_async(6000, &held, &latency);
+  check(async_error == 0 && ltcSim.stats().lostFrames == 0, "6 ms loop pass between groups, no frame lost");
+
+  // The scheduler as main.cpp runs it, the loop doing LOOP_PASS_US of other work per pass
+  MeasurementScheduler scheduler(TOTAL_IC, bms_ic, MD_7KHZ_3KHZ, DCP_ENABLED, true, STAT_INTERVAL);
+  uint64_t service_ns = 0;
+  uint32_t cycles = 0;
+  scheduler.start();
+  start = ltcSim.nowNs();
+  while (cycles < CYCLES)
+  {
+    uint64_t call = ltcSim.nowNs();
+    cycles += scheduler.service();
+    service_ns += ltcSim.nowNs() - call;
+    hal_delay_us(LOOP_PASS_US);
+  }
+  uint64_t period_ns = (ltcSim.nowNs() - start)/CYCLES;
+  uint64_t per_cycle_ns = service_ns/CYCLES;
+  uint64_t cell_bus_ns = (uint64_t)cell_bytes*8000000000ULL/SPI_HZ;
+  check(scheduler.stats().pecErrors == 0 && ltcSim.stats().lostFrames == 0, "scheduler cycles without PEC errors or lost frames");
+
+  printf("      scheduler, %lu us loop pass: cycle %.1f us, on the bus in service() %.1f us of which cell registers %.1f us\n",
+         (unsigned long)LOOP_PASS_US, period_ns/1000.0, per_cycle_ns/1000.0, cell_bus_ns/1000.0);
+  printf("      CPU held on the bus: blocking read %.1f%%, cell registers by DMA %.1f%% (computed from bus time, not observed)\n",
+         100.0*per_cycle_ns/period_ns, 100.0*(per_cycle_ns - cell_bus_ns)/period_ns);
+
+  printf("%s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
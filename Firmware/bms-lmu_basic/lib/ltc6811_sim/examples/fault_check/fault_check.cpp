@@ -0,0 +1,138 @@
+/*
+fault_check.cpp
+
+Cost of the Stack pack fault checks in fixed point (CellVoltage and
+Temperature from bms_units.h) against the double compares they replaced,
+on the host. The old checks compared the raw ADC code with 4.2 and 2.8, so
+they are timed as they were and also as a float check that scales the code
+to volts first, which is what a correct float version would have cost.
+The old code had no over-temperature check, both float ways compare the
+temperature in degrees as a double.
+Each way runs the three checks of check_errors() on a stack whose extremes
+move between calls and is timed in batches with hal_cycles(). The host has
+a hardware FPU; on the M3 every double compare is a soft-float call, so the
+gap there is wider than shown here. check_errors() itself is timed on the
+target by its TRACE_FAULT_CHECK probe.
+
+Checks the trip boundaries of both ways. Prints PASS/FAIL per check and
+exits non-zero if any failed.
+*/
+
+// From Firmware/bms-lmu_basic:
+//
+//   g++ -std=gnu++14 -O2 -Iinclude lib/ltc6811_sim/examples/fault_check/fault_check.cpp src/hal_linux.cpp -o fault_check && ./fault_check
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "hal.h"
+#include "PBalancer.h"
+
+#define CALLS 1000000
+#define BATCH 1000
+#define PATTERNS 256
+
+static int failures = 0;
+
+static void check(bool ok, const char *what)
+{
+  printf("%s  %s\n", ok ? "PASS" : "FAIL", what);
+  if (!ok)
+  {
+    failures++;
+  }
+}
+
+/* The old thresholds, volts and degrees as doubles */
+#define OLD_MAX_VOLTAGE 4.2
+#define OLD_MIN_VOLTAGE 2.8
+#define OLD_MAX_TEMPERATURE 60
+
+static Stack stack;
+
+__attribute__((noinline)) static uint8_t fixed_checks()
+{
+  return stack.ov_fault() | stack.uv_fault() << 1 | stack.ot_fault() << 2;
+}
+
+/* As the old ov_fault()/uv_fault() were: the ADC code against volts */
+__attribute__((noinline)) static uint8_t old_checks()
+{
+  return (stack.max() > OLD_MAX_VOLTAGE) | (stack.min() < OLD_MIN_VOLTAGE) << 1
+         | (stack.max_temperature().decidegrees/10.0 > OLD_MAX_TEMPERATURE) << 2;
+}
+
+/* The float checks done right: the code scaled to volts first */
+__attribute__((noinline)) static uint8_t float_checks()
+{
+  return (stack.max()*0.0001 > OLD_MAX_VOLTAGE) | (stack.min()*0.0001 < OLD_MIN_VOLTAGE) << 1
+         | (stack.max_temperature().decidegrees/10.0 > OLD_MAX_TEMPERATURE) << 2;
+}
+
+static uint16_t cell_codes[PATTERNS];
+static int16_t temperatures[PATTERNS];
+static volatile uint32_t sink;
+
+/* Mean ns per call of three checks, one cell and one temperature moved between calls */
+static double time_checks(uint8_t (*checks)())
+{
+  uint64_t cycles = 0;
+  uint32_t faults = 0;
+  for (uint32_t done = 0; done < CALLS; done += BATCH)
+  {
+    uint32_t start = hal_cycles();
+    for (uint32_t i = 0; i < BATCH; i++)
+    {
+      faults += checks();
+    }
+    cycles += hal_cycles() - start;
+    stack.update_cell(done/BATCH % STACK_SIZE, cell_codes[done/BATCH % PATTERNS]);
+    stack.update_temperature(done/BATCH % STACK_TEMPERATURES, Temperature::from_decidegrees(temperatures[done/BATCH % PATTERNS]));
+  }
+  sink = faults;
+  return cycles*1e9/hal_cycles_hz()/CALLS;
+}
+
+static uint8_t checks_at(uint8_t (*checks)(), uint16_t code, int16_t decidegrees)
+{
+  for (int i = 0; i < STACK_SIZE; i++)
+  {
+    stack.update_cell(i, code);
+  }
+  for (int i = 0; i < STACK_TEMPERATURES; i++)
+  {
+    stack.update_temperature(i, Temperature::from_decidegrees(decidegrees));
+  }
+  return checks();
+}
+
+int main()
+{
+  hal_cycles_init();
+  srand(7);
+
+  check(checks_at(fixed_checks, 42000, 600) == 0 && checks_at(fixed_checks, 42001, 600) == 1
+        && checks_at(fixed_checks, 28000, 600) == 0 && checks_at(fixed_checks, 27999, 600) == 2
+        && checks_at(fixed_checks, 36000, 601) == 4, "fixed point checks trip above 4.2 V, below 2.8 V and above 60 C");
+  check(checks_at(float_checks, 42000, 600) == 0 && checks_at(float_checks, 42001, 600) == 1
+        && checks_at(float_checks, 28000, 600) == 0 && checks_at(float_checks, 27999, 600) == 2
+        && checks_at(float_checks, 36000, 601) == 4, "scaled float checks agree on the boundaries");
+  check(checks_at(old_checks, 36000, 250) == 1, "old checks trip OV on a healthy 3.6 V pack");
+
+  // Healthy pack with an extreme now and then, so the branches are not all taken one way
+  for (int i = 0; i < PATTERNS; i++)
+  {
+    cell_codes[i] = (rand() % 16) ? 36000 + rand() % 2000 : 27000 + rand() % 16000;
+    temperatures[i] = (rand() % 16) ? 250 + rand() % 100 : 550 + rand() % 100;
+  }
+  checks_at(fixed_checks, 36000, 250);
+
+  double fixed_ns = time_checks(fixed_checks);
+  double old_ns = time_checks(old_checks);
+  double float_ns = time_checks(float_checks);
+  printf("      ov/uv/ot checks per call: fixed point %.2f ns, old double compare %.2f ns, scaled double %.2f ns\n",
+         fixed_ns, old_ns, float_ns);
+
+  printf("%s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
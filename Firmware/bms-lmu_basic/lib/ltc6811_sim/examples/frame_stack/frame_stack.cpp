@@ -0,0 +1,366 @@
+/*
+frame_stack.cpp
+
+Peak stack and heap of the LTC681x frame paths, the static frame buffer
+against the per call copies it replaced, on the simulated chain. The old
+write_68/read_68/wrcfg/rdcfg/rdcv are kept here as the reference, as they
+were before the static buffer, with their malloc() calls counted. Each path
+runs on its own painted stack (ucontext) and the deepest byte touched is
+reported; both run through the same trampoline and call the LTC681x_
+functions directly, so the difference is the frame path alone. rdcv only
+moves its malloc() into the static buffer, its stack stays about the same.
+Host (x86-64) frame sizes, the Cortex-M3 figures are smaller but the
+buffers are the same bytes. Checks both paths read the same data. Prints PASS/FAIL per check and exits non-zero if any failed.
+*/
+
+// From Firmware/bms-lmu_basic:
+//
+//   g++ -std=gnu++14 -O2 -DTOTAL_IC_MAX=4 -Ilib/ltc6811_sim/src -Iinclude lib/ltc6811_sim/examples/frame_stack/frame_stack.cpp lib/ltc6811_sim/src/*.cpp src/LTC681x.cpp src/LTC6811.cpp src/pec15.cpp src/bms_hardware.cpp src/hal_linux.cpp src/Trace.cpp -o frame_stack && ./frame_stack
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+#include "LTC6811.h"
+#include "LTC681x.h"
+#include "bms_hardware.h"
+#include "pec15.h"
+#include "LTC6811Sim.h"
+
+#define TOTAL_IC TOTAL_IC_MAX
+#define STACK_LEN 16384
+#define PAINT 0xA5
+
+cell_asic bms_ic[TOTAL_IC];
+static int failures = 0;
+static uint32_t heap_now = 0;
+static uint32_t heap_peak = 0;
+
+static void check(bool ok, const char *what)
+{
+  printf("%s  %s\n", ok ? "PASS" : "FAIL", what);
+  if (!ok)
+  {
+    failures++;
+  }
+}
+
+static void *counted_malloc(size_t len)
+{
+  heap_now += len;
+  heap_peak = (heap_now > heap_peak) ? heap_now : heap_peak;
+  uint32_t *block = (uint32_t *)malloc(len + sizeof(uint32_t));
+  block[0] = (uint32_t)len;
+  return block + 1;
+}
+
+static void counted_free(void *p)
+{
+  uint32_t *block = (uint32_t *)p - 1;
+  heap_now -= block[0];
+  free(block);
+}
+
+/* write_68() as it was, before the static frame buffer */
+static void old_write_68(uint8_t total_ic, uint8_t tx_cmd[2], uint8_t data[])
+{
+	const uint8_t BYTES_IN_REG = 6;
+	const uint8_t CMD_LEN = 4+(8*total_ic);
+	uint8_t *cmd;
+	uint16_t data_pec;
+	uint16_t cmd_pec;
+	uint8_t cmd_index;
+
+	cmd = (uint8_t *)counted_malloc(CMD_LEN*sizeof(uint8_t));
+	cmd[0] = tx_cmd[0];
+	cmd[1] = tx_cmd[1];
+	cmd_pec = pec15_calc(2, cmd);
+	cmd[2] = (uint8_t)(cmd_pec >> 8);
+	cmd[3] = (uint8_t)(cmd_pec);
+
+	cmd_index = 4;
+	for (uint8_t current_ic = total_ic; current_ic > 0; current_ic--)
+	{
+		data_pec = pec15_init();
+		for (uint8_t current_byte = 0; current_byte < BYTES_IN_REG; current_byte++)
+		{
+			cmd[cmd_index] = data[((current_ic-1)*6)+current_byte];
+			data_pec = pec15_update_byte(data_pec, cmd[cmd_index]);
+			cmd_index = cmd_index + 1;
+		}
+
+		data_pec = pec15_final(data_pec);
+		cmd[cmd_index] = (uint8_t)(data_pec >> 8);
+		cmd[cmd_index + 1] = (uint8_t)data_pec;
+		cmd_index = cmd_index + 2;
+	}
+
+	cs_low(CS_PIN);
+	spi_write_array(CMD_LEN, cmd);
+	cs_high(CS_PIN);
+
+	counted_free(cmd);
+}
+
+/* read_68() as it was */
+static int8_t old_read_68(uint8_t total_ic, uint8_t tx_cmd[2], uint8_t *rx_data)
+{
+	const uint8_t BYTES_IN_REG = 8;
+	uint8_t cmd[4];
+	uint8_t data[256];
+	int8_t pec_error = 0;
+	uint16_t cmd_pec;
+	uint16_t data_pec;
+	uint16_t received_pec;
+
+	cmd[0] = tx_cmd[0];
+	cmd[1] = tx_cmd[1];
+	cmd_pec = pec15_calc(2, cmd);
+	cmd[2] = (uint8_t)(cmd_pec >> 8);
+	cmd[3] = (uint8_t)(cmd_pec);
+
+	cs_low(CS_PIN);
+	spi_write_read(cmd, 4, data, (BYTES_IN_REG*total_ic));
+	cs_high(CS_PIN);
+
+	for (uint8_t current_ic = 0; current_ic < total_ic; current_ic++)
+	{
+		for (uint8_t current_byte = 0; current_byte < BYTES_IN_REG; current_byte++)
+		{
+			rx_data[(current_ic*8)+current_byte] = data[current_byte + (current_ic*BYTES_IN_REG)];
+		}
+
+		received_pec = (rx_data[(current_ic*8)+6]<<8) + rx_data[(current_ic*8)+7];
+		data_pec = pec15_calc(6, &rx_data[current_ic*8]);
+
+		if (received_pec != data_pec)
+		{
+		  pec_error = -1;
+		}
+	}
+
+	return(pec_error);
+}
+
+/* LTC681x_wrcfg() as it was */
+static void old_wrcfg(uint8_t total_ic, cell_asic ic[])
+{
+	uint8_t cmd[2] = {0x00 , 0x01} ;
+	uint8_t write_buffer[256];
+	uint8_t write_count = 0;
+	uint8_t c_ic = 0;
+
+	for (uint8_t current_ic = 0; current_ic<total_ic; current_ic++)
+	{
+		if (ic->isospi_reverse == false)
+		{
+			c_ic = current_ic;
+		}
+		else
+		{
+			c_ic = total_ic - current_ic - 1;
+		}
+
+		for (uint8_t data = 0; data<6; data++)
+		{
+			write_buffer[write_count] = ic[c_ic].config.tx_data[data];
+			write_count++;
+		}
+	}
+	old_write_68(total_ic, cmd, write_buffer);
+}
+
+/* LTC681x_rdcfg() as it was */
+static int8_t old_rdcfg(uint8_t total_ic, cell_asic ic[])
+{
+	uint8_t cmd[2]= {0x00 , 0x02};
+	uint8_t read_buffer[256];
+	int8_t pec_error = 0;
+	uint16_t data_pec;
+	uint16_t calc_pec;
+	uint8_t c_ic = 0;
+
+	pec_error = old_read_68(total_ic, cmd, read_buffer);
+
+	for (uint8_t current_ic = 0; current_ic<total_ic; current_ic++)
+	{
+		if (ic->isospi_reverse == false)
+		{
+			c_ic = current_ic;
+		}
+		else
+		{
+			c_ic = total_ic - current_ic - 1;
+		}
+
+		for (int byte=0; byte<8; byte++)
+		{
+			ic[c_ic].config.rx_data[byte] = read_buffer[byte+(8*current_ic)];
+		}
+
+		calc_pec = pec15_calc(6,&read_buffer[8*current_ic]);
+		data_pec = read_buffer[7+(8*current_ic)] | (read_buffer[6+(8*current_ic)]<<8);
+		if (calc_pec != data_pec )
+		{
+			ic[c_ic].config.rx_pec_match = 1;
+		}
+		else ic[c_ic].config.rx_pec_match = 0;
+	}
+	LTC681x_check_pec(total_ic,CFGR,ic);
+
+	return(pec_error);
+}
+
+/* LTC681x_rdcv(REG_ALL) as it was */
+static uint8_t old_rdcv(uint8_t total_ic, cell_asic *ic)
+{
+	int8_t pec_error = 0;
+	uint8_t *cell_data;
+	uint8_t c_ic = 0;
+	cell_data = (uint8_t *) counted_malloc((NUM_RX_BYT*total_ic)*sizeof(uint8_t));
+
+	for (uint8_t cell_reg = 1; cell_reg<ic_traits::num_cv_reg+1; cell_reg++)
+	{
+		LTC681x_rdcv_reg(cell_reg, total_ic,cell_data );
+		for (int current_ic = 0; current_ic<total_ic; current_ic++)
+		{
+		if (ic->isospi_reverse == false)
+		{
+		  c_ic = current_ic;
+		}
+		else
+		{
+		  c_ic = total_ic - current_ic - 1;
+		}
+		pec_error = pec_error + parse_cells(current_ic,cell_reg, cell_data,
+											&ic[c_ic].cells.c_codes[0],
+											&ic[c_ic].cells.pec_match[0]);
+		}
+	}
+	LTC681x_check_pec(total_ic,CELL,ic);
+	counted_free(cell_data);
+	return(pec_error);
+}
+
+static void old_wr() { wakeup_idle(TOTAL_IC); old_wrcfg(TOTAL_IC, bms_ic); }
+static void new_wr() { wakeup_idle(TOTAL_IC); LTC681x_wrcfg(TOTAL_IC, bms_ic); }
+static void old_rd() { wakeup_idle(TOTAL_IC); old_rdcfg(TOTAL_IC, bms_ic); }
+static void new_rd() { wakeup_idle(TOTAL_IC); LTC681x_rdcfg(TOTAL_IC, bms_ic); }
+static void old_cv() { wakeup_idle(TOTAL_IC); old_rdcv(TOTAL_IC, bms_ic); }
+static void new_cv() { wakeup_idle(TOTAL_IC); LTC681x_rdcv(REG_ALL, TOTAL_IC, bms_ic); }
+static void nothing() { }
+
+static ucontext_t caller;
+static ucontext_t painted;
+static uint8_t stack[STACK_LEN];
+
+/* Bytes of the painted stack fn touched, the stack grows down from the top */
+static uint32_t stack_used(void (*fn)())
+{
+  memset(stack, PAINT, sizeof(stack));
+  getcontext(&painted);
+  painted.uc_stack.ss_sp = stack;
+  painted.uc_stack.ss_size = sizeof(stack);
+  painted.uc_link = &caller;
+  makecontext(&painted, fn, 0);
+  swapcontext(&caller, &painted);
+
+  uint32_t untouched = 0;
+  while (untouched < sizeof(stack) && stack[untouched] == PAINT)
+  {
+    untouched++;
+  }
+  return sizeof(stack) - untouched;
+}
+
+struct path {
+  const char *name;
+  void (*old_fn)();
+  void (*new_fn)();
+};
+
+int main()
+{
+  bool gpio[5] = {true, true, true, true, true};
+  bool dcc[12] = {false};
+  bool dcto[4] = {false};
+
+  ltcSim.reset(TOTAL_IC);
+  ltcSim.attach();
+  for (uint8_t ic = 0; ic < TOTAL_IC; ic++)
+  {
+    for (uint8_t c = 0; c < ic_traits::cell_channels; c++)
+    {
+      ltcSim.setCell(ic, c, 3.6 + 0.01*ic + 0.001*c);
+    }
+  }
+  LTC6811_init_cfg(TOTAL_IC, bms_ic);
+  for (uint8_t ic = 0; ic < TOTAL_IC; ic++)
+  {
+    LTC6811_set_cfgr(ic, bms_ic, true, false, gpio, dcc, dcto, 30000 + ic, 41000);
+  }
+  LTC6811_reset_crc_count(TOTAL_IC, bms_ic);
+  LTC6811_init_reg_limits(TOTAL_IC, bms_ic);
+  wakeup_sleep(TOTAL_IC);
+  wakeup_idle(TOTAL_IC);
+  LTC6811_adcv(MD_7KHZ_3KHZ, DCP_DISABLED, CELL_CH_ALL);
+  LTC6811_pollAdc();
+
+  // Same bytes both ways
+  uint8_t old_config[TOTAL_IC][8];
+  uint16_t old_cells[TOTAL_IC][ic_traits::cell_channels];
+  old_wr();
+  old_rd();
+  old_cv();
+  for (uint8_t ic = 0; ic < TOTAL_IC; ic++)
+  {
+    memcpy(old_config[ic], bms_ic[ic].config.rx_data, 8);
+    memcpy(old_cells[ic], bms_ic[ic].cells.c_codes, sizeof(old_cells[ic]));
+  }
+  new_wr();
+  new_rd();
+  new_cv();
+  bool same = true;
+  for (uint8_t ic = 0; ic < TOTAL_IC; ic++)
+  {
+    same = same && memcmp(old_config[ic], bms_ic[ic].config.rx_data, 8) == 0
+                && memcmp(old_cells[ic], bms_ic[ic].cells.c_codes, sizeof(old_cells[ic])) == 0
+                && memcmp(bms_ic[ic].config.tx_data, bms_ic[ic].config.rx_data, 6) == 0;
+  }
+  check(same, "old and new paths write and read the same bytes");
+
+  const path paths[] = {
+    {"wrcfg", old_wr, new_wr},
+    {"rdcfg", old_rd, new_rd},
+    {"rdcv", old_cv, new_cv},
+  };
+  uint32_t base = stack_used(nothing);
+  uint32_t worst_old = 0;
+  uint32_t worst_new = 0;
+  uint32_t new_heap_total = 0;
+
+  printf("      %d ICs, bytes of stack above an empty call (%lu), peak heap\n", TOTAL_IC, (unsigned long)base);
+  printf("      path    old stack  new stack  old heap  new heap\n");
+  for (const path &p : paths)
+  {
+    heap_peak = 0;
+    uint32_t old_stack = stack_used(p.old_fn) - base;
+    uint32_t old_heap = heap_peak;
+    heap_peak = 0;
+    uint32_t new_stack = stack_used(p.new_fn) - base;
+    uint32_t new_heap = heap_peak;
+    printf("      %-7s %-10lu %-10lu %-9lu %lu\n", p.name, (unsigned long)old_stack, (unsigned long)new_stack,
+           (unsigned long)old_heap, (unsigned long)new_heap);
+    worst_old = (old_stack > worst_old) ? old_stack : worst_old;
+    worst_new = (new_stack > worst_new) ? new_stack : worst_new;
+    new_heap_total += new_heap;
+  }
+  printf("      static frame buffer %d bytes\n", FRAME_BUFFER_LEN);
+
+  check(new_heap_total == 0, "no heap on the new paths");
+  check(worst_new + 256 <= worst_old, "static frame saves at least one 256 byte buffer of peak stack");
+
+  printf("%s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,236 @@
+/*
+isotp_round_trip.cpp
+
+A 300 byte diagnostic response through IsoTp and CanTxQueue to a model of
+the gateway's ISO 15765-2 receiver, on the host with a clock the program
+moves itself through the Linux HAL port. The gateway asks with a single
+frame request, grants blocks of BLOCK_SIZE frames at STmin and puts the
+payload back together. Also runs a transfer whose first frame never gets
+a mailbox, which must time out ISOTP_TIMEOUT_MS after it was queued, and
+checks that only transfers send() accepted are counted. Prints PASS/FAIL
+per check and exits non-zero if any failed.
+*/
+
+// From Firmware/bms-lmu_basic:
+//
+//   g++ -std=gnu++14 -O2 -Iinclude lib/ltc6811_sim/examples/isotp_round_trip/isotp_round_trip.cpp src/IsoTp.cpp src/CanTxQueue.cpp src/hal_linux.cpp -o isotp_round_trip && ./isotp_round_trip
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "hal.h"
+#include "hal_linux.h"
+#include "CanFrame.h"
+#include "CanTxQueue.h"
+#include "IsoTp.h"
+
+#define LMU_ID 0x7E8
+#define GATEWAY_ID 0x7E0
+#define RESPONSE_LEN 300
+#define BLOCK_SIZE 8
+#define ST_MIN 1           // ms
+#define PASS_US 100        // Loop pass of the LMU
+#define RUN_LIMIT_MS 5000
+
+static int failures = 0;
+static uint64_t now_ns = 0;
+static bool busOff = false;
+
+static void check(bool ok, const char *what)
+{
+  printf("%s  %s\n", ok ? "PASS" : "FAIL", what);
+  if (!ok)
+  {
+    failures++;
+  }
+}
+
+static uint64_t clock_now()
+{
+  return now_ns;
+}
+
+static void clock_wait(uint64_t ns)
+{
+  now_ns += ns;
+}
+
+static const hal_linux_clock clock_hooks = {clock_now, clock_wait};
+
+/* The gateway end: reassembles what the LMU sends, answers with flow control */
+struct gatewayRx {
+  uint8_t data[ISOTP_BUFFER_SIZE];
+  uint16_t expected;
+  uint16_t received;
+  uint8_t sequence;
+  uint8_t blockLeft;
+  bool done;
+  bool error;
+  uint32_t frames;
+  uint32_t lastCfUs;
+  uint32_t minGapUs;
+  canFrame reply;      // Flow control waiting to go out on the next pass
+  bool replyPending;
+};
+
+static gatewayRx gateway;
+
+static void gateway_flow_control()
+{
+  gateway.reply.id = GATEWAY_ID;
+  gateway.reply.len = 3;
+  gateway.reply.bytes[0] = (ISOTP_FLOW_CONTROL << 4) | ISOTP_FC_CTS;
+  gateway.reply.bytes[1] = BLOCK_SIZE;
+  gateway.reply.bytes[2] = ST_MIN;
+  gateway.replyPending = true;
+  gateway.blockLeft = BLOCK_SIZE;
+}
+
+static bool gateway_take(const canFrame &frame)
+{
+  if (busOff)
+  {
+    return false;
+  }
+  if (frame.id != LMU_ID)
+  {
+    return true;
+  }
+  gateway.frames++;
+
+  uint8_t pci = frame.bytes[0] >> 4;
+  if (pci == ISOTP_SINGLE)
+  {
+    gateway.expected = frame.bytes[0] & 0x0F;
+    memcpy(gateway.data, &frame.bytes[1], gateway.expected);
+    gateway.received = gateway.expected;
+    gateway.done = true;
+  }
+  else if (pci == ISOTP_FIRST)
+  {
+    gateway.expected = ((frame.bytes[0] & 0x0F) << 8) | frame.bytes[1];
+    memcpy(gateway.data, &frame.bytes[2], ISOTP_FF_DATA);
+    gateway.received = ISOTP_FF_DATA;
+    gateway.sequence = 1;
+    gateway.lastCfUs = 0;
+    gateway.minGapUs = UINT32_MAX;
+    gateway_flow_control();
+  }
+  else if (pci == ISOTP_CONSECUTIVE)
+  {
+    uint32_t now = hal_micros();
+    if (gateway.lastCfUs != 0 && gateway.blockLeft != BLOCK_SIZE && now - gateway.lastCfUs < gateway.minGapUs)
+    {
+      gateway.minGapUs = now - gateway.lastCfUs;
+    }
+    gateway.lastCfUs = now;
+
+    uint16_t chunk = gateway.expected - gateway.received;
+    chunk = (chunk > ISOTP_CF_DATA) ? ISOTP_CF_DATA : chunk;
+    gateway.error = gateway.error || (frame.bytes[0] & 0x0F) != gateway.sequence || frame.len != 1 + chunk;
+    memcpy(&gateway.data[gateway.received], &frame.bytes[1], chunk);
+    gateway.received += chunk;
+    gateway.sequence = (gateway.sequence + 1) & 0x0F;
+    if (gateway.received >= gateway.expected)
+    {
+      gateway.done = true;
+    }
+    else if (--gateway.blockLeft == 0)
+    {
+      gateway_flow_control();
+    }
+  }
+  return true;
+}
+
+static CanTxQueue tx(gateway_take, 250000);
+static IsoTp isoTp(tx, LMU_ID, GATEWAY_ID);
+static uint8_t response[RESPONSE_LEN];
+
+static void answer(const uint8_t *data, uint8_t len)
+{
+  if (len == 2 && data[0] == 0x22)
+  {
+    isoTp.send(response, RESPONSE_LEN);
+  }
+}
+
+/* Loop passes of the LMU until the gateway has it all or limit_ms passes */
+static uint32_t run(uint32_t limit_ms)
+{
+  uint32_t start = hal_millis();
+  while (!gateway.done && hal_millis() - start < limit_ms)
+  {
+    if (gateway.replyPending)
+    {
+      gateway.replyPending = false;
+      isoTp.receive(gateway.reply);
+    }
+    isoTp.service();
+    tx.service();
+    now_ns += (uint64_t)PASS_US*1000;
+  }
+  return hal_millis() - start;
+}
+
+int main()
+{
+  hal_linux_set_clock(&clock_hooks);
+  for (int i = 0; i < RESPONSE_LEN; i++)
+  {
+    response[i] = (uint8_t)(i*7 + 3);
+  }
+  isoTp.onRequest(answer);
+
+  // Request, then the segmented response
+  canFrame request = {GATEWAY_ID, 3, {(ISOTP_SINGLE << 4) | 2, 0x22, 0x01}};
+  isoTp.receive(request);
+  uint32_t elapsed = run(RUN_LIMIT_MS);
+  const isoTpStats &stats = isoTp.stats();
+  uint32_t frames = 1 + (RESPONSE_LEN - ISOTP_FF_DATA + ISOTP_CF_DATA - 1)/ISOTP_CF_DATA;
+
+  check(gateway.done && !gateway.error && gateway.received == RESPONSE_LEN
+        && memcmp(gateway.data, response, RESPONSE_LEN) == 0, "300 byte response reassembled intact");
+  check(stats.requests == 1 && stats.transfers == 1 && stats.completed == 1 && stats.timeouts == 0
+        && gateway.frames == frames && stats.framesSent == frames, "one request, one transfer, every segment once");
+  check(gateway.minGapUs >= ST_MIN*1000, "consecutive frames no closer than STmin");
+  printf("      %d bytes in %lu frames, %lu ms, closest consecutive frames %lu us\n", RESPONSE_LEN,
+         (unsigned long)gateway.frames, (unsigned long)elapsed, (unsigned long)gateway.minGapUs);
+
+  // Only accepted transfers count: not with the TX queue full of pinned frames, nor while busy
+  isoTp.resetStats();
+  gateway = gatewayRx();
+  busOff = true;
+  uint32_t ticket;
+  for (int i = 0; i < CAN_TX_QUEUE_SIZE; i++)
+  {
+    canFrame other = {0x700, 1, {0}};
+    tx.queuePinned(other, CAN_TX_DIAG, ticket);
+  }
+  bool full = isoTp.send(response, RESPONSE_LEN) || isoTp.send(response, 5);
+  busOff = false;
+  while (tx.depth() > 0)
+  {
+    tx.service();
+  }
+  bool first = isoTp.send(response, RESPONSE_LEN);
+  bool second = isoTp.send(response, 10);
+  bool oversize = isoTp.send(response, ISOTP_BUFFER_SIZE + 1);
+  check(!full && first && !second && !oversize && isoTp.stats().transfers == 1, "refused sends are not counted as transfers");
+  run(RUN_LIMIT_MS);
+
+  // The first frame never gets a mailbox: timed out from queueing, not from leaving the queue
+  isoTp.resetStats();
+  gateway = gatewayRx();
+  busOff = true;
+  isoTp.send(response, RESPONSE_LEN);
+  run(ISOTP_TIMEOUT_MS - 10);
+  bool waiting = isoTp.busy() && isoTp.stats().timeouts == 0;
+  run(20);
+  check(waiting && !isoTp.busy() && isoTp.stats().timeouts == 1 && isoTp.stats().completed == 0,
+        "a segment stuck in the queue times out ISOTP_TIMEOUT_MS after queueing");
+  busOff = false;
+
+  printf("%s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
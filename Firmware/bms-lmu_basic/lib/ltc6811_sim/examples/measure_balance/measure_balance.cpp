@@ -0,0 +1,302 @@
+/*
+measure_balance.cpp
+
+Runs the LTC681x driver against the simulated chain: configuration write
+and read back, cell, aux and status conversions, balancing, the watchdog,
+a noisy link with bit errors and the wake state tracker, then times the
+measurement cycle, with the size of cell_asic and the parse_cells() time
+of the variant built for, and prints the trace probe table of that run
+(host time).
+Prints PASS/FAIL per check and exits non-zero if any failed.
+*/
+
+// From Firmware/bms-lmu_basic:
+//
+//   g++ -std=gnu++14 -O2 -DTOTAL_IC_MAX=4 -Ilib/ltc6811_sim/src -Iinclude lib/ltc6811_sim/examples/measure_balance/measure_balance.cpp lib/ltc6811_sim/src/*.cpp src/LTC681x.cpp src/LTC6811.cpp src/pec15.cpp src/bms_hardware.cpp src/hal_linux.cpp src/Trace.cpp -o measure_balance && ./measure_balance
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include "LTC6811.h"
+#include "LTC681x.h"
+#include "bms_hardware.h"
+#include "LTC6811Sim.h"
+#include "Trace.h"
+
+#define TOTAL_IC TOTAL_IC_MAX
+#define DISCHARGE_RATE 0.001 // V/s
+
+cell_asic bms_ic[TOTAL_IC];
+static int failures = 0;
+
+static void check(bool ok, const char *what)
+{
+  printf("%s  %s\n", ok ? "PASS" : "FAIL", what);
+  if (!ok)
+  {
+    failures++;
+  }
+}
+
+static uint16_t expected_code(double volts)
+{
+  return (uint16_t)(volts*10000.0 + 0.5);
+}
+
+static void configure()
+{
+  bool gpio[5] = {true, true, true, true, true};
+  bool dcc[12] = {false};
+  bool dcto[4] = {false};
+
+  LTC6811_init_cfg(TOTAL_IC, bms_ic);
+  for (uint8_t ic = 0; ic < TOTAL_IC; ic++)
+  {
+    LTC6811_set_cfgr(ic, bms_ic, true, false, gpio, dcc, dcto, 30000, 41000);
+  }
+  LTC6811_reset_crc_count(TOTAL_IC, bms_ic);
+  LTC6811_init_reg_limits(TOTAL_IC, bms_ic);
+  wakeup_sleep(TOTAL_IC);
+  LTC6811_wrcfg(TOTAL_IC, bms_ic);
+}
+
+static int8_t measure_cells(uint8_t md)
+{
+  wakeup_idle(TOTAL_IC);
+  LTC6811_adcv(md, DCP_DISABLED, CELL_CH_ALL);
+  LTC6811_pollAdc();
+  wakeup_idle(TOTAL_IC);
+  return (int8_t)LTC6811_rdcv(REG_ALL, TOTAL_IC, bms_ic);
+}
+
+static bool cells_match(uint16_t tolerance)
+{
+  for (uint8_t ic = 0; ic < TOTAL_IC; ic++)
+  {
+    for (uint8_t c = 0; c < ic_traits::cell_channels; c++)
+    {
+      int32_t diff = (int32_t)bms_ic[ic].cells.c_codes[c] - expected_code(ltcSim.cell(ic, c));
+      if (diff > tolerance || diff < -(int32_t)tolerance)
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static void test_config()
+{
+  configure();
+  wakeup_idle(TOTAL_IC);
+  int8_t rc = LTC6811_rdcfg(TOTAL_IC, bms_ic);
+  bool same = true;
+  for (uint8_t ic = 0; ic < TOTAL_IC; ic++)
+  {
+    for (uint8_t b = 0; b < 6; b++)
+    {
+      same = same && (bms_ic[ic].config.rx_data[b] == bms_ic[ic].config.tx_data[b]);
+    }
+  }
+  check(rc == 0 && same, "configuration reads back what was written");
+}
+
+static void test_measurement()
+{
+  for (uint8_t ic = 0; ic < TOTAL_IC; ic++)
+  {
+    for (uint8_t c = 0; c < 12; c++)
+    {
+      ltcSim.setCell(ic, c, 3.2 + 0.05*c + 0.01*ic);
+    }
+    ltcSim.setGpio(ic, 0, 1.234);
+  }
+  ltcSim.setCell(0, 11, 4.3);
+
+  int8_t rc = measure_cells(MD_7KHZ_3KHZ);
+  uint32_t conv = LTC6811_adc_elapsed();
+  check(rc == 0 && cells_match(0), "cell codes match the simulated voltages");
+  printf("      7kHz all cell conversion took %lu us (datasheet 2335 us)\n", (unsigned long)conv);
+
+  wakeup_idle(TOTAL_IC);
+  LTC6811_adax(MD_7KHZ_3KHZ, AUX_CH_ALL);
+  LTC6811_pollAdc();
+  wakeup_idle(TOTAL_IC);
+  rc = LTC6811_rdaux(REG_ALL, TOTAL_IC, bms_ic);
+  check(rc == 0 && bms_ic[1].aux.a_codes[0] == expected_code(1.234) && bms_ic[1].aux.a_codes[5] == expected_code(3.0),
+        "GPIO1 and REF2 read back");
+
+  wakeup_idle(TOTAL_IC);
+  LTC6811_adstat(MD_7KHZ_3KHZ, STAT_CH_ALL);
+  LTC6811_pollAdc();
+  wakeup_idle(TOTAL_IC);
+  rc = LTC6811_rdstat(REG_ALL, TOTAL_IC, bms_ic);
+  double sum = 0;
+  for (uint8_t c = 0; c < 12; c++)
+  {
+    sum += ltcSim.cell(2, c);
+  }
+  check(rc == 0 && bms_ic[2].stat.stat_codes[0] == expected_code(sum/20.0), "sum of cells");
+  check((bms_ic[0].stat.flags[2] & 0x80) && !(bms_ic[1].stat.flags[2] & 0x80), "cell 12 over voltage flag");
+}
+
+static void test_balancing()
+{
+  double before[12];
+  for (uint8_t c = 0; c < 12; c++)
+  {
+    before[c] = ltcSim.cell(1, c);
+  }
+
+  LTC6811_set_discharge(3, TOTAL_IC, bms_ic);
+  wakeup_idle(TOTAL_IC);
+  LTC6811_wrcfg(TOTAL_IC, bms_ic);
+  check(ltcSim.discharging(1, 2) && !ltcSim.discharging(1, 3), "DCC3 set on the chain");
+
+  for (int i = 0; i < 100; i++) // 10s, read back every 100ms to keep the watchdog fed
+  {
+    delay_m(100);
+    wakeup_idle(TOTAL_IC);
+    LTC6811_rdcfg(TOTAL_IC, bms_ic);
+  }
+  double drop = before[2] - ltcSim.cell(1, 2);
+  check(drop > 0.0099 && drop < 0.0102 && ltcSim.cell(1, 3) == before[3], "only cell 3 discharged, by 10mV in 10s");
+
+  LTC6811_clear_discharge(TOTAL_IC, bms_ic);
+  wakeup_idle(TOTAL_IC);
+  LTC6811_wrcfg(TOTAL_IC, bms_ic);
+  check(!ltcSim.discharging(1, 2), "discharge cleared");
+}
+
+static void test_watchdog()
+{
+  LTC6811_set_discharge(5, TOTAL_IC, bms_ic);
+  wakeup_idle(TOTAL_IC);
+  LTC6811_wrcfg(TOTAL_IC, bms_ic);
+  uint32_t sleeps = ltcSim.stats().sleeps;
+
+  delay_m(2500);
+  check(!ltcSim.discharging(0, 4) && ltcSim.stats().sleeps == sleeps + TOTAL_IC, "watchdog timeout drops DCC");
+
+  uint32_t lost = ltcSim.stats().lostFrames;
+  int8_t rc = LTC6811_rdcfg(TOTAL_IC, bms_ic);
+  check(rc != 0 && ltcSim.stats().lostFrames == lost + 1, "read without a wake-up is lost");
+
+  LTC6811_clear_discharge(TOTAL_IC, bms_ic);
+  configure();
+}
+
+static void test_noisy_link()
+{
+  const int cycles = 2000;
+  int pec_errors = 0;
+  int silent = 0;
+
+  ltcSim.setNoise(0.0005);
+  ltcSim.setBitErrorRate(1e-5);
+  ltcSim.resetStats();
+  for (int i = 0; i < cycles; i++)
+  {
+    int8_t rc = measure_cells(MD_7KHZ_3KHZ);
+    if (rc != 0)
+    {
+      pec_errors++;
+    }
+    else if (!cells_match(50)) // 10 sigma
+    {
+      silent++;
+    }
+  }
+  printf("      %d cycles, %lu bits flipped, %d reads with PEC errors, %lu commands dropped\n",
+         cycles, (unsigned long)ltcSim.stats().bitErrors, pec_errors,
+         (unsigned long)ltcSim.stats().cmdPecErrors);
+  check(ltcSim.stats().bitErrors > 0 && silent == 0, "no corrupted reading passes the PEC");
+  ltcSim.setNoise(0);
+  ltcSim.setBitErrorRate(0);
+}
+
+static void test_wake_tracker()
+{
+  bool ok = true;
+
+  // The run_command pattern: a sleep wake-up before every command
+  ltcSim.resetStats();
+  LTC6811_wake_reset_stats();
+  for (int i = 0; i < 100; i++)
+  {
+    wakeup_sleep(TOTAL_IC);
+    ok = ok && LTC6811_rdcfg(TOTAL_IC, bms_ic) == 0;
+  }
+  wake_stats wake = LTC6811_wake_stats();
+  check(ok && ltcSim.stats().redundantWakes == 0 && wake.pulses_skipped >= 99*TOTAL_IC,
+        "no wake pulses sent to an awake chain");
+
+  // Past tIDLE only the ports are woken, past tSLEEP the cores too
+  delay_m(10);
+  wakeup_sleep(TOTAL_IC);
+  ok = LTC6811_rdcfg(TOTAL_IC, bms_ic) == 0;
+  check(ok && LTC6811_wake_stats().sleep_downgraded == wake.sleep_downgraded + 1, "idle ports get an idle wake-up");
+  delay_m(2000);
+  wakeup_sleep(TOTAL_IC);
+  LTC6811_wrcfg(TOTAL_IC, bms_ic);
+  ok = LTC6811_rdcfg(TOTAL_IC, bms_ic) == 0;
+  check(ok && LTC6811_wake_stats().sleep_wakes == wake.sleep_wakes + 1 && ltcSim.stats().lostFrames == 0,
+        "sleeping cores get a full wake-up");
+
+  // Sleep resets the configuration, the shadow cache must not skip the rewrite
+  wakeup_idle(TOTAL_IC);
+  LTC6811_sync_cfg(TOTAL_IC, bms_ic);
+  delay_m(2000);
+  wakeup_sleep(TOTAL_IC);
+  uint32_t writes = LTC6811_shadow_stats().writes;
+  LTC6811_sync_cfg(TOTAL_IC, bms_ic);
+  check(LTC6811_shadow_stats().writes == writes + 1 && (ltcSim.config(0)[0] & 0x04),
+        "configuration rewritten after a sleep wake-up");
+}
+
+static void benchmark()
+{
+  const int cycles = 1000;
+  struct timespec start, end;
+
+  ltcSim.resetStats();
+  trace_reset();
+  uint64_t sim_start = ltcSim.nowNs();
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i = 0; i < cycles; i++)
+  {
+    measure_cells(MD_27KHZ_14KHZ);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double host_us = ((end.tv_sec - start.tv_sec)*1e9 + (end.tv_nsec - start.tv_nsec))/1e3/cycles;
+  double sim_us = (ltcSim.nowNs() - sim_start)/1e3/cycles;
+  printf("      27kHz cycle: %.1f us simulated, %lu bus bytes, %.2f us host\n",
+         sim_us, (unsigned long)(ltcSim.stats().busBytes/cycles), host_us);
+
+  // parse_cells() runs once per register group and IC, its loops bounded by the variant's traits
+  const trace_stats *parse = trace_get(TRACE_PARSE_CELLS);
+  printf("      LTC%d: cell_asic %lu bytes, parse_cells %lu calls per cycle, mean %.1f ns host\n",
+         LTC681X_VARIANT, (unsigned long)sizeof(cell_asic), (unsigned long)(parse->count/cycles),
+         parse->count ? parse->sum*1e9/hal_cycles_hz()/parse->count : 0.0);
+}
+
+int main()
+{
+  ltcSim.attach(CS_PIN);
+  trace_init();
+  ltcSim.reset(TOTAL_IC);
+  ltcSim.setDischargeRate(DISCHARGE_RATE);
+
+  test_config();
+  test_measurement();
+  test_balancing();
+  test_watchdog();
+  test_noisy_link();
+  test_wake_tracker();
+  benchmark();
+  trace_print();
+
+  printf("%s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,151 @@
+/*
+pec15_bench.cpp
+
+Times the slice-by-4 PEC15 engine (src/pec15.cpp) against the byte wise
+table walk it replaced, on the host. The old walk is kept here as the
+reference: right aligned remainder, one 256 entry table lookup per byte.
+Both are checked bit exact over random frames first, then timed at the
+lengths the driver uses (2 byte commands, 6 byte register groups) and on
+longer buffers. Prints PASS/FAIL per check and ns/byte per length, exits
+non-zero if a check failed.
+*/
+
+// From Firmware/bms-lmu_basic:
+//
+//   g++ -std=gnu++14 -O2 -Iinclude lib/ltc6811_sim/examples/pec15_bench/pec15_bench.cpp src/pec15.cpp -o pec15_bench && ./pec15_bench
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include "pec15.h"
+
+#define FRAMES 100000
+#define BUFFER_LEN 1024
+
+static uint16_t crc15Table[256];
+static int failures = 0;
+static volatile uint16_t sink;
+
+static void check(bool ok, const char *what)
+{
+  printf("%s  %s\n", ok ? "PASS" : "FAIL", what);
+  if (!ok)
+  {
+    failures++;
+  }
+}
+
+/* The datasheet table is the engine's byte table right aligned */
+static void build_old_table()
+{
+  for (uint16_t i = 0; i < 256; i++)
+  {
+    crc15Table[i] = pec15_lut.t[0][i] >> 1;
+  }
+}
+
+/* pec15_calc() as it was, before the slice-by-4 engine */
+__attribute__((noinline)) static uint16_t old_pec15_calc(uint8_t len, const uint8_t *data)
+{
+  uint16_t remainder,addr;
+  remainder = 16;//initialize the PEC
+
+  for (uint8_t i = 0; i<len; i++) // loops for each byte in data array
+  {
+    addr = ((remainder>>7)^data[i])&0xff;//calculate PEC table address
+    remainder = (remainder<<8)^crc15Table[addr];
+  }
+
+  return(remainder*2);//The CRC15 has a 0 in the LSB so the remainder must be multiplied by 2
+}
+
+__attribute__((noinline)) static uint16_t new_pec15_calc(uint16_t len, const uint8_t *data)
+{
+  return pec15_final(pec15_update(pec15_init(), data, len));
+}
+
+static double now_ns()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec*1e9 + t.tv_nsec;
+}
+
+/* Best of a few runs, ns per byte */
+static double time_old(const uint8_t *data, uint8_t len, uint32_t calls)
+{
+  double best = 1e30;
+  for (int run = 0; run < 5; run++)
+  {
+    double start = now_ns();
+    for (uint32_t i = 0; i < calls; i++)
+    {
+      sink = old_pec15_calc(len, data + (i & 63));
+    }
+    double ns = (now_ns() - start)/calls/len;
+    if (ns < best)
+    {
+      best = ns;
+    }
+  }
+  return best;
+}
+
+static double time_new(const uint8_t *data, uint16_t len, uint32_t calls)
+{
+  double best = 1e30;
+  for (int run = 0; run < 5; run++)
+  {
+    double start = now_ns();
+    for (uint32_t i = 0; i < calls; i++)
+    {
+      sink = new_pec15_calc(len, data + (i & 63));
+    }
+    double ns = (now_ns() - start)/calls/len;
+    if (ns < best)
+    {
+      best = ns;
+    }
+  }
+  return best;
+}
+
+int main()
+{
+  static uint8_t data[BUFFER_LEN + 64];
+  const uint8_t lengths[] = {2, 6, 8, 64, 255};
+  bool exact = true;
+
+  build_old_table();
+  srand(1);
+  for (uint16_t i = 0; i < sizeof(data); i++)
+  {
+    data[i] = (uint8_t)rand();
+  }
+
+  // Datasheet example: RDCFGA is 0x00 0x02 with PEC 0x2B 0x0A
+  const uint8_t rdcfg[2] = {0x00, 0x02};
+  check(new_pec15_calc(2, rdcfg) == 0x2B0A && old_pec15_calc(2, rdcfg) == 0x2B0A, "RDCFGA command PEC");
+
+  for (uint32_t frame = 0; frame < FRAMES && exact; frame++)
+  {
+    uint8_t len = (uint8_t)(1 + rand() % 255);
+    const uint8_t *p = data + rand() % (sizeof(data) - len);
+    exact = old_pec15_calc(len, p) == new_pec15_calc(len, p);
+  }
+  check(exact, "bit exact with the table walk over random frames");
+
+  printf("      len   table walk   slice-by-4   (ns/byte)\n");
+  for (uint8_t n = 0; n < sizeof(lengths); n++)
+  {
+    uint8_t len = lengths[n];
+    uint32_t calls = 20000000/len;
+    double old_ns = time_old(data, len, calls);
+    double new_ns = time_new(data, len, calls);
+    printf("      %-5u %-12.2f %-12.2f %.1fx\n", len, old_ns, new_ns, old_ns/new_ns);
+  }
+
+  printf("%s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
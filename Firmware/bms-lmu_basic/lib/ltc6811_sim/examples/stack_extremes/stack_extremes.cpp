@@ -0,0 +1,189 @@
+/*
+stack_extremes.cpp
+
+Stack pack statistics from include/PBalancer.h against a brute-force scan
+of the cells after every write, over random writes and over charging and
+discharging passes where the extreme cell keeps moving back into the pack.
+Also times a full-pack pass of update_cell() against the rescan on
+retreat it replaced, which is O(STACK_SIZE) per write once the extreme
+moves on every write. Build with -DSTACK_SIZE=n for other pack sizes.
+Prints PASS/FAIL per check and exits non-zero if any failed.
+*/
+
+// From Firmware/bms-lmu_basic:
+//
+//   g++ -std=gnu++14 -O2 -Iinclude lib/ltc6811_sim/examples/stack_extremes/stack_extremes.cpp src/hal_linux.cpp -o stack_extremes && ./stack_extremes
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "hal.h"
+#include "PBalancer.h"
+
+#define RANDOM_WRITES 1000000
+#define PASSES 2000
+
+static int failures = 0;
+
+static void check(bool ok, const char *what)
+{
+  printf("%s  %s\n", ok ? "PASS" : "FAIL", what);
+  if (!ok)
+  {
+    failures++;
+  }
+}
+
+/* The extremes before the tournament trees: rescanned when the extreme cell retreats */
+struct rescanStack {
+  uint16_t cells[STACK_SIZE];
+  uint16_t min_cell;
+  uint16_t max_cell;
+  int min_pos;
+  int max_pos;
+
+  void rescan_min(){
+    min_pos = 0;
+    for (int i = 1; i < STACK_SIZE; i++){
+      if (cells[i] < cells[min_pos]) {
+        min_pos = i;
+      }
+    }
+    min_cell = cells[min_pos];
+  }
+
+  void rescan_max(){
+    max_pos = 0;
+    for (int i = 1; i < STACK_SIZE; i++){
+      if (cells[i] > cells[max_pos]) {
+        max_pos = i;
+      }
+    }
+    max_cell = cells[max_pos];
+  }
+
+  void update_cell(int pos, uint16_t cell_voltage){
+    cells[pos] = cell_voltage;
+    if (cell_voltage <= min_cell) {
+      min_cell = cell_voltage;
+      min_pos = pos;
+    } else if (pos == min_pos) {
+      rescan_min();
+    }
+
+    if (cell_voltage >= max_cell) {
+      max_cell = cell_voltage;
+      max_pos = pos;
+    } else if (pos == max_pos) {
+      rescan_max();
+    }
+  }
+};
+
+static Stack stack;
+static uint16_t cells[STACK_SIZE];
+static uint32_t mismatches = 0;
+
+/* Writes one cell to the Stack and the reference, then compares every statistic */
+static void write_and_compare(int pos, uint16_t code)
+{
+  stack.update_cell(pos, code);
+  cells[pos] = code;
+
+  uint16_t lo = cells[0];
+  uint16_t hi = cells[0];
+  uint32_t sum = 0;
+  for (int i = 0; i < STACK_SIZE; i++)
+  {
+    lo = (cells[i] < lo) ? cells[i] : lo;
+    hi = (cells[i] > hi) ? cells[i] : hi;
+    sum += cells[i];
+  }
+  bool ok = stack.min() == lo && stack.max() == hi
+            && stack.cell_voltage(stack.argmin()) == lo && stack.cell_voltage(stack.argmax()) == hi
+            && stack.spread() == hi - lo && (uint32_t)stack.sum_stack_voltage() == sum;
+  mismatches += ok ? 0 : 1;
+}
+
+/* Every cell moves by step in order, the extreme cell retreats on most writes */
+static void pass(int16_t step)
+{
+  for (int pos = 0; pos < STACK_SIZE; pos++)
+  {
+    write_and_compare(pos, (uint16_t)(cells[pos] + step));
+  }
+}
+
+static volatile uint16_t sink;
+
+/* Mean ns per write over PASSES charging passes */
+template <typename S>
+static double time_charging(S &s)
+{
+  uint16_t code = 30000;
+  for (int pos = 0; pos < STACK_SIZE; pos++)
+  {
+    s.update_cell(pos, code);
+  }
+  uint32_t start = hal_cycles();
+  for (int p = 0; p < PASSES; p++)
+  {
+    code++;
+    for (int pos = 0; pos < STACK_SIZE; pos++)
+    {
+      s.update_cell(pos, code);
+    }
+  }
+  uint32_t cycles = hal_cycles() - start;
+  sink = s.min_cell_code();
+  return cycles*1e9/hal_cycles_hz()/((double)PASSES*STACK_SIZE);
+}
+
+struct timedStack : Stack {
+  uint16_t min_cell_code() { return min(); }
+};
+
+struct timedRescan : rescanStack {
+  uint16_t min_cell_code() { return min_cell; }
+};
+
+int main()
+{
+  hal_cycles_init();
+  srand(6811);
+
+  // Random codes over a narrow band, so ties and repeated extremes are common
+  for (uint32_t i = 0; i < RANDOM_WRITES; i++)
+  {
+    write_and_compare(rand() % STACK_SIZE, 36000 + rand() % 64);
+  }
+  check(mismatches == 0, "random writes match the brute-force scan");
+
+  // A pack at one voltage, then charged and discharged a code per pass
+  for (int pos = 0; pos < STACK_SIZE; pos++)
+  {
+    write_and_compare(pos, 36000);
+  }
+  for (int p = 0; p < PASSES; p++)
+  {
+    pass((p < PASSES/2) ? 1 : -1);
+  }
+  check(mismatches == 0, "charging and discharging passes match the brute-force scan");
+
+  // Full range, including the zeros the Stack starts from
+  for (uint32_t i = 0; i < RANDOM_WRITES/10; i++)
+  {
+    write_and_compare(rand() % STACK_SIZE, (rand() % 4) ? (uint16_t)rand() : 0);
+  }
+  check(mismatches == 0, "full range writes match the brute-force scan");
+
+  static timedStack tree;
+  static timedRescan rescan = {};
+  double tree_ns = time_charging(tree);
+  double rescan_ns = time_charging(rescan);
+  printf("      %d cells, charging pass: tournament trees %.1f ns/write, rescan on retreat %.1f ns/write\n",
+         STACK_SIZE, tree_ns, rescan_ns);
+
+  printf("%s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,110 @@
+/*
+ticker_queue.cpp
+
+Ready queue of the TickerInterrupt at its limits, stepped through the
+manual ticks of the Linux HAL port. MAX_TICKER_NUMBER tickers of one
+priority released on the same tick must all be queued, and detaching a
+ticker whose release is still queued must give its entry back, so ids
+reused by attach() and released again never find the queue full or run
+a callback twice. Prints PASS/FAIL per check and exits non-zero if any
+failed.
+*/
+
+// From Firmware/bms-lmu_basic:
+//
+//   g++ -std=gnu++14 -O2 -Iinclude lib/ltc6811_sim/examples/ticker_queue/ticker_queue.cpp src/TickerInterrupt.cpp src/hal_linux.cpp src/Trace.cpp -o ticker_queue && ./ticker_queue
+
+#include <stdio.h>
+#include <stdint.h>
+#include "hal.h"
+#include "hal_linux.h"
+#include "TickerInterrupt.h"
+
+#define ROUNDS 100
+
+static int failures = 0;
+static uint32_t runs = 0;
+static uint32_t stale_runs = 0;
+
+static void check(bool ok, const char *what)
+{
+  printf("%s  %s\n", ok ? "PASS" : "FAIL", what);
+  if (!ok)
+  {
+    failures++;
+  }
+}
+
+static void count_run()
+{
+  runs++;
+}
+
+static void detached_run()
+{
+  stale_runs++;
+}
+
+static uint32_t overruns(TickerInterrupt &ticker)
+{
+  uint32_t total = 0;
+  for (int i = 0; i < MAX_TICKER_NUMBER; i++)
+  {
+    total += ticker.stats(i).overruns;
+  }
+  return total;
+}
+
+int main()
+{
+  hal_linux_set_manual_tick(true);
+  TickerInterrupt ticker(NULL, 1);
+  ticker.start();
+
+  // Every ticker due on the same tick, all in the one ready queue
+  for (int i = 0; i < MAX_TICKER_NUMBER; i++)
+  {
+    ticker.attach(count_run, 10);
+  }
+  for (int t = 0; t < 10*ROUNDS; t++)
+  {
+    hal_linux_tick();
+    if (t % 10 == 9)
+    {
+      while (ticker.dispatch());
+    }
+  }
+  check(runs == (uint32_t)MAX_TICKER_NUMBER*ROUNDS && overruns(ticker) == 0,
+        "MAX_TICKER_NUMBER releases on one tick all queued");
+  printf("      %d tickers, queue of %d: %lu runs, %lu overruns\n", MAX_TICKER_NUMBER, TICKER_QUEUE_SIZE,
+         (unsigned long)runs, (unsigned long)overruns(ticker));
+  for (int i = 0; i < MAX_TICKER_NUMBER; i++)
+  {
+    ticker.detach(i);
+  }
+
+  // Released, detached before dispatch, attached again and released again
+  runs = 0;
+  bool churned = true;
+  for (int round = 0; round < ROUNDS; round++)
+  {
+    for (int i = 0; i < MAX_TICKER_NUMBER; i++)
+    {
+      ticker.attach(detached_run, 1);
+    }
+    hal_linux_tick();
+    for (int i = 0; i < MAX_TICKER_NUMBER; i++)
+    {
+      ticker.detach(i);
+      ticker.once(count_run, 1);
+    }
+    hal_linux_tick();
+    churned = churned && overruns(ticker) == 0;
+    while (ticker.dispatch());
+  }
+  check(churned && runs == (uint32_t)MAX_TICKER_NUMBER*ROUNDS && stale_runs == 0,
+        "detach frees the queued entry, reused ids run once each");
+
+  printf("%s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,171 @@
+/*
+ticker_scaling.cpp
+
+Per tick cost of the TickerInterrupt timer wheel as the number of tickers
+grows from 4 to 512, on the host. The Linux HAL port is set to manual ticks
+so the program steps the ticker handler itself and times each batch of
+ticks with hal_cycles(). Intervals grow with the ticker count, so every run
+releases about one ticker per TICKS_PER_RELEASE ticks and only the number
+of tickers held changes. The countdown scan the wheel replaced is timed
+the same way for comparison. Checks that every release was dispatched and
+that the wheel's per tick cost stays flat. Prints PASS/FAIL per check and
+exits non-zero if any failed.
+*/
+
+// From Firmware/bms-lmu_basic:
+//
+//   g++ -std=gnu++14 -O2 -DMAX_TICKER_NUMBER=512 -DTICKER_QUEUE_SIZE=512 -Iinclude lib/ltc6811_sim/examples/ticker_scaling/ticker_scaling.cpp src/TickerInterrupt.cpp src/hal_linux.cpp src/Trace.cpp -o ticker_scaling && ./ticker_scaling
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "hal.h"
+#include "hal_linux.h"
+#include "TickerInterrupt.h"
+
+#define TICKS 200000
+#define BATCH 32                 // Ticks timed together, dispatch runs between batches
+#define TICKS_PER_RELEASE 20     // Mean ticks between releases, whatever the ticker count
+
+static_assert(MAX_TICKER_NUMBER >= 512, "Build with -DMAX_TICKER_NUMBER=512 -DTICKER_QUEUE_SIZE=512");
+static_assert(BATCH < 4*TICKS_PER_RELEASE/2, "A batch must be shorter than the shortest interval, at 4 tickers");
+
+static int failures = 0;
+static uint32_t runs = 0;
+
+static void check(bool ok, const char *what)
+{
+  printf("%s  %s\n", ok ? "PASS" : "FAIL", what);
+  if (!ok)
+  {
+    failures++;
+  }
+}
+
+static void count_run()
+{
+  runs++;
+}
+
+/* The handler before the wheel: every ticker counted down on every tick */
+struct scanTicker {
+  uint32_t interval;
+  uint32_t countdown;
+  bool pending;
+};
+
+static scanTicker scan[MAX_TICKER_NUMBER];
+static volatile uint32_t scanReleases = 0;
+
+__attribute__((noinline)) static void scan_tick(int count)
+{
+  for (int i = 0; i < count; i++) {
+    if (--scan[i].countdown == 0) {
+      scan[i].countdown = scan[i].interval;
+      scan[i].pending = true;
+      scanReleases++;
+    }
+  }
+}
+
+static uint32_t random_interval(int count)
+{
+  // Mean of count*TICKS_PER_RELEASE, spread +/-50% so releases do not line up
+  uint32_t mean = count*TICKS_PER_RELEASE;
+  return mean/2 + (uint32_t)rand() % (mean + 1);
+}
+
+/* Mean ns per tick of the wheel, releases dispatched between batches */
+static double time_wheel(int count, uint32_t *released)
+{
+  TickerInterrupt ticker(NULL, 1);
+  ticker.start();
+  for (int i = 0; i < count; i++)
+  {
+    ticker.attach(count_run, (int)random_interval(count), TICKER_PRIORITY_NORMAL, 0, rand() % 64);
+  }
+
+  uint64_t cycles = 0;
+  runs = 0;
+  for (uint32_t done = 0; done < TICKS; done += BATCH)
+  {
+    uint32_t start = hal_cycles();
+    for (int t = 0; t < BATCH; t++)
+    {
+      hal_linux_tick();
+    }
+    cycles += hal_cycles() - start;
+    while (ticker.dispatch());
+  }
+
+  uint32_t overruns = 0;
+  for (int i = 0; i < count; i++)
+  {
+    overruns += ticker.stats(i).overruns;
+    ticker.detach(i);
+  }
+  *released = runs + overruns;
+  return (double)cycles*1e9/hal_cycles_hz()/TICKS;
+}
+
+static double time_scan(int count)
+{
+  for (int i = 0; i < count; i++)
+  {
+    scan[i].interval = random_interval(count);
+    scan[i].countdown = scan[i].interval;
+    scan[i].pending = false;
+  }
+
+  uint64_t cycles = 0;
+  for (uint32_t done = 0; done < TICKS; done += BATCH)
+  {
+    uint32_t start = hal_cycles();
+    for (int t = 0; t < BATCH; t++)
+    {
+      scan_tick(count);
+    }
+    cycles += hal_cycles() - start;
+    for (int i = 0; i < count; i++)
+    {
+      scan[i].pending = false;
+    }
+  }
+  return (double)cycles*1e9/hal_cycles_hz()/TICKS;
+}
+
+int main()
+{
+  const int counts[] = {4, 16, 64, 128, 256, 512};
+  const int runsCount = sizeof(counts)/sizeof(counts[0]);
+  double wheel[runsCount];
+  bool allDispatched = true;
+
+  srand(1);
+  hal_linux_set_manual_tick(true);
+  hal_cycles_init();
+
+  printf("      tickers   wheel(ns/tick)   scan(ns/tick)   releases\n");
+  for (int r = 0; r < runsCount; r++)
+  {
+    uint32_t released = 0;
+    wheel[r] = time_wheel(counts[r], &released);
+    double scanned = time_scan(counts[r]);
+    printf("      %-9d %-16.1f %-15.1f %lu\n", counts[r], wheel[r], scanned, (unsigned long)released);
+    allDispatched = allDispatched && released > 0 && released == runs;
+  }
+
+  check(allDispatched, "every release dispatched, no overruns");
+
+  double lowest = wheel[0];
+  double highest = wheel[0];
+  for (int r = 1; r < runsCount; r++)
+  {
+    lowest = (wheel[r] < lowest) ? wheel[r] : lowest;
+    highest = (wheel[r] > highest) ? wheel[r] : highest;
+  }
+  check(highest < 2*lowest, "wheel per tick cost within 2x from 4 to 512 tickers");
+
+  printf("%s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,604 @@
+/***************************************************************************
+    LTC6811Sim.cpp
+
+    INTRO
+    Command decoder, register groups and conversion model of the host side
+    LTC6811 chain. Register layouts, command codes and timings follow the
+    LTC6811-1/-2 datasheet. See LTC6811Sim.h
+
+****************************************************************************/
+#ifndef ARDUINO
+
+#include "LTC6811Sim.h"
+#include "hal_linux.h"
+#include <string.h>
+
+LTC6811Sim ltcSim;
+
+#define SIM_REV 0x1              // Silicon revision reported in STBR5
+#define SIM_VA 5.0               // VREGA
+#define SIM_VD 3.0               // VREGD
+#define SIM_REF2 3.0             // Second reference, measured as aux channel 6
+#define SIM_DIAGN_US 400         // Approximate MUX self test time
+
+// Command codes without the MD, DCP and channel fields
+#define CMD_WRCFGA 0x001
+#define CMD_RDCFGA 0x002
+#define CMD_RDCVA 0x004
+#define CMD_RDCVB 0x006
+#define CMD_RDCVC 0x008
+#define CMD_RDCVD 0x00A
+#define CMD_RDAUXA 0x00C
+#define CMD_RDAUXB 0x00E
+#define CMD_RDSTATA 0x010
+#define CMD_RDSTATB 0x012
+#define CMD_WRSCTRL 0x014
+#define CMD_RDSCTRL 0x016
+#define CMD_CLRSCTRL 0x018
+#define CMD_STSCTRL 0x019
+#define CMD_WRPWM 0x020
+#define CMD_RDPWM 0x022
+#define CMD_CLRCELL 0x711
+#define CMD_CLRAUX 0x712
+#define CMD_CLRSTAT 0x713
+#define CMD_PLADC 0x714
+#define CMD_DIAGN 0x715
+#define CMD_WRCOMM 0x721
+#define CMD_RDCOMM 0x722
+#define CMD_STCOMM 0x723
+
+/*
+All cell conversion time in microseconds by [MD][ADCOPT]. A conversion of
+n measurement steps takes n/6 of it.
+*/
+static const uint32_t simConvTable[4][2] = {
+    {12807, 6134},   // 422Hz, 1kHz
+    {1113, 1288},    // 27kHz, 14kHz
+    {2335, 3033},    // 7kHz, 3kHz
+    {201317, 4407}   // 26Hz, 2kHz
+};
+
+/* Datasheet CRC15 bit by bit, independent of the driver's table engine */
+static uint16_t simPec(const uint8_t *data, uint8_t len) {
+    uint16_t remainder = 16;
+    for (uint8_t i = 0; i < len; i++) {
+        for (int8_t bit = 7; bit >= 0; bit--) {
+            uint16_t in = ((data[i] >> bit) & 0x01) ^ ((remainder >> 14) & 0x01);
+            remainder = (uint16_t)((remainder << 1) & 0x7FFF);
+            if (in) {
+                remainder ^= 0x4599;
+            }
+        }
+    }
+    return (uint16_t)(remainder << 1);
+}
+
+static void putCodes(uint8_t *out, const uint16_t *codes) {
+    for (uint8_t i = 0; i < 3; i++) {
+        out[2*i] = (uint8_t)codes[i];
+        out[2*i+1] = (uint8_t)(codes[i] >> 8);
+    }
+}
+
+LTC6811Sim::LTC6811Sim() {
+    clockNs = 0;
+    settledNs = 0;
+    byteNs = 8000;                   // 1MHz SCK
+    noiseSigma = 0;
+    bitErrorRate = 0;
+    dischargeRate = 0.001;
+    wakeModel = true;
+    selected = false;
+    rng.seed(1);
+    _stats = ltcSimStats();
+    reset(1);
+}
+
+void LTC6811Sim::reset(uint8_t _totalIc) {
+    totalIc = (_totalIc > LTC6811_SIM_MAX_IC) ? LTC6811_SIM_MAX_IC : _totalIc;
+    for (uint8_t i = 0; i < LTC6811_SIM_MAX_IC; i++) {
+        simIc &ic = ics[i];
+        powerOnReset(ic);
+        for (uint8_t c = 0; c < LTC6811_SIM_CELLS; c++) {
+            ic.cellV[c] = 3.7;
+        }
+        for (uint8_t g = 0; g < LTC6811_SIM_GPIOS; g++) {
+            ic.gpioV[g] = 1.5;
+        }
+        ic.dieTemp = 25.0;
+        ic.openWires = 0;
+        ic.lastPortNs = clockNs;
+        ic.lastCommandNs = clockNs;
+        ic.asleep = true;
+    }
+    settledNs = clockNs;
+}
+
+void LTC6811Sim::powerOnReset(simIc &ic) {
+    static const uint8_t cfgrDefault[6] = {0xF8, 0x00, 0x00, 0x00, 0x00, 0x00};
+    memcpy(ic.cfgr, cfgrDefault, sizeof(ic.cfgr));
+    memset(ic.sctrl, 0x00, sizeof(ic.sctrl));
+    memset(ic.pwm, 0xFF, sizeof(ic.pwm));
+    memset(ic.comm, 0xFF, sizeof(ic.comm));
+    memset(ic.cv, 0xFF, sizeof(ic.cv));
+    memset(ic.aux, 0xFF, sizeof(ic.aux));
+    memset(ic.stat, 0xFF, sizeof(ic.stat));
+    memset(ic.flags, 0xFF, sizeof(ic.flags));
+    ic.statb5 = (uint8_t)(SIM_REV << 4) | 0x03;
+    ic.convKind = CONV_NONE;
+}
+
+void LTC6811Sim::setCell(uint8_t ic, uint8_t cell, double volts) {
+    ics[ic].cellV[cell] = volts;
+}
+
+void LTC6811Sim::setAllCells(double volts) {
+    for (uint8_t i = 0; i < LTC6811_SIM_MAX_IC; i++) {
+        for (uint8_t c = 0; c < LTC6811_SIM_CELLS; c++) {
+            ics[i].cellV[c] = volts;
+        }
+    }
+}
+
+void LTC6811Sim::setGpio(uint8_t ic, uint8_t gpio, double volts) {
+    ics[ic].gpioV[gpio] = volts;
+}
+
+void LTC6811Sim::setDieTemp(uint8_t ic, double celsius) {
+    ics[ic].dieTemp = celsius;
+}
+
+void LTC6811Sim::setOpenWire(uint8_t ic, uint8_t wire, bool open) {
+    if (open) {
+        ics[ic].openWires |= (uint16_t)(1 << wire);
+    } else {
+        ics[ic].openWires &= (uint16_t)~(1 << wire);
+    }
+}
+
+bool LTC6811Sim::discharging(uint8_t ic, uint8_t cell) const {
+    if (cell < 8) {
+        return (ics[ic].cfgr[4] >> cell) & 0x01;
+    }
+    return (ics[ic].cfgr[5] >> (cell - 8)) & 0x01;
+}
+
+bool LTC6811Sim::converting() const {
+    for (uint8_t i = 0; i < totalIc; i++) {
+        if (ics[i].convKind != CONV_NONE) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void LTC6811Sim::resetStats() {
+    _stats = ltcSimStats();
+}
+
+static uint64_t simNowNs() {
+    ltcSim.advance(LTC6811_SIM_CALL_NS);
+    return ltcSim.nowNs();
+}
+
+static void simWaitNs(uint64_t ns) { ltcSim.advance(ns); }
+static void simSelect() { ltcSim.select(); }
+static void simDeselect() { ltcSim.deselect(); }
+static uint8_t simTransfer(uint8_t mosi) { return ltcSim.transfer(mosi); }
+static void simSpiClock(uint32_t hz) { ltcSim.setSpiClock(hz); }
+
+void LTC6811Sim::attach(uint32_t csPin) {
+    static const hal_linux_clock clock = {simNowNs, simWaitNs};
+    static hal_linux_spi_device device;
+
+    device.cs_pin = csPin;
+    device.select = simSelect;
+    device.deselect = simDeselect;
+    device.transfer = simTransfer;
+    device.set_clock = simSpiClock;
+    hal_linux_set_clock(&clock);
+    hal_linux_set_spi_device(&device);
+}
+
+void LTC6811Sim::advance(uint64_t ns) {
+    clockNs += ns;
+    settle();
+}
+
+/* Brings conversions, discharge and the watchdog up to the current time */
+void LTC6811Sim::settle() {
+    for (uint8_t i = 0; i < totalIc; i++) {
+        simIc &ic = ics[i];
+        uint64_t until = clockNs;
+        bool timeout = wakeModel && !ic.asleep && (clockNs - ic.lastCommandNs > (uint64_t)LTC6811_SIM_T_SLEEP_US*1000);
+
+        if (ic.convKind != CONV_NONE && ic.convEndNs <= clockNs) {
+            finishConversion(ic);
+        }
+        if (timeout) {
+            until = ic.lastCommandNs + (uint64_t)LTC6811_SIM_T_SLEEP_US*1000;
+        }
+        if (!ic.asleep && until > settledNs && dischargeRate > 0) {
+            double drop = dischargeRate*(double)(until - settledNs)*1e-9;
+            for (uint8_t c = 0; c < LTC6811_SIM_CELLS; c++) {
+                if (discharging(i, c)) {
+                    ic.cellV[c] = (ic.cellV[c] > drop) ? ic.cellV[c] - drop : 0;
+                }
+            }
+        }
+        if (timeout) {
+            powerOnReset(ic);
+            ic.asleep = true;
+            _stats.sleeps++;
+        }
+    }
+    settledNs = clockNs;
+}
+
+/*
+Every port in front of the first sleeping or idle one passes the frame on.
+That one is woken by the frame and the ICs behind it never see it, which is
+why the wake-up routines pulse chip select once per IC.
+*/
+void LTC6811Sim::wakeChain() {
+    reached = 0;
+    if (!wakeModel) {
+        reached = totalIc;
+        return;
+    }
+    while (reached < totalIc) {
+        simIc &ic = ics[reached];
+        if (ic.asleep) {
+            ic.asleep = false;
+            ic.lastCommandNs = clockNs;
+            ic.lastPortNs = clockNs;
+            _stats.wakeups++;
+            return;
+        }
+        if (clockNs - ic.lastPortNs > (uint64_t)LTC6811_SIM_T_IDLE_US*1000) {
+            ic.lastPortNs = clockNs;
+            _stats.wakeups++;
+            return;
+        }
+        reached++;
+    }
+}
+
+void LTC6811Sim::select() {
+    selected = true;
+    byteIndex = 0;
+    cmdValid = false;
+    cmdAddressed = false;
+    cmdCode = 0;
+    writeLen = 0;
+    responseLen = 0;
+    _stats.frames++;
+    wakeChain();
+}
+
+void LTC6811Sim::deselect() {
+    if (!selected) {
+        return;
+    }
+    selected = false;
+
+    for (uint8_t i = 0; i < reached; i++) {
+        ics[i].lastPortNs = clockNs;
+        if (cmdValid && addressed(i)) {
+            ics[i].lastCommandNs = clockNs;
+        }
+    }
+    if (byteIndex < 4) {
+        if (reached == totalIc) {
+            _stats.redundantWakes++;
+        }
+        return;
+    }
+    if (reached < totalIc) {
+        _stats.lostFrames++;
+    }
+    if (cmdValid && writeLen > 0) {
+        applyWrite();
+    }
+}
+
+uint8_t LTC6811Sim::flipBits(uint8_t data) {
+    if (bitErrorRate <= 0) {
+        return data;
+    }
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    for (uint8_t bit = 0; bit < 8; bit++) {
+        if (uniform(rng) < bitErrorRate) {
+            data ^= (uint8_t)(1 << bit);
+            _stats.bitErrors++;
+        }
+    }
+    return data;
+}
+
+uint8_t LTC6811Sim::transfer(uint8_t mosi) {
+    uint8_t miso = 0xFF;
+
+    if (!selected) {
+        return miso;
+    }
+    _stats.busBytes++;
+    mosi = flipBits(mosi);
+
+    if (reached > 0) {
+        if (byteIndex < 4) {
+            cmd[byteIndex] = mosi;
+            if (byteIndex == 3) {
+                decode();
+            }
+        } else if (cmdValid) {
+            uint16_t k = byteIndex - 4;
+            switch (cmdCode) {
+            case CMD_WRCFGA:
+            case CMD_WRSCTRL:
+            case CMD_WRPWM:
+            case CMD_WRCOMM:
+                if (writeLen < sizeof(writeData)) {
+                    writeData[writeLen++] = mosi;
+                }
+                break;
+            case CMD_PLADC:
+                miso = converting() ? 0x00 : 0xFF;
+                break;
+            default:
+                if (k < responseLen) {
+                    miso = response[k];
+                }
+                break;
+            }
+        }
+    }
+    byteIndex++;
+    advance(byteNs);
+    return flipBits(miso);
+}
+
+void LTC6811Sim::decode() {
+    uint16_t pec = simPec(cmd, 2);
+    if (cmd[2] != (uint8_t)(pec >> 8) || cmd[3] != (uint8_t)pec) {
+        _stats.cmdPecErrors++;
+        return;
+    }
+    cmdValid = true;
+    cmdAddressed = (cmd[0] & 0x80) != 0;
+    cmdAddr = (cmd[0] >> 3) & 0x0F;
+    cmdCode = (uint16_t)(((cmd[0] & 0x07) << 8) | cmd[1]);
+    _stats.commands++;
+
+    uint8_t md = (cmdCode >> 7) & 0x03;
+    uint8_t dcp = (cmdCode >> 4) & 0x01;
+    uint8_t ch = cmdCode & 0x07;
+    uint8_t st = (cmdCode >> 5) & 0x03;
+
+    switch (cmdCode) {
+    case CMD_RDCFGA: case CMD_RDCVA: case CMD_RDCVB: case CMD_RDCVC: case CMD_RDCVD:
+    case CMD_RDAUXA: case CMD_RDAUXB: case CMD_RDSTATA: case CMD_RDSTATB:
+    case CMD_RDSCTRL: case CMD_RDPWM: case CMD_RDCOMM:
+        loadResponse();
+        return;
+    case CMD_WRCFGA: case CMD_WRSCTRL: case CMD_WRPWM: case CMD_WRCOMM:
+    case CMD_PLADC: case CMD_STSCTRL: case CMD_STCOMM:
+        return;
+    case CMD_CLRCELL: case CMD_CLRAUX: case CMD_CLRSTAT: case CMD_CLRSCTRL:
+        for (uint8_t i = 0; i < reached; i++) {
+            if (!addressed(i)) continue;
+            simIc &ic = ics[i];
+            if (cmdCode == CMD_CLRCELL) {
+                memset(ic.cv, 0xFF, sizeof(ic.cv));
+            } else if (cmdCode == CMD_CLRAUX) {
+                memset(ic.aux, 0xFF, sizeof(ic.aux));
+            } else if (cmdCode == CMD_CLRSTAT) {
+                memset(ic.stat, 0xFF, sizeof(ic.stat));
+                memset(ic.flags, 0xFF, sizeof(ic.flags));
+                ic.statb5 |= 0x03;
+            } else {
+                memset(ic.sctrl, 0x00, sizeof(ic.sctrl));
+            }
+        }
+        return;
+    case CMD_DIAGN:
+        startConversion(CONV_DIAGN, 0, 0, 0, 0);
+        return;
+    }
+
+    // ADC commands, self tests before the conversions whose channel field they overlap
+    if ((cmdCode & 0x61F) == 0x207) startConversion(CONV_CVST, md, st, 0, 6);
+    else if ((cmdCode & 0x61F) == 0x407) startConversion(CONV_AXST, md, st, 0, 6);
+    else if ((cmdCode & 0x61F) == 0x40F) startConversion(CONV_STATST, md, st, 0, 4);
+    else if ((cmdCode & 0x66F) == 0x46F) startConversion(CONV_CVAX, md, 0, dcp, 8);
+    else if ((cmdCode & 0x66F) == 0x467) startConversion(CONV_CVSC, md, 0, dcp, 7);
+    else if ((cmdCode & 0x66F) == 0x201) startConversion(CONV_OL, md, 0, dcp, 1);
+    else if ((cmdCode & 0x668) == 0x260) startConversion(CONV_CV, md, ch, dcp, ch ? 1 : 6);
+    else if ((cmdCode & 0x628) == 0x228) startConversion(CONV_OW, md, (uint8_t)(ch | ((cmdCode >> 3) & 0x08)), dcp, ch ? 1 : 6);
+    else if ((cmdCode & 0x678) == 0x460) startConversion(CONV_AX, md, ch, 0, ch ? 1 : 6);
+    else if ((cmdCode & 0x678) == 0x400) startConversion(CONV_AX, md, ch, 0, ch ? 1 : 6);
+    else if ((cmdCode & 0x678) == 0x468) startConversion(CONV_STAT, md, ch, 0, ch ? 1 : 4);
+    else if ((cmdCode & 0x678) == 0x408) startConversion(CONV_STAT, md, ch, 0, ch ? 1 : 4);
+}
+
+void LTC6811Sim::startConversion(uint8_t kind, uint8_t md, uint8_t arg, uint8_t dcp, uint8_t steps) {
+    _stats.conversions++;
+    for (uint8_t i = 0; i < reached; i++) {
+        if (!addressed(i)) continue;
+        simIc &ic = ics[i];
+        uint32_t us = SIM_DIAGN_US;
+        if (kind != CONV_DIAGN) {
+            us = (simConvTable[md][ic.cfgr[0] & 0x01]*steps + 5)/6;
+        }
+        ic.convKind = kind;
+        ic.convMd = md;
+        ic.convArg = arg;
+        ic.convDcp = dcp;
+        ic.convEndNs = clockNs + (uint64_t)us*1000;
+    }
+}
+
+uint16_t LTC6811Sim::measure(double volts) {
+    if (noiseSigma > 0) {
+        std::normal_distribution<double> noise(0.0, noiseSigma);
+        volts += noise(rng);
+    }
+    double code = volts*10000.0 + 0.5;
+    if (code < 0) return 0;
+    if (code > 65535) return 65535;
+    return (uint16_t)code;
+}
+
+/* Converts one cell and updates its under and over voltage flags against VUV and VOV */
+void LTC6811Sim::measureCell(simIc &ic, uint8_t cell, double volts) {
+    uint16_t code = measure(volts);
+    uint16_t vuv = (uint16_t)(ic.cfgr[1] | ((ic.cfgr[2] & 0x0F) << 8));
+    uint16_t vov = (uint16_t)((ic.cfgr[2] >> 4) | (ic.cfgr[3] << 4));
+    uint8_t shift = (uint8_t)(2*(cell % 4));
+    uint8_t &flags = ic.flags[cell/4];
+
+    ic.cv[cell] = code;
+    flags &= (uint8_t)~(0x03 << shift);
+    if ((uint32_t)code < (uint32_t)(vuv + 1)*16) flags |= (uint8_t)(0x01 << shift);
+    if ((uint32_t)code > (uint32_t)vov*16) flags |= (uint8_t)(0x02 << shift);
+}
+
+uint16_t LTC6811Sim::selfTestCode(const simIc &ic) const {
+    bool st1 = (ic.convArg == 1);
+    if (ic.convMd == 1) {
+        if ((ic.cfgr[0] & 0x01) == 0) {
+            return st1 ? 0x9565 : 0x6A9A;
+        }
+        return st1 ? 0x9553 : 0x6AAC;
+    }
+    return st1 ? 0x9555 : 0x6AAA;
+}
+
+void LTC6811Sim::finishConversion(simIc &ic) {
+    uint8_t kind = ic.convKind;
+    uint8_t arg = ic.convArg;
+    ic.convKind = CONV_NONE;
+
+    if (kind == CONV_CV || kind == CONV_CVAX || kind == CONV_CVSC || kind == CONV_OW) {
+        uint8_t ch = (kind == CONV_CV || kind == CONV_OW) ? (arg & 0x07) : 0;
+        bool pullUp = (kind == CONV_OW) && (arg & 0x08);
+        for (uint8_t c = 0; c < LTC6811_SIM_CELLS; c++) {
+            if (ch != 0 && (c % 6) + 1 != ch) continue;
+            double v = ic.cellV[c];
+            if (kind == CONV_OW) {
+                // A broken wire Cn drags cell n+1 down under the pull-up current,
+                // C0 and C12 read zero with the pull-up and pull-down respectively
+                if (pullUp && c == 0 && (ic.openWires & 0x0001)) v = 0;
+                else if (pullUp && c > 0 && (ic.openWires & (1 << c))) v -= 1.0;
+                else if (!pullUp && c == 11 && (ic.openWires & (1 << 12))) v = 0;
+            }
+            measureCell(ic, c, v);
+        }
+    }
+    switch (kind) {
+    case CONV_CVST:
+        for (uint8_t c = 0; c < LTC6811_SIM_CELLS; c++) ic.cv[c] = selfTestCode(ic);
+        break;
+    case CONV_OL:
+        // Cell 7 converted by both ADCs, the second result lands in cell 8
+        ic.cv[6] = measure(ic.cellV[6]);
+        ic.cv[7] = measure(ic.cellV[6]);
+        break;
+    case CONV_AX:
+    case CONV_CVAX:
+        for (uint8_t g = 0; g < 6; g++) {
+            uint8_t chg = (kind == CONV_CVAX) ? ((g < 2) ? g + 1 : 0xFF) : arg;
+            if (chg != 0 && chg != g + 1) continue;
+            ic.aux[g] = measure((g < LTC6811_SIM_GPIOS) ? ic.gpioV[g] : SIM_REF2);
+        }
+        break;
+    case CONV_AXST:
+        for (uint8_t g = 0; g < 6; g++) ic.aux[g] = selfTestCode(ic);
+        break;
+    case CONV_STAT:
+    case CONV_CVSC:
+        if (kind == CONV_CVSC || arg == 0 || arg == 1) {
+            double sum = 0;
+            for (uint8_t c = 0; c < LTC6811_SIM_CELLS; c++) sum += ic.cellV[c];
+            ic.stat[0] = measure(sum/20.0);
+        }
+        if (kind == CONV_STAT && (arg == 0 || arg == 2)) {
+            ic.stat[1] = measure((ic.dieTemp + 273.0)*0.0075);
+            ic.statb5 &= (uint8_t)~0x01; // THSD
+        }
+        if (kind == CONV_STAT && (arg == 0 || arg == 3)) ic.stat[2] = measure(SIM_VA);
+        if (kind == CONV_STAT && (arg == 0 || arg == 4)) ic.stat[3] = measure(SIM_VD);
+        break;
+    case CONV_STATST:
+        for (uint8_t s = 0; s < 4; s++) ic.stat[s] = selfTestCode(ic);
+        break;
+    case CONV_DIAGN:
+        ic.statb5 &= (uint8_t)~0x02; // MUXFAIL
+        break;
+    }
+}
+
+/* Builds what the chain shifts out for a read command, nearest IC first */
+void LTC6811Sim::loadResponse() {
+    responseLen = 0;
+    for (uint8_t i = 0; i < totalIc; i++) {
+        if (!addressed(i)) continue;
+        uint8_t *out = &response[responseLen];
+        responseLen += 8;
+        if (i >= reached) {
+            memset(out, 0xFF, 8);
+            continue;
+        }
+        simIc &ic = ics[i];
+        switch (cmdCode) {
+        case CMD_RDCFGA: memcpy(out, ic.cfgr, 6); break;
+        case CMD_RDCVA: putCodes(out, &ic.cv[0]); break;
+        case CMD_RDCVB: putCodes(out, &ic.cv[3]); break;
+        case CMD_RDCVC: putCodes(out, &ic.cv[6]); break;
+        case CMD_RDCVD: putCodes(out, &ic.cv[9]); break;
+        case CMD_RDAUXA: putCodes(out, &ic.aux[0]); break;
+        case CMD_RDAUXB: putCodes(out, &ic.aux[3]); break;
+        case CMD_RDSTATA: putCodes(out, &ic.stat[0]); break;
+        case CMD_RDSTATB:
+            out[0] = (uint8_t)ic.stat[3];
+            out[1] = (uint8_t)(ic.stat[3] >> 8);
+            memcpy(&out[2], ic.flags, 3);
+            out[5] = ic.statb5;
+            break;
+        case CMD_RDSCTRL: memcpy(out, ic.sctrl, 6); break;
+        case CMD_RDPWM: memcpy(out, ic.pwm, 6); break;
+        case CMD_RDCOMM: memcpy(out, ic.comm, 6); break;
+        }
+        uint16_t pec = simPec(out, 6);
+        out[6] = (uint8_t)(pec >> 8);
+        out[7] = (uint8_t)pec;
+    }
+}
+
+/*
+Register data is shifted down the chain, so the last payload stays in the
+first IC and the first payload travels furthest. Each IC checks the PEC of
+its own payload and keeps its old register contents on a mismatch.
+*/
+void LTC6811Sim::applyWrite() {
+    uint8_t payloads = (uint8_t)(writeLen/8);
+    for (uint8_t p = 0; p < payloads; p++) {
+        uint8_t i = cmdAddressed ? cmdAddr : (uint8_t)(payloads - 1 - p);
+        if (i >= reached || (cmdAddressed && p > 0)) continue;
+        const uint8_t *data = &writeData[p*8];
+        uint16_t pec = simPec(data, 6);
+        if (data[6] != (uint8_t)(pec >> 8) || data[7] != (uint8_t)pec) {
+            _stats.dataPecErrors++;
+            continue;
+        }
+        simIc &ic = ics[i];
+        switch (cmdCode) {
+        case CMD_WRCFGA: memcpy(ic.cfgr, data, 6); break;
+        case CMD_WRSCTRL: memcpy(ic.sctrl, data, 6); break;
+        case CMD_WRPWM: memcpy(ic.pwm, data, 6); break;
+        case CMD_WRCOMM: memcpy(ic.comm, data, 6); break;
+        }
+    }
+}
+
+#endif // ARDUINO
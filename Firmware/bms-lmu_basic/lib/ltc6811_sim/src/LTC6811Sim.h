@@ -0,0 +1,208 @@
+/***************************************************************************
+    LTC6811Sim.h
+
+    INTRO
+    Register level model of a daisy chain of LTC6811-1 monitors for host
+    builds. attach() connects it to the SPI port of the Linux HAL port, so
+    the unmodified LTC681x driver and bms_hardware.cpp talk to it byte by
+    byte: commands and their PEC are decoded, the register groups are read
+    and written with per IC PEC, and conversions take their datasheet time
+    on a simulated clock that also drives hal_micros(), hal_millis() and the
+    delays.
+
+    The isoSPI ports go idle after tIDLE and the cores go to sleep after
+    tSLEEP without a valid command, losing their configuration, so missing
+    wake-ups show up the way they do on the bench. Measurement noise, bit
+    errors on the wire and open sense wires can be injected, and the cells
+    discharge while their DCC bit is set.
+
+    Compiles to nothing on the target (ARDUINO is defined there).
+
+****************************************************************************/
+#ifndef LTC6811_SIM_H
+#define LTC6811_SIM_H
+
+#ifndef ARDUINO
+
+#include <stdint.h>
+#include <random>
+#include "hal.h"
+
+#ifndef LTC6811_SIM_MAX_IC
+#define LTC6811_SIM_MAX_IC 16
+#endif
+#define LTC6811_SIM_CELLS 12
+#define LTC6811_SIM_GPIOS 5
+
+#define LTC6811_SIM_T_IDLE_US 4300    // isoSPI port READY -> IDLE, datasheet minimum
+#define LTC6811_SIM_T_SLEEP_US 1800000 // Watchdog timeout STANDBY -> SLEEP, datasheet minimum
+
+#ifndef LTC6811_SIM_CALL_NS
+#define LTC6811_SIM_CALL_NS 1000 // Simulated time each hal_micros()/hal_millis() call costs, keeps polling loops moving
+#endif
+
+struct ltcSimStats {
+    uint32_t frames;          // Chip select low to high transactions
+    uint32_t commands;        // Commands decoded with a good PEC
+    uint32_t cmdPecErrors;    // Commands dropped on a PEC mismatch
+    uint32_t dataPecErrors;   // Register writes an IC dropped on a PEC mismatch
+    uint32_t bitErrors;       // Bits flipped by the error injection
+    uint32_t lostFrames;      // Commands that did not reach every IC because a port was asleep
+    uint32_t wakeups;         // Ports or cores woken
+    uint32_t sleeps;          // Cores that timed out and lost their registers
+    uint32_t redundantWakes;  // Wake pulses sent while the whole chain was already awake
+    uint32_t conversions;     // ADC commands started
+    uint32_t busBytes;        // Bytes clocked on the SPI port
+};
+
+/**LTC6811Sim Contructor
+ *
+ * One IC at 3.7V per cell, no noise or errors, wake model enabled
+*/
+class LTC6811Sim {
+public:
+    LTC6811Sim();
+
+    /**reset()
+     * Power on the chain: registers at their reset values, cells at 3.7V,
+     * every port and core asleep, clock and stats kept
+    */
+    void reset(uint8_t _totalIc);
+
+    /**attach()
+     * Take over the clock and the SPI port of the Linux HAL port, with the
+     * chain selected by hal_pin_write() on csPin
+    */
+    void attach(uint32_t csPin = PA1);
+
+    /// Analog inputs, in volts and degrees C
+    void setCell(uint8_t ic, uint8_t cell, double volts);
+    void setAllCells(double volts);
+    void setGpio(uint8_t ic, uint8_t gpio, double volts);
+    void setDieTemp(uint8_t ic, double celsius);
+    double cell(uint8_t ic, uint8_t cell) const { return ics[ic].cellV[cell]; }
+
+    /**setOpenWire()
+     * Break sense wire C<wire> (0 to 12) of an IC, seen by ADOW only
+    */
+    void setOpenWire(uint8_t ic, uint8_t wire, bool open);
+
+    /// Gaussian noise added to every conversion, standard deviation in volts
+    void setNoise(double sigmaVolts) { noiseSigma = sigmaVolts; }
+
+    /// Probability of each bit on MOSI and MISO being flipped
+    void setBitErrorRate(double perBit) { bitErrorRate = perBit; }
+
+    void setSeed(uint32_t seed) { rng.seed(seed); }
+
+    /// Cell voltage lost per second while its DCC bit is set
+    void setDischargeRate(double voltsPerSecond) { dischargeRate = voltsPerSecond; }
+
+    /// SCK frequency, sets the time each byte takes on the simulated clock
+    void setSpiClock(uint32_t hz) { byteNs = 8000000000ULL / hz; }
+
+    /**setWakeModel()
+     * false treats every port and core as always awake, for tests that do
+     * not care about wake-ups
+    */
+    void setWakeModel(bool enabled) { wakeModel = enabled; }
+
+    /// Register contents as the driver would read them
+    const uint8_t *config(uint8_t ic) const { return ics[ic].cfgr; }
+    bool discharging(uint8_t ic, uint8_t cell) const;
+    bool converting() const;
+
+    /// Simulated clock, advanced by the bus, the delays and every micros() call
+    uint64_t nowNs() const { return clockNs; }
+    uint32_t micros() const { return (uint32_t)(clockNs / 1000); }
+    void advance(uint64_t ns);
+
+    const ltcSimStats &stats() const { return _stats; }
+    void resetStats();
+
+    /// SPI side, called through the HAL hooks installed by attach()
+    void select();
+    void deselect();
+    uint8_t transfer(uint8_t mosi);
+
+private:
+    enum convKind { CONV_NONE, CONV_CV, CONV_OW, CONV_CVST, CONV_OL, CONV_AX, CONV_AXST,
+                    CONV_STAT, CONV_STATST, CONV_CVAX, CONV_CVSC, CONV_DIAGN };
+
+    struct simIc {
+        uint8_t cfgr[6];
+        uint8_t sctrl[6];
+        uint8_t pwm[6];
+        uint8_t comm[6];
+        uint16_t cv[LTC6811_SIM_CELLS];
+        uint16_t aux[6];              // GPIO1-5, REF2
+        uint16_t stat[4];             // SC, ITMP, VA, VD
+        uint8_t flags[3];             // CxUV/CxOV
+        uint8_t statb5;               // REV, MUXFAIL, THSD
+
+        double cellV[LTC6811_SIM_CELLS];
+        double gpioV[LTC6811_SIM_GPIOS];
+        double dieTemp;
+        uint16_t openWires;           // Bit n: sense wire Cn open
+
+        uint64_t lastPortNs;          // Last transaction that reached the port
+        uint64_t lastCommandNs;       // Last valid command, feeds the watchdog
+        bool asleep;
+
+        // Conversion in progress
+        uint8_t convKind;
+        uint8_t convMd;
+        uint8_t convArg;
+        uint8_t convDcp;
+        uint64_t convEndNs;
+    };
+
+    void settle();
+    void wakeChain();
+    void powerOnReset(simIc &ic);
+    void decode();
+    void startConversion(uint8_t kind, uint8_t md, uint8_t arg, uint8_t dcp, uint8_t steps);
+    void finishConversion(simIc &ic);
+    void applyWrite();
+    void loadResponse();
+    uint16_t measure(double volts);
+    void measureCell(simIc &ic, uint8_t cell, double volts);
+    uint16_t selfTestCode(const simIc &ic) const;
+    uint8_t flipBits(uint8_t data);
+    bool addressed(uint8_t index) const { return !cmdAddressed || index == cmdAddr; }
+
+    simIc ics[LTC6811_SIM_MAX_IC];
+    uint8_t totalIc;
+
+    uint64_t clockNs;
+    uint64_t settledNs;
+    uint64_t byteNs;
+
+    // Current transaction
+    bool selected;
+    uint8_t reached;                  // ICs in front of the first sleeping port
+    uint16_t byteIndex;
+    uint8_t cmd[4];
+    bool cmdValid;
+    bool cmdAddressed;
+    uint8_t cmdAddr;
+    uint16_t cmdCode;
+    uint8_t writeData[LTC6811_SIM_MAX_IC*8];
+    uint16_t writeLen;
+    uint8_t response[LTC6811_SIM_MAX_IC*8];
+    uint16_t responseLen;
+
+    double noiseSigma;
+    double bitErrorRate;
+    double dischargeRate;
+    bool wakeModel;
+    std::mt19937 rng;
+
+    ltcSimStats _stats;
+};
+
+extern LTC6811Sim ltcSim;
+
+#endif // ARDUINO
+
+#endif
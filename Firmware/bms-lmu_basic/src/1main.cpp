@@ -4,6 +4,12 @@
 // #include <eXoCAN.h>
 // #include "TickerInterrupt.h"
 // #include "PBalancer.h"
+// #include "CanTelemetry.h"
+// #include "CanDispatcher.h"
+// #include "CanTxQueue.h"
+// #include "DeadbandReporter.h"
+// #include "IsoTp.h"
+// #include "Trace.h"
 
 // /******************************************************************************
 //  * BMS_LMU - HARDWARE REVISION 0
@@ -42,7 +48,26 @@
 // #define CAN_INTERVAL 800
 // #define CANBUS_FREQUENCY 250000
 
+// // Deadband reporting: poll every CAN_POLL_INTERVAL, send on change,
+// // fault or at least every CAN_REFRESH_INTERVAL. Comment out for fixed rate.
+// #define CAN_REPORT_DEADBAND
+// #define CAN_POLL_INTERVAL 100
+// #define CAN_REFRESH_INTERVAL 10000
+// #define CELL_DEADBAND 20 // 2mV
+// #define TEMPERATURE_DEADBAND 5 // 0.5C
+// #define CAN_DIAG_INTERVAL 1000 // diagnostics change rarely, kept off the fast poll
+
 // #define TX_ADDRESS 0x481
+// #define RX_BALANCE_ADDRESS 0x401
+// #define RX_CONFIG_ADDRESS 0x402
+// #define RX_TIME_SYNC_ADDRESS 0x403
+// #define DIAG_TX_ADDRESS 0x4F1
+// #define DIAG_RX_ADDRESS 0x4F0
+
+// // diagnostic requests, first byte of a single frame from the gateway
+// #define DIAG_REQUEST_IC_SNAPSHOT 0x01 // + IC index, answers with the whole cell_asic
+// #define DIAG_REQUEST_STACK 0x02
+// #define DIAG_REQUEST_TRACE 0x03 // answers with trace_encode(), + 1 to clear the probes after
 
 // // led pins
 // DigitalOut can_tx_led(CAN_TX_LED);
@@ -57,6 +82,15 @@
 
 // // Interfaces
 // eXoCAN can;
+// CanDispatcher can_rx_queue;
+
+// bool can_send(const canFrame &frame){
+//   return can.transmit(frame.id, frame.bytes, frame.len);
+// }
+// CanTxQueue can_tx_queue(can_send, CANBUS_FREQUENCY);
+// DeadbandReporter can_reporter(STACK_SIZE, STACK_TEMPERATURES, CELL_DEADBAND, TEMPERATURE_DEADBAND, CAN_REFRESH_INTERVAL);
+// IsoTp diag(can_tx_queue, DIAG_TX_ADDRESS, DIAG_RX_ADDRESS);
+// cell_asic bms_ic[TOTAL_IC];
 
 // // Timers
 // TickerInterrupt ticker(TIM2, 1);
@@ -68,31 +102,118 @@
 // };
 
 // static msg_frame	heart_frame {.len = 3},
-//                	bms_lower_bank {.len = 6}, 
-// 				        bms_upper_bank {.len = 6},
-//                	temperature {.len = 8};
+//                	temperature {.len = 2 + STACK_TEMPERATURES},
+//                	can_diagnostics {.len = 6};
+
+// // cell voltages go out packed on TX_ADDRESS + 1 onwards
+// CanTelemetry cell_telemetry(TX_ADDRESS + 1, STACK_SIZE);
+// canFrame cell_frames[CAN_TELEMETRY_MAX_FRAMES];
+// uint8_t cell_frame_count = 0;
 
 // uint8_t rxData[8];
 
-// void can_tx(){
-//   can.transmit(TX_ADDRESS, heart_frame.bytes, heart_frame.len);
-//   can.transmit(TX_ADDRESS + 1, bms_lower_bank.bytes, bms_lower_bank.len);
-//   can.transmit(TX_ADDRESS + 2, bms_upper_bank.bytes, bms_upper_bank.len);
-//   can.transmit(TX_ADDRESS + 3, temperature.bytes, temperature.len);
+// void queue_frame(uint32_t id, msg_frame &frame, canTxPriority priority){
+//   canFrame out;
+//   out.id = id;
+//   out.len = frame.len;
+//   memcpy(out.bytes, frame.bytes, frame.len);
+//   can_tx_queue.queue(out, priority);
+// }
 
-//   can_tx_led = !can_tx_led;
+// // heartbeat and diagnostic frames keep their own fixed rates in deadband mode
+// void heartbeat_tx(){
+//   queue_frame(TX_ADDRESS, heart_frame, CAN_TX_FAULT);
 // }
 
-// // Can receive interupt service routine
-// void canISR() {
-// 	can.rxMsgLen = can.receive(can.id, can.fltIdx, can.rxData.bytes);
+// void diagnostics_tx(){
+//   queue_frame(TX_ADDRESS + 2 + CAN_TELEMETRY_MAX_FRAMES, can_diagnostics, CAN_TX_DIAG);
+// }
+
+// // only queues the frames, can_tx_queue.service() feeds the mailboxes from loop()
+// void can_tx(){
+// #ifdef CAN_REPORT_DEADBAND
+//   uint8_t groups = can_reporter.poll(stack.cell_voltages(), stack.temperatures(), heartbeat.fault_code(), millis());
+// #else
+//   uint8_t groups = REPORT_HEARTBEAT | REPORT_CELLS | REPORT_TEMPERATURES;
+// #endif
+//   if (groups & REPORT_HEARTBEAT){
+//     queue_frame(TX_ADDRESS, heart_frame, CAN_TX_FAULT);
+//   }
+//   if (groups & REPORT_CELLS){
+//     for (int i = 0; i < cell_frame_count; i++){
+//       can_tx_queue.queue(cell_frames[i], CAN_TX_CELL);
+//     }
+//   }
+//   if (groups & REPORT_TEMPERATURES){
+//     queue_frame(TX_ADDRESS + 1 + CAN_TELEMETRY_MAX_FRAMES, temperature, CAN_TX_CELL);
+//   }
+// #ifndef CAN_REPORT_DEADBAND
+//   diagnostics_tx();
+// #endif
 // }
 
+// // Can receive interupt service routine, only queues the frame
+// void canISR() {
+//   int id, fltIdx;
+//   canFrame frame;
+//   int len = can.receive(id, fltIdx, frame.bytes);
+//   if (len > -1) {
+//     frame.id = id;
+//     frame.len = len;
+//     can_rx_queue.push(frame);
+//   }
+// }
 
 // void can_rx() {
-// 	if (can.rxMsgLen > -1) {
+//   if (can_rx_queue.dispatch() > 0) {
 //     can_rx_led = !can_rx_led;
-// 	}
+//   }
+// }
+
+// // CAN command handlers, run from can_rx() in the main loop
+// void balance_command(const canFrame &frame){
+//   if (frame.len >= 1) {
+//     heartbeat.state(frame.bytes[0] ? PASSIVE_BALANCING : IDLE);
+//   }
+// }
+
+// uint16_t discharge_timer_limit = DISCHARGE_TIMER_LIMIT;
+// void config_update(const canFrame &frame){
+//   if (frame.len >= 2) {
+//     discharge_timer_limit = frame.bytes[0] | (frame.bytes[1] << 8);
+//   }
+// }
+
+// void diag_rx(const canFrame &frame){
+//   diag.receive(frame);
+// }
+
+// void diag_request(const uint8_t *data, uint8_t len){
+//   switch (data[0]) {
+//     case DIAG_REQUEST_IC_SNAPSHOT:
+//       if (len >= 2 && data[1] < TOTAL_IC) {
+//         diag.send((const uint8_t *)&bms_ic[data[1]], sizeof(cell_asic));
+//       }
+//       break;
+//     case DIAG_REQUEST_STACK:
+//       diag.send((const uint8_t *)stack.cell_voltages(), STACK_SIZE*sizeof(uint16_t));
+//       break;
+//     case DIAG_REQUEST_TRACE: {
+//       uint8_t trace[TRACE_ENCODED_LEN];
+//       if (diag.send(trace, trace_encode(trace, sizeof(trace))) && len >= 2 && data[1]) {
+//         trace_reset();
+//       }
+//       break;
+//     }
+//   }
+// }
+
+// uint32_t time_offset = 0;
+// void time_sync(const canFrame &frame){
+//   if (frame.len >= 4) {
+//     uint32_t cmu_time = frame.bytes[0] | (frame.bytes[1] << 8) | (frame.bytes[2] << 16) | ((uint32_t)frame.bytes[3] << 24);
+//     time_offset = cmu_time - millis();
+//   }
 // }
 
 // uint8_t array_to_uint8(bool arr[], int count){
@@ -106,11 +227,12 @@
 // }
 
 // uint16_t check_errors(){
+//   TRACE_SCOPE(TRACE_FAULT_CHECK);
 //   bool error_code[8];
 
 // 	error_code[ERROR_OV_FAULT] = stack.ov_fault();
 // 	error_code[ERROR_UV_FAULT] = stack.uv_fault();
-// 	// error_code[ERROR_OT_FAULT] = !imd.get_IMD_ok();
+// 	error_code[ERROR_OT_FAULT] = stack.ot_fault();
 // 	error_code[ERROR_RELAY_FAULT] = heartbeat.relay_fault();
 	
 // 	// error_code[ERROR_ORION_LOW_VOTLAGE] 	= orion.check_low_voltage();
@@ -121,24 +243,40 @@
 // 	return array_to_uint8(error_code, 8);
 // }
 
-// void update_can_frames(){
-//   heart_frame.bytes[0] = heartbeat.state();
-//   heart_frame.bytes[0] = heartbeat.counter();
-//   heart_frame.bytes[1] = heartbeat.fault_code();
-
-//   for (int i = 0; i < 6; i++){
-//     bms_lower_bank.bytes[i] = stack.cell_voltage(i);
+// // GPIO1-5 thermistors of the first IC, against VREF2 (aux code 5)
+// void update_temperatures(){
+//   for (int i = 0; i < STACK_TEMPERATURES; i++){
+//     stack.update_temperature(i, thermistor_temperature(bms_ic[0].aux.a_codes[i], bms_ic[0].aux.a_codes[5]));
 //   }
+// }
 
-//   for (int i = 6; i < 12; i++){
-//     bms_upper_bank.bytes[i] = stack.cell_voltage(i);
+// void update_can_frames(){
+//   heart_frame.bytes[0] = heartbeat.state();
+//   heart_frame.bytes[1] = heartbeat.counter();
+//   heart_frame.bytes[2] = heartbeat.fault_code();
+
+//   cell_frame_count = cell_telemetry.encode(stack.cell_voltages(), stack.min(), stack.max(), cell_frames);
+
+//   const canRxStats &rx = can_rx_queue.stats();
+//   can_diagnostics.bytes[0] = rx.dropped;
+//   can_diagnostics.bytes[1] = rx.dropped >> 8;
+//   can_diagnostics.bytes[2] = rx.unhandled;
+//   can_diagnostics.bytes[3] = rx.unhandled >> 8;
+//   can_diagnostics.bytes[4] = can_rx_queue.depth();
+//   can_diagnostics.bytes[5] = rx.highWater;
+
+//   // hottest sensor in 0.1C, then every sensor in whole degrees
+//   int16_t hottest = stack.max_temperature().decidegrees;
+//   temperature.bytes[0] = hottest;
+//   temperature.bytes[1] = hottest >> 8;
+//   for (int i = 0; i < STACK_TEMPERATURES; i++){
+//     temperature.bytes[2 + i] = Temperature::from_decidegrees(stack.temperatures()[i]).celsius();
 //   }
-
-//   // add in the temp measurement thing.
 // }
 
 // void state_d(){
 
+//   update_temperatures();
 //   update_can_frames();
 //   heartbeat.fault_code(check_error());
 
@@ -213,15 +351,28 @@
 //   can.begin(STD_ID_LEN, CANBUS_FREQUENCY, PORTA_11_12_WIRE_PULLUP);   //11 Bit Id, 500Kbps
 //   // can.filterMask16Init(0, 0x600, 0x7ff);
 //   can.attachInterrupt(canISR);
+//   can_rx_queue.on(RX_BALANCE_ADDRESS, 0x7FF, balance_command);
+//   can_rx_queue.on(RX_CONFIG_ADDRESS, 0x7FF, config_update);
+//   can_rx_queue.on(RX_TIME_SYNC_ADDRESS, 0x7FF, time_sync);
+//   can_rx_queue.on(DIAG_RX_ADDRESS, 0x7FF, diag_rx);
+//   diag.onRequest(diag_request);
+//   trace_init();
   
 //   // setup heartbeat tickers.
 //   ticker.start();
-//   ticker.attach(heartbeat_cb, HEART_RATE);
+//   ticker.setTickless(true);
+//   ticker.attach(heartbeat_cb, HEART_RATE, TICKER_PRIORITY_HIGH);
 
 //   // start up the pbalancer
 //   passive_balancer.setup();
 
-//   ticker.attach(can_tx, CAN_INTERVAL);
+// #ifdef CAN_REPORT_DEADBAND
+//   ticker.attach(can_tx, CAN_POLL_INTERVAL, TICKER_PRIORITY_NORMAL);
+//   ticker.attach(heartbeat_tx, HEART_RATE, TICKER_PRIORITY_HIGH, 0, CAN_POLL_INTERVAL/2);
+//   ticker.attach(diagnostics_tx, CAN_DIAG_INTERVAL, TICKER_PRIORITY_LOW);
+// #else
+//   ticker.attach(can_tx, CAN_INTERVAL, TICKER_PRIORITY_NORMAL);
+// #endif
 
 //   // finished boot, flash the lights to confirm startup!
 //   start_up_lights();
@@ -244,6 +395,15 @@
 
 // void loop() {
 
+//     // run any ticker callbacks released since the last pass
+//     while (ticker.dispatch());
+//     can_rx();
+//     diag.service();
+//     if (can_tx_queue.service() > 0) {
+//       can_tx_led = !can_tx_led;
+//     }
+//     ticker.idle();
+
 //     temp_sensor_ss = 0;
 //     active_balance_upper_ss = 1;
 //     active_balance_lower_ss = 1;
@@ -0,0 +1,68 @@
+/***************************************************************************
+    CanDispatcher.cpp
+
+    INTRO
+    CAN RX ring and ID dispatch table.
+    See CanDispatcher.h
+
+****************************************************************************/
+#include <CanDispatcher.h>
+
+CanDispatcher::CanDispatcher() {
+    head = 0;
+    tail = 0;
+    handlerCount = 0;
+    _stats = canRxStats();
+}
+
+bool CanDispatcher::push(const canFrame &frame) {
+    uint8_t pos = head;
+    _stats.received++;
+    if ((uint8_t)(pos - tail) == CAN_RX_QUEUE_SIZE) {
+        _stats.dropped++;
+        return false;
+    }
+    ring[pos & (CAN_RX_QUEUE_SIZE-1)] = frame;
+    head = pos + 1;
+
+    uint8_t queued = depth();
+    if (queued > _stats.highWater) {
+        _stats.highWater = queued;
+    }
+    return true;
+}
+
+bool CanDispatcher::on(uint32_t _id, uint32_t _mask, canHandler _handler) {
+    if (handlerCount >= CAN_MAX_HANDLERS) {
+        return false;
+    }
+    handlers[handlerCount].id = _id & _mask;
+    handlers[handlerCount].mask = _mask;
+    handlers[handlerCount].handler = _handler;
+    handlerCount++;
+    return true;
+}
+
+uint8_t CanDispatcher::dispatch(uint8_t maxFrames) {
+    uint8_t handled = 0;
+    while (tail != head && handled < maxFrames) {
+        // Handled in place, the slot is only released to the ISR afterwards
+        const canFrame &frame = ring[tail & (CAN_RX_QUEUE_SIZE-1)];
+        uint8_t h = 0;
+        while (h < handlerCount && (frame.id & handlers[h].mask) != handlers[h].id) {
+            h++;
+        }
+        if (h < handlerCount) {
+            handlers[h].handler(frame);
+        } else {
+            _stats.unhandled++;
+        }
+        tail = tail + 1;
+        handled++;
+    }
+    return handled;
+}
+
+void CanDispatcher::resetStats() {
+    _stats = canRxStats();
+}
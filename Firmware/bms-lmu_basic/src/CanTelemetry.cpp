@@ -0,0 +1,151 @@
+/***************************************************************************
+    CanTelemetry.cpp
+
+    INTRO
+    Packed cell voltage telemetry for CAN.
+    See CanTelemetry.h
+
+****************************************************************************/
+#include <string.h>
+#include <CanTelemetry.h>
+
+CanTelemetry::CanTelemetry(uint32_t _baseId, uint8_t _cells) {
+    baseId = _baseId;
+    cells = (_cells < CAN_TELEMETRY_MAX_CELLS) ? _cells : CAN_TELEMETRY_MAX_CELLS;
+    txSeq = 0;
+    rxSeq = 0;
+    rxMask = 0;
+    _stats = telemetryStats();
+}
+
+/* Payload bit pos lives in frame pos/60, after that frame's sequence nibble */
+void CanTelemetry::putBits(uint8_t *buffer, uint16_t pos, uint32_t value, uint8_t bits) {
+    while (bits--) {
+        uint16_t offset = (pos / CAN_TELEMETRY_FRAME_BITS)*64 + 4 + pos % CAN_TELEMETRY_FRAME_BITS;
+        uint8_t mask = 0x80 >> (offset & 7);
+        if ((value >> bits) & 1) {
+            buffer[offset >> 3] |= mask;
+        } else {
+            buffer[offset >> 3] &= ~mask;
+        }
+        pos++;
+    }
+}
+
+uint32_t CanTelemetry::getBits(const uint8_t *buffer, uint16_t pos, uint8_t bits) {
+    uint32_t value = 0;
+    while (bits--) {
+        uint16_t offset = (pos / CAN_TELEMETRY_FRAME_BITS)*64 + 4 + pos % CAN_TELEMETRY_FRAME_BITS;
+        value = (value << 1) | ((buffer[offset >> 3] >> (7 - (offset & 7))) & 1);
+        pos++;
+    }
+    return value;
+}
+
+uint8_t CanTelemetry::crc8(uint8_t seq, const uint16_t *codes, uint8_t cells) {
+    uint8_t crc = 0;
+    for (int i = -1; i < 2*cells; i++) {
+        uint8_t data = (i < 0) ? seq : (uint8_t)(codes[i >> 1] >> (8*(i & 1)));
+        crc ^= data;
+        for (uint8_t b = 0; b < 8; b++) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+uint8_t CanTelemetry::encode(const uint16_t *codes, canFrame *frames) {
+    uint16_t minCode = 0xFFFF;
+    uint16_t maxCode = 0;
+    for (uint8_t i = 0; i < cells; i++) {
+        if (codes[i] < minCode) {
+            minCode = codes[i];
+        }
+        if (codes[i] > maxCode) {
+            maxCode = codes[i];
+        }
+    }
+    return encode(codes, minCode, maxCode, frames);
+}
+
+uint8_t CanTelemetry::encode(const uint16_t *codes, uint16_t minCode, uint16_t maxCode, canFrame *frames) {
+    uint8_t width = 0;
+    for (uint16_t spread = maxCode - minCode; spread != 0; spread >>= 1) {
+        width++;
+    }
+
+    uint8_t buffer[CAN_TELEMETRY_MAX_FRAMES*8] = {0};
+    uint16_t pos = 0;
+    putBits(buffer, pos, minCode, 16);
+    pos += 16;
+    putBits(buffer, pos, width, 5);
+    pos += 5;
+    for (uint8_t i = 0; i < cells; i++) {
+        putBits(buffer, pos, (uint16_t)(codes[i] - minCode), width);
+        pos += width;
+    }
+    putBits(buffer, pos, crc8(txSeq, codes, cells), CAN_TELEMETRY_CRC_BITS);
+    pos += CAN_TELEMETRY_CRC_BITS;
+
+    uint8_t frameCount = canTelemetryFrames(cells, width);
+    for (uint8_t f = 0; f < frameCount; f++) {
+        uint16_t bits = (f + 1 < frameCount) ? CAN_TELEMETRY_FRAME_BITS : pos - f*CAN_TELEMETRY_FRAME_BITS;
+        frames[f].id = baseId + f;
+        frames[f].len = (uint8_t)((4 + bits + 7) / 8);
+        memcpy(frames[f].bytes, &buffer[f*8], 8);
+        frames[f].bytes[0] = (uint8_t)((txSeq << 4) | (frames[f].bytes[0] & 0x0F));
+    }
+
+    txSeq = (txSeq + 1) & 0x0F;
+    _stats.updatesSent++;
+    _stats.framesSent += frameCount;
+    return frameCount;
+}
+
+bool CanTelemetry::decode(const canFrame &frame, uint16_t *codes) {
+    uint32_t index = frame.id - baseId;
+    if (index >= CAN_TELEMETRY_MAX_FRAMES || frame.len == 0) {
+        return false;
+    }
+
+    uint8_t seq = frame.bytes[0] >> 4;
+    if (rxMask != 0 && seq != rxSeq) {
+        _stats.incomplete++;
+        rxMask = 0;
+    }
+    rxSeq = seq;
+    memcpy(&rxBytes[index*8], frame.bytes, (frame.len < 8) ? frame.len : 8);
+    rxMask |= 1 << index;
+
+    // Frame 0 carries the width, which fixes how many frames make the update
+    if ((rxMask & 1) == 0) {
+        return false;
+    }
+    uint8_t width = (uint8_t)getBits(rxBytes, 16, 5);
+    if (width > 16) {
+        rxMask = 0;
+        _stats.crcErrors++;
+        return false;
+    }
+    uint8_t frameCount = canTelemetryFrames(cells, width);
+    if (rxMask != (uint16_t)((1 << frameCount) - 1)) {
+        return false;
+    }
+    rxMask = 0;
+
+    uint16_t decoded[CAN_TELEMETRY_MAX_CELLS];
+    uint16_t minCode = (uint16_t)getBits(rxBytes, 0, 16);
+    uint16_t pos = CAN_TELEMETRY_HEADER_BITS;
+    for (uint8_t i = 0; i < cells; i++) {
+        decoded[i] = (uint16_t)(minCode + getBits(rxBytes, pos, width));
+        pos += width;
+    }
+    if (getBits(rxBytes, pos, CAN_TELEMETRY_CRC_BITS) != crc8(seq, decoded, cells)) {
+        _stats.crcErrors++;
+        return false;
+    }
+
+    memcpy(codes, decoded, cells*sizeof(uint16_t));
+    _stats.updatesReceived++;
+    return true;
+}
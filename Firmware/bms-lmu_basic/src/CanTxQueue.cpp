@@ -0,0 +1,167 @@
+/***************************************************************************
+    CanTxQueue.cpp
+
+    INTRO
+    Prioritised CAN transmit queue.
+    See CanTxQueue.h
+
+****************************************************************************/
+#include <CanTxQueue.h>
+
+CanTxQueue::CanTxQueue(canTransmitFn _transmit, uint32_t _bitrate) {
+    transmit = _transmit;
+    bitrate = _bitrate;
+    for (int i = 0; i < CAN_TX_QUEUE_SIZE; i++) {
+        entries[i].inUse = false;
+    }
+    count = 0;
+    nextOrder = 0;
+    resetStats();
+}
+
+#if defined(STM32F1xx)
+/* bxCAN sets TMEx while mailbox x is empty */
+uint8_t CanTxQueue::freeMailboxes() {
+    uint32_t tsr = CAN1->TSR;
+    return ((tsr & CAN_TSR_TME0) ? 1 : 0) + ((tsr & CAN_TSR_TME1) ? 1 : 0) + ((tsr & CAN_TSR_TME2) ? 1 : 0);
+}
+#else
+uint8_t CanTxQueue::freeMailboxes() {
+    return CAN_TX_MAILBOXES;
+}
+#endif
+
+bool CanTxQueue::queue(const canFrame &frame, canTxPriority priority, bool coalesce) {
+    return insert(frame, priority, coalesce, false) >= 0;
+}
+
+bool CanTxQueue::queuePinned(const canFrame &frame, canTxPriority priority, uint32_t &ticket) {
+    int8_t slot = insert(frame, priority, false, true);
+    if (slot < 0) {
+        return false;
+    }
+    ticket = entries[slot].order;
+    return true;
+}
+
+bool CanTxQueue::pending(uint32_t ticket) const {
+    for (int8_t i = 0; i < CAN_TX_QUEUE_SIZE; i++) {
+        const txEntry &e = entries[i];
+        if (e.inUse && e.pinned && e.order == ticket) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Returns the slot the frame went to, -1 if it was dropped */
+int8_t CanTxQueue::insert(const canFrame &frame, canTxPriority priority, bool coalesce, bool pinned) {
+    if (priority >= CAN_TX_PRIORITY_COUNT) {
+        priority = CAN_TX_DIAG;
+    }
+
+    int8_t freeSlot = -1;
+    int8_t evict = -1;
+    for (int8_t i = 0; i < CAN_TX_QUEUE_SIZE; i++) {
+        txEntry &e = entries[i];
+        if (!e.inUse) {
+            if (freeSlot < 0) {
+                freeSlot = i;
+            }
+        } else if (coalesce && !e.pinned && e.frame.id == frame.id) {
+            // Keeps its place and queue time, only the payload is newer. A
+            // more urgent copy lifts the queued one to its priority
+            e.frame = frame;
+            if (priority < e.priority) {
+                e.priority = priority;
+            }
+            _stats.queued++;
+            _stats.coalesced++;
+            return i;
+        } else if (!e.pinned && e.priority > priority &&
+                   (evict < 0 || e.priority > entries[evict].priority ||
+                    (e.priority == entries[evict].priority && (int32_t)(e.order - entries[evict].order) > 0))) {
+            evict = i;
+        }
+    }
+
+    if (freeSlot < 0) {
+        // Full, make room by dropping the newest frame of the lowest priority below this one
+        _stats.dropped++;
+        if (evict < 0) {
+            return -1;
+        }
+        freeSlot = evict;
+        count--;
+    }
+
+    txEntry &e = entries[freeSlot];
+    e.frame = frame;
+    e.priority = priority;
+    e.order = nextOrder++;
+    e.queuedAt = hal_micros();
+    e.inUse = true;
+    e.pinned = pinned;
+    count++;
+    _stats.queued++;
+    return freeSlot;
+}
+
+int8_t CanTxQueue::next() const {
+    int8_t best = -1;
+    for (int8_t i = 0; i < CAN_TX_QUEUE_SIZE; i++) {
+        const txEntry &e = entries[i];
+        if (e.inUse && (best < 0 || e.priority < entries[best].priority ||
+                        (e.priority == entries[best].priority && (int32_t)(e.order - entries[best].order) < 0))) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+uint8_t CanTxQueue::service() {
+    uint8_t sent = 0;
+    uint8_t mailboxes = freeMailboxes();
+
+    while (mailboxes > 0 && count > 0) {
+        int8_t i = next();
+        txEntry &e = entries[i];
+        if (!transmit(e.frame)) {
+            break;
+        }
+
+        uint32_t latency = hal_micros() - e.queuedAt;
+        if (latency > _stats.latencyMax[e.priority]) {
+            _stats.latencyMax[e.priority] = latency;
+        }
+        latencySum[e.priority] += latency;
+        latencyCount[e.priority]++;
+        _stats.latencyMean[e.priority] = (uint32_t)(latencySum[e.priority] / latencyCount[e.priority]);
+
+        // Standard ID data frame without stuff bits: 47 bits of framing plus the data
+        _stats.busBits += 47 + 8*e.frame.len;
+        _stats.sent++;
+
+        e.inUse = false;
+        count--;
+        mailboxes--;
+        sent++;
+    }
+    return sent;
+}
+
+const canTxStats &CanTxQueue::stats() {
+    uint32_t elapsed = hal_micros() - statsSince;
+    uint64_t available = (uint64_t)bitrate*elapsed / 1000000;
+    _stats.busLoad = available ? (uint16_t)((uint64_t)_stats.busBits*1000 / available) : 0;
+    return _stats;
+}
+
+void CanTxQueue::resetStats() {
+    _stats = canTxStats();
+    for (int p = 0; p < CAN_TX_PRIORITY_COUNT; p++) {
+        latencySum[p] = 0;
+        latencyCount[p] = 0;
+    }
+    statsSince = hal_micros();
+}
@@ -0,0 +1,120 @@
+/*
+Datalog.cpp
+
+Binary data-log stream for the serial port, see Datalog.h
+*/
+
+#include <Arduino.h>
+#include <stdint.h>
+#include "Datalog.h"
+
+static uint8_t datalog_seq = 0;
+static uint32_t datalog_drops = 0;
+
+static uint8_t datalog_crc8(const uint8_t *data, uint16_t len)
+{
+  uint8_t crc = 0;
+  for (uint16_t i = 0; i < len; i++)
+  {
+    crc ^= data[i];
+    for (uint8_t b = 0; b < 8; b++)
+    {
+      crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+// COBS encode, each 0x00 is replaced by the distance to the next one
+uint16_t cobs_encode(const uint8_t *data, uint16_t len, uint8_t *out)
+{
+  uint16_t code_index = 0;
+  uint16_t out_index = 1;
+  uint8_t code = 1;
+
+  for (uint16_t i = 0; i < len; i++)
+  {
+    if (data[i] != 0)
+    {
+      out[out_index++] = data[i];
+      code++;
+    }
+    if (data[i] == 0 || code == 0xFF)
+    {
+      out[code_index] = code;
+      code_index = out_index++;
+      code = 1;
+    }
+  }
+  out[code_index] = code;
+  out[out_index++] = 0x00; // frame delimiter
+  return out_index;
+}
+
+bool datalog_record(uint8_t type, uint8_t ic, const uint8_t *payload, uint8_t len)
+{
+  uint8_t record[DATALOG_MAX_RECORD];
+  uint8_t frame[DATALOG_MAX_FRAME];
+  uint32_t now = micros();
+
+  if (len > DATALOG_MAX_PAYLOAD) len = DATALOG_MAX_PAYLOAD;
+
+  record[0] = type;
+  record[1] = ic;
+  record[2] = datalog_seq;
+  record[3] = (uint8_t)now;
+  record[4] = (uint8_t)(now >> 8);
+  record[5] = (uint8_t)(now >> 16);
+  record[6] = (uint8_t)(now >> 24);
+  for (uint8_t i = 0; i < len; i++)
+  {
+    record[DATALOG_HEADER_LEN + i] = payload[i];
+  }
+  record[DATALOG_HEADER_LEN + len] = datalog_crc8(record, DATALOG_HEADER_LEN + len);
+
+  uint16_t frame_len = cobs_encode(record, DATALOG_HEADER_LEN + len + 1, frame);
+  datalog_seq++;
+  if (Serial.availableForWrite() < (int)frame_len)
+  {
+    datalog_drops++;
+    return false;
+  }
+  Serial.write(frame, frame_len);
+  return true;
+}
+
+bool datalog_codes(uint8_t type, uint8_t ic, const uint16_t *codes, uint8_t count)
+{
+  uint8_t payload[DATALOG_MAX_PAYLOAD];
+  if (count > DATALOG_MAX_PAYLOAD/2) count = DATALOG_MAX_PAYLOAD/2;
+  for (uint8_t i = 0; i < count; i++)
+  {
+    payload[2*i] = (uint8_t)codes[i];
+    payload[2*i+1] = (uint8_t)(codes[i] >> 8);
+  }
+  return datalog_record(type, ic, payload, 2*count);
+}
+
+bool datalog_fits(uint8_t len)
+{
+  if (len > DATALOG_MAX_PAYLOAD) len = DATALOG_MAX_PAYLOAD;
+  return Serial.availableForWrite() >= (int)DATALOG_FRAME_LEN(len);
+}
+
+void datalog_skip()
+{
+  datalog_seq++;
+  datalog_drops++;
+}
+
+void datalog_start()
+{
+  datalog_seq = 0;
+  datalog_drops = 0;
+  Serial.write((uint8_t)0x00);
+}
+
+uint32_t datalog_dropped()
+{
+  return datalog_drops;
+}
@@ -0,0 +1,79 @@
+/***************************************************************************
+    DeadbandReporter.cpp
+
+    INTRO
+    Deadband and forced refresh CAN reporting.
+    See DeadbandReporter.h
+
+****************************************************************************/
+#include <string.h>
+#include <DeadbandReporter.h>
+
+DeadbandReporter::DeadbandReporter(uint8_t _cells, uint8_t _temperatures, uint16_t _cellDeadband,
+                                   uint16_t _tempDeadband, uint32_t _refresh) {
+    cells = (_cells < REPORT_MAX_CELLS) ? _cells : REPORT_MAX_CELLS;
+    temperatures = (_temperatures < REPORT_MAX_TEMPERATURES) ? _temperatures : REPORT_MAX_TEMPERATURES;
+    cellDeadband = _cellDeadband;
+    tempDeadband = _tempDeadband;
+    refresh = _refresh;
+    primed = false;
+    lastFault = 0;
+    lastCellReport = 0;
+    lastTempReport = 0;
+    _stats = reportStats();
+}
+
+uint8_t DeadbandReporter::poll(const uint16_t *cellCodes, const int16_t *temps, uint8_t faultCode, uint32_t now) {
+    uint8_t groups = REPORT_NONE;
+    _stats.polls++;
+
+    if (!primed || faultCode != lastFault) {
+        // Fault bits go out at once, with the data that explains them
+        if (primed) {
+            _stats.faultReports++;
+        }
+        groups = REPORT_HEARTBEAT | REPORT_CELLS | REPORT_TEMPERATURES;
+    } else {
+        for (uint8_t i = 0; i < cells; i++) {
+            int32_t moved = (int32_t)cellCodes[i] - reportedCells[i];
+            if (moved > cellDeadband || -moved > cellDeadband) {
+                groups |= REPORT_CELLS;
+                break;
+            }
+        }
+        if (!(groups & REPORT_CELLS) && now - lastCellReport >= refresh) {
+            groups |= REPORT_CELLS;
+            _stats.refreshes++;
+        }
+
+        if (temps != NULL) {
+            for (uint8_t i = 0; i < temperatures; i++) {
+                int32_t moved = (int32_t)temps[i] - reportedTemps[i];
+                if (moved > tempDeadband || -moved > tempDeadband) {
+                    groups |= REPORT_TEMPERATURES;
+                    break;
+                }
+            }
+            if (!(groups & REPORT_TEMPERATURES) && now - lastTempReport >= refresh) {
+                groups |= REPORT_TEMPERATURES;
+                _stats.refreshes++;
+            }
+        }
+    }
+
+    if (groups & REPORT_CELLS) {
+        memcpy(reportedCells, cellCodes, cells*sizeof(uint16_t));
+        lastCellReport = now;
+        _stats.cellReports++;
+    }
+    if (temps == NULL) {
+        groups &= ~REPORT_TEMPERATURES;
+    } else if (groups & REPORT_TEMPERATURES) {
+        memcpy(reportedTemps, temps, temperatures*sizeof(int16_t));
+        lastTempReport = now;
+        _stats.temperatureReports++;
+    }
+    lastFault = faultCode;
+    primed = true;
+    return groups;
+}
@@ -0,0 +1,196 @@
+/***************************************************************************
+    IsoTp.cpp
+
+    INTRO
+    ISO 15765-2 style segmented transfer over CAN.
+    See IsoTp.h
+
+****************************************************************************/
+#include <string.h>
+#include <IsoTp.h>
+
+IsoTp::IsoTp(CanTxQueue &_tx, uint32_t _txId, uint32_t _rxId) : tx(_tx) {
+    txId = _txId;
+    rxId = _rxId;
+    handler = NULL;
+    state = ISOTP_IDLE;
+    length = 0;
+    offset = 0;
+    sequence = 0;
+    blockSize = 0;
+    blockLeft = 0;
+    separation = 0;
+    lastFrame = 0;
+    ticket = 0;
+    inFlight = false;
+    waitStart = 0;
+    _stats = isoTpStats();
+}
+
+/* STmin 0x00-0x7F is ms, 0xF1-0xF9 is 100-900us, anything else is reserved
+   and read as the longest time */
+uint32_t IsoTp::separationTime(uint8_t stMin) {
+    if (stMin <= 0x7F) {
+        return (uint32_t)stMin*1000;
+    }
+    if (stMin >= 0xF1 && stMin <= 0xF9) {
+        return (uint32_t)(stMin - 0xF0)*100;
+    }
+    return 127000;
+}
+
+bool IsoTp::queueFrame(const uint8_t *bytes, uint8_t len, bool segment) {
+    canFrame frame;
+    frame.id = txId;
+    frame.len = len;
+    memcpy(frame.bytes, bytes, len);
+    if (segment) {
+        // Pinned, the receiver can not recover a lost segment
+        if (!tx.queuePinned(frame, CAN_TX_DIAG, ticket)) {
+            return false;
+        }
+        inFlight = true;
+        waitStart = hal_millis();
+    } else if (!tx.queue(frame, CAN_TX_DIAG, false)) { // Shares the ID with the segments, must not coalesce
+        return false;
+    }
+    _stats.framesSent++;
+    return true;
+}
+
+bool IsoTp::send(const uint8_t *data, uint16_t len) {
+    if (state != ISOTP_IDLE || len > ISOTP_BUFFER_SIZE) {
+        return false;
+    }
+    uint8_t bytes[8];
+
+    if (len <= ISOTP_SF_MAX) {
+        bytes[0] = (ISOTP_SINGLE << 4) | len;
+        memcpy(&bytes[1], data, len);
+        if (queueFrame(bytes, 1 + len)) {
+            _stats.transfers++;
+            _stats.completed++;
+            return true;
+        }
+        return false;
+    }
+
+    memcpy(buffer, data, len);
+    length = len;
+    bytes[0] = (ISOTP_FIRST << 4) | (len >> 8);
+    bytes[1] = len & 0xFF;
+    memcpy(&bytes[2], buffer, ISOTP_FF_DATA);
+    if (!queueFrame(bytes, 8, true)) {
+        return false;
+    }
+    _stats.transfers++;
+    offset = ISOTP_FF_DATA;
+    sequence = 1;
+    state = ISOTP_WAIT_FC;
+    return true;
+}
+
+void IsoTp::receive(const canFrame &frame) {
+    if (frame.id != rxId || frame.len == 0) {
+        return;
+    }
+
+    switch (frame.bytes[0] >> 4) {
+    case ISOTP_FLOW_CONTROL:
+        if (state != ISOTP_WAIT_FC || frame.len < 3) {
+            break;
+        }
+        switch (frame.bytes[0] & 0x0F) {
+        case ISOTP_FC_CTS:
+            blockSize = frame.bytes[1];
+            blockLeft = blockSize;
+            separation = separationTime(frame.bytes[2]);
+            lastFrame = hal_micros() - separation;
+            inFlight = false; // The receiver has the last segment
+            state = ISOTP_SENDING;
+            break;
+        case ISOTP_FC_WAIT:
+            waitStart = hal_millis();
+            break;
+        default:
+            state = ISOTP_IDLE;
+            _stats.aborted++;
+            break;
+        }
+        break;
+
+    case ISOTP_SINGLE: {
+        uint8_t len = frame.bytes[0] & 0x0F;
+        if (len >= 1 && len < frame.len && handler != NULL) {
+            _stats.requests++;
+            handler(&frame.bytes[1], len);
+        }
+        break;
+    }
+
+    case ISOTP_FIRST: {
+        // Only single frame requests are taken
+        uint8_t bytes[3] = {(ISOTP_FLOW_CONTROL << 4) | ISOTP_FC_OVERFLOW, 0, 0};
+        queueFrame(bytes, 3);
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+void IsoTp::service() {
+    if (inFlight) {
+        if (tx.pending(ticket)) {
+            // A segment that can not get onto the bus times out from queueing
+            if (state != ISOTP_IDLE && hal_millis() - waitStart > ISOTP_TIMEOUT_MS) {
+                inFlight = false;
+                state = ISOTP_IDLE;
+                _stats.timeouts++;
+            }
+            return;
+        }
+        // STmin and the flow control timeout run from the segment leaving the queue
+        inFlight = false;
+        lastFrame = hal_micros();
+        waitStart = hal_millis();
+    }
+
+    if (state == ISOTP_WAIT_FC) {
+        if (hal_millis() - waitStart > ISOTP_TIMEOUT_MS) {
+            state = ISOTP_IDLE;
+            _stats.timeouts++;
+        }
+        return;
+    }
+    if (state != ISOTP_SENDING) {
+        return;
+    }
+
+    // Paced by STmin, and held back while the queue is busy with other traffic
+    if (hal_micros() - lastFrame < separation || tx.depth() >= CAN_TX_QUEUE_SIZE/2) {
+        return;
+    }
+
+    uint8_t bytes[8];
+    uint16_t chunk = length - offset;
+    if (chunk > ISOTP_CF_DATA) {
+        chunk = ISOTP_CF_DATA;
+    }
+    bytes[0] = (ISOTP_CONSECUTIVE << 4) | sequence;
+    memcpy(&bytes[1], &buffer[offset], chunk);
+    if (!queueFrame(bytes, 1 + chunk, true)) {
+        return;
+    }
+    offset += chunk;
+    sequence = (sequence + 1) & 0x0F;
+
+    if (offset >= length) {
+        state = ISOTP_IDLE;
+        _stats.completed++;
+    } else if (blockSize != 0 && --blockLeft == 0) {
+        state = ISOTP_WAIT_FC;
+        waitStart = hal_millis();
+    }
+}
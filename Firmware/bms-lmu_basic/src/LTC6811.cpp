@@ -61,6 +61,7 @@
 #include "stdint.h"
 #include "LTC681x.h"
 #include "LTC6811.h"
+#include "Trace.h"
 
 /* Initialize the Register limits */
 void LTC6811_init_reg_limits(uint8_t total_ic, //The number of ICs in the system
@@ -69,12 +70,12 @@ void LTC6811_init_reg_limits(uint8_t total_ic, //The number of ICs in the system
 {
   for (uint8_t cic=0; cic<total_ic; cic++)
   {
-    ic[cic].ic_reg.cell_channels=12;
-    ic[cic].ic_reg.stat_channels=4;
-    ic[cic].ic_reg.aux_channels=6;
-    ic[cic].ic_reg.num_cv_reg=4;
-    ic[cic].ic_reg.num_gpio_reg=2;
-    ic[cic].ic_reg.num_stat_reg=3;
+    ic[cic].ic_reg.cell_channels=ic_traits::cell_channels;
+    ic[cic].ic_reg.stat_channels=ic_traits::stat_channels;
+    ic[cic].ic_reg.aux_channels=ic_traits::aux_channels;
+    ic[cic].ic_reg.num_cv_reg=ic_traits::num_cv_reg;
+    ic[cic].ic_reg.num_gpio_reg=ic_traits::num_gpio_reg;
+    ic[cic].ic_reg.num_stat_reg=ic_traits::num_stat_reg;
   }
 }
 
@@ -151,11 +152,26 @@ uint8_t LTC6811_rdcv(uint8_t reg, // Controls which cell voltage register is rea
                      cell_asic *ic // Array of the parsed cell codes
                     )
 {
+  TRACE_SCOPE(TRACE_LTC6811_RDCV);
   int8_t pec_error = 0;
   pec_error = LTC681x_rdcv(reg,total_ic,ic);
   return(pec_error);
 }
 
+/* Starts a non-blocking read of all cell voltage registers */
+void LTC6811_rdcv_start(uint8_t total_ic, // The number of ICs in the system
+                        cell_asic *ic // Array of the parsed cell codes
+                       )
+{
+  LTC681x_rdcv_start(total_ic,ic);
+}
+
+/* Advances the cell register read, 1 once it is complete */
+uint8_t LTC6811_rdcv_service(int8_t *pec_error)
+{
+  return(LTC681x_rdcv_service(pec_error));
+}
+
 /*
 The function is used to read the  parsed GPIO codes of the LTC6811. 
 This function will send the requested read commands parse the data 
@@ -199,6 +215,30 @@ uint32_t LTC6811_pollAdc()
   return(LTC681x_pollAdc());
 }
 
+/* Non-blocking conversion check, fires the callback set with LTC6811_adc_set_callback() on completion */
+uint8_t LTC6811_adc_service()
+{
+  return(LTC681x_adc_service());
+}
+
+/* Returns 1 once the next LTC6811_adc_service() will confirm with PLADC */
+uint8_t LTC6811_adc_confirm_due()
+{
+  return(LTC681x_adc_confirm_due());
+}
+
+/* Sets the continuation fired when a conversion completes */
+void LTC6811_adc_set_callback(adc_callback callback)
+{
+  LTC681x_adc_set_callback(callback);
+}
+
+/* Returns the measured time in microseconds of the last completed conversion */
+uint32_t LTC6811_adc_elapsed()
+{
+  return(LTC681x_adc_elapsed());
+}
+
 /*
 The command clears the cell voltage registers and initializes all values to 1. 
 The register will read back hexadecimal 0xFF after the command is sent.
@@ -448,6 +488,156 @@ int8_t LTC6811_rdcomm(uint8_t total_ic, //Number of ICs in the system
   return(pec_error);
 }
 
+/* Writes the configuration register only if it changed, verifies the readback on the shadow cadence */
+int8_t LTC6811_sync_cfg(uint8_t total_ic, //Number of ICs in the system
+                        cell_asic *ic //A two dimensional array of the configuration data
+                       )
+{
+  return(LTC681x_sync_cfg(total_ic,ic));
+}
+
+/* Writes a PWM register group only if it changed */
+int8_t LTC6811_sync_pwm(uint8_t total_ic, //Number of ICs in the system
+                        uint8_t pwmReg, //The PWM register group, A (0) or B
+                        cell_asic *ic //A two dimensional array of the pwm data
+                       )
+{
+  return(LTC681x_sync_pwm(total_ic,pwmReg,ic));
+}
+
+/* Writes a Sctrl register group only if it changed */
+int8_t LTC6811_sync_sctrl(uint8_t total_ic, //Number of ICs in the system
+                          uint8_t sctrl_reg, //The Sctrl register group, A (0) or B
+                          cell_asic *ic //A two dimensional array of the sctrl data
+                         )
+{
+  return(LTC681x_sync_sctrl(total_ic,sctrl_reg,ic));
+}
+
+/* Writes the COMM registers only if they changed or were used by a stcomm */
+int8_t LTC6811_sync_comm(uint8_t total_ic, //Number of ICs in the system
+                         cell_asic *ic //A two dimensional array of the comm data
+                        )
+{
+  return(LTC681x_sync_comm(total_ic,ic));
+}
+
+/* Forgets the register shadows so the next sync writes every group */
+void LTC6811_shadow_invalidate(uint8_t total_ic, //Number of ICs in the system
+                               cell_asic *ic //A two dimensional array that stores the data
+                              )
+{
+  LTC681x_shadow_invalidate(total_ic,ic);
+}
+
+/* Sets how many syncs of a register group pass between readback verifications */
+void LTC6811_shadow_set_verify_interval(uint16_t interval)
+{
+  LTC681x_shadow_set_verify_interval(interval);
+}
+
+/* Returns the register shadow cache counters */
+shadow_stats LTC6811_shadow_stats()
+{
+  return(LTC681x_shadow_stats());
+}
+
+/* Sets the timeouts the wake state is tracked against */
+void LTC6811_wake_set_timeouts(uint32_t idle_us, uint32_t sleep_ms)
+{
+  LTC681x_wake_set_timeouts(idle_us,sleep_ms);
+}
+
+/* Forgets the wake state so the next wake-up routines pulse the chain */
+void LTC6811_wake_invalidate()
+{
+  LTC681x_wake_invalidate();
+}
+
+/* Returns the wake state tracker counters */
+wake_stats LTC6811_wake_stats()
+{
+  return(LTC681x_wake_stats());
+}
+
+/* Clears the wake state tracker counters */
+void LTC6811_wake_reset_stats()
+{
+  LTC681x_wake_reset_stats();
+}
+
+/* Sets the LTC6811-2 address of an IC */
+void LTC6811_set_address(uint8_t nIC, //Current IC
+                         cell_asic *ic, //A two dimensional array that stores the data
+                         uint8_t addr //Address strapped on the A0-A3 pins
+                        )
+{
+  LTC681x_set_address(nIC,ic,addr);
+}
+
+/* Writes the configuration register of a single addressed LTC6811-2 */
+void LTC6811_wrcfg_addr(uint8_t nIC, //IC to be written
+                        cell_asic *ic //A two dimensional array of the configuration data
+                       )
+{
+  LTC681x_wrcfg_addr(nIC,ic);
+}
+
+/* Reads the configuration register of a single addressed LTC6811-2 */
+int8_t LTC6811_rdcfg_addr(uint8_t nIC, //IC to be read
+                          cell_asic *ic //A two dimensional array that stores the read data
+                         )
+{
+  return(LTC681x_rdcfg_addr(nIC,ic));
+}
+
+/* Reads and parses the cell voltage registers of a single addressed LTC6811-2 */
+int8_t LTC6811_rdcv_addr(uint8_t reg, //Cell voltage register to read back, REG_ALL for all
+                         uint8_t nIC, //IC to be read
+                         cell_asic *ic //A two dimensional array that stores the parsed codes
+                        )
+{
+  return(LTC681x_rdcv_addr(reg,nIC,ic));
+}
+
+/* Reads and parses the auxiliary registers of a single addressed LTC6811-2 */
+int8_t LTC6811_rdaux_addr(uint8_t reg, //Aux register to read back, REG_ALL for all
+                          uint8_t nIC, //IC to be read
+                          cell_asic *ic //A two dimensional array that stores the parsed codes
+                         )
+{
+  return(LTC681x_rdaux_addr(reg,nIC,ic));
+}
+
+/* Reads and parses the status registers of a single addressed LTC6811-2 */
+int8_t LTC6811_rdstat_addr(uint8_t reg, //Stat register to read back, REG_ALL for all
+                           uint8_t nIC, //IC to be read
+                           cell_asic *ic //A two dimensional array that stores the parsed codes
+                          )
+{
+  return(LTC681x_rdstat_addr(reg,nIC,ic));
+}
+
+/* Reads the cell voltages of the LTC6811-2s selected in ic_mask only */
+int8_t LTC6811_rdcv_subset(uint8_t reg, //Cell voltage register to read back, REG_ALL for all
+                           uint8_t total_ic, //Number of ICs in the system
+                           cell_asic *ic, //A two dimensional array that stores the parsed codes
+                           uint32_t ic_mask //Bit n set reads IC n
+                          )
+{
+  return(LTC681x_rdcv_subset(reg,total_ic,ic,ic_mask));
+}
+
+/* Reads the auxiliary registers of the LTC6811-2s selected in ic_mask only */
+int8_t LTC6811_rdaux_subset(uint8_t reg, //Aux register to read back, REG_ALL for all
+                            uint8_t total_ic, //Number of ICs in the system
+                            cell_asic *ic, //A two dimensional array that stores the parsed codes
+                            uint32_t ic_mask //Bit n set reads IC n
+                           )
+{
+  return(LTC681x_rdaux_subset(reg,total_ic,ic,ic_mask));
+}
+
 /* Shifts data in COMM register out over LTC6811 SPI/I2C port */
 void LTC6811_stcomm(uint8_t len)
 {
@@ -43,15 +43,59 @@
 */
 
 #include <stdint.h>
+#include <string.h>
 #include "LTC681x.h"
 #include "bms_hardware.h"
+#include "Trace.h"
 
-#ifdef LINDUINO
-#include <Arduino.h>
-#endif
+/*
+Wake state of the chain. Every frame stamps the port activity when chip select
+goes high and a broadcast command also restarts the watchdog of every core, so
+the wake-up routines only pulse chip select when the ports may have gone idle
+(tIDLE) or the cores may have gone to sleep (tSLEEP) since. The watchdog is
+tracked in milliseconds so a long pause can not wrap the comparison.
+*/
+static uint32_t wake_idle_us = LTC681X_WAKE_IDLE_US;
+static uint32_t wake_sleep_ms = LTC681X_WAKE_SLEEP_MS;
+static uint32_t last_frame_us = 0; // hal_micros() when chip select last went high
+static uint32_t last_frame_ms = 0;
+static uint32_t last_command_ms = 0; // hal_millis() of the last broadcast command or wake from sleep
+static uint8_t ports_ready = 0; // last_frame_us is known to hold
+static uint8_t cores_awake = 0; // last_command_ms is known to hold
+static uint8_t cores_reset = 0; // Bit per register shadow group, set when a sleep wake reset the cores to defaults
+static wake_stats wake_counters;
+
+static bool ports_idle()
+{
+	return(!ports_ready || wake_idle_us == 0
+	       || (uint32_t)(hal_micros() - last_frame_us) > wake_idle_us
+	       || (uint32_t)(hal_millis() - last_frame_ms) > wake_idle_us/1000);
+}
 
-/* Wake isoSPI up from IDlE state and enters the READY state */
-void wakeup_idle(uint8_t total_ic) //Number of ICs in the system
+static bool cores_asleep()
+{
+	return(!cores_awake || wake_sleep_ms == 0 || (uint32_t)(hal_millis() - last_command_ms) > wake_sleep_ms);
+}
+
+static void stamp_frame()
+{
+	last_frame_us = hal_micros();
+	last_frame_ms = hal_millis();
+	ports_ready = 1;
+}
+
+/* Releases chip select after a command frame. Only a broadcast command that found the chain awake feeds every watchdog */
+static void release_cs(uint8_t cmd0)
+{
+	cs_high(CS_PIN);
+	if (!(cmd0 & 0x80) && !ports_idle() && !cores_asleep())
+	{
+		last_command_ms = hal_millis();
+	}
+	stamp_frame();
+}
+
+static void pulse_idle(uint8_t total_ic)
 {
 	for (int i =0; i<total_ic; i++)
 	{
@@ -59,11 +103,40 @@ void wakeup_idle(uint8_t total_ic) //Number of ICs in the system
 	   spi_read_byte(0xff);//Guarantees the isoSPI will be in ready mode
 	   cs_high(CS_PIN);
 	}
+	stamp_frame();
 }
 
-/* Generic wakeup command to wake the LTC681x from sleep state */
+/* Wake isoSPI up from IDlE state and enters the READY state, skipped while the ports are known to be ready */
+void wakeup_idle(uint8_t total_ic) //Number of ICs in the system
+{
+	if (!ports_idle())
+	{
+		wake_counters.skipped++;
+		wake_counters.pulses_skipped += total_ic;
+		return;
+	}
+	pulse_idle(total_ic);
+	wake_counters.idle_wakes++;
+}
+
+/* Generic wakeup command to wake the LTC681x from sleep state, only the isoSPI is woken while the cores are known to be awake */
 void wakeup_sleep(uint8_t total_ic) //Number of ICs in the system
 {
+	if (!cores_asleep())
+	{
+		if (ports_idle())
+		{
+			pulse_idle(total_ic);
+			wake_counters.idle_wakes++;
+			wake_counters.sleep_downgraded++;
+		}
+		else
+		{
+			wake_counters.skipped++;
+			wake_counters.pulses_skipped += total_ic;
+		}
+		return;
+	}
 	for (int i =0; i<total_ic; i++)
 	{
 	   cs_low(CS_PIN);
@@ -71,8 +144,47 @@ void wakeup_sleep(uint8_t total_ic) //Number of ICs in the system
 	   cs_high(CS_PIN);
 	   delay_u(10);
 	}
+	stamp_frame();
+	last_command_ms = last_frame_ms; // The watchdog starts over on waking
+	cores_awake = 1;
+	cores_reset = 0xFF; // Registers may have been lost to sleep, no shadow can be trusted
+	wake_counters.sleep_wakes++;
+}
+
+/* Sets the timeouts the wake state is tracked against, 0 wakes every time */
+void LTC681x_wake_set_timeouts(uint32_t idle_us, uint32_t sleep_ms)
+{
+	wake_idle_us = idle_us;
+	wake_sleep_ms = sleep_ms;
+}
+
+/* Forgets the wake state so the next wake-up routines pulse the chain */
+void LTC681x_wake_invalidate()
+{
+	ports_ready = 0;
+	cores_awake = 0;
+}
+
+wake_stats LTC681x_wake_stats()
+{
+	return(wake_counters);
+}
+
+void LTC681x_wake_reset_stats()
+{
+	wake_counters = wake_stats();
 }
 
+/* State of the conversion started by the last ADC command, see LTC681x_adc_arm() */
+static uint8_t adc_opt = 0; // Last ADCOPT value set in the configuration
+static uint8_t adc_armed = 0;
+static uint32_t adc_start = 0;
+static uint32_t adc_duration = 0;
+static uint32_t adc_timeout = 0;
+static uint8_t adc_confirm = 0;
+static uint32_t adc_last_elapsed = 0;
+static adc_callback adc_done_callback = NULL;
+
 /* Generic function to write 68xx commands. Function calculates PEC for tx_cmd data. */
 void cmd_68(uint8_t tx_cmd[2]) //The command to be transmitted
 {
@@ -88,7 +200,45 @@ void cmd_68(uint8_t tx_cmd[2]) //The command to be transmitted
 	
 	cs_low(CS_PIN);
 	spi_write_array(4,cmd);
-	cs_high(CS_PIN);
+	release_cs(cmd[0]);
+	adc_armed = 0; // ADC start commands re-arm straight after, anything else is polled from scratch
+}
+
+/*
+Single transaction buffer shared by every frame the driver builds:
+command + PEC followed by 6 data bytes + PEC per IC. Sized at compile time
+from TOTAL_IC_MAX so no frame touches the heap or needs a stack copy.
+*/
+static uint8_t frame[FRAME_BUFFER_LEN];
+
+/* Writes the command and its PEC into the head of the frame */
+static void frame_cmd(uint8_t tx_cmd[2])
+{
+	uint16_t cmd_pec;
+	
+	frame[0] = tx_cmd[0];
+	frame[1] = tx_cmd[1];
+	cmd_pec = pec15_calc(2, frame);
+	frame[2] = (uint8_t)(cmd_pec >> 8);
+	frame[3] = (uint8_t)(cmd_pec);
+}
+
+/* Copies one ICs register data into the frame at index followed by its PEC, returns the next free index */
+static uint8_t frame_payload(uint8_t index, const uint8_t data[6])
+{
+	uint16_t data_pec = pec15_init();
+	
+	for (uint8_t current_byte = 0; current_byte < 6; current_byte++)
+	{
+		frame[index] = data[current_byte];
+		data_pec = pec15_update_byte(data_pec, data[current_byte]);
+		index++;
+	}
+	data_pec = pec15_final(data_pec);
+	frame[index] = (uint8_t)(data_pec >> 8);
+	frame[index + 1] = (uint8_t)data_pec;
+	
+	return(index + 2);
 }
 
 /* 
@@ -100,40 +250,49 @@ void write_68(uint8_t total_ic, //Number of ICs to be written to
 			  uint8_t data[] // Payload Data
 			  )
 {
-	const uint8_t BYTES_IN_REG = 6;
-	const uint8_t CMD_LEN = 4+(8*total_ic);
-	uint8_t *cmd;
-	uint16_t data_pec;
-	uint16_t cmd_pec;
-	uint8_t cmd_index;
-	
-	cmd = (uint8_t *)malloc(CMD_LEN*sizeof(uint8_t));
-	cmd[0] = tx_cmd[0];
-	cmd[1] = tx_cmd[1];
-	cmd_pec = pec15_calc(2, cmd);
-	cmd[2] = (uint8_t)(cmd_pec >> 8);
-	cmd[3] = (uint8_t)(cmd_pec);
+	uint8_t cmd_index = NUM_CMD_BYT;
 	
-	cmd_index = 4;
+	frame_cmd(tx_cmd);
 	for (uint8_t current_ic = total_ic; current_ic > 0; current_ic--)               // Executes for each LTC681x, this loops starts with the last IC on the stack.
     {	                                                                            //The first configuration written is received by the last IC in the daisy chain
-		for (uint8_t current_byte = 0; current_byte < BYTES_IN_REG; current_byte++)
+		cmd_index = frame_payload(cmd_index, &data[(current_ic-1)*6]);
+	}
+	
+	cs_low(CS_PIN);
+	spi_write_array(cmd_index, frame);
+	release_cs(frame[0]);
+}
+
+/*
+Writes one register group of every IC straight from its cell_asic tx_data
+into the frame, in the same order write_68 would have sent a packed buffer.
+ */
+static void write_68_reg(uint8_t total_ic, //Number of ICs to be written to
+						 uint8_t tx_cmd[2], //The command to be transmitted
+						 cell_asic ic[], //The ICs holding the data
+						 ic_register cell_asic::*reg //The register group to be written
+						 )
+{
+	uint8_t cmd_index = NUM_CMD_BYT;
+	uint8_t c_ic;
+	
+	frame_cmd(tx_cmd);
+	for (uint8_t current_ic = total_ic; current_ic > 0; current_ic--)
+	{
+		if (ic->isospi_reverse == false)
 		{
-			cmd[cmd_index] = data[((current_ic-1)*6)+current_byte];
-			cmd_index = cmd_index + 1;
+			c_ic = current_ic - 1;
 		}
-		
-		data_pec = (uint16_t)pec15_calc(BYTES_IN_REG, &data[(current_ic-1)*6]);    // Calculating the PEC for each ICs configuration register data
-		cmd[cmd_index] = (uint8_t)(data_pec >> 8);
-		cmd[cmd_index + 1] = (uint8_t)data_pec;
-		cmd_index = cmd_index + 2;
+		else
+		{
+			c_ic = total_ic - current_ic;
+		}
+		cmd_index = frame_payload(cmd_index, (ic[c_ic].*reg).tx_data);
 	}
 	
 	cs_low(CS_PIN);
-	spi_write_array(CMD_LEN, cmd);
-	cs_high(CS_PIN);
-	
-	free(cmd);
+	spi_write_array(cmd_index, frame);
+	release_cs(frame[0]);
 }
 
 /* Generic function to write 68xx commands and read data. Function calculated PEC for tx_cmd data */
@@ -143,30 +302,18 @@ int8_t read_68( uint8_t total_ic, // Number of ICs in the system
 				)
 {
 	const uint8_t BYTES_IN_REG = 8;
-	uint8_t cmd[4];
-	uint8_t data[256];
 	int8_t pec_error = 0;
-	uint16_t cmd_pec;
 	uint16_t data_pec;
 	uint16_t received_pec;
 	
-	cmd[0] = tx_cmd[0];
-	cmd[1] = tx_cmd[1];
-	cmd_pec = pec15_calc(2, cmd);
-	cmd[2] = (uint8_t)(cmd_pec >> 8);
-	cmd[3] = (uint8_t)(cmd_pec);
+	frame_cmd(tx_cmd);
 	
 	cs_low(CS_PIN);
-	spi_write_read(cmd, 4, data, (BYTES_IN_REG*total_ic));         //Transmits the command and reads the configuration data of all ICs on the daisy chain into rx_data[] array
-	cs_high(CS_PIN);                                         
+	spi_write_read(frame, NUM_CMD_BYT, rx_data, (BYTES_IN_REG*total_ic));         //Transmits the command and reads the configuration data of all ICs on the daisy chain into rx_data[] array
+	release_cs(frame[0]);
 
-	for (uint8_t current_ic = 0; current_ic < total_ic; current_ic++) //Executes for each LTC681x in the daisy chain and packs the data
-	{																//into the rx_data array as well as check the received data for any bit errors
-		for (uint8_t current_byte = 0; current_byte < BYTES_IN_REG; current_byte++)
-		{
-			rx_data[(current_ic*8)+current_byte] = data[current_byte + (current_ic*BYTES_IN_REG)];
-		}
-		
+	for (uint8_t current_ic = 0; current_ic < total_ic; current_ic++) //Executes for each LTC681x in the daisy chain and checks the received data for any bit errors
+	{
 		received_pec = (rx_data[(current_ic*8)+6]<<8) + rx_data[(current_ic*8)+7];
 		data_pec = pec15_calc(6, &rx_data[current_ic*8]);
 		
@@ -179,38 +326,26 @@ int8_t read_68( uint8_t total_ic, // Number of ICs in the system
 	return(pec_error);
 }
 
-/* Calculates  and returns the CRC15 */
-uint16_t pec15_calc(uint8_t len, //Number of bytes that will be used to calculate a PEC
-                    uint8_t *data //Array of data that will be used to calculate  a PEC
-                   )
+/*
+Reads one register group of every IC straight into its cell_asic rx_data
+and flags the PEC match per IC. Chip select stays low for the whole chain.
+ */
+static int8_t read_68_reg(uint8_t total_ic, //Number of ICs in the system
+						  uint8_t tx_cmd[2], //The command to be transmitted
+						  cell_asic ic[], //The ICs the data is stored in
+						  ic_register cell_asic::*reg //The register group to be read
+						  )
 {
-	uint16_t remainder,addr;
-	remainder = 16;//initialize the PEC
-	
-	for (uint8_t i = 0; i<len; i++) // loops for each byte in data array
-	{
-		addr = ((remainder>>7)^data[i])&0xff;//calculate PEC table address
-		#ifdef MBED
-			remainder = (remainder<<8)^crc15Table[addr];
-		#else
-			remainder = (remainder<<8)^pgm_read_word_near(crc15Table+addr);
-		#endif
-	}
+	int8_t pec_error = 0;
+	uint16_t data_pec;
+	uint16_t received_pec;
+	uint8_t c_ic;
 	
-	return(remainder*2);//The CRC15 has a 0 in the LSB so the remainder must be multiplied by 2
-}
-
-/* Write the LTC681x CFGRA */
-void LTC681x_wrcfg(uint8_t total_ic, //The number of ICs being written to
-                   cell_asic ic[]  // A two dimensional array of the configuration data that will be written
-                  )
-{
-	uint8_t cmd[2] = {0x00 , 0x01} ;
-	uint8_t write_buffer[256];
-	uint8_t write_count = 0;
-	uint8_t c_ic = 0;
+	frame_cmd(tx_cmd);
 	
-	for (uint8_t current_ic = 0; current_ic<total_ic; current_ic++)
+	cs_low(CS_PIN);
+	spi_write_array(NUM_CMD_BYT, frame);
+	for (uint8_t current_ic = 0; current_ic < total_ic; current_ic++)
 	{
 		if (ic->isospi_reverse == false)
 		{
@@ -220,45 +355,124 @@ void LTC681x_wrcfg(uint8_t total_ic, //The number of ICs being written to
 		{
 			c_ic = total_ic - current_ic - 1;
 		}
+		spi_write_read(NULL, 0, (ic[c_ic].*reg).rx_data, NUM_RX_BYT);
+	}
+	release_cs(frame[0]);
+	
+	for (uint8_t current_ic = 0; current_ic < total_ic; current_ic++)
+	{
+		ic_register *rx = &(ic[current_ic].*reg);
 		
-		for (uint8_t data = 0; data<6; data++)
+		received_pec = (rx->rx_data[6]<<8) | rx->rx_data[7];
+		data_pec = pec15_calc(6, rx->rx_data);
+		if (received_pec != data_pec)
 		{
-			write_buffer[write_count] = ic[c_ic].config.tx_data[data];
-			write_count++;
+			rx->rx_pec_match = 1;
+			pec_error = -1;
 		}
+		else rx->rx_pec_match = 0;
+	}
+	
+	return(pec_error);
+}
+
+/* Builds the addressed form of a command into the head of the frame */
+static void frame_cmd_addr(uint8_t addr, uint8_t tx_cmd[2])
+{
+	uint8_t cmd[2];
+	
+	cmd[0] = ADDR_CMD0(addr, tx_cmd[0]);
+	cmd[1] = tx_cmd[1];
+	frame_cmd(cmd);
+}
+
+/* Sends a command to a single LTC681x-2 */
+void cmd_68_addr(uint8_t addr, //Address of the IC
+				 uint8_t tx_cmd[2] //The command to be transmitted
+				 )
+{
+	frame_cmd_addr(addr, tx_cmd);
+	
+	cs_low(CS_PIN);
+	spi_write_array(NUM_CMD_BYT, frame);
+	release_cs(frame[0]);
+	adc_armed = 0;
+}
+
+/* Writes one register group of a single LTC681x-2 */
+void write_68_addr(uint8_t addr, //Address of the IC
+				   uint8_t tx_cmd[2], //The command to be transmitted
+				   uint8_t data[6] //Register data
+				   )
+{
+	uint8_t cmd_index;
+	
+	frame_cmd_addr(addr, tx_cmd);
+	cmd_index = frame_payload(NUM_CMD_BYT, data);
+	
+	cs_low(CS_PIN);
+	spi_write_array(cmd_index, frame);
+	release_cs(frame[0]);
+}
+
+/* Clocks one register group of a single LTC681x-2 into rx_data, the PEC is left to the caller */
+static void read_68_addr_raw(uint8_t addr, uint8_t tx_cmd[2], uint8_t rx_data[8])
+{
+	frame_cmd_addr(addr, tx_cmd);
+	
+	cs_low(CS_PIN);
+	spi_write_read(frame, NUM_CMD_BYT, rx_data, NUM_RX_BYT);
+	release_cs(frame[0]);
+}
+
+/* Reads one register group of a single LTC681x-2 */
+int8_t read_68_addr(uint8_t addr, //Address of the IC
+					uint8_t tx_cmd[2], //The command to be transmitted
+					uint8_t rx_data[8] //Data to be read
+					)
+{
+	uint16_t received_pec;
+	
+	read_68_addr_raw(addr, tx_cmd, rx_data);
+	received_pec = (rx_data[6]<<8) | rx_data[7];
+	if (received_pec != pec15_calc(6, rx_data))
+	{
+		return(-1);
 	}
-	write_68(total_ic, cmd, write_buffer);
+	
+	return(0);
+}
+
+/* Calculates  and returns the CRC15 */
+uint16_t pec15_calc(uint8_t len, //Number of bytes that will be used to calculate a PEC
+                    uint8_t *data //Array of data that will be used to calculate  a PEC
+                   )
+{
+	TRACE_SCOPE(TRACE_PEC15_CALC);
+	return(pec15_final(pec15_update(pec15_init(), data, len)));
 }
 
+/* Write the LTC681x CFGRA */
+void LTC681x_wrcfg(uint8_t total_ic, //The number of ICs being written to
+                   cell_asic ic[]  // A two dimensional array of the configuration data that will be written
+                  )
+{
+	uint8_t cmd[2] = {0x00 , 0x01} ;
+	
+	write_68_reg(total_ic, cmd, ic, &cell_asic::config);
+}
+
+#if LTC681X_HAS_B_REGS
 /* Write the LTC681x CFGRB */
 void LTC681x_wrcfgb(uint8_t total_ic, //The number of ICs being written to
                     cell_asic ic[] // A two dimensional array of the configuration data that will be written
                    )
 {
 	uint8_t cmd[2] = {0x00 , 0x24} ;
-	uint8_t write_buffer[256];
-	uint8_t write_count = 0;
-	uint8_t c_ic = 0;
 	
-	for (uint8_t current_ic = 0; current_ic<total_ic; current_ic++)
-	{
-		if (ic->isospi_reverse == false)
-		{
-			c_ic = current_ic;
-		}
-		else
-		{
-			c_ic = total_ic - current_ic - 1;
-		}
-		
-		for (uint8_t data = 0; data<6; data++)
-		{
-			write_buffer[write_count] = ic[c_ic].configb.tx_data[data];
-			write_count++;
-		}
-	}
-	write_68(total_ic, cmd, write_buffer);
+	write_68_reg(total_ic, cmd, ic, &cell_asic::configb);
 }
+#endif
 
 /* Read the LTC681x CFGA */
 int8_t LTC681x_rdcfg(uint8_t total_ic, //Number of ICs in the system
@@ -266,85 +480,29 @@ int8_t LTC681x_rdcfg(uint8_t total_ic, //Number of ICs in the system
                     )
 {
 	uint8_t cmd[2]= {0x00 , 0x02};
-	uint8_t read_buffer[256];
 	int8_t pec_error = 0;
-	uint16_t data_pec;
-	uint16_t calc_pec;
-	uint8_t c_ic = 0;
 	
-	pec_error = read_68(total_ic, cmd, read_buffer);
-	
-	for (uint8_t current_ic = 0; current_ic<total_ic; current_ic++)
-	{
-		if (ic->isospi_reverse == false)
-		{
-			c_ic = current_ic;
-		}
-		else
-		{
-			c_ic = total_ic - current_ic - 1;
-		}
-		
-		for (int byte=0; byte<8; byte++)
-		{
-			ic[c_ic].config.rx_data[byte] = read_buffer[byte+(8*current_ic)];
-		}
-		
-		calc_pec = pec15_calc(6,&read_buffer[8*current_ic]);
-		data_pec = read_buffer[7+(8*current_ic)] | (read_buffer[6+(8*current_ic)]<<8);
-		if (calc_pec != data_pec )
-		{
-			ic[c_ic].config.rx_pec_match = 1;
-		}
-		else ic[c_ic].config.rx_pec_match = 0;
-	}
+	pec_error = read_68_reg(total_ic, cmd, ic, &cell_asic::config);
 	LTC681x_check_pec(total_ic,CFGR,ic);
 	
 	return(pec_error);
 }
 
+#if LTC681X_HAS_B_REGS
 /* Reads the LTC681x CFGB */
 int8_t LTC681x_rdcfgb(uint8_t total_ic, //Number of ICs in the system
                       cell_asic ic[] // A two dimensional array that the function stores the read configuration data.
                      )
 {
 	uint8_t cmd[2]= {0x00 , 0x26};
-	uint8_t read_buffer[256];
 	int8_t pec_error = 0;
-	uint16_t data_pec;
-	uint16_t calc_pec;
-	uint8_t c_ic = 0;
-	
-	pec_error = read_68(total_ic, cmd, read_buffer);
 	
-	for (uint8_t current_ic = 0; current_ic<total_ic; current_ic++)
-	{
-		if (ic->isospi_reverse == false)
-		{
-			c_ic = current_ic;
-		}
-		else
-		{
-			c_ic = total_ic - current_ic - 1;
-		}
-		
-		for (int byte=0; byte<8; byte++)
-		{
-			ic[c_ic].configb.rx_data[byte] = read_buffer[byte+(8*current_ic)];
-		}
-		
-		calc_pec = pec15_calc(6,&read_buffer[8*current_ic]);
-		data_pec = read_buffer[7+(8*current_ic)] | (read_buffer[6+(8*current_ic)]<<8);
-		if (calc_pec != data_pec )
-		{
-			ic[c_ic].configb.rx_pec_match = 1;
-		}
-		else ic[c_ic].configb.rx_pec_match = 0;
-	}
+	pec_error = read_68_reg(total_ic, cmd, ic, &cell_asic::configb);
 	LTC681x_check_pec(total_ic,CFGRB,ic);
 	
 	return(pec_error);
 }
+#endif
 
 /* Starts ADC conversion for cell voltage */
 void LTC681x_adcv( uint8_t MD, //ADC Mode
@@ -361,6 +519,7 @@ void LTC681x_adcv( uint8_t MD, //ADC Mode
 	cmd[1] =  md_bits + 0x60 + (DCP<<4) + CH;
 	
 	cmd_68(cmd);
+	LTC681x_adc_arm(MD, (CH == CELL_CH_ALL) ? ADC_STEPS_CELL_ALL : ADC_STEPS_SINGLE);
 }
 
 /* Start ADC Conversion for GPIO and Vref2  */
@@ -377,6 +536,7 @@ void LTC681x_adax(uint8_t MD, //ADC Mode
 	cmd[1] = md_bits + 0x60 + CHG ;
 	
 	cmd_68(cmd);
+	LTC681x_adc_arm(MD, (CHG == AUX_CH_ALL) ? ADC_STEPS_AUX_ALL : ADC_STEPS_SINGLE);
 }
 
 /* Start ADC Conversion for Status  */
@@ -393,6 +553,7 @@ void LTC681x_adstat(uint8_t MD, //ADC Mode
 	cmd[1] = md_bits + 0x68 + CHST ;
 	
 	cmd_68(cmd);
+	LTC681x_adc_arm(MD, (CHST == STAT_CH_ALL) ? ADC_STEPS_STAT_ALL : ADC_STEPS_SINGLE);
 }
 
 /* Starts cell voltage and SOC conversion */
@@ -409,6 +570,7 @@ void LTC681x_adcvsc(uint8_t MD, //ADC Mode
 	cmd[1] =  md_bits | 0x60 | (DCP<<4) | 0x07;
 	
 	cmd_68(cmd);
+	LTC681x_adc_arm(MD, ADC_STEPS_CVSC);
 }
 
 /* Starts cell voltage and GPIO 1&2 conversion */
@@ -425,6 +587,7 @@ void LTC681x_adcvax(uint8_t MD, //ADC Mode
 	cmd[1] =  md_bits | ((DCP&0x01)<<4) + 0x6F;
 	
 	cmd_68(cmd);
+	LTC681x_adc_arm(MD, ADC_STEPS_CVAX);
 }
 
 /*
@@ -439,13 +602,12 @@ uint8_t LTC681x_rdcv(uint8_t reg, // Controls which cell voltage register is rea
                     )
 {
 	int8_t pec_error = 0;
-	uint8_t *cell_data;
+	uint8_t *cell_data = &frame[NUM_CMD_BYT]; //Register data is parsed in place from the shared frame buffer
 	uint8_t c_ic = 0;
-	cell_data = (uint8_t *) malloc((NUM_RX_BYT*total_ic)*sizeof(uint8_t));
 
 	if (reg == 0)
 	{
-		for (uint8_t cell_reg = 1; cell_reg<ic[0].ic_reg.num_cv_reg+1; cell_reg++) //Executes once for each of the LTC681x cell voltage registers
+		for (uint8_t cell_reg = 1; cell_reg<ic_traits::num_cv_reg+1; cell_reg++) //Executes once for each of the LTC681x cell voltage registers
 		{
 			LTC681x_rdcv_reg(cell_reg, total_ic,cell_data );
 			for (int current_ic = 0; current_ic<total_ic; current_ic++)
@@ -485,7 +647,6 @@ uint8_t LTC681x_rdcv(uint8_t reg, // Controls which cell voltage register is rea
 		}
 	}
 	LTC681x_check_pec(total_ic,CELL,ic);
-	free(cell_data);
 
 	return(pec_error);
 }
@@ -500,14 +661,13 @@ int8_t LTC681x_rdaux(uint8_t reg, //Determines which GPIO voltage register is re
                      cell_asic *ic//A two dimensional array of the gpio voltage codes.
                     )
 {
-	uint8_t *data;
+	uint8_t *data = &frame[NUM_CMD_BYT]; //Register data is parsed in place from the shared frame buffer
 	int8_t pec_error = 0;
 	uint8_t c_ic =0;
-	data = (uint8_t *) malloc((NUM_RX_BYT*total_ic)*sizeof(uint8_t));
 
 	if (reg == 0)
 	{
-		for (uint8_t gpio_reg = 1; gpio_reg<ic[0].ic_reg.num_gpio_reg+1; gpio_reg++) //Executes once for each of the LTC681x aux voltage registers
+		for (uint8_t gpio_reg = 1; gpio_reg<ic_traits::num_gpio_reg+1; gpio_reg++) //Executes once for each of the LTC681x aux voltage registers
 		{
 			LTC681x_rdaux_reg(gpio_reg, total_ic,data);                 //Reads the raw auxiliary register data into the data[] array
 			for (int current_ic = 0; current_ic<total_ic; current_ic++)
@@ -546,7 +706,6 @@ int8_t LTC681x_rdaux(uint8_t reg, //Determines which GPIO voltage register is re
 		}
 	}
 	LTC681x_check_pec(total_ic,AUX,ic);
-	free(data);
 
 	return (pec_error);
 }
@@ -565,7 +724,7 @@ int8_t LTC681x_rdstat(uint8_t reg, //Determines which Stat  register is read bac
 {
 	const uint8_t BYT_IN_REG = 6;
 	const uint8_t STAT_IN_REG = 3;
-	uint8_t *data;
+	uint8_t *data = &frame[NUM_CMD_BYT]; //Register data is parsed in place from the shared frame buffer
 	uint8_t data_counter = 0;
 	int8_t pec_error = 0;
 	uint16_t parsed_stat;
@@ -573,8 +732,6 @@ int8_t LTC681x_rdstat(uint8_t reg, //Determines which Stat  register is read bac
 	uint16_t data_pec;
 	uint8_t c_ic = 0;
 	
-	data = (uint8_t *) malloc((12*total_ic)*sizeof(uint8_t));
-	
 	if (reg == 0)
 	{
 		for (uint8_t stat_reg = 1; stat_reg< 3; stat_reg++)                      //Executes once for each of the LTC681x stat voltage registers
@@ -685,19 +842,14 @@ int8_t LTC681x_rdstat(uint8_t reg, //Determines which Stat  register is read bac
 	}
 	LTC681x_check_pec(total_ic,STAT,ic);
 	
-	free(data);
-	
 	return (pec_error);
 }
 
-/* Writes the command and reads the raw cell voltage register data */
-void LTC681x_rdcv_reg(uint8_t reg, //Determines which cell voltage register is read back
-                      uint8_t total_ic, //the number of ICs in the
-                      uint8_t *data //An array of the unparsed cell codes
-                     )
+/* Builds the read command and its PEC for a cell voltage register */
+static void rdcv_reg_cmd(uint8_t reg, //Determines which cell voltage register is read back
+                         uint8_t cmd[4] //Command and PEC
+                        )
 {
-	const uint8_t REG_LEN = 8; //Number of bytes in each ICs register + 2 bytes for the PEC
-	uint8_t cmd[4];
 	uint16_t cmd_pec;
 
 	if (reg == 1)     //1: RDCVA
@@ -734,10 +886,103 @@ void LTC681x_rdcv_reg(uint8_t reg, //Determines which cell voltage register is r
 	cmd_pec = pec15_calc(2, cmd);
 	cmd[2] = (uint8_t)(cmd_pec >> 8);
 	cmd[3] = (uint8_t)(cmd_pec);
+}
+
+/* Writes the command and reads the raw cell voltage register data */
+void LTC681x_rdcv_reg(uint8_t reg, //Determines which cell voltage register is read back
+                      uint8_t total_ic, //the number of ICs in the
+                      uint8_t *data //An array of the unparsed cell codes
+                     )
+{
+	const uint8_t REG_LEN = 8; //Number of bytes in each ICs register + 2 bytes for the PEC
+	uint8_t cmd[4];
+
+	rdcv_reg_cmd(reg, cmd);
 
 	cs_low(CS_PIN);
 	spi_write_read(cmd,4,data,(REG_LEN*total_ic));
-	cs_high(CS_PIN);
+	release_cs(cmd[0]);
+}
+
+/*
+Non-blocking read of all cell voltage registers. Each register group is one
+frame moved by spi_write_read_async(); the frame callback runs when chip
+select goes high, from the DMA interrupt on the target, and stamps the wake
+tracker like any blocking frame. The register is parsed and the next frame
+queued from LTC681x_rdcv_service(), so the caller's loop runs while the
+bytes are on the wire. The read back lands in its own buffer, the shared
+frame buffer may be rebuilt by other commands in the meantime.
+*/
+static uint8_t rdcv_async_cmd[4];
+static uint8_t rdcv_async_data[NUM_RX_BYT*TOTAL_IC_MAX];
+static uint8_t rdcv_async_next = 0; // Register group on the wire, 0 when no read is in flight
+static uint8_t rdcv_async_total_ic;
+static cell_asic *rdcv_async_ic;
+static int8_t rdcv_async_pec_error;
+
+static void rdcv_async_frame_done()
+{
+	release_cs(rdcv_async_cmd[0]);
+}
+
+static void rdcv_async_queue(uint8_t reg)
+{
+	rdcv_reg_cmd(reg, rdcv_async_cmd);
+	rdcv_async_next = reg;
+	spi_write_read_async(CS_PIN, rdcv_async_cmd, 4, rdcv_async_data, NUM_RX_BYT*rdcv_async_total_ic, rdcv_async_frame_done);
+}
+
+void LTC681x_rdcv_start(uint8_t total_ic, //The number of ICs in the system
+                        cell_asic *ic //Array of the parsed cell codes
+                       )
+{
+	spi_async_wait();
+	rdcv_async_total_ic = total_ic;
+	rdcv_async_ic = ic;
+	rdcv_async_pec_error = 0;
+	rdcv_async_queue(1);
+}
+
+uint8_t LTC681x_rdcv_service(int8_t *pec_error)
+{
+	uint8_t c_ic = 0;
+
+	if (rdcv_async_next == 0)
+	{
+		*pec_error = rdcv_async_pec_error;
+		return 1;
+	}
+	if (spi_async_busy())
+	{
+		return 0;
+	}
+
+	for (int current_ic = 0; current_ic<rdcv_async_total_ic; current_ic++)
+	{
+		if (rdcv_async_ic->isospi_reverse == false)
+		{
+		  c_ic = current_ic;
+		}
+		else
+		{
+		  c_ic = rdcv_async_total_ic - current_ic - 1;
+		}
+		rdcv_async_pec_error = rdcv_async_pec_error + parse_cells(current_ic, rdcv_async_next, rdcv_async_data,
+											&rdcv_async_ic[c_ic].cells.c_codes[0],
+											&rdcv_async_ic[c_ic].cells.pec_match[0]);
+	}
+
+	if (rdcv_async_next < ic_traits::num_cv_reg)
+	{
+		wakeup_idle(rdcv_async_total_ic); // The loop may have been away longer than tIDLE
+		rdcv_async_queue(rdcv_async_next + 1);
+		return 0;
+	}
+
+	rdcv_async_next = 0;
+	LTC681x_check_pec(rdcv_async_total_ic,CELL,rdcv_async_ic);
+	*pec_error = rdcv_async_pec_error;
+	return 1;
 }
 
 /*
@@ -786,7 +1031,7 @@ void LTC681x_rdaux_reg(uint8_t reg, //Determines which GPIO voltage register is
 
 	cs_low(CS_PIN);
 	spi_write_read(cmd,4,data,(REG_LEN*total_ic));
-	cs_high(CS_PIN);
+	release_cs(cmd[0]);
 }
 
 /*
@@ -826,7 +1071,7 @@ void LTC681x_rdstat_reg(uint8_t reg, //Determines which stat register is read ba
 
 	cs_low(CS_PIN);
 	spi_write_read(cmd,4,data,(REG_LEN*total_ic));
-	cs_high(CS_PIN);
+	release_cs(cmd[0]);
 }
 
 /* Helper function that parses voltage measurement registers */
@@ -837,6 +1082,7 @@ int8_t parse_cells(uint8_t current_ic, // Current IC
 					uint8_t *ic_pec // PEC error
 					)
 {
+	TRACE_SCOPE(TRACE_PARSE_CELLS);
 	const uint8_t BYT_IN_REG = 6;
 	const uint8_t CELL_IN_REG = 3;
 	int8_t pec_error = 0;
@@ -865,68 +1111,139 @@ int8_t parse_cells(uint8_t current_ic, // Current IC
 		pec_error = 1;                             //The pec_error variable is simply set negative if any PEC errors
 		ic_pec[cell_reg-1]=1;
 	}
-	else
+	else
+	{
+		ic_pec[cell_reg-1]=0;
+	}
+	data_counter=data_counter+2;
+	
+	return(pec_error);
+}
+
+/* Sends the poll ADC command */
+uint8_t LTC681x_pladc()
+{
+	uint8_t cmd[4];
+	uint8_t adc_state = 0xFF;
+	uint16_t cmd_pec;
+	
+	cmd[0] = 0x07;
+	cmd[1] = 0x14;
+	cmd_pec = pec15_calc(2, cmd);
+	cmd[2] = (uint8_t)(cmd_pec >> 8);
+	cmd[3] = (uint8_t)(cmd_pec);
+	
+	cs_low(CS_PIN);
+	spi_write_array(4,cmd);
+	adc_state = spi_read_byte(0xFF);
+	release_cs(cmd[0]);
+	
+	return(adc_state);
+}
+
+/*
+Conversion time of all cells (6 measurement steps) in microseconds, indexed
+by [MD][ADCOPT]. Other commands are scaled by their number of steps.
+*/
+static const uint32_t adc_conv_table[4][2] =
+{
+	{12807, 6134},	// MD_422HZ_1KHZ
+	{1113, 1288},	// MD_27KHZ_14KHZ
+	{2335, 3033},	// MD_7KHZ_3KHZ
+	{201317, 4407}	// MD_26HZ_2KHZ
+};
+
+/* Looks up the conversion time of an ADC command */
+uint32_t LTC681x_adc_conv_time(uint8_t MD, uint8_t adcopt, uint8_t steps)
+{
+	uint32_t all_cells = adc_conv_table[MD & 0x03][adcopt & 0x01];
+	
+	return((all_cells*steps + ADC_STEPS_CELL_ALL - 1)/ADC_STEPS_CELL_ALL + ADC_CONV_MARGIN_US);
+}
+
+/* Records the start and deadline of the ADC command just sent */
+void LTC681x_adc_arm(uint8_t MD, uint8_t steps)
+{
+	adc_start = hal_micros();
+	adc_duration = LTC681x_adc_conv_time(MD, adc_opt, steps);
+	adc_timeout = 2*adc_duration; // A late conversion is given up to twice its table time
+	adc_confirm = ADC_PLADC_CONFIRM;
+	adc_armed = 1;
+}
+
+/* Sets the continuation fired when a conversion completes */
+void LTC681x_adc_set_callback(adc_callback callback)
+{
+	adc_done_callback = callback;
+}
+
+/* Non-blocking conversion check */
+uint8_t LTC681x_adc_service()
+{
+	uint32_t elapsed;
+	
+	if (adc_armed == 0)
+	{
+		return(1);
+	}
+	
+	elapsed = hal_micros() - adc_start;
+	if (elapsed < adc_duration)
+	{
+		return(0);
+	}
+	
+	if (adc_confirm)
+	{
+		if ((LTC681x_pladc() == 0) && (elapsed < adc_timeout))
+		{
+			return(0);
+		}
+		elapsed = hal_micros() - adc_start;
+	}
+	
+	adc_armed = 0;
+	adc_last_elapsed = elapsed;
+	if (adc_done_callback != NULL)
 	{
-		ic_pec[cell_reg-1]=0;
+		adc_done_callback();
 	}
-	data_counter=data_counter+2;
 	
-	return(pec_error);
+	return(1);
 }
 
-/* Sends the poll ADC command */
-uint8_t LTC681x_pladc()
+uint8_t LTC681x_adc_busy()
 {
-	uint8_t cmd[4];
-	uint8_t adc_state = 0xFF;
-	uint16_t cmd_pec;
-	
-	cmd[0] = 0x07;
-	cmd[1] = 0x14;
-	cmd_pec = pec15_calc(2, cmd);
-	cmd[2] = (uint8_t)(cmd_pec >> 8);
-	cmd[3] = (uint8_t)(cmd_pec);
-	
-	cs_low(CS_PIN);
-	spi_write_array(4,cmd);
-	adc_state = spi_read_byte(0xFF);
-	cs_high(CS_PIN);
-	
-	return(adc_state);
+	return(adc_armed);
+}
+
+uint8_t LTC681x_adc_confirm_due()
+{
+	return(adc_armed && adc_confirm && (uint32_t)(hal_micros() - adc_start) >= adc_duration);
+}
+
+uint32_t LTC681x_adc_elapsed()
+{
+	return(adc_last_elapsed);
 }
 
 /* This function will block operation until the ADC has finished it's conversion */
 uint32_t LTC681x_pollAdc()
 {
-	uint32_t counter = 0;
-	uint8_t finished = 0;
-	uint8_t current_time = 0;
-	uint8_t cmd[4];
-	uint16_t cmd_pec;
-	
-	cmd[0] = 0x07;
-	cmd[1] = 0x14;
-	cmd_pec = pec15_calc(2, cmd);
-	cmd[2] = (uint8_t)(cmd_pec >> 8);
-	cmd[3] = (uint8_t)(cmd_pec);
-	
-	cs_low(CS_PIN);
-	spi_write_array(4,cmd);
-	while ((counter<200000)&&(finished == 0))
+	if (adc_armed == 0)
+	{
+		// Commands without a table entry (self tests, STSCTRL, STCOMM) are polled with PLADC from now
+		adc_start = hal_micros();
+		adc_duration = 0;
+		adc_timeout = ADC_POLL_TIMEOUT_US;
+		adc_confirm = 1;
+		adc_armed = 1;
+	}
+	while (LTC681x_adc_service() == 0)
 	{
-		current_time = spi_read_byte(0xff);
-		if (current_time>0)
-		{
-			finished = 1;
-		}
-		else
-		{
-			counter = counter + 10;
-		}
 	}
-	cs_high(CS_PIN);
 	
-	return(counter);
+	return(adc_last_elapsed);
 }
 
 /*
@@ -1048,6 +1365,7 @@ void LTC681x_adaxd(uint8_t MD, //ADC Mode
 	cmd[1] = md_bits + CHG ;
 
 	cmd_68(cmd);
+	LTC681x_adc_arm(MD, (CHG == AUX_CH_ALL) ? ADC_STEPS_AUX_ALL : ADC_STEPS_SINGLE);
 }
 
 /* Start a Status register redundancy test Conversion */
@@ -1064,6 +1382,7 @@ void LTC681x_adstatd(uint8_t MD, //ADC Mode
 	cmd[1] = md_bits + 0x08 + CHST ;
 	
 	cmd_68(cmd);
+	LTC681x_adc_arm(MD, (CHST == STAT_CH_ALL) ? ADC_STEPS_STAT_ALL : ADC_STEPS_SINGLE);
 }
 
 /* Runs the Digital Filter Self Test */
@@ -1094,7 +1413,7 @@ int16_t LTC681x_run_cell_adc_st(uint8_t adc_reg, // Type of register
 			  error = LTC681x_rdcv(0, total_ic,ic);      
 			  for (int cic = 0; cic < total_ic; cic++)
 				{
-				  for (int channel=0; channel< ic[cic].ic_reg.cell_channels; channel++)
+				  for (int channel=0; channel< ic_traits::cell_channels; channel++)
 				  {
 								 
 					if (ic[cic].cells.c_codes[channel] != expected_result)
@@ -1115,7 +1434,7 @@ int16_t LTC681x_run_cell_adc_st(uint8_t adc_reg, // Type of register
 			  LTC681x_rdaux(0, total_ic,ic);     
 			  for (int cic = 0; cic < total_ic; cic++)
 				{
-				  for (int channel=0; channel< ic[cic].ic_reg.aux_channels; channel++)
+				  for (int channel=0; channel< ic_traits::aux_channels; channel++)
 				  { 
 					 
 					if (ic[cic].aux.a_codes[channel] != expected_result)
@@ -1135,7 +1454,7 @@ int16_t LTC681x_run_cell_adc_st(uint8_t adc_reg, // Type of register
 			  error = LTC681x_rdstat(0,total_ic,ic);
 			  for (int cic = 0; cic < total_ic; cic++)
 				{
-				  for (int channel=0; channel< ic[cic].ic_reg.stat_channels; channel++)
+				  for (int channel=0; channel< ic_traits::stat_channels; channel++)
 				  {
 					if (ic[cic].stat.stat_codes[channel] != expected_result)
 					{
@@ -1206,7 +1525,7 @@ int16_t LTC681x_run_adc_redundancy_st(uint8_t adc_mode, // ADC Mode
 			error = LTC681x_rdaux(0, total_ic,ic);
 			for (int cic = 0; cic < total_ic; cic++)
 			{
-				for (int channel=0; channel< ic[cic].ic_reg.aux_channels; channel++)
+				for (int channel=0; channel< ic_traits::aux_channels; channel++)
 				{ 
 					if (ic[cic].aux.a_codes[channel] >= 65280)
 					{
@@ -1223,7 +1542,7 @@ int16_t LTC681x_run_adc_redundancy_st(uint8_t adc_mode, // ADC Mode
 			error = LTC681x_rdstat(0,total_ic,ic);
 			for (int cic = 0; cic < total_ic; cic++)
 			{
-				for (int channel=0; channel< ic[cic].ic_reg.stat_channels; channel++)
+				for (int channel=0; channel< ic_traits::stat_channels; channel++)
 				{
 					if (ic[cic].stat.stat_codes[channel] >= 65280)
 					{
@@ -1328,7 +1647,7 @@ void LTC681x_run_openwire_single(uint8_t total_ic, // Number of ICs in the daisy
 								)
 {				  
 	uint16_t OPENWIRE_THRESHOLD = 4000;
-	const uint8_t  N_CHANNELS = ic[0].ic_reg.cell_channels;
+	const uint8_t  N_CHANNELS = ic_traits::cell_channels;
 	
 	uint16_t pullUp[total_ic][N_CHANNELS];
 	uint16_t pullDwn[total_ic][N_CHANNELS];
@@ -1418,7 +1737,7 @@ void LTC681x_run_openwire_single(uint8_t total_ic, // Number of ICs in the daisy
 						  )
 {              
 	uint16_t OPENWIRE_THRESHOLD = 4000;
-	const uint8_t  N_CHANNELS = ic[0].ic_reg.cell_channels;
+	const uint8_t  N_CHANNELS = ic_traits::cell_channels;
 
 	uint16_t pullUp[total_ic][N_CHANNELS];
 	uint16_t pullDwn[total_ic][N_CHANNELS];
@@ -1490,8 +1809,7 @@ void LTC681x_run_openwire_single(uint8_t total_ic, // Number of ICs in the daisy
 	{ 
 		n=0;
 						
-		Serial.print("IC:");
-		Serial.println(cic+1, DEC);
+		hal_log("IC:%d\r\n", cic+1);
 		
 		for (int cell=0; cell<N_CHANNELS; cell++)
 		{  
@@ -1518,7 +1836,7 @@ void LTC681x_run_openwire_single(uint8_t total_ic, // Number of ICs in the daisy
 		if (pullDwn[cic][0] == 0)
 		{
 		  opencells[n] = 0;
-		  Serial.println("Cell 0 is Open and multiple open wires maybe possible.");
+		  hal_log("Cell 0 is Open and multiple open wires maybe possible.\r\n");
 		  n++;
 		}
 					
@@ -1566,24 +1884,23 @@ void LTC681x_run_openwire_single(uint8_t total_ic, // Number of ICs in the daisy
 		}
 					
 	//Checking the value of n				
-		Serial.println("Number of Open wires:");
-		Serial.println(n);
+		hal_log("Number of Open wires:\r\n%d\r\n", (int)n);
 		   
 	//Printing open cell array
-		Serial.println("OPEN CELLS:");
+		hal_log("OPEN CELLS:\r\n");
 		if(n==0)
 		{
-			Serial.println("No Open wires");
+			hal_log("No Open wires\r\n");
 		}
 		else
 		{				
 			for(i=0;i<n;i++)
 			{
-					Serial.println(opencells[i]);	
+					hal_log("%d\r\n", (int)opencells[i]);	
 			}
 		}
 	}
-	Serial.println("\n");
+	hal_log("\n\r\n");
 }
 
 /* Runs open wire for GPIOs */
@@ -1592,7 +1909,7 @@ void LTC681x_run_gpio_openwire(uint8_t total_ic, // Number of ICs in the daisy c
 								)
  {				  
 	uint16_t OPENWIRE_THRESHOLD = 150;
-	const uint8_t  N_CHANNELS = ic[0].ic_reg.aux_channels +1;
+	const uint8_t  N_CHANNELS = (ic_traits::aux_channels+1 < AUX_CODES) ? ic_traits::aux_channels+1 : AUX_CODES;
 	
 	uint16_t aux_val[total_ic][N_CHANNELS];
 	uint16_t pDwn[total_ic][N_CHANNELS];
@@ -1687,8 +2004,10 @@ void LTC681x_clear_discharge(uint8_t total_ic, // Number of ICs in the daisy cha
 	{
 	   ic[i].config.tx_data[4] = 0;
 	   ic[i].config.tx_data[5] =ic[i].config.tx_data[5]&(0xF0);
+#if LTC681X_HAS_B_REGS
 	   ic[i].configb.tx_data[0]=ic[i].configb.tx_data[0]&(0x0F); 
 	   ic[i].configb.tx_data[1]=ic[i].configb.tx_data[1]&(0xF0);
+#endif
 	}
 }
 
@@ -1699,9 +2018,6 @@ void LTC681x_wrpwm(uint8_t total_ic, // Number of ICs in the daisy chain
                   )
 {
 	uint8_t cmd[2];
-	uint8_t write_buffer[256];
-	uint8_t write_count = 0;
-	uint8_t c_ic = 0;
 	if (pwmReg == 0)
 	{
 	cmd[0] = 0x00;
@@ -1713,24 +2029,7 @@ void LTC681x_wrpwm(uint8_t total_ic, // Number of ICs in the daisy chain
 	cmd[1] = 0x1C;
 	}
 	
-	for (uint8_t current_ic = 0; current_ic<total_ic; current_ic++)
-	{
-		if (ic->isospi_reverse == false)
-		{
-			c_ic = current_ic;
-		}
-		else
-		{
-			c_ic = total_ic - current_ic - 1;
-		}
-		
-		for (uint8_t data = 0; data<6; data++)
-		{
-			write_buffer[write_count] = ic[c_ic].pwm.tx_data[data];
-			write_count++;
-		}
-	}
-	write_68(total_ic, cmd, write_buffer);
+	write_68_reg(total_ic, cmd, ic, &cell_asic::pwm);
 }
 
 
@@ -1742,11 +2041,7 @@ int8_t LTC681x_rdpwm(uint8_t total_ic, //Number of ICs in the system
 {
 	const uint8_t BYTES_IN_REG = 8;
 	uint8_t cmd[4];
-	uint8_t read_buffer[256];
 	int8_t pec_error = 0;
-	uint16_t data_pec;
-	uint16_t calc_pec;
-	uint8_t c_ic = 0;
 	
 	if (pwmReg == 0)
 	{
@@ -1759,31 +2054,7 @@ int8_t LTC681x_rdpwm(uint8_t total_ic, //Number of ICs in the system
 		cmd[1] = 0x1E;
 	}
 	
-	pec_error = read_68(total_ic, cmd, read_buffer);
-	for (uint8_t current_ic =0; current_ic<total_ic; current_ic++)
-	{
-		if (ic->isospi_reverse == false)
-		{
-			c_ic = current_ic;
-		}
-		else
-		{
-			c_ic = total_ic - current_ic - 1;
-		}
-		
-		for (int byte=0; byte<8; byte++)
-		{
-			ic[c_ic].pwm.rx_data[byte] = read_buffer[byte+(8*current_ic)];
-		}
-		
-		calc_pec = pec15_calc(6,&read_buffer[8*current_ic]);
-		data_pec = read_buffer[7+(8*current_ic)] | (read_buffer[6+(8*current_ic)]<<8);
-		if (calc_pec != data_pec )
-		{
-			ic[c_ic].pwm.rx_pec_match = 1;
-		}
-		else ic[c_ic].pwm.rx_pec_match = 0;
-	}
+	pec_error = read_68_reg(total_ic, cmd, ic, &cell_asic::pwm);
 	return(pec_error);
 }
 
@@ -1794,9 +2065,6 @@ void LTC681x_wrsctrl(uint8_t total_ic, // Number of ICs in the daisy chain
                     )
 {
 	uint8_t cmd[2];
-    uint8_t write_buffer[256];
-    uint8_t write_count = 0;
-    uint8_t c_ic = 0;
     if (sctrl_reg == 0)
     {
       cmd[0] = 0x00;
@@ -1808,19 +2076,7 @@ void LTC681x_wrsctrl(uint8_t total_ic, // Number of ICs in the daisy chain
       cmd[1] = 0x1C;
     }
     
-    for(uint8_t current_ic = 0; current_ic<total_ic;current_ic++)
-    {
-        if(ic->isospi_reverse == false){c_ic = current_ic;}
-        else{c_ic = total_ic - current_ic - 1;}
-		
-
-        for(uint8_t data = 0; data<6;data++)
-        {
-            write_buffer[write_count] = ic[c_ic].sctrl.tx_data[data];
-            write_count++;
-        }
-    }
-    write_68(total_ic, cmd, write_buffer);
+    write_68_reg(total_ic, cmd, ic, &cell_asic::sctrl);
 }					
 					
 /*  Reads sctrl registers of a LTC681x daisy chain */    
@@ -1830,11 +2086,7 @@ int8_t LTC681x_rdsctrl(uint8_t total_ic, // Number of ICs in the daisy chain
                       )	
 {
     uint8_t cmd[4];
-    uint8_t read_buffer[256];
     int8_t pec_error = 0;
-    uint16_t data_pec;
-    uint16_t calc_pec;
-    uint8_t c_ic = 0;
     
     if (sctrl_reg == 0)
     {
@@ -1847,28 +2099,7 @@ int8_t LTC681x_rdsctrl(uint8_t total_ic, // Number of ICs in the daisy chain
       cmd[1] = 0x1E;
 	}
     
-    pec_error = read_68(total_ic, cmd, read_buffer);
-
-    for(uint8_t current_ic =0; current_ic<total_ic; current_ic++)
-    {	
-        if(ic->isospi_reverse == false){c_ic = current_ic;}
-        else{c_ic = total_ic - current_ic - 1;}
-	
-		
-        for(int byte=0; byte<8;byte++)
-        {
-            ic[c_ic].sctrl.rx_data[byte] = read_buffer[byte+(8*current_ic)]; 	
-        }
-		
-        calc_pec = pec15_calc(6,&read_buffer[8*current_ic]);
-        data_pec = read_buffer[7+(8*current_ic)] | (read_buffer[6+(8*current_ic)]<<8);
-        if(calc_pec != data_pec )
-        {
-            ic[c_ic].sctrl.rx_pec_match = 1;
-        }
-        else ic[c_ic].sctrl.rx_pec_match = 0;
-		
-    }
+    pec_error = read_68_reg(total_ic, cmd, ic, &cell_asic::sctrl);
     return(pec_error);
 }
 
@@ -1889,7 +2120,7 @@ void LTC681x_stsctrl()
     
     cs_low(CS_PIN);
     spi_write_array(4,cmd);          
-    cs_high(CS_PIN);
+    release_cs(cmd[0]);
 }
 
 /*
@@ -1909,69 +2140,413 @@ void LTC681x_wrcomm(uint8_t total_ic, //The number of ICs being written to
                    )
 {
 	uint8_t cmd[2]= {0x07 , 0x21};
-	uint8_t write_buffer[256];
-	uint8_t write_count = 0;
-	uint8_t c_ic = 0;
-	for (uint8_t current_ic = 0; current_ic<total_ic; current_ic++)
+	write_68_reg(total_ic, cmd, ic, &cell_asic::com);
+}
+
+/* Reads COMM registers of a LTC681x daisy chain */
+int8_t LTC681x_rdcomm(uint8_t total_ic, //Number of ICs in the system
+                      cell_asic ic[] //A two dimensional array that stores the read data
+                     )
+{
+	uint8_t cmd[2]= {0x07 , 0x22};
+	int8_t pec_error = 0;
+	
+	pec_error = read_68_reg(total_ic, cmd, ic, &cell_asic::com);
+	
+    return(pec_error);
+}
+
+/* Register groups held in the shadow cache, indexes the verify cadence counters */
+enum
+{
+	SHADOW_CFGR,
+	SHADOW_CFGRB,
+	SHADOW_PWM,
+	SHADOW_PWMB,
+	SHADOW_SCTRL,
+	SHADOW_SCTRLB,
+	SHADOW_COMM,
+	SHADOW_GROUPS
+};
+
+static uint16_t shadow_verify_interval = 10;
+static uint16_t shadow_verify_count[SHADOW_GROUPS];
+static shadow_stats shadow_counters;
+static uint8_t comm_stale = 0; // Set by STCOMM, the COMM register now holds the transfer result
+
+#define NO_PEC_COUNT 0xFF
+
+/*
+Writes a register group only if some IC's tx_data differs from its shadow, then
+reads it back every shadow_verify_interval calls. mask0 selects the bits of the
+first byte that read back what was written, 0 skips verification altogether.
+*/
+static int8_t sync_68_reg(uint8_t total_ic, // Number of ICs in the system
+						  uint8_t wr_cmd[2], // Write command of the group
+						  uint8_t rd_cmd[2], // Read command of the group
+						  cell_asic ic[], // The ICs holding the data
+						  ic_register cell_asic::*reg, // The register group
+						  uint8_t group, // SHADOW_ index of the group
+						  uint8_t mask0, // Bits of byte 0 that read back as written
+						  uint8_t pec_reg, // Register type for the PEC counters, NO_PEC_COUNT for none
+						  uint8_t force // Write even if the shadow matches
+						  )
+{
+	const uint16_t frame_len = NUM_CMD_BYT + NUM_RX_BYT*total_ic;
+	uint8_t dirty = force;
+	int8_t error = 0;
+	
+	if (cores_reset & (1 << group))
 	{
-		if (ic->isospi_reverse == false)
+		dirty = 1;
+		cores_reset &= ~(1 << group);
+	}
+	
+	for (uint8_t current_ic = 0; current_ic < total_ic; current_ic++)
+	{
+		ic_register *r = &(ic[current_ic].*reg);
+		if ((r->shadow_valid == 0) || (memcmp(r->tx_data, r->shadow, 6) != 0))
 		{
-			c_ic = current_ic;
+			dirty = 1;
 		}
-		else
+	}
+	
+	if (dirty)
+	{
+		write_68_reg(total_ic, wr_cmd, ic, reg);
+		for (uint8_t current_ic = 0; current_ic < total_ic; current_ic++)
 		{
-			c_ic = total_ic - current_ic - 1;
+			ic_register *r = &(ic[current_ic].*reg);
+			memcpy(r->shadow, r->tx_data, 6);
+			r->shadow_valid = 1;
 		}
+		shadow_counters.writes++;
+	}
+	else
+	{
+		shadow_counters.writes_skipped++;
+		shadow_counters.bytes_saved += frame_len;
+	}
+	
+	if ((mask0 == 0) || (shadow_verify_interval == 0))
+	{
+		return(0);
+	}
+	if (++shadow_verify_count[group] < shadow_verify_interval)
+	{
+		shadow_counters.bytes_saved += frame_len; // Readback skipped
+		return(0);
+	}
+	shadow_verify_count[group] = 0;
+	shadow_counters.verifies++;
 	
-		for (uint8_t data = 0; data<6; data++)
+	error = read_68_reg(total_ic, rd_cmd, ic, reg);
+	if (pec_reg != NO_PEC_COUNT)
+	{
+		LTC681x_check_pec(total_ic, pec_reg, ic);
+	}
+	for (uint8_t current_ic = 0; current_ic < total_ic; current_ic++)
+	{
+		ic_register *r = &(ic[current_ic].*reg);
+		if ((r->rx_pec_match != 0)
+			|| ((r->rx_data[0] & mask0) != (r->shadow[0] & mask0))
+			|| (memcmp(&r->rx_data[1], &r->shadow[1], 5) != 0))
 		{
-			write_buffer[write_count] = ic[c_ic].com.tx_data[data];
-			write_count++;
+			r->shadow_valid = 0;
+			error = -1;
 		}
 	}
-	write_68(total_ic, cmd, write_buffer);
+	if (error != 0)
+	{
+		shadow_counters.verify_failures++;
+	}
+	
+	return(error);
 }
 
-/* Reads COMM registers of a LTC681x daisy chain */
-int8_t LTC681x_rdcomm(uint8_t total_ic, //Number of ICs in the system
-                      cell_asic ic[] //A two dimensional array that stores the read data
-                     )
+/* Writes CFGR only if it changed */
+int8_t LTC681x_sync_cfg(uint8_t total_ic, cell_asic ic[])
 {
-	uint8_t cmd[2]= {0x07 , 0x22};
-	uint8_t read_buffer[256];
+	uint8_t wr_cmd[2] = {0x00 , 0x01};
+	uint8_t rd_cmd[2] = {0x00 , 0x02};
+	
+	// GPIO bits read back the pin level and DTEN the DTEN pin, only REFON and ADCOPT are compared
+	return(sync_68_reg(total_ic, wr_cmd, rd_cmd, ic, &cell_asic::config, SHADOW_CFGR, 0x05, CFGR, 0));
+}
+
+#if LTC681X_HAS_B_REGS
+/* Writes CFGRB only if it changed */
+int8_t LTC681x_sync_cfgb(uint8_t total_ic, cell_asic ic[])
+{
+	uint8_t wr_cmd[2] = {0x00 , 0x24};
+	uint8_t rd_cmd[2] = {0x00 , 0x26};
+	
+	// Low nibble of byte 0 is GPIO6-9 and reads back the pin level
+	return(sync_68_reg(total_ic, wr_cmd, rd_cmd, ic, &cell_asic::configb, SHADOW_CFGRB, 0xF0, CFGRB, 0));
+}
+#endif
+
+/* Writes a PWM register group only if it changed */
+int8_t LTC681x_sync_pwm(uint8_t total_ic, uint8_t pwmReg, cell_asic ic[])
+{
+	uint8_t wr_cmd[2] = {0x00 , 0x20};
+	uint8_t rd_cmd[2] = {0x00 , 0x22};
+	
+#if LTC681X_HAS_B_REGS
+	if (pwmReg != 0)
+	{
+		wr_cmd[1] = 0x1C;
+		rd_cmd[1] = 0x1E;
+		return(sync_68_reg(total_ic, wr_cmd, rd_cmd, ic, &cell_asic::pwmb, SHADOW_PWMB, 0xFF, NO_PEC_COUNT, 0));
+	}
+#else
+	(void)pwmReg;
+#endif
+	return(sync_68_reg(total_ic, wr_cmd, rd_cmd, ic, &cell_asic::pwm, SHADOW_PWM, 0xFF, NO_PEC_COUNT, 0));
+}
+
+/* Writes a SCTRL register group only if it changed */
+int8_t LTC681x_sync_sctrl(uint8_t total_ic, uint8_t sctrl_reg, cell_asic ic[])
+{
+	uint8_t wr_cmd[2] = {0x00 , 0x14};
+	uint8_t rd_cmd[2] = {0x00 , 0x16};
+	
+#if LTC681X_HAS_B_REGS
+	if (sctrl_reg != 0)
+	{
+		wr_cmd[1] = 0x1C;
+		rd_cmd[1] = 0x1E;
+		return(sync_68_reg(total_ic, wr_cmd, rd_cmd, ic, &cell_asic::sctrlb, SHADOW_SCTRLB, 0xFF, NO_PEC_COUNT, 0));
+	}
+#else
+	(void)sctrl_reg;
+#endif
+	return(sync_68_reg(total_ic, wr_cmd, rd_cmd, ic, &cell_asic::sctrl, SHADOW_SCTRL, 0xFF, NO_PEC_COUNT, 0));
+}
+
+/* Writes COMM only if it changed or has been used by a STCOMM */
+int8_t LTC681x_sync_comm(uint8_t total_ic, cell_asic ic[])
+{
+	uint8_t wr_cmd[2] = {0x07 , 0x21};
+	uint8_t rd_cmd[2] = {0x07 , 0x22};
+	int8_t error;
+	
+	error = sync_68_reg(total_ic, wr_cmd, rd_cmd, ic, &cell_asic::com, SHADOW_COMM, 0, NO_PEC_COUNT, comm_stale);
+	comm_stale = 0;
+	
+	return(error);
+}
+
+/* Forgets the shadow of every register group */
+void LTC681x_shadow_invalidate(uint8_t total_ic, cell_asic ic[])
+{
+	for (uint8_t current_ic = 0; current_ic < total_ic; current_ic++)
+	{
+		ic[current_ic].config.shadow_valid = 0;
+		ic[current_ic].pwm.shadow_valid = 0;
+		ic[current_ic].sctrl.shadow_valid = 0;
+		ic[current_ic].com.shadow_valid = 0;
+#if LTC681X_HAS_B_REGS
+		ic[current_ic].configb.shadow_valid = 0;
+		ic[current_ic].pwmb.shadow_valid = 0;
+		ic[current_ic].sctrlb.shadow_valid = 0;
+#endif
+	}
+}
+
+void LTC681x_shadow_set_verify_interval(uint16_t interval)
+{
+	shadow_verify_interval = interval;
+}
+
+shadow_stats LTC681x_shadow_stats()
+{
+	return(shadow_counters);
+}
+
+/* Second command byte of the register group reads, indexed by register - 1 */
+static const uint8_t rdcv_cmd[6] = {0x04, 0x06, 0x08, 0x0A, 0x09, 0x0B};
+static const uint8_t rdaux_cmd[4] = {0x0C, 0x0E, 0x0D, 0x0F};
+static const uint8_t rdstat_cmd[2] = {0x10, 0x12};
+
+/* Sets the LTC681x-2 address of an IC */
+void LTC681x_set_address(uint8_t nIC, cell_asic *ic, uint8_t addr)
+{
+	ic[nIC].address = addr & 0x0F;
+}
+
+/* Writes the configuration register of a single addressed IC */
+void LTC681x_wrcfg_addr(uint8_t nIC, //IC to be written
+						cell_asic ic[] //A two dimensional array of the configuration data
+						)
+{
+	uint8_t cmd[2] = {0x00 , 0x01};
+	
+	write_68_addr(ic[nIC].address, cmd, ic[nIC].config.tx_data);
+}
+
+/* Reads the configuration register of a single addressed IC */
+int8_t LTC681x_rdcfg_addr(uint8_t nIC, //IC to be read
+						  cell_asic ic[] //A two dimensional array that stores the read data
+						  )
+{
+	uint8_t cmd[2] = {0x00 , 0x02};
+	int8_t pec_error;
+	
+	pec_error = read_68_addr(ic[nIC].address, cmd, ic[nIC].config.rx_data);
+	ic[nIC].config.rx_pec_match = (pec_error != 0);
+	LTC681x_check_pec(1, CFGR, &ic[nIC]);
+	
+	return(pec_error);
+}
+
+/* Reads and parses the cell voltage registers of a single addressed IC */
+int8_t LTC681x_rdcv_addr(uint8_t reg, //Cell voltage register to read back, REG_ALL for all
+						 uint8_t nIC, //IC to be read
+						 cell_asic ic[] //A two dimensional array that stores the parsed codes
+						 )
+{
+	uint8_t *data = &frame[NUM_CMD_BYT];
+	uint8_t cmd[2] = {0x00 , 0x00};
+	uint8_t first = reg;
+	uint8_t last = reg;
 	int8_t pec_error = 0;
-	uint16_t data_pec;
-	uint16_t calc_pec;
-	uint8_t c_ic=0;
 	
-	pec_error = read_68(total_ic, cmd, read_buffer);
+	if (reg == REG_ALL)
+	{
+		first = 1;
+		last = ic_traits::num_cv_reg;
+	}
+	for (uint8_t cell_reg = first; cell_reg <= last; cell_reg++)
+	{
+		cmd[1] = rdcv_cmd[cell_reg-1];
+		read_68_addr_raw(ic[nIC].address, cmd, data);
+		pec_error = pec_error + parse_cells(0, cell_reg, data,
+											&ic[nIC].cells.c_codes[0],
+											&ic[nIC].cells.pec_match[0]);
+	}
+	LTC681x_check_pec(1, CELL, &ic[nIC]);
+	
+	return(pec_error);
+}
+
+/* Reads and parses the auxiliary registers of a single addressed IC */
+int8_t LTC681x_rdaux_addr(uint8_t reg, //Aux register to read back, REG_ALL for all
+						  uint8_t nIC, //IC to be read
+						  cell_asic ic[] //A two dimensional array that stores the parsed codes
+						  )
+{
+	uint8_t *data = &frame[NUM_CMD_BYT];
+	uint8_t cmd[2] = {0x00 , 0x00};
+	uint8_t first = reg;
+	uint8_t last = reg;
+	int8_t pec_error = 0;
 	
-	for (uint8_t current_ic = 0; current_ic<total_ic; current_ic++)
+	if (reg == REG_ALL)
 	{
-		if (ic->isospi_reverse == false)
+		first = 1;
+		last = ic_traits::num_gpio_reg;
+	}
+	for (uint8_t gpio_reg = first; gpio_reg <= last; gpio_reg++)
+	{
+		cmd[1] = rdaux_cmd[gpio_reg-1];
+		read_68_addr_raw(ic[nIC].address, cmd, data);
+		pec_error = pec_error + parse_cells(0, gpio_reg, data,
+											&ic[nIC].aux.a_codes[0],
+											&ic[nIC].aux.pec_match[0]);
+	}
+	LTC681x_check_pec(1, AUX, &ic[nIC]);
+	
+	return(pec_error);
+}
+
+/* Reads and parses the status registers of a single addressed IC */
+int8_t LTC681x_rdstat_addr(uint8_t reg, //Stat register to read back, REG_ALL for all
+						   uint8_t nIC, //IC to be read
+						   cell_asic ic[] //A two dimensional array that stores the parsed codes
+						   )
+{
+	uint8_t *data = &frame[NUM_CMD_BYT];
+	uint8_t cmd[2] = {0x00 , 0x00};
+	uint8_t first = reg;
+	uint8_t last = reg;
+	int8_t pec_error = 0;
+	st *stat = &ic[nIC].stat;
+	
+	if (reg == REG_ALL)
+	{
+		first = 1;
+		last = 2;
+	}
+	for (uint8_t stat_reg = first; stat_reg <= last; stat_reg++)
+	{
+		cmd[1] = rdstat_cmd[stat_reg-1];
+		read_68_addr_raw(ic[nIC].address, cmd, data);
+		if (stat_reg == 1)
 		{
-			c_ic = current_ic;
+			stat->stat_codes[0] = data[0] | (data[1]<<8);
+			stat->stat_codes[1] = data[2] | (data[3]<<8);
+			stat->stat_codes[2] = data[4] | (data[5]<<8);
 		}
 		else
 		{
-			c_ic = total_ic - current_ic - 1;
+			stat->stat_codes[3] = data[0] | (data[1]<<8);
+			stat->flags[0] = data[2];
+			stat->flags[1] = data[3];
+			stat->flags[2] = data[4];
+			stat->mux_fail[0] = (data[5] & 0x02)>>1;
+			stat->thsd[0] = data[5] & 0x01;
+		}
+		if (((data[6]<<8) | data[7]) != pec15_calc(6, data))
+		{
+			stat->pec_match[stat_reg-1] = 1;
+			pec_error++;
 		}
+		else stat->pec_match[stat_reg-1] = 0;
+	}
+	LTC681x_check_pec(1, STAT, &ic[nIC]);
+	
+	return(pec_error);
+}
+
+/* Reads the cell voltages of the ICs selected in ic_mask only */
+int8_t LTC681x_rdcv_subset(uint8_t reg, //Cell voltage register to read back, REG_ALL for all
+						   uint8_t total_ic, //Number of ICs in the system
+						   cell_asic ic[], //A two dimensional array that stores the parsed codes
+						   uint32_t ic_mask //Bit n set reads IC n
+						   )
+{
+	int8_t pec_error = 0;
 	
-		for (int byte=0; byte<8; byte++)
+	for (uint8_t current_ic = 0; current_ic < total_ic; current_ic++)
+	{
+		if (ic_mask & (1UL << current_ic))
 		{
-			ic[c_ic].com.rx_data[byte] = read_buffer[byte+(8*current_ic)];
+			pec_error = pec_error + LTC681x_rdcv_addr(reg, current_ic, ic);
 		}
-		
-		calc_pec = pec15_calc(6,&read_buffer[8*current_ic]);
-		data_pec = read_buffer[7+(8*current_ic)] | (read_buffer[6+(8*current_ic)]<<8);
-		if (calc_pec != data_pec )
+	}
+	
+	return(pec_error);
+}
+
+/* Reads the auxiliary registers of the ICs selected in ic_mask only */
+int8_t LTC681x_rdaux_subset(uint8_t reg, //Aux register to read back, REG_ALL for all
+							uint8_t total_ic, //Number of ICs in the system
+							cell_asic ic[], //A two dimensional array that stores the parsed codes
+							uint32_t ic_mask //Bit n set reads IC n
+							)
+{
+	int8_t pec_error = 0;
+	
+	for (uint8_t current_ic = 0; current_ic < total_ic; current_ic++)
+	{
+		if (ic_mask & (1UL << current_ic))
 		{
-			ic[c_ic].com.rx_pec_match = 1;
+			pec_error = pec_error + LTC681x_rdaux_addr(reg, current_ic, ic);
 		}
-		else ic[c_ic].com.rx_pec_match = 0;
 	}
 	
-    return(pec_error);
+	return(pec_error);
 }
 
 /* Shifts data in COMM register out over LTC681x SPI/I2C port */
@@ -1992,7 +2567,8 @@ void LTC681x_stcomm(uint8_t len) //Length of data to be transmitted
 	{
 	  spi_read_byte(0xFF);
 	}
-	cs_high(CS_PIN);
+	release_cs(cmd[0]);
+	comm_stale = 1;
 }
 
 /* Helper function that increments PEC counters */
@@ -2011,6 +2587,7 @@ void LTC681x_check_pec(uint8_t total_ic, //Number of ICs in the system
 		  }
 		break;
 
+#if LTC681X_HAS_B_REGS
 		case CFGRB:
 		  for (int current_ic = 0 ; current_ic < total_ic; current_ic++)
 		  {
@@ -2018,10 +2595,11 @@ void LTC681x_check_pec(uint8_t total_ic, //Number of ICs in the system
 			ic[current_ic].crc_count.cfgr_pec = ic[current_ic].crc_count.cfgr_pec + ic[current_ic].configb.rx_pec_match;
 		  }
 		break;
+#endif
 		case CELL:
 		  for (int current_ic = 0 ; current_ic < total_ic; current_ic++)
 		  {
-			for (int i=0; i<ic[0].ic_reg.num_cv_reg; i++)
+			for (int i=0; i<ic_traits::num_cv_reg; i++)
 			{
 			  ic[current_ic].crc_count.pec_count = ic[current_ic].crc_count.pec_count + ic[current_ic].cells.pec_match[i];
 			  ic[current_ic].crc_count.cell_pec[i] = ic[current_ic].crc_count.cell_pec[i] + ic[current_ic].cells.pec_match[i];
@@ -2031,7 +2609,7 @@ void LTC681x_check_pec(uint8_t total_ic, //Number of ICs in the system
 		case AUX:
 		  for (int current_ic = 0 ; current_ic < total_ic; current_ic++)
 		  {
-			for (int i=0; i<ic[0].ic_reg.num_gpio_reg; i++)
+			for (int i=0; i<ic_traits::num_gpio_reg; i++)
 			{
 			  ic[current_ic].crc_count.pec_count = ic[current_ic].crc_count.pec_count + (ic[current_ic].aux.pec_match[i]);
 			  ic[current_ic].crc_count.aux_pec[i] = ic[current_ic].crc_count.aux_pec[i] + (ic[current_ic].aux.pec_match[i]);
@@ -2043,7 +2621,7 @@ void LTC681x_check_pec(uint8_t total_ic, //Number of ICs in the system
 		  for (int current_ic = 0 ; current_ic < total_ic; current_ic++)
 		  {
 
-			for (int i=0; i<ic[0].ic_reg.num_stat_reg-1; i++)
+			for (int i=0; i<ic_traits::num_stat_reg-1; i++)
 			{
 			  ic[current_ic].crc_count.pec_count = ic[current_ic].crc_count.pec_count + ic[current_ic].stat.pec_match[i];
 			  ic[current_ic].crc_count.stat_pec[i] = ic[current_ic].crc_count.stat_pec[i] + ic[current_ic].stat.pec_match[i];
@@ -2064,12 +2642,12 @@ void LTC681x_reset_crc_count(uint8_t total_ic, //Number of ICs in the system
 	{
 		ic[current_ic].crc_count.pec_count = 0;
 		ic[current_ic].crc_count.cfgr_pec = 0;
-		for (int i=0; i<6; i++)
+		for (int i=0; i<ic_traits::num_cv_reg; i++)
 		{
 			ic[current_ic].crc_count.cell_pec[i]=0;
 		
 		}
-		for (int i=0; i<4; i++)
+		for (int i=0; i<ic_traits::num_gpio_reg; i++)
 		{
 			ic[current_ic].crc_count.aux_pec[i]=0;
 		}
@@ -2127,6 +2705,7 @@ void LTC681x_set_cfgr_adcopt(uint8_t nIC, cell_asic *ic, bool adcopt)
 {
 	if (adcopt) ic[nIC].config.tx_data[0] = ic[nIC].config.tx_data[0]|0x01;
 	else ic[nIC].config.tx_data[0] = ic[nIC].config.tx_data[0]&0xFE;
+	adc_opt = adcopt;
 }
 
 /* Helper function to set GPIO bits */
@@ -76,10 +76,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
     Library for LT_SPI: Routines to communicate with ATmega328P's hardware SPI port.
 */
 
-#include <Arduino.h>
 #include <stdint.h>
-#include <SPI.h>
-#include "Linduino.h"
+#include "hal.h"
 #include "LT_SPI.h"
 
 // modified CS pin 
@@ -89,11 +87,11 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 // Return 0 if successful, 1 if failed
 void spi_transfer_byte(uint8_t cs_pin, uint8_t tx, uint8_t *rx)
 {
-  output_low(cs_pin);                 //! 1) Pull CS low
+  hal_pin_write(cs_pin, 0);                 //! 1) Pull CS low
 
-  *rx = SPI.transfer(tx);             //! 2) Read byte and send byte
+  *rx = hal_spi_transfer(tx);             //! 2) Read byte and send byte
 
-  output_high(cs_pin);                //! 3) Pull CS high
+  hal_pin_write(cs_pin, 1);                //! 3) Pull CS high
 }
 
 // Reads and sends a word
@@ -114,14 +112,14 @@ void spi_transfer_word(uint8_t cs_pin, uint16_t tx, uint16_t *rx)
 
   data_tx.w = tx;
 
-  output_low(cs_pin);                         //! 1) Pull CS low
+  hal_pin_write(cs_pin, 0);                         //! 1) Pull CS low
 
-  data_rx.b[1] = SPI.transfer(data_tx.b[1]);  //! 2) Read MSB and send MSB
-  data_rx.b[0] = SPI.transfer(data_tx.b[0]);  //! 3) Read LSB and send LSB
+  data_rx.b[1] = hal_spi_transfer(data_tx.b[1]);  //! 2) Read MSB and send MSB
+  data_rx.b[0] = hal_spi_transfer(data_tx.b[0]);  //! 3) Read LSB and send LSB
 
   *rx = data_rx.w;
 
-  output_high(cs_pin);                        //! 4) Pull CS high
+  hal_pin_write(cs_pin, 1);                        //! 4) Pull CS high
 }
 
 // Reads and sends a byte array
@@ -129,12 +127,12 @@ void spi_transfer_block(uint8_t cs_pin, uint8_t *tx, uint8_t *rx, uint8_t length
 {
   int8_t i;
 
-  output_low(cs_pin);                 //! 1) Pull CS low
+  hal_pin_write(cs_pin, 0);                 //! 1) Pull CS low
 
   for (i=(length-1);  i >= 0; i--)
-    rx[i] = SPI.transfer(tx[i]);    //! 2) Read and send byte array
+    rx[i] = hal_spi_transfer(tx[i]);    //! 2) Read and send byte array
 
-  output_high(cs_pin);                //! 3) Pull CS high
+  hal_pin_write(cs_pin, 1);                //! 3) Pull CS high
 }
 
 // Connect SPI pins to QuikEval connector through the Linduino MUX. This will disconnect I2C.
@@ -162,44 +160,27 @@ void quikeval_SPI_init(void)  // Initializes SPI
 // calls this function.
 void spi_enable(uint8_t spi_clock_divider) // Configures SCK frequency. Use constant defined in header file.
 {
-  pinMode(SCK, OUTPUT);             //! 1) Setup SCK as output
-  pinMode(MOSI, OUTPUT);            //! 2) Setup MOSI as output
-  pinMode(PASSIVE_CS_OVERRIDE, OUTPUT);     //! 3) Setup CS as output
-  SPI.begin();
-  SPI.setClockDivider(spi_clock_divider);
+  hal_pin_mode(PASSIVE_CS_OVERRIDE, HAL_PIN_OUTPUT);     //! 1) Setup CS as output
+  hal_spi_begin(spi_clock_divider);                       //! 2) SCK and MOSI as outputs, set the clock
 }
 
 // Disable the SPI hardware port
 void spi_disable()
 {
-  SPI.end();
+  hal_spi_end();
 }
 
 // Write a data byte using the SPI hardware
 void spi_write(int8_t  data)  // Byte to be written to SPI port
 {
-#if defined(ARDUINO_ARCH_AVR)
-  SPDR = data;                  //! 1) Start the SPI transfer
-  while (!(SPSR & _BV(SPIF)));  //! 2) Wait until transfer complete
-#else
-  SPI.transfer(data);
-#endif
-
+  hal_spi_transfer((uint8_t)data);
 }
 
 // Read and write a data byte using the SPI hardware
 // Returns the data byte read
 int8_t spi_read(int8_t  data) //!The data byte to be written
 {
-#if defined(ARDUINO_ARCH_AVR)
-  SPDR = data;                  //! 1) Start the SPI transfer
-  while (!(SPSR & _BV(SPIF)));  //! 2) Wait until transfer complete
-  return SPDR;                  //! 3) Return the data read
-#else
-  return SPI.transfer(data);
-#endif
-
-
+  return (int8_t)hal_spi_transfer((uint8_t)data);
 }
 
 // Below are implementations of spi_read, etc. that do not use the
@@ -0,0 +1,210 @@
+/***************************************************************************
+    MeasurementScheduler.cpp
+
+    INTRO
+    Pipelined cell/aux/stat acquisition for an LTC6811 daisy chain.
+    See MeasurementScheduler.h
+
+****************************************************************************/
+#include "LTC681x.h"
+#include "LTC6811.h"
+#include <MeasurementScheduler.h>
+
+MeasurementScheduler::MeasurementScheduler(uint8_t _totalIc, cell_asic *_ic, uint8_t _md, uint8_t _dcp,
+                                           bool _measureAux, uint8_t _statInterval) {
+    totalIc = _totalIc;
+    ic = _ic;
+    md = _md;
+    dcp = _dcp;
+    measureAux = _measureAux;
+    statInterval = _statInterval;
+    running = false;
+    converting = GROUP_NONE;
+    readingCells = false;
+    startAfterRead = GROUP_NONE;
+    cycleDone = false;
+    statCycle = false;
+    statCountdown = _statInterval;
+    resetStats();
+}
+
+void MeasurementScheduler::resetStats() {
+    _stats = measurementStats();
+    periodSum = 0;
+    periodCount = 0;
+    cellStartValid = false;
+}
+
+void MeasurementScheduler::start() {
+    wakeup_sleep(totalIc);
+    running = true;
+    converting = GROUP_NONE;
+    readingCells = false;
+    startAfterRead = GROUP_NONE;
+    statCountdown = statInterval;
+    cellStartValid = false;
+    startConversion(GROUP_CELL);
+}
+
+void MeasurementScheduler::stop() {
+    running = false;
+}
+
+bool MeasurementScheduler::service() {
+    if (!running) {
+        return false;
+    }
+
+    // The loop gets on with other work while the cell registers are on the wire
+    if (readingCells) {
+        int8_t error = 0;
+        if (LTC6811_rdcv_service(&error) == 0) {
+            return false;
+        }
+        readingCells = false;
+        if (!statCycle) {
+            // Sum of cells from ADCVSC, the full status group is read after ADSTAT instead
+            wakeup_idle(totalIc);
+            error |= LTC6811_rdstat(1, totalIc, ic);
+        }
+        checkError(error);
+        return finishRead();
+    }
+
+    if (converting == GROUP_NONE) {
+        return false;
+    }
+
+    // Waits out the table conversion time without touching the bus, then confirms with PLADC
+    if (LTC6811_adc_confirm_due()) {
+        wakeup_idle(totalIc);
+    }
+    if (LTC6811_adc_service() == 0) {
+        return false;
+    }
+
+    group_t done = converting;
+    uint32_t convTime = LTC6811_adc_elapsed();
+    switch (done) {
+        case GROUP_CELL: _stats.convTimeCell = convTime; break;
+        case GROUP_AUX:  _stats.convTimeAux = convTime;  break;
+        case GROUP_STAT: _stats.convTimeStat = convTime; break;
+        default: break;
+    }
+
+    // Start the next conversion before reading back unless it would overwrite the registers about to be read
+    group_t next = nextGroup(done);
+    converting = GROUP_NONE;
+    cycleDone = (next == GROUP_CELL);
+    if (conflicts(next, done)) {
+        startAfterRead = next;
+    }
+    else {
+        startConversion(next);
+    }
+    readResults(done);
+    if (readingCells) {
+        return false;
+    }
+    return finishRead();
+}
+
+bool MeasurementScheduler::finishRead() {
+    if (startAfterRead != GROUP_NONE) {
+        startConversion(startAfterRead);
+        startAfterRead = GROUP_NONE;
+    }
+    if (cycleDone) {
+        _stats.cycles++;
+        return true;
+    }
+    return false;
+}
+
+MeasurementScheduler::group_t MeasurementScheduler::nextGroup(group_t done) {
+    switch (done) {
+        case GROUP_CELL:
+            if (statCycle) return GROUP_STAT;
+            return measureAux ? GROUP_AUX : GROUP_CELL;
+        case GROUP_STAT:
+            return measureAux ? GROUP_AUX : GROUP_CELL;
+        default:
+            return GROUP_CELL;
+    }
+}
+
+bool MeasurementScheduler::conflicts(group_t next, group_t done) {
+    // ADCVSC also writes the sum of cells into status register A
+    return (next == done) || (next == GROUP_CELL && done == GROUP_STAT);
+}
+
+void MeasurementScheduler::startConversion(group_t group) {
+    wakeup_idle(totalIc);
+    switch (group) {
+        case GROUP_CELL:
+            if (statInterval != 0 && --statCountdown == 0) {
+                statCountdown = statInterval;
+                statCycle = true;
+            }
+            else {
+                statCycle = false;
+            }
+            LTC6811_adcvsc(md, dcp);
+            break;
+        case GROUP_AUX:
+            LTC6811_adax(md, AUX_CH_ALL);
+            break;
+        case GROUP_STAT:
+            LTC6811_adstat(md, STAT_CH_ALL);
+            break;
+        default:
+            return;
+    }
+    convStart = hal_micros();
+    converting = group;
+
+    if (group == GROUP_CELL) {
+        if (cellStartValid) {
+            uint32_t period = convStart - cellStart;
+            _stats.periodLast = period;
+            if (periodCount == 0 || period < _stats.periodMin) _stats.periodMin = period;
+            if (period > _stats.periodMax) _stats.periodMax = period;
+            periodSum += period;
+            periodCount++;
+            _stats.periodMean = periodSum / periodCount;
+            _stats.jitter = _stats.periodMax - _stats.periodMin;
+        }
+        cellStart = convStart;
+        cellStartValid = true;
+    }
+}
+
+void MeasurementScheduler::readResults(group_t group) {
+    int8_t error = 0;
+
+    wakeup_idle(totalIc);
+    switch (group) {
+        case GROUP_CELL:
+            // Finished by service() once the last register group is in
+            LTC6811_rdcv_start(totalIc, ic);
+            readingCells = true;
+            return;
+        case GROUP_AUX:
+            error = LTC6811_rdaux(REG_ALL, totalIc, ic);
+            break;
+        case GROUP_STAT:
+            error = LTC6811_rdstat(REG_ALL, totalIc, ic);
+            break;
+        default:
+            return;
+    }
+    checkError(error);
+}
+
+void MeasurementScheduler::checkError(int8_t error) {
+    if (error != 0) {
+        _stats.pecErrors++;
+        // The chain may have slept or reset, wake it properly before the next frame
+        LTC6811_wake_invalidate();
+    }
+}
@@ -8,9 +8,17 @@
     INTRO
     This library support attaching callback function to "proper"ticker
     with stm32duino framework.
-    A HardwareTimer is used as the base interrupt will call the timerHandler 
-    function every 1ms. timerHandler will then check if it's time to call the
-    actual callback function using a counter
+    A HardwareTimer, set up by hal_tick_start(), is used as the base interrupt will call the timerHandler 
+    function every 1ms. Tickers are kept in a two level timer wheel, so
+    timerHandler only looks at the slot for the current tick and attach,
+    once and detach are O(1) whatever the number of tickers. An expired
+    ticker is posted to a ready queue for its priority and its callback
+    runs to completion from dispatch() in the main loop, so SPI and CAN
+    work never holds off other interrupts.
+
+    With tickless idle enabled, idle() stretches the timer period to the
+    next occupied wheel slot, stops SysTick and sleeps the core until the
+    timer or another interrupt wakes it.
 
     Based on STM32_TimerInterrupt
     Author: Khoi Hoang
@@ -18,43 +26,368 @@
     Revision     Date          Comments
     --------   ----------     ------------
     0.0        24/06/2021     Initial coding
+    0.1        17/10/2026     Callbacks run from dispatch(), priorities,
+                              deadlines and run time statistics
+    0.2        17/10/2026     Timer wheel, detach, one shot tickers and
+                              phase offsets
+    0.3        17/10/2026     Tickless idle
+    0.4        17/10/2026     Timer and sleep through hal.h
+    0.5        17/10/2026     Ready queues use every entry, detach takes
+                              a queued release out
 
 ****************************************************************************/
-#include "Arduino.h"
 #include <TickerInterrupt.h>
+#include "Trace.h"
 
 
-volatile int TickerInterrupt::tickerNumber = -1;
+volatile uint32_t TickerInterrupt::tick = 0;
+int16_t TickerInterrupt::freeList = -1;
+int16_t TickerInterrupt::wheel[2*TICKER_WHEEL_SIZE];
+uint64_t TickerInterrupt::occupied[2];
 tickerInfo TickerInterrupt::ticker[MAX_TICKER_NUMBER];
+tickerQueue TickerInterrupt::queue[TICKER_PRIORITY_COUNT];
 
-TickerInterrupt::TickerInterrupt(TIM_TypeDef *_timerInstance, double _interval) {
+TickerInterrupt::TickerInterrupt(hal_timer _timerInstance, double _interval) {
     timerInstance = _timerInstance;
     interval = (uint32_t)(_interval*1000);
+    started = false;
+    tickless = false;
+    _idleStats = idleStats();
+
+    for (int i = 0; i < 2*TICKER_WHEEL_SIZE; i++) {
+        wheel[i] = -1;
+    }
+    for (int i = 0; i < MAX_TICKER_NUMBER; i++) {
+        ticker[i].inUse = false;
+        ticker[i].slot = TICKER_SLOT_NONE;
+        ticker[i].next = (i + 1 < MAX_TICKER_NUMBER) ? i + 1 : -1;
+    }
+    freeList = 0;
+    occupied[0] = 0;
+    occupied[1] = 0;
+}
+
+static inline uint64_t rotr64(uint64_t bits, uint8_t n) {
+    n &= TICKER_WHEEL_MASK;
+    return n ? (bits >> n) | (bits << (64 - n)) : bits;
+}
+
+/* Put a ticker in the wheel slot for its expiry, relative to the current tick.
+   Due within TICKER_WHEEL_SIZE ticks goes in level 0, otherwise in level 1 by
+   the upper bits of the expiry. Beyond the span of level 1 it is parked in
+   the furthest level 1 slot and placed again when that slot cascades. */
+void TickerInterrupt::link(int16_t id) {
+    tickerInfo &t = ticker[id];
+    uint32_t now = tick;
+    uint32_t delta = t.expires - now;
+    uint8_t slot;
+
+    if (delta < TICKER_WHEEL_SIZE) {
+        slot = t.expires & TICKER_WHEEL_MASK;
+    } else if (delta < TICKER_WHEEL_SPAN - TICKER_WHEEL_SIZE) {
+        slot = TICKER_WHEEL_SIZE + ((t.expires >> TICKER_WHEEL_BITS) & TICKER_WHEEL_MASK);
+    } else {
+        slot = TICKER_WHEEL_SIZE + (((now >> TICKER_WHEEL_BITS) - 1) & TICKER_WHEEL_MASK);
+    }
+
+    t.slot = slot;
+    t.prev = -1;
+    t.next = wheel[slot];
+    if (t.next >= 0) {
+        ticker[t.next].prev = id;
+    }
+    wheel[slot] = id;
+    occupied[slot / TICKER_WHEEL_SIZE] |= (uint64_t)1 << (slot & TICKER_WHEEL_MASK);
+}
+
+void TickerInterrupt::unlink(int16_t id) {
+    tickerInfo &t = ticker[id];
+    if (t.slot == TICKER_SLOT_NONE) {
+        return;
+    }
+    if (t.prev >= 0) {
+        ticker[t.prev].next = t.next;
+    } else {
+        wheel[t.slot] = t.next;
+        if (t.next < 0) {
+            occupied[t.slot / TICKER_WHEEL_SIZE] &= ~((uint64_t)1 << (t.slot & TICKER_WHEEL_MASK));
+        }
+    }
+    if (t.next >= 0) {
+        ticker[t.next].prev = t.prev;
+    }
+    t.slot = TICKER_SLOT_NONE;
+}
+
+/* Post an expired ticker to its ready queue, ISR context */
+void TickerInterrupt::release(int16_t id) {
+    tickerInfo &t = ticker[id];
+    tickerQueue &q = queue[t.priority];
+    uint16_t head = q.head;
+
+    if (t.pending || (uint16_t)(head - q.tail) == TICKER_QUEUE_SIZE) {
+        // Still queued or running from the last release
+        t.stats.overruns++;
+        return;
+    }
+    t.released = hal_micros();
+    t.pending = true;
+    q.slot[head & (TICKER_QUEUE_SIZE-1)] = id;
+    q.head = head + 1;
+}
+
+/* Take the queued release of a ticker out of its ready queue, the later
+   entries move up one. Interrupts disabled, from the main loop */
+void TickerInterrupt::unqueue(int16_t id) {
+    tickerQueue &q = queue[ticker[id].priority];
+    uint16_t head = q.head;
+    uint16_t i = q.tail;
+
+    while (i != head && q.slot[i & (TICKER_QUEUE_SIZE-1)] != id) {
+        i++;
+    }
+    if (i == head) {
+        return;
+    }
+    for (uint16_t next = i + 1; next != head; i = next++) {
+        q.slot[i & (TICKER_QUEUE_SIZE-1)] = q.slot[next & (TICKER_QUEUE_SIZE-1)];
+    }
+    q.head = head - 1;
 }
 
 void TickerInterrupt::timerHandler() {
-    for (int i = 0; i <= tickerNumber; i++) {
-        ticker[i].counter++;
-        if (ticker[i].counter/ticker[i].interval >= 1) {
-            ticker[i].counter = 0;
-            ticker[i].callback();
-        }    
+    step();
+}
+
+/* Advance the wheel by one tick */
+void TickerInterrupt::step() {
+    uint32_t now = tick + 1;
+    tick = now;
+
+    // Entering a new level 0 revolution, move the matching level 1 slot down
+    if ((now & TICKER_WHEEL_MASK) == 0) {
+        uint8_t slot = TICKER_WHEEL_SIZE + ((now >> TICKER_WHEEL_BITS) & TICKER_WHEEL_MASK);
+        int16_t id = wheel[slot];
+        wheel[slot] = -1;
+        occupied[1] &= ~((uint64_t)1 << (slot & TICKER_WHEEL_MASK));
+        while (id >= 0) {
+            int16_t next = ticker[id].next;
+            link(id);
+            id = next;
+        }
     }
+
+    uint8_t slot = now & TICKER_WHEEL_MASK;
+    int16_t id = wheel[slot];
+    wheel[slot] = -1;
+    occupied[0] &= ~((uint64_t)1 << slot);
+    while (id >= 0) {
+        tickerInfo &t = ticker[id];
+        int16_t next = t.next;
+        t.slot = TICKER_SLOT_NONE;
+        release(id);
+        if (t.interval != 0) {
+            t.expires += t.interval;
+            link(id);
+        }
+        id = next;
+    }
+}
+
+/* Ticks from the current one to the next that has work: an occupied level 0
+   slot or a cascade of an occupied level 1 slot */
+uint32_t TickerInterrupt::nextDue() {
+    uint32_t now = tick;
+    uint32_t due = TICKER_MAX_SLEEP_TICKS;
+
+    uint64_t level0 = rotr64(occupied[0], (now + 1) & TICKER_WHEEL_MASK);
+    if (level0) {
+        due = __builtin_ctzll(level0) + 1;
+    }
+
+    uint32_t boundary = (now | TICKER_WHEEL_MASK) + 1;
+    uint64_t level1 = rotr64(occupied[1], (boundary >> TICKER_WHEEL_BITS) & TICKER_WHEEL_MASK);
+    if (level1) {
+        uint32_t cascade = (boundary - now) + ((uint32_t)__builtin_ctzll(level1) << TICKER_WHEEL_BITS);
+        if (cascade < due) {
+            due = cascade;
+        }
+    }
+    return due;
 }
 
 void TickerInterrupt::start() {
-    HardwareTimer *timer = new HardwareTimer(timerInstance);
-    timer->setOverflow(interval,MICROSEC_FORMAT); // 10 Hz
-    timer->attachInterrupt(timerHandler);
-    timer->resume();
+    hal_tick_start(timerInstance, interval, TICKER_COUNTS_PER_TICK, timerHandler);
+    started = true;
+}
+
+bool TickerInterrupt::idle() {
+    if (!tickless || !started) {
+        return false;
+    }
+
+    hal_irq_disable();
+    for (uint8_t p = 0; p < TICKER_PRIORITY_COUNT; p++) {
+        if (queue[p].tail != queue[p].head) {
+            hal_irq_enable();
+            return false;
+        }
+    }
+    uint32_t sleep = nextDue();
+    if (sleep <= 1) {
+        hal_irq_enable();
+        return false;
+    }
+
+    // The port stretches the timer period to the boundary of the due tick
+    hal_tick_wake wake;
+    if (!hal_tick_sleep(sleep, &wake)) {
+        hal_irq_enable();
+        return false;
+    }
+
+    uint32_t ticks = wake.position / TICKER_COUNTS_PER_TICK;
+    for (uint32_t i = 0; i < ticks; i++) {
+        step();
+    }
+    hal_irq_enable();
+
+    _idleStats.sleeps++;
+    _idleStats.ticksSlept += ticks;
+    if (wake.fired) {
+        uint32_t latency = wake.count*interval / TICKER_COUNTS_PER_TICK;
+        _idleStats.wakeLatencyLast = latency;
+        if (latency > _idleStats.wakeLatencyMax) {
+            _idleStats.wakeLatencyMax = latency;
+        }
+    } else {
+        _idleStats.earlyWakes++;
+    }
+    return true;
+}
+
+int TickerInterrupt::add(fpointer _callback, uint32_t _interval, uint32_t _delay,
+                         tickerPriority _priority, uint32_t _deadline) {
+    hal_irq_disable();
+    int16_t id = freeList;
+    if (id < 0) {
+        hal_irq_enable();
+        return -1;
+    }
+    freeList = ticker[id].next;
+
+    tickerInfo &t = ticker[id];
+    t.interval = _interval;
+    t.callback = _callback;
+    t.priority = (_priority < TICKER_PRIORITY_COUNT) ? _priority : TICKER_PRIORITY_LOW;
+    t.deadline = _deadline*1000;
+    t.pending = false;
+    t.runTimeSum = 0;
+    t.stats = tickerStats();
+    t.inUse = true;
+    t.expires = tick + (_delay ? _delay : 1);
+    link(id);
+    hal_irq_enable();
+    return id;
+}
+
+int TickerInterrupt::attach(fpointer _callback, int _interval, tickerPriority _priority, int _deadline, int _phase) {
+    if (_interval < 1) {
+        _interval = 1;
+    }
+    if (_phase < 0) {
+        _phase = 0;
+    }
+    return add(_callback, (uint32_t)_interval, (uint32_t)(_interval + _phase), _priority,
+               (uint32_t)((_deadline > 0) ? _deadline : _interval));
+}
+
+int TickerInterrupt::once(fpointer _callback, int _delay, tickerPriority _priority, int _deadline) {
+    if (_delay < 1) {
+        _delay = 1;
+    }
+    return add(_callback, 0, (uint32_t)_delay, _priority,
+               (uint32_t)((_deadline > 0) ? _deadline : _delay));
+}
+
+void TickerInterrupt::detach(int id) {
+    if (id < 0 || id >= MAX_TICKER_NUMBER) {
+        return;
+    }
+    hal_irq_disable();
+    tickerInfo &t = ticker[id];
+    if (t.inUse) {
+        unlink(id);
+        // Drop a release already in a ready queue, so its slot is free for
+        // the next ticker given this id
+        if (t.pending) {
+            unqueue(id);
+        }
+        t.pending = false;
+        t.inUse = false;
+        t.next = freeList;
+        freeList = id;
+    }
+    hal_irq_enable();
+}
+
+bool TickerInterrupt::dispatch() {
+    for (uint8_t p = 0; p < TICKER_PRIORITY_COUNT; p++) {
+        tickerQueue &q = queue[p];
+        while (q.tail != q.head) {
+            int16_t id = q.slot[q.tail & (TICKER_QUEUE_SIZE-1)];
+            q.tail = q.tail + 1;
+            if (ticker[id].pending) {
+                run(id);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void TickerInterrupt::run(int16_t id) {
+    tickerInfo &t = ticker[id];
+    uint32_t released = t.released;
+
+    // Cleared before the callback so a release during a long run is queued, not lost
+    t.pending = false;
+
+    uint32_t begin = hal_micros();
+    {
+        TRACE_SCOPE(TRACE_TICKER_CALLBACK);
+        t.callback();
+    }
+    uint32_t end = hal_micros();
+
+    tickerStats &s = t.stats;
+    uint32_t runTime = end - begin;
+    s.runs++;
+    s.runTimeLast = runTime;
+    if (runTime > s.runTimeMax) {
+        s.runTimeMax = runTime;
+    }
+    t.runTimeSum += runTime;
+    s.runTimeMean = t.runTimeSum / s.runs;
+    if (begin - released > s.latencyMax) {
+        s.latencyMax = begin - released;
+    }
+    if (end - released > t.deadline) {
+        s.deadlineMisses++;
+    }
+
+    // A one shot ticker is done unless the callback detached it already
+    if (t.interval == 0 && t.inUse) {
+        detach(id);
+    }
 }
 
-void TickerInterrupt::attach(fpointer _callback, int _interval) {
-    tickerNumber++;
-    if (tickerNumber < MAX_TICKER_NUMBER) {
-        ticker[tickerNumber].counter = 0;
-        ticker[tickerNumber].interval = (uint32_t)(_interval);
-        ticker[tickerNumber].callback = _callback;
+void TickerInterrupt::resetStats() {
+    _idleStats = idleStats();
+    for (int i = 0; i < MAX_TICKER_NUMBER; i++) {
+        if (ticker[i].inUse) {
+            ticker[i].runTimeSum = 0;
+            ticker[i].stats = tickerStats();
+        }
     }
-    delay(10);
-}
\ No newline at end of file
+}
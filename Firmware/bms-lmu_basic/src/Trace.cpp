@@ -0,0 +1,161 @@
+/*
+Trace.cpp
+
+Cycle accurate timing of hot paths, see Trace.h
+*/
+
+#include <stdint.h>
+#include "hal.h"
+#include "Trace.h"
+
+static const char *const trace_names[TRACE_PROBE_COUNT] =
+{
+  "LTC6811_rdcv",
+  "pec15_calc",
+  "parse_cells",
+  "ticker_callback",
+  "cs_low",
+  "fault_check",
+};
+
+static trace_stats trace_table[TRACE_PROBE_COUNT];
+static uint32_t trace_overhead = 0; // Cycles of an empty probe, taken off every sample
+
+void trace_init()
+{
+  hal_cycles_init();
+
+  // Shortest of a few back to back reads, the first may include a cache or flash wait
+  trace_overhead = UINT32_MAX;
+  for (uint8_t i = 0; i < 8; i++)
+  {
+    uint32_t start = hal_cycles();
+    uint32_t cycles = hal_cycles() - start;
+    if (cycles < trace_overhead)
+    {
+      trace_overhead = cycles;
+    }
+  }
+  trace_reset();
+}
+
+void trace_reset()
+{
+  for (uint8_t i = 0; i < TRACE_PROBE_COUNT; i++)
+  {
+    trace_table[i] = trace_stats();
+    trace_table[i].min = UINT32_MAX;
+  }
+}
+
+void trace_record(trace_probe_id id, uint32_t cycles)
+{
+  trace_stats &s = trace_table[id];
+
+  cycles = (cycles > trace_overhead) ? cycles - trace_overhead : 0;
+  s.count++;
+  s.sum += cycles;
+  if (cycles < s.min)
+  {
+    s.min = cycles;
+  }
+  if (cycles > s.max)
+  {
+    s.max = cycles;
+  }
+
+  uint8_t bucket = (uint8_t)(31 - __builtin_clz(cycles | 1));
+  if (bucket >= TRACE_BUCKETS)
+  {
+    bucket = TRACE_BUCKETS - 1;
+  }
+  s.buckets[bucket]++;
+}
+
+const trace_stats *trace_get(trace_probe_id id)
+{
+  return &trace_table[id];
+}
+
+const char *trace_name(trace_probe_id id)
+{
+  return trace_names[id];
+}
+
+static uint32_t trace_mean(const trace_stats &s)
+{
+  return s.count ? (uint32_t)(s.sum / s.count) : 0;
+}
+
+static uint32_t trace_ns(uint32_t cycles)
+{
+  return (uint32_t)((uint64_t)cycles*1000000000ULL / hal_cycles_hz());
+}
+
+void trace_print()
+{
+  hal_log("Probe            count      min(ns)    mean(ns)   max(ns)\r\n");
+  for (uint8_t i = 0; i < TRACE_PROBE_COUNT; i++)
+  {
+    const trace_stats &s = trace_table[i];
+    if (s.count == 0)
+    {
+      continue;
+    }
+    hal_log("%-16s %-10lu %-10lu %-10lu %-10lu\r\n", trace_names[i], (unsigned long)s.count,
+            (unsigned long)trace_ns(s.min), (unsigned long)trace_ns(trace_mean(s)),
+            (unsigned long)trace_ns(s.max));
+
+    // Histogram as <first cycle count of the bucket>:<samples>
+    hal_log("  cycles");
+    for (uint8_t b = 0; b < TRACE_BUCKETS; b++)
+    {
+      if (s.buckets[b])
+      {
+        hal_log(" %lu:%lu", 1UL << b, (unsigned long)s.buckets[b]);
+      }
+    }
+    hal_log("\r\n");
+  }
+  hal_log("Counter %lu Hz, probe overhead %lu cycles\r\n",
+          (unsigned long)hal_cycles_hz(), (unsigned long)trace_overhead);
+}
+
+static uint8_t *put32(uint8_t *out, uint32_t value)
+{
+  out[0] = (uint8_t)value;
+  out[1] = (uint8_t)(value >> 8);
+  out[2] = (uint8_t)(value >> 16);
+  out[3] = (uint8_t)(value >> 24);
+  return out + 4;
+}
+
+uint16_t trace_encode(uint8_t *out, uint16_t size)
+{
+  if (size < TRACE_ENCODED_LEN)
+  {
+    return 0;
+  }
+
+  uint8_t *p = out;
+  *p++ = TRACE_FORMAT;
+  *p++ = TRACE_PROBE_COUNT;
+  *p++ = TRACE_BUCKETS;
+  p = put32(p, hal_cycles_hz());
+  for (uint8_t i = 0; i < TRACE_PROBE_COUNT; i++)
+  {
+    const trace_stats &s = trace_table[i];
+    *p++ = i;
+    p = put32(p, s.count);
+    p = put32(p, s.count ? s.min : 0);
+    p = put32(p, trace_mean(s));
+    p = put32(p, s.max);
+    for (uint8_t b = 0; b < TRACE_BUCKETS; b++)
+    {
+      uint16_t samples = (s.buckets[b] > 0xFFFF) ? 0xFFFF : (uint16_t)s.buckets[b];
+      *p++ = (uint8_t)samples;
+      *p++ = (uint8_t)(samples >> 8);
+    }
+  }
+  return (uint16_t)(p - out);
+}
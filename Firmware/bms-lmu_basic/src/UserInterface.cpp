@@ -41,37 +41,92 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <Arduino.h>
 #include <stdint.h>
+#include <string.h>
 #include "UserInterface.h"
 
 char ui_buffer[UI_BUFFER_SIZE];
 
-// Read data from the serial interface into the ui_buffer
-uint8_t read_data()
+static char ui_line[UI_BUFFER_SIZE]; // line being typed, ui_buffer keeps the last complete one
+static uint8_t ui_index = 0;
+static bool ui_last_cr = false;
+
+// Collect available serial input, returns the line length once a line is complete
+int16_t ui_poll()
 {
-  uint8_t index = 0; //index to hold current location in ui_buffer
-  int c; // single character used to store incoming keystrokes
-  while (index < UI_BUFFER_SIZE-1)
+  while (Serial.available() > 0)
   {
-    c = Serial.read(); //read one character
-    if (((char) c == '\r') || ((char) c == '\n')) break; // if carriage return or linefeed, stop and return data
-    if ( ((char) c == '\x7F') || ((char) c == '\x08') )   // remove previous character (decrement index) if Backspace/Delete key pressed      index--;
+    int c = Serial.read(); // single character used to store incoming keystrokes
+    if (c < 0) break;
+
+    if ((char) c == '\n' && ui_last_cr)  // linefeed of a CR LF pair, the line already ended on the CR
     {
-      if (index > 0) index--;
+      ui_last_cr = false;
+      continue;
     }
-    else if (c >= 0)
+    ui_last_cr = ((char) c == '\r');
+
+    if (((char) c == '\r') || ((char) c == '\n')) // carriage return or linefeed ends the line
+    {
+      uint8_t length = ui_index;
+      memcpy(ui_buffer, ui_line, length);
+      ui_buffer[length] = '\0';  // terminate string with NULL
+      ui_index = 0;
+      return length;
+    }
+    if ( ((char) c == '\x7F') || ((char) c == '\x08') )   // remove previous character if Backspace/Delete key pressed
     {
-      ui_buffer[index++]=(char) c; // put character into ui_buffer
+      if (ui_index > 0) ui_index--;
+    }
+    else if (ui_index < UI_BUFFER_SIZE-1)
+    {
+      ui_line[ui_index++] = (char) c; // put character into the line
     }
   }
-  ui_buffer[index]='\0';  // terminate string with NULL
+  return -1;
+}
 
-  if ((char) c == '\r')    // if the last character was a carriage return, also clear linefeed if it is next character
+// Parse an integer, see read_int() for the accepted formats
+int32_t ui_parse_int(const char *text, const char **end)
+{
+  char *stop;
+  int32_t data;
+  if ((text[0] == 'B') || (text[0] == 'b'))
   {
-    delay(10);  // allow 10ms for linefeed to appear on serial pins
-    if (Serial.peek() == '\n') Serial.read(); // if linefeed appears, read it and throw it away
+    data = strtol(text+1, &stop, 2);
+    if (stop == text+1) stop = (char *)text; // bare prefix, no number
   }
+  else
+    data = strtol(text, &stop, 0);
+  if (end != NULL) *end = stop;
+  return(data);
+}
 
-  return index; // return number of characters, not including null terminator
+// Run the table entry covering the command number at the start of line
+bool ui_dispatch(const char *line, const ui_command *table, uint8_t count)
+{
+  const char *args;
+  while (*line == ' ') line++;
+  uint32_t cmd = (uint32_t)ui_parse_int(line, &args);
+  if (args == line) return false; // no number
+  while (*args == ' ') args++;
+
+  for (uint8_t i = 0; i < count; i++)
+  {
+    if (cmd >= table[i].first && cmd <= table[i].last)
+    {
+      table[i].handler(cmd, args);
+      return true;
+    }
+  }
+  return false;
+}
+
+// Read data from the serial interface into the ui_buffer
+uint8_t read_data()
+{
+  int16_t length;
+  while ((length = ui_poll()) < 0) {}  // wait for a complete line
+  return (uint8_t)length; // return number of characters, not including null terminator
 }
 
 // Read a float value from the serial interface
@@ -96,12 +151,7 @@ int32_t read_int()
   read_data();
   if (ui_buffer[0] == 'm')
     return('m');
-  if ((ui_buffer[0] == 'B') || (ui_buffer[0] == 'b'))
-  {
-    data = strtol(ui_buffer+1, NULL, 2);
-  }
-  else
-    data = strtol(ui_buffer, NULL, 0);
+  data = ui_parse_int(ui_buffer, NULL);
   return(data);
 }
 
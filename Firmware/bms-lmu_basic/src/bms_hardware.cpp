@@ -40,31 +40,48 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 Copyright 2017 Linear Technology Corp. (LTC)
 */
-#include <Arduino.h>
 #include <stdint.h>
+#include <stddef.h>
 #include "bms_hardware.h"
-#include "Linduino.h"
-#include "LT_SPI.h"
-#include <SPI.h>
+#include "hal.h"
+#include "Trace.h"
+
+/* Chip select pin, resolved on first use and again only if the pin changes */
+static hal_gpio cs_gpio;
+static uint8_t cs_gpio_pin;
+static bool cs_gpio_bound = false;
+
+static inline const hal_gpio *cs_lookup(uint8_t pin)
+{
+  if (!cs_gpio_bound || pin != cs_gpio_pin)
+  {
+    cs_gpio = hal_gpio_bind(pin);
+    cs_gpio_pin = pin;
+    cs_gpio_bound = true;
+  }
+  return &cs_gpio;
+}
 
 void cs_low(uint8_t pin)
 {
-  output_low(pin);
+  spi_async_wait(); // A frame in flight owns chip select until it completes, outside the probe
+  TRACE_SCOPE(TRACE_CS_LOW);
+  hal_gpio_clear(cs_lookup(pin));
 }
 
 void cs_high(uint8_t pin)
 {
-  output_high(pin);
+  hal_gpio_set(cs_lookup(pin));
 }
 
 void delay_u(uint16_t micro)
 {
-  delayMicroseconds(micro);
+  hal_delay_us(micro);
 }
 
 void delay_m(uint16_t milli)
 {
-  delay(milli);
+  hal_delay_ms(milli);
 }
 
 /*
@@ -74,9 +91,10 @@ void spi_write_array(uint8_t len, // Option: Number of bytes to be written on th
                      uint8_t data[] //Array of bytes to be written on the SPI port
                     )
 {
+  spi_async_wait();
   for (uint8_t i = 0; i < len; i++)
   {
-    SPI.transfer((int8_t)data[i]);
+    hal_spi_transfer(data[i]);
   }
 }
 
@@ -91,15 +109,16 @@ void spi_write_read(uint8_t tx_Data[],//array of data to be written on SPI port
                     uint8_t rx_len //Option: number of bytes to be read from the SPI port
                    )
 {
+  spi_async_wait();
   for (uint8_t i = 0; i < tx_len; i++)
   {
-    SPI.transfer(tx_Data[i]);
+    hal_spi_transfer(tx_Data[i]);
   }
 
   for (uint8_t i = 0; i < rx_len; i++)
   {
 
-    rx_data[i] = (uint8_t)SPI.transfer(0xFF);
+    rx_data[i] = hal_spi_transfer(0xFF);
   }
 
 }
@@ -108,6 +127,166 @@ void spi_write_read(uint8_t tx_Data[],//array of data to be written on SPI port
 uint8_t spi_read_byte(uint8_t tx_dat)
 {
   uint8_t data;
-  data = (uint8_t)SPI.transfer(0xFF);
+  spi_async_wait();
+  data = hal_spi_transfer(0xFF);
   return(data);
 }
+
+static volatile bool spi_busy = false;
+static spi_callback spi_done_callback = NULL;
+static uint8_t spi_cs_pin;
+
+#if defined(STM32F1xx)
+#include <Arduino.h> // CMSIS register definitions for the DMA engine
+/*
+ SPI1 is serviced by DMA1 channel 2 (RX) and channel 3 (TX). A frame is moved
+ in two phases so the caller's buffers are used in place: the command phase
+ clocks tx_data out and discards what comes back, the read phase clocks 0xFF
+ out and stores the reply in rx_data. Both phases complete on the RX channel
+ so chip select is only released once the last bit has been shifted in.
+*/
+#define SPI_PHASE_TX 1
+#define SPI_PHASE_RX 2
+
+static volatile uint8_t spi_phase;
+static uint8_t *spi_rx_ptr;
+static uint16_t spi_rx_len;
+static uint8_t spi_rx_discard;
+static const uint8_t spi_tx_fill = 0xFF;
+
+static void spi_dma_start(const uint8_t *tx, bool tx_inc, uint8_t *rx, bool rx_inc, uint16_t len)
+{
+  DMA1_Channel2->CCR = 0;
+  DMA1_Channel3->CCR = 0;
+  DMA1->IFCR = DMA_IFCR_CGIF2 | DMA_IFCR_CGIF3;
+
+  DMA1_Channel2->CPAR = (uint32_t)&SPI1->DR;
+  DMA1_Channel2->CMAR = (uint32_t)rx;
+  DMA1_Channel2->CNDTR = len;
+  DMA1_Channel3->CPAR = (uint32_t)&SPI1->DR;
+  DMA1_Channel3->CMAR = (uint32_t)tx;
+  DMA1_Channel3->CNDTR = len;
+
+  DMA1_Channel2->CCR = DMA_CCR_PL_1 | DMA_CCR_TCIE | (rx_inc ? DMA_CCR_MINC : 0) | DMA_CCR_EN;
+  SPI1->CR2 |= SPI_CR2_RXDMAEN;
+  DMA1_Channel3->CCR = DMA_CCR_PL_1 | DMA_CCR_DIR | (tx_inc ? DMA_CCR_MINC : 0) | DMA_CCR_EN;
+  SPI1->CR2 |= SPI_CR2_TXDMAEN;
+}
+
+extern "C" void DMA1_Channel2_IRQHandler(void)
+{
+  DMA1->IFCR = DMA_IFCR_CGIF2 | DMA_IFCR_CGIF3;
+  DMA1_Channel2->CCR = 0;
+  DMA1_Channel3->CCR = 0;
+  SPI1->CR2 &= ~(SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN);
+
+  if ((spi_phase == SPI_PHASE_TX) && (spi_rx_len > 0))
+  {
+    spi_phase = SPI_PHASE_RX;
+    spi_dma_start(&spi_tx_fill, false, spi_rx_ptr, true, spi_rx_len);
+    return;
+  }
+
+  cs_high(spi_cs_pin);
+  spi_busy = false;
+  if (spi_done_callback != NULL)
+  {
+    spi_done_callback();
+  }
+}
+
+void spi_async_init()
+{
+  RCC->AHBENR |= RCC_AHBENR_DMA1EN;
+  NVIC_SetPriority(DMA1_Channel2_IRQn, 1);
+  NVIC_EnableIRQ(DMA1_Channel2_IRQn);
+}
+
+uint8_t spi_write_read_async(uint8_t cs_pin, uint8_t tx_data[], uint8_t tx_len,
+                             uint8_t *rx_data, uint16_t rx_len, spi_callback callback)
+{
+  if (spi_busy)
+  {
+    return 1;
+  }
+  if ((tx_len == 0) && (rx_len == 0))
+  {
+    // DMA never completes a zero length transfer, finish the empty frame here as the stand-in does
+    cs_low(cs_pin);
+    cs_high(cs_pin);
+    if (callback != NULL)
+    {
+      callback();
+    }
+    return 0;
+  }
+  cs_low(cs_pin);
+  spi_busy = true;
+  spi_cs_pin = cs_pin;
+  spi_done_callback = callback;
+  spi_rx_ptr = rx_data;
+  spi_rx_len = rx_len;
+
+  if (tx_len > 0)
+  {
+    spi_phase = SPI_PHASE_TX;
+    spi_dma_start(tx_data, true, &spi_rx_discard, false, tx_len);
+  }
+  else
+  {
+    spi_phase = SPI_PHASE_RX;
+    spi_dma_start(&spi_tx_fill, false, rx_data, true, rx_len);
+  }
+  return 0;
+}
+
+#else
+/*
+ Stand-in for targets without a DMA driver (and host builds). The frame is
+ transferred before returning, so callers written against the asynchronous
+ interface behave the same, only without the overlap.
+*/
+void spi_async_init()
+{
+}
+
+uint8_t spi_write_read_async(uint8_t cs_pin, uint8_t tx_data[], uint8_t tx_len,
+                             uint8_t *rx_data, uint16_t rx_len, spi_callback callback)
+{
+  if (spi_busy)
+  {
+    return 1;
+  }
+  cs_low(cs_pin);
+  spi_busy = true;
+  spi_cs_pin = cs_pin;
+  spi_done_callback = callback;
+
+  for (uint8_t i = 0; i < tx_len; i++)
+  {
+    hal_spi_transfer(tx_data[i]);
+  }
+  for (uint16_t i = 0; i < rx_len; i++)
+  {
+    rx_data[i] = hal_spi_transfer(0xFF);
+  }
+  cs_high(spi_cs_pin);
+
+  spi_busy = false;
+  if (spi_done_callback != NULL)
+  {
+    spi_done_callback();
+  }
+  return 0;
+}
+#endif
+
+bool spi_async_busy()
+{
+  return spi_busy;
+}
+
+void spi_async_wait()
+{
+  while (spi_busy);
+}
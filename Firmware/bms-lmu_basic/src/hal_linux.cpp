@@ -0,0 +1,207 @@
+/*
+hal_linux.cpp
+
+Linux port of hal.h for host builds, see hal_linux.h
+*/
+
+#ifndef ARDUINO
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/time.h>
+#include "hal.h"
+#include "hal_linux.h"
+
+#define HAL_LINUX_PINS 64
+#define HAL_LINUX_SPI_CLOCK 72000000UL // SPI1 clock the divider applies to, as on the STM32
+
+static uint64_t monotonic_ns()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec*1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static void sleep_ns(uint64_t ns)
+{
+  struct timespec duration;
+  duration.tv_sec = (time_t)(ns / 1000000000ULL);
+  duration.tv_nsec = (long)(ns % 1000000000ULL);
+  while (nanosleep(&duration, &duration) != 0)
+  {
+  }
+}
+
+static const hal_linux_clock monotonic_clock = {monotonic_ns, sleep_ns};
+static const hal_linux_clock *clock_source = &monotonic_clock;
+static const hal_linux_spi_device *spi_device = NULL;
+static uint8_t pin_level[HAL_LINUX_PINS];
+
+void hal_linux_set_clock(const hal_linux_clock *clock)
+{
+  clock_source = (clock != NULL) ? clock : &monotonic_clock;
+}
+
+void hal_linux_set_spi_device(const hal_linux_spi_device *device)
+{
+  spi_device = device;
+}
+
+uint32_t hal_micros()
+{
+  return (uint32_t)(clock_source->now_ns() / 1000);
+}
+
+uint32_t hal_millis()
+{
+  return (uint32_t)(clock_source->now_ns() / 1000000);
+}
+
+void hal_delay_us(uint32_t us)
+{
+  clock_source->wait_ns((uint64_t)us*1000);
+}
+
+void hal_delay_ms(uint32_t ms)
+{
+  clock_source->wait_ns((uint64_t)ms*1000000);
+}
+
+void hal_cycles_init()
+{
+}
+
+uint32_t hal_cycles_hz()
+{
+  return 1000000000UL;
+}
+
+/* Always the real clock, a device model's clock would time the model and not the host */
+uint32_t hal_cycles()
+{
+  return (uint32_t)monotonic_ns();
+}
+
+void hal_pin_mode(uint32_t, uint8_t)
+{
+}
+
+void hal_pin_write(uint32_t pin, uint32_t level)
+{
+  if (spi_device != NULL && pin == spi_device->cs_pin)
+  {
+    if (level)
+    {
+      spi_device->deselect();
+    }
+    else
+    {
+      spi_device->select();
+    }
+  }
+  if (pin < HAL_LINUX_PINS)
+  {
+    pin_level[pin] = (level != 0);
+  }
+}
+
+int hal_pin_read(uint32_t pin)
+{
+  return (pin < HAL_LINUX_PINS) ? pin_level[pin] : 0;
+}
+
+void hal_spi_begin(uint8_t clock_divider)
+{
+  if (spi_device != NULL && spi_device->set_clock != NULL && clock_divider != 0)
+  {
+    spi_device->set_clock(HAL_LINUX_SPI_CLOCK / clock_divider);
+  }
+}
+
+void hal_spi_end()
+{
+}
+
+uint8_t hal_spi_transfer(uint8_t data)
+{
+  return (spi_device != NULL) ? spi_device->transfer(data) : 0xFF;
+}
+
+static void alarm_mask(int how)
+{
+  sigset_t alarm;
+  sigemptyset(&alarm);
+  sigaddset(&alarm, SIGALRM);
+  sigprocmask(how, &alarm, NULL);
+}
+
+void hal_irq_disable()
+{
+  alarm_mask(SIG_BLOCK);
+}
+
+void hal_irq_enable()
+{
+  alarm_mask(SIG_UNBLOCK);
+}
+
+static hal_isr tick_handler = NULL;
+static bool manual_tick = false;
+
+static void tick_signal(int)
+{
+  tick_handler();
+}
+
+void hal_tick_start(hal_timer, uint32_t tick_us, uint16_t, hal_isr handler)
+{
+  struct sigaction action = {};
+  struct itimerval period = {};
+
+  tick_handler = handler;
+  if (manual_tick)
+  {
+    return;
+  }
+  action.sa_handler = tick_signal;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART;
+  sigaction(SIGALRM, &action, NULL);
+
+  period.it_interval.tv_sec = tick_us / 1000000;
+  period.it_interval.tv_usec = tick_us % 1000000;
+  period.it_value = period.it_interval;
+  setitimer(ITIMER_REAL, &period, NULL);
+}
+
+void hal_linux_set_manual_tick(bool manual)
+{
+  manual_tick = manual;
+}
+
+void hal_linux_tick()
+{
+  if (tick_handler != NULL)
+  {
+    tick_handler();
+  }
+}
+
+bool hal_tick_sleep(uint32_t, hal_tick_wake *)
+{
+  return false;
+}
+
+void hal_log(const char *format, ...)
+{
+  va_list args;
+
+  va_start(args, format);
+  vprintf(format, args);
+  va_end(args);
+}
+
+#endif // ARDUINO
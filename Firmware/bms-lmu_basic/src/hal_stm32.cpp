@@ -0,0 +1,178 @@
+/*
+hal_stm32.cpp
+
+STM32duino port of hal.h. Pins, SPI and time go to the Arduino core, the
+ticker runs on a HardwareTimer whose period idle sleeps stretch in place.
+*/
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include "hal.h"
+
+#ifndef HAL_LOG_LEN
+#define HAL_LOG_LEN 128 //!< Longest hal_log() line, longer lines are cut
+#endif
+
+uint32_t hal_micros()
+{
+  return micros();
+}
+
+uint32_t hal_millis()
+{
+  return millis();
+}
+
+void hal_delay_us(uint32_t us)
+{
+  delayMicroseconds(us);
+}
+
+void hal_delay_ms(uint32_t ms)
+{
+  delay(ms);
+}
+
+void hal_cycles_init()
+{
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+uint32_t hal_cycles_hz()
+{
+  return SystemCoreClock;
+}
+
+void hal_pin_mode(uint32_t pin, uint8_t mode)
+{
+  pinMode(pin, (mode == HAL_PIN_OUTPUT) ? OUTPUT : INPUT);
+}
+
+void hal_pin_write(uint32_t pin, uint32_t level)
+{
+  digitalWrite(pin, level);
+}
+
+int hal_pin_read(uint32_t pin)
+{
+  return digitalRead(pin);
+}
+
+void hal_spi_begin(uint8_t clock_divider)
+{
+  pinMode(SCK, OUTPUT);
+  pinMode(MOSI, OUTPUT);
+  SPI.begin();
+  SPI.setClockDivider(clock_divider);
+}
+
+void hal_spi_end()
+{
+  SPI.end();
+}
+
+uint8_t hal_spi_transfer(uint8_t data)
+{
+  return (uint8_t)SPI.transfer(data);
+}
+
+void hal_irq_disable()
+{
+  noInterrupts();
+}
+
+void hal_irq_enable()
+{
+  interrupts();
+}
+
+static HardwareTimer *tick_timer = NULL;
+static TIM_TypeDef *tick_instance;
+static uint32_t tick_us;
+static uint16_t tick_counts;
+static uint32_t systick_remainder = 0; // us of SysTick time not yet added to uwTick
+
+void hal_tick_start(hal_timer timer, uint32_t _tick_us, uint16_t counts_per_tick, hal_isr handler)
+{
+  tick_instance = (TIM_TypeDef *)timer;
+  tick_us = _tick_us;
+  tick_counts = counts_per_tick;
+
+  tick_timer = new HardwareTimer(tick_instance);
+  // Fixed count rate so hal_tick_sleep() can stretch the period without a prescaler change
+  tick_timer->setPrescaleFactor((uint32_t)((uint64_t)tick_timer->getTimerClkFreq()*tick_us
+                                           / (1000000UL*tick_counts)));
+  tick_timer->setOverflow(tick_counts, TICK_FORMAT); // 1 tick
+  tick_instance->CR1 &= ~TIM_CR1_ARPE; // ARR writes take effect at once
+  tick_timer->attachInterrupt(handler);
+  tick_timer->resume();
+}
+
+bool hal_tick_sleep(uint32_t ticks, hal_tick_wake *wake)
+{
+  if (tick_timer == NULL)
+  {
+    return false;
+  }
+
+  // A tick that already overflowed is left pending for the tick handler,
+  // stretching ARR now would count it again as a slept tick
+  if (tick_instance->SR & TIM_SR_UIF)
+  {
+    return false;
+  }
+
+  // The counter keeps its place in the current tick, the overflow moves out
+  // to the boundary of the due tick
+  uint32_t start = tick_instance->CNT;
+  tick_instance->ARR = ticks*tick_counts - 1;
+  if (tick_instance->SR & TIM_SR_UIF)
+  {
+    // Overflowed between the check and the write, put the period back
+    tick_instance->ARR = tick_counts - 1;
+    return false;
+  }
+  HAL_SuspendTick();
+
+  // Wakes with PRIMASK set, the pending interrupt runs once the caller enables them
+  __WFI();
+
+  tick_instance->CR1 &= ~TIM_CR1_CEN;
+  wake->count = tick_instance->CNT;
+  wake->position = wake->count;
+  wake->fired = (tick_instance->SR & TIM_SR_UIF) != 0;
+  if (wake->fired)
+  {
+    wake->position += ticks*tick_counts;
+    tick_instance->SR = ~TIM_SR_UIF; // Handled here, not in the tick handler
+  }
+  tick_instance->ARR = tick_counts - 1;
+  tick_instance->CNT = wake->position % tick_counts;
+  tick_instance->CR1 |= TIM_CR1_CEN;
+
+  // SysTick was stopped, credit millis() with the time slept
+  systick_remainder += (wake->position - start)*tick_us / tick_counts;
+  uwTick += systick_remainder / 1000;
+  systick_remainder %= 1000;
+  HAL_ResumeTick();
+  return true;
+}
+
+void hal_log(const char *format, ...)
+{
+  char line[HAL_LOG_LEN];
+  va_list args;
+
+  va_start(args, format);
+  vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  Serial.print(line);
+}
+
+#endif // ARDUINO
@@ -82,6 +82,10 @@ USER INPUT DATA FORMAT:
 #include "UserInterface.h"   // serial interface routines to communicate with the user
 #include "LTC681x.h"
 #include "LTC6811.h"
+#include "bms_hardware.h"    // asynchronous SPI for the cell register reads
+#include "MeasurementScheduler.h"
+#include "Datalog.h"         // binary data-log records for command 12
+#include "Trace.h"           // hot path timing, commands 32 and 33
 #include <SPI.h>
 
 #define ENABLED 1
@@ -94,6 +98,7 @@ void print_menu();
 void print_cells(uint8_t datalog_en);
 void print_aux(uint8_t datalog_en);
 void print_stat();
+void log_cycle(bool fresh);
 void print_open();
 void print_config();
 void print_rxconfig();
@@ -110,8 +115,13 @@ void check_error(int error);
 void print_pec();
 void serial_print_hex(uint8_t data);
 char get_char();
-void run_command(uint32_t cmd);
+void run_command(uint32_t cmd, const char *args);
+void start_loop(uint32_t cmd, const char *args);
+void stop_loop();
+void set_discharge(uint32_t cmd, const char *args);
+void handle_line(const char *line);
 void measurement_loop(uint8_t datalog_en);
+void print_measurement_stats();
 
 /**********************************************************
   Setup Variables
@@ -119,6 +129,7 @@ void measurement_loop(uint8_t datalog_en);
   configure the software.
 ***********************************************************/
 const uint8_t TOTAL_IC = 1;//!< Number of ICs in the daisy chain
+static_assert(TOTAL_IC <= TOTAL_IC_MAX, "TOTAL_IC_MAX must cover the daisy chain, raise it in the build flags");
 
 //ADC Command Configurations. See LTC681x.h for options.
 const uint8_t ADC_OPT = ADC_OPT_DISABLED; //!< ADC Mode option bit
@@ -129,6 +140,8 @@ const uint8_t AUX_CH_TO_CONVERT = AUX_CH_ALL; //!< Channel Selection for ADC con
 const uint8_t STAT_CH_TO_CONVERT = STAT_CH_ALL; //!< Channel Selection for ADC conversion
 const uint8_t NO_OF_REG = REG_ALL; //!< Register Selection
 const uint16_t MEASUREMENT_LOOP_TIME = 500; //!< Loop Time in milliseconds(ms)
+const uint8_t STAT_INTERVAL = 10; //!< Full status conversion every n measurement cycles
+const uint16_t CONFIG_VERIFY_INTERVAL = 10; //!< Configuration readback verified every n loop reports
 
 //Under Voltage and Over Voltage Thresholds
 const uint16_t OV_THRESHOLD = 41000; //!< Over voltage threshold ADC Code. LSB = 0.0001 ---(4.1V)
@@ -153,6 +166,39 @@ const uint8_t PRINT_PEC = ENABLED; //!< Loop Measurement Setup
  ******************************************************/
 cell_asic bms_ic[TOTAL_IC]; //!< Global Battery Variable
 
+MeasurementScheduler scheduler(TOTAL_IC, bms_ic, ADC_CONVERSION_MODE, ADC_DCP,
+                               MEASURE_AUX == ENABLED, (MEASURE_STAT == ENABLED) ? STAT_INTERVAL : 0); //!< Pipelined loop measurements
+uint32_t last_report = 0; //!< millis() of the last loop measurement report
+uint32_t last_bytes_saved = 0; //!< Register shadow bus bytes saved at the last report
+const uint8_t LOG_RECORDS = 3*TOTAL_IC; //!< Data-log records per cycle: cells, aux and stat for each IC
+uint8_t log_next = LOG_RECORDS; //!< Next data-log record of the cycle being sent
+uint8_t log_types[LOG_RECORDS]; //!< Record types of the cycle being sent
+uint8_t log_lens[LOG_RECORDS]; //!< Payload lengths of the cycle being sent, 0 if not measured
+uint8_t log_payloads[LOG_RECORDS][DATALOG_MAX_PAYLOAD]; //!< Payloads of the cycle being sent
+
+/*!**********************************************************************
+ Serial commands. Each line is parsed as it arrives, a number selects the
+ table entry and anything after it is passed on as arguments, e.g. "21 5".
+ ***********************************************************************/
+enum loop_mode_t
+{
+  LOOP_OFF,
+  LOOP_PLAIN,    //!< Command 11
+  LOOP_DATALOG   //!< Command 12
+};
+loop_mode_t loop_mode = LOOP_OFF; //!< Loop measurements run from loop() until 'm' is received
+ui_handler pending_handler = NULL; //!< Command waiting for its argument on the next line
+uint32_t pending_command = 0;
+
+const ui_command commands[] =
+{
+  {1, 10, run_command},
+  {11, 12, start_loop},
+  {13, 20, run_command},
+  {21, 21, set_discharge},
+  {22, 33, run_command},
+};
+
 /*********************************************************
  Set the configuration bits. 
  Refer to the Configuration Register Group from data sheet. 
@@ -189,13 +235,17 @@ void setup()
   // quikeval_SPI_connect();
   
   spi_enable(SPI_CLOCK_DIV128); // This will set the Linduino to have a 1MHz Clock
+  spi_async_init(); // DMA for the cell register reads of the measurement loop
   LTC6811_init_cfg(TOTAL_IC, bms_ic);
   for (uint8_t current_ic = 0; current_ic<TOTAL_IC;current_ic++) 
   {
     LTC6811_set_cfgr(current_ic,bms_ic,REFON,ADCOPT,gpioBits_a,dccBits_a, dctoBits, UV, OV);
+    LTC6811_set_address(current_ic,bms_ic,current_ic); // LTC6811-2 address straps follow the IC order
   }
   LTC6811_reset_crc_count(TOTAL_IC,bms_ic);
   LTC6811_init_reg_limits(TOTAL_IC,bms_ic);
+  LTC6811_shadow_set_verify_interval(CONFIG_VERIFY_INTERVAL);
+  trace_init();
   print_menu();
 }
 
@@ -205,35 +255,127 @@ void setup()
 ***********************************************************************/
 void loop()
 {
-  if (Serial.available())           // Check for user input
+  if (ui_poll() >= 0)               // Never waits, only takes the bytes already received
   {
-    uint32_t user_command;
-    user_command = read_int();      // Read the user command
-    if(user_command=='m')
-    { 
-      print_menu();
+    handle_line(ui_buffer);
+  }
+
+  if (loop_mode != LOOP_OFF)
+  {
+    measurement_loop((loop_mode == LOOP_DATALOG) ? DATALOG_ENABLED : DATALOG_DISABLED);
+  }
+}
+
+/*!*****************************************
+ \brief Acts on a complete line of user input
+ @return void
+*******************************************/
+void handle_line(const char *line)
+{
+  if (loop_mode != LOOP_OFF)
+  {
+    if (line[0] == 'm')
+    {
+      stop_loop();
     }
-    else
-    { 
-      Serial.println(user_command);
-      run_command(user_command); 
-    }   
+    return;
+  }
+
+  if (line[0] == 'm')
+  {
+    pending_handler = NULL;
+    print_menu();
+    return;
+  }
+
+  if (pending_handler != NULL)
+  {
+    // The whole line is the argument the last command asked for
+    ui_handler handler = pending_handler;
+    pending_handler = NULL;
+    handler(pending_command, line);
+    return;
+  }
+
+  Serial.println((uint32_t)ui_parse_int(line, NULL));
+  if (!ui_dispatch(line, commands, sizeof(commands)/sizeof(commands[0])))
+  {
+    Serial.println(F("Incorrect Option"));
+    Serial.println();
   }
 }
 
+/*!*****************************************
+ \brief Starts loop measurements, command 11 plain and 12 with data-log output
+ @return void
+*******************************************/
+void start_loop(uint32_t cmd, const char *)
+{
+  Serial.println(F("transmit 'm' to quit"));
+  wakeup_sleep(TOTAL_IC);
+  LTC6811_shadow_invalidate(TOTAL_IC,bms_ic);
+  LTC6811_sync_cfg(TOTAL_IC,bms_ic);
+  scheduler.resetStats();
+  scheduler.start();
+  last_report = millis();
+  loop_mode = (cmd == 12) ? LOOP_DATALOG : LOOP_PLAIN;
+  if (loop_mode == LOOP_DATALOG)
+  {
+    datalog_start();
+    log_next = LOG_RECORDS;
+  }
+}
+
+/*!*****************************************
+ \brief Ends loop measurements
+ @return void
+*******************************************/
+void stop_loop()
+{
+  scheduler.stop();
+  loop_mode = LOOP_OFF;
+  print_menu();
+}
+
+/*!*****************************************
+ \brief Enables a discharge transistor, command 21.
+ The cell number follows the command or comes on the next line.
+ @return void
+*******************************************/
+void set_discharge(uint32_t cmd, const char *args)
+{
+  int8_t error = 0;
+  int8_t readIC = 0;
+
+  if (*args == '\0')
+  {
+    Serial.println(F("Please enter the Spin number:"));
+    pending_handler = set_discharge;
+    pending_command = cmd;
+    return;
+  }
+  readIC = (int8_t)ui_parse_int(args, NULL);
+  Serial.println(readIC);
+  wakeup_sleep(TOTAL_IC);
+  LTC6811_set_discharge(readIC,TOTAL_IC,bms_ic);
+  LTC6811_wrcfg(TOTAL_IC,bms_ic);   
+  print_config();
+  wakeup_idle(TOTAL_IC);
+  error = LTC6811_rdcfg(TOTAL_IC,bms_ic);
+  check_error(error);
+  print_rxconfig();
+}
+
 
 /*!*****************************************
  \brief Executes the user command
  @return void
 *******************************************/
-void run_command(uint32_t cmd)
+void run_command(uint32_t cmd, const char *)
 {
   const uint8_t STREG=0;
   int8_t error = 0;
   uint32_t conv_time = 0;
-  uint32_t user_command;
-  int8_t readIC=0;
-  char input = 0;
   
   switch (cmd)
   {
@@ -344,42 +486,6 @@ void run_command(uint32_t cmd)
       Serial.println();
       break;
       
-    case 11: // Loop Measurements without data-log output
-      Serial.println(F("transmit 'm' to quit"));
-      wakeup_sleep(TOTAL_IC);
-      LTC6811_wrcfg(TOTAL_IC,bms_ic);
-      while (input != 'm')
-      {
-        if (Serial.available() > 0)
-        {
-          input = read_char();
-        }
-
-        measurement_loop(DATALOG_DISABLED);
-
-        delay(MEASUREMENT_LOOP_TIME);
-      }
-      print_menu();
-      break;
-
-    case 12: //Data-log print option Loop Measurements
-      Serial.println(F("transmit 'm' to quit"));
-      wakeup_sleep(TOTAL_IC);
-      LTC6811_wrcfg(TOTAL_IC,bms_ic);
-      while (input != 'm')
-      {
-        if (Serial.available() > 0)
-        {
-          input = read_char();
-        }
-
-        measurement_loop(DATALOG_ENABLED);
-
-        delay(MEASUREMENT_LOOP_TIME);
-      }
-      print_menu();
-      break;
-
     case 13: // Run the Mux Decoder Self Test
       wakeup_sleep(TOTAL_IC);
       LTC6811_diagn();
@@ -464,20 +570,6 @@ void run_command(uint32_t cmd)
       Serial.println();
       break;
       
-    case 21: // Enable a discharge transistor
-      Serial.println(F("Please enter the Spin number:"));
-      readIC = (int8_t)read_int();
-      Serial.println(readIC);
-      wakeup_sleep(TOTAL_IC);
-      LTC6811_set_discharge(readIC,TOTAL_IC,bms_ic);
-      LTC6811_wrcfg(TOTAL_IC,bms_ic);   
-      print_config();
-      wakeup_idle(TOTAL_IC);
-      error = LTC6811_rdcfg(TOTAL_IC,bms_ic);
-      check_error(error);
-      print_rxconfig();
-      break;
-      
     case 22: // Clear all discharge transistors
       wakeup_sleep(TOTAL_IC);
       LTC6811_clear_discharge(TOTAL_IC,bms_ic);
@@ -722,6 +814,15 @@ void run_command(uint32_t cmd)
       wakeup_idle(TOTAL_IC);
       LTC6811_wrcfg(TOTAL_IC,bms_ic);
       print_config();
+      break;
+
+    case 32: // Print the trace probe table
+      trace_print();
+      break;
+
+    case 33: // Reset the trace probe table
+      trace_reset();
+      Serial.println(F("Trace probes cleared"));
       break;
 	  
 	  case 'm': //prints menu
@@ -737,21 +838,50 @@ void run_command(uint32_t cmd)
 
 /*!*********************************
   \brief For Loop Measurement
+  Keeps the measurement pipeline moving and reports
+  the latest results every MEASUREMENT_LOOP_TIME
  @return void
 ***********************************/
 void measurement_loop(uint8_t datalog_en)
 {
   int8_t error = 0;
+
+  bool fresh = scheduler.service();
+  if (datalog_en == DATALOG_ENABLED)
+  {
+    // Every completed cycle is logged as binary records, not just one per report
+    log_cycle(fresh);
+  }
+
+  if ((uint32_t)(millis() - last_report) < MEASUREMENT_LOOP_TIME)
+  {
+    return;
+  }
+  last_report = millis();
+
   if (WRITE_CONFIG == ENABLED)
   {
-    wakeup_sleep(TOTAL_IC);
-    LTC6811_wrcfg(TOTAL_IC,bms_ic);
-    print_config();
+    // Only sent when the configuration changed, the readback is verified every CONFIG_VERIFY_INTERVAL reports
+    wakeup_idle(TOTAL_IC);
+    error = LTC6811_sync_cfg(TOTAL_IC,bms_ic);
+    check_error(error);
+    if (datalog_en == DATALOG_DISABLED)
+    {
+      print_config();
+    }
+  }
+
+  if (datalog_en == DATALOG_ENABLED)
+  {
+    // No text between the binary records
+    scheduler.resetStats();
+    return;
   }
 
   if (READ_CONFIG == ENABLED)
   {
-    wakeup_sleep(TOTAL_IC);
+    // sync_cfg only reads back on verify cycles, fetch the registers so the print is current
+    wakeup_idle(TOTAL_IC);
     error = LTC6811_rdcfg(TOTAL_IC,bms_ic);
     check_error(error);
     print_rxconfig();
@@ -759,35 +889,16 @@ void measurement_loop(uint8_t datalog_en)
 
   if (MEASURE_CELL == ENABLED)
   {
-    wakeup_idle(TOTAL_IC);
-    LTC6811_adcv(ADC_CONVERSION_MODE,ADC_DCP,CELL_CH_TO_CONVERT);
-    LTC6811_pollAdc();
-    wakeup_idle(TOTAL_IC);
-    error = LTC6811_rdcv(NO_OF_REG, TOTAL_IC,bms_ic);
-    check_error(error);
     print_cells(datalog_en);
-
   }
 
   if (MEASURE_AUX == ENABLED)
   {
-    wakeup_idle(TOTAL_IC);
-    LTC6811_adax(ADC_CONVERSION_MODE , AUX_CH_ALL);
-    LTC6811_pollAdc();
-    wakeup_idle(TOTAL_IC);
-    error = LTC6811_rdaux(NO_OF_REG,TOTAL_IC,bms_ic); // Set to read back all aux registers
-    check_error(error);
     print_aux(datalog_en);
   }
 
   if (MEASURE_STAT == ENABLED)
   {
-    wakeup_idle(TOTAL_IC);
-    LTC6811_adstat(ADC_CONVERSION_MODE, STAT_CH_ALL);
-    LTC6811_pollAdc();
-    wakeup_idle(TOTAL_IC);
-    error = LTC6811_rdstat(NO_OF_REG,TOTAL_IC,bms_ic); // Set to read back all aux registers
-    check_error(error);
     print_stat();
   }
 
@@ -796,6 +907,57 @@ void measurement_loop(uint8_t datalog_en)
     print_pec();
   }
 
+  print_measurement_stats();
+}
+
+/*!*********************************
+  \brief Prints the achieved cell sample period and jitter
+ @return void
+***********************************/
+void print_measurement_stats()
+{
+  const measurementStats &stats = scheduler.stats();
+
+  Serial.print(F("Cycles: "));
+  Serial.print(stats.cycles);
+  Serial.print(F(", Cell period(us) last: "));
+  Serial.print(stats.periodLast);
+  Serial.print(F(" mean: "));
+  Serial.print(stats.periodMean);
+  Serial.print(F(" min: "));
+  Serial.print(stats.periodMin);
+  Serial.print(F(" max: "));
+  Serial.print(stats.periodMax);
+  Serial.print(F(" jitter: "));
+  Serial.println(stats.jitter);
+  Serial.print(F("Conversion(us) cell: "));
+  Serial.print(stats.convTimeCell);
+  Serial.print(F(" aux: "));
+  Serial.print(stats.convTimeAux);
+  Serial.print(F(" stat: "));
+  Serial.print(stats.convTimeStat);
+  Serial.print(F(", PEC errors: "));
+  Serial.println(stats.pecErrors);
+  shadow_stats shadow = LTC6811_shadow_stats();
+  Serial.print(F("Register writes skipped: "));
+  Serial.print(shadow.writes_skipped);
+  Serial.print(F(", verify failures: "));
+  Serial.print(shadow.verify_failures);
+  Serial.print(F(", bus bytes saved/min: "));
+  Serial.println((shadow.bytes_saved - last_bytes_saved) * (60000UL / MEASUREMENT_LOOP_TIME));
+  last_bytes_saved = shadow.bytes_saved;
+  wake_stats wake = LTC6811_wake_stats();
+  Serial.print(F("Wake-ups sent sleep: "));
+  Serial.print(wake.sleep_wakes);
+  Serial.print(F(" idle: "));
+  Serial.print(wake.idle_wakes);
+  Serial.print(F(", skipped: "));
+  Serial.print(wake.skipped);
+  Serial.print(F(", pulses skipped: "));
+  Serial.println(wake.pulses_skipped);
+  LTC6811_wake_reset_stats();
+  Serial.println();
+  scheduler.resetStats();
 }
 
 /*!*********************************
@@ -814,8 +976,8 @@ void print_menu()
   Serial.println(F("Start Stat Voltage Conversion: 7                            |Open Wire Test for multiple cell or two consecutive cells detection:18 |Clear Registers: 29"));
   Serial.println(F("Read Stat Voltages: 8                                       |Print PEC Counter: 19                                                  |Read CV,AUX and ADSTAT Voltages:30"));
   Serial.println(F("Start Combined Cell Voltage and GPIO1, GPIO2 Conversion: 9  |Reset PEC Counter: 20                                                  |Set or Reset the GPIO pins: 31 "));
-  Serial.println(F("Start  Cell Voltage and Sum of cells : 10                   |Set Discharge: 21                                                      |"));
-  Serial.println(F("loop Measurements: 11                                       |Clear Discharge: 22                                                    |"));
+  Serial.println(F("Start  Cell Voltage and Sum of cells : 10                   |Set Discharge: 21 <cell>                                               |Print Trace Probes: 32"));
+  Serial.println(F("loop Measurements: 11                                       |Clear Discharge: 22                                                    |Reset Trace Probes: 33"));
   Serial.println();
   Serial.println(F("Print 'm' for menu"));
   Serial.println(F("Please enter command: "));
@@ -905,7 +1067,7 @@ void print_cells(uint8_t datalog_en)
       Serial.print(" IC ");
       Serial.print(current_ic+1,DEC);
       Serial.print(": ");
-      for (int i=0; i<bms_ic[0].ic_reg.cell_channels; i++)
+      for (int i=0; i<ic_traits::cell_channels; i++)
       {
 
         Serial.print(" C");
@@ -918,17 +1080,13 @@ void print_cells(uint8_t datalog_en)
     }
     else
     {
-      Serial.print("Cells ");
-      
-      for (int i=0; i<bms_ic[0].ic_reg.cell_channels; i++)
-      {
-        Serial.print(bms_ic[current_ic].cells.c_codes[i]*0.0001,4);
-        Serial.print(",");
-      }
-
+      datalog_codes(DATALOG_CELLS, current_ic, bms_ic[current_ic].cells.c_codes, ic_traits::cell_channels);
     }
   }
-  Serial.println();
+  if (datalog_en == 0)
+  {
+    Serial.println();
+  }
 }
 
 /*!****************************************************************************
@@ -961,16 +1119,13 @@ void print_aux(uint8_t datalog_en)
     }
     else
     {
-      Serial.print("AUX ");
-
-      for (int i=0; i < 6; i++)
-      {
-        Serial.print(bms_ic[current_ic].aux.a_codes[i]*0.0001,4);
-        Serial.print(",");
-      }
+      datalog_codes(DATALOG_AUX, current_ic, bms_ic[current_ic].aux.a_codes, 6);
     }
   }
-  Serial.println();
+  if (datalog_en == 0)
+  {
+    Serial.println();
+  }
 }
 
 /*!****************************************************************************
@@ -997,16 +1152,107 @@ void print_aux1(uint8_t datalog_en)
     }
     else
     {
-      Serial.print("AUX ");
+      datalog_codes(DATALOG_AUX, current_ic, bms_ic[current_ic].aux.a_codes, 6);
+    }
+  }
+  if (datalog_en == 0)
+  {
+    Serial.println();
+  }
+}
+
+/*!****************************************************************************
+  \brief Builds record n of a data-log cycle: cells, then aux, then stat, one
+  per IC
+ @return payload length, 0 if that measurement is not enabled
+ *****************************************************************************/
+uint8_t log_payload(uint8_t n, uint8_t *type, uint8_t *payload)
+{
+  const cell_asic &ic = bms_ic[n % TOTAL_IC];
+  const uint16_t *codes = NULL;
+  uint8_t count = 0;
+
+  switch (n / TOTAL_IC)
+  {
+    case 0:
+      if (MEASURE_CELL != ENABLED) return 0;
+      *type = DATALOG_CELLS;
+      codes = ic.cells.c_codes;
+      count = ic_traits::cell_channels;
+      break;
+
+    case 1:
+      if (MEASURE_AUX != ENABLED) return 0;
+      *type = DATALOG_AUX;
+      codes = ic.aux.a_codes;
+      count = 6;
+      break;
+
+    default:
+      if (MEASURE_STAT != ENABLED) return 0;
+      *type = DATALOG_STAT;
+      codes = ic.stat.stat_codes;
+      count = 4;
+      payload[8] = ic.stat.flags[0];
+      payload[9] = ic.stat.flags[1];
+      payload[10] = ic.stat.flags[2];
+      payload[11] = ic.stat.mux_fail[0];
+      payload[12] = ic.stat.thsd[0];
+      break;
+  }
+
+  for (uint8_t i = 0; i < count; i++)
+  {
+    payload[2*i] = (uint8_t)codes[i];
+    payload[2*i+1] = (uint8_t)(codes[i] >> 8);
+  }
+  return (*type == DATALOG_STAT) ? 13 : 2*count;
+}
 
-      for (int i=0; i < 6; i++)
+/*!****************************************************************************
+  \brief Sends the records of a cycle as the serial TX buffer drains. A cycle
+  is more than the 64 byte buffer holds, so its records go out over several
+  passes from a copy taken when the cycle completed. Cycles that complete
+  while one is still being sent are dropped whole.
+ @return void
+ *****************************************************************************/
+void log_cycle(bool fresh)
+{
+  if (fresh)
+  {
+    bool sending = log_next < LOG_RECORDS;
+    for (uint8_t n = 0; n < LOG_RECORDS; n++)
+    {
+      uint8_t type;
+      uint8_t payload[DATALOG_MAX_PAYLOAD];
+      if (!sending)
       {
-        Serial.print(bms_ic[current_ic].aux.a_codes[i]*0.0001,4);
-        Serial.print(",");
+        log_lens[n] = log_payload(n, &log_types[n], log_payloads[n]);
       }
+      else if (log_payload(n, &type, payload))
+      {
+        datalog_skip();
+      }
+    }
+    if (!sending)
+    {
+      log_next = 0;
     }
   }
-  Serial.println();
+
+  for (; log_next < LOG_RECORDS; log_next++)
+  {
+    uint8_t len = log_lens[log_next];
+    if (len == 0)
+    {
+      continue;
+    }
+    if (!datalog_fits(len))
+    {
+      return;
+    }
+    datalog_record(log_types[log_next], log_next % TOTAL_IC, log_payloads[log_next], len);
+  }
 }
 
 /*!****************************************************************************
@@ -1325,6 +1571,7 @@ void check_error(int error)
   if (error == -1)
   {
     Serial.println(F("A PEC error was detected in the received data"));
+    LTC6811_wake_invalidate(); // The chain may have slept or reset, the next wake-up pulses it
   }
 }
 
@@ -0,0 +1,71 @@
+/*
+pec15.cpp
+
+Compile time generated slice-by-4 PEC (CRC15) engine for the LTC681x.
+See pec15.h for the state convention.
+*/
+
+#include <stdint.h>
+#include "pec15.h"
+
+/* Builds the byte table and the tables for a byte followed by 1, 2 and 3 zero bytes */
+static constexpr pec15_tables pec15_generate()
+{
+	pec15_tables tables = {};
+
+	for (uint16_t i = 0; i < 256; i++)
+	{
+		uint16_t remainder = (uint16_t)(i << 8);
+		for (uint8_t bit = 0; bit < 8; bit++)
+		{
+			if (remainder & 0x8000)
+			{
+				remainder = (uint16_t)((remainder << 1) ^ PEC15_POLY);
+			}
+			else
+			{
+				remainder = (uint16_t)(remainder << 1);
+			}
+		}
+		tables.t[0][i] = remainder;
+	}
+
+	for (uint8_t k = 1; k < 4; k++)
+	{
+		for (uint16_t i = 0; i < 256; i++)
+		{
+			uint16_t prev = tables.t[k-1][i];
+			tables.t[k][i] = (uint16_t)((prev << 8) ^ tables.t[0][prev >> 8]);
+		}
+	}
+
+	return tables;
+}
+
+extern constexpr pec15_tables pec15_lut = pec15_generate();
+
+// First entries of the datasheet CRC15 table, left aligned
+static_assert(pec15_lut.t[0][1] == (uint16_t)(0xc599 << 1), "PEC15 table generation");
+static_assert(pec15_lut.t[0][255] == (uint16_t)(0x8095 << 1), "PEC15 table generation");
+
+uint16_t pec15_update(uint16_t pec, const uint8_t *data, uint16_t len)
+{
+	while (len >= 4)
+	{
+		pec = pec15_lut.t[3][(pec >> 8) ^ data[0]] ^
+		      pec15_lut.t[2][(pec & 0xFF) ^ data[1]] ^
+		      pec15_lut.t[1][data[2]] ^
+		      pec15_lut.t[0][data[3]];
+		data = data + 4;
+		len = len - 4;
+	}
+
+	while (len > 0)
+	{
+		pec = pec15_update_byte(pec, *data);
+		data++;
+		len--;
+	}
+
+	return pec;
+}
@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""Decode the binary data-log stream (command 12) into CSV.
+
+The stream is COBS framed records, see include/Datalog.h. Reads a capture
+file, or a serial port when pyserial is installed, and writes one CSV row
+per record:
+
+    time_s,seq,type,ic,values...
+
+Cell and aux values are volts. Stat rows are SOC (V), die temperature (C),
+VregA (V), VregD (V) followed by the flag bytes in hex.
+
+    datalog_decode.py capture.bin > log.csv
+    datalog_decode.py --port /dev/ttyUSB0 --baud 9600 > log.csv
+"""
+
+import argparse
+import struct
+import sys
+
+CELLS, AUX, STAT = 0x01, 0x02, 0x03
+TYPE_NAMES = {CELLS: "cells", AUX: "aux", STAT: "stat"}
+HEADER = struct.Struct("<BBBI")
+LSB = 0.0001  # 100uV per ADC code
+
+
+def crc8(data):
+    crc = 0
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+def cobs_decode(frame):
+    out = bytearray()
+    i = 0
+    while i < len(frame):
+        code = frame[i]
+        if code == 0 or i + code > len(frame) + 1:
+            return None
+        out += frame[i + 1:i + code]
+        i += code
+        if code != 0xFF and i < len(frame):
+            out.append(0)
+    return bytes(out)
+
+
+def frames(stream):
+    """Yield the bytes between 0x00 delimiters"""
+    buffer = bytearray()
+    while True:
+        chunk = stream.read(256)
+        if not chunk:
+            break
+        for byte in chunk:
+            if byte == 0:
+                if buffer:
+                    yield bytes(buffer)
+                buffer.clear()
+            else:
+                buffer.append(byte)
+
+
+def values(kind, payload):
+    if kind in (CELLS, AUX):
+        codes = struct.unpack("<%dH" % (len(payload) // 2), payload[:len(payload) // 2 * 2])
+        return ["%.4f" % (code * LSB) for code in codes]
+    if kind == STAT and len(payload) >= 13:
+        soc, itmp, vreg_a, vreg_d = struct.unpack("<4H", payload[:8])
+        return ["%.4f" % (soc * LSB * 20), "%.2f" % (itmp * LSB / 0.0075 - 273),
+                "%.4f" % (vreg_a * LSB), "%.4f" % (vreg_d * LSB)] + ["0x%02X" % b for b in payload[8:13]]
+    return [payload.hex()]
+
+
+def decode(stream, out):
+    good = bad = 0
+    for frame in frames(stream):
+        record = cobs_decode(frame)
+        if record is None or len(record) < HEADER.size + 1 or crc8(record[:-1]) != record[-1]:
+            bad += 1
+            continue
+        kind, ic, seq, time_us = HEADER.unpack_from(record)
+        row = ["%.6f" % (time_us / 1e6), str(seq), TYPE_NAMES.get(kind, str(kind)), str(ic)]
+        out.write(",".join(row + values(kind, record[HEADER.size:-1])) + "\n")
+        good += 1
+    return good, bad
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("capture", nargs="?", help="binary capture file, stdin if omitted")
+    parser.add_argument("--port", help="read from a serial port instead (needs pyserial)")
+    parser.add_argument("--baud", type=int, default=9600)
+    args = parser.parse_args()
+
+    if args.port:
+        import serial
+        stream = serial.Serial(args.port, args.baud, timeout=None)
+    elif args.capture:
+        stream = open(args.capture, "rb")
+    else:
+        stream = sys.stdin.buffer
+
+    try:
+        good, bad = decode(stream, sys.stdout)
+    except KeyboardInterrupt:
+        return
+    print("%d records, %d bad frames" % (good, bad), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()